@@ -0,0 +1,407 @@
+#include "screen_capture/screen_capture.h"
+#include "screen_capture/synthetic_capture_source.h"
+#include "screen_capture/replay_capture_source.h"
+#include "encoding/tile_cache.h"
+#include "encoding/frame_protocol.h"
+#ifdef HAVE_XSHM
+#include "screen_capture/xshm_capture_source.h"
+#include <X11/Xlib.h>
+#endif
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+/**
+ * Headless capture/encode/send benchmark
+ * Drives ScreenCapture from a synthetic or replayed source and reports per-stage cost
+ */
+
+#ifdef HAVE_XSHM
+// Scripted drawing for damage tests: a small window with a block moving across it
+static void drawLoop(const std::string& displayName, const std::atomic<bool>& running) {
+    Display* display = XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
+    if (!display) {
+        std::cerr << "Scripted drawing could not open X display" << std::endl;
+        return;
+    }
+
+    int screen = DefaultScreen(display);
+    Window window = XCreateSimpleWindow(display, RootWindow(display, screen), 100, 100, 400, 300, 0,
+                                        BlackPixel(display, screen), WhitePixel(display, screen));
+    XStoreName(display, window, "xlauncher-bench-draw");
+    XMapWindow(display, window);
+    GC gc = XCreateGC(display, window, 0, nullptr);
+
+    for (int step = 0; running; step++) {
+        int x = (step * 8) % 360;
+        XSetForeground(display, gc, WhitePixel(display, screen));
+        XFillRectangle(display, window, gc, 0, 100, 400, 40);
+        XSetForeground(display, gc, BlackPixel(display, screen));
+        XFillRectangle(display, window, gc, x, 100, 40, 40);
+        XFlush(display);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+}
+#endif
+
+static void printUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --source synthetic|replay|xshm\n"
+              << "                              Frame source (default: synthetic)\n"
+              << "  --replay <path>             Raw frame file for the replay source\n"
+              << "  --scene mixed|static|scroll|windows|video|switch\n"
+              << "                              Synthetic desktop activity (default: mixed)\n"
+              << "  --width <px>                Synthetic desktop width (default: 1920)\n"
+              << "  --height <px>               Synthetic desktop height (default: 1080)\n"
+              << "  --out-width <px>            Downscale encoded frames to fit this width (default: native)\n"
+              << "  --out-height <px>           Downscale encoded frames to fit this height (default: native)\n"
+              << "  --viewport <x,y,w,h>        Encode only this part of the screen, fitted to the output size\n"
+              << "  --thumbnail-fps <n>         Whole-screen thumbnail rate while a viewport is set, 0 disables (default: 0)\n"
+              << "  --fps <n>                   Target frame rate (default: 30)\n"
+              << "  --quality <n>               JPEG quality, the upper limit with a target (default: 70)\n"
+              << "  --bitrate-kbps <n>          Pick each JPEG frame's quality to fit this bitrate\n"
+              << "  --psnr-floor <db>           Pick the lowest JPEG quality keeping luma PSNR above this\n"
+              << "  --mode <name>               Encoding mode: jpeg, tiles, lossless or video (default: jpeg)\n"
+              << "  --codecs <list>             Whole-frame codecs in jpeg mode, e.g. webp,jpeg; the client gets the first\n"
+              << "  --profiles <list>           Encode these outputs once per frame in jpeg mode, e.g. 1920x1080@80,960x540@60;\n"
+              << "                              each stands for one client and uses the first of --codecs\n"
+              << "  --encode-threads <n>        Threads encoding each JPEG frame in bands (default: cores - 1)\n"
+              << "  --tile-size <px>            Tile size for tiles mode (default: 64)\n"
+              << "  --no-scroll-detection       Encode scrolled areas as tiles instead of copy rects\n"
+              << "  --no-region-coding          Encode every tile as JPEG 4:2:0 regardless of content\n"
+              << "  --tile-cache-mb <n>         Simulated client tile cache, 0 disables (default: 32)\n"
+              << "  --input-ms <n>              Simulate remote input every n ms, each triggering a capture burst\n"
+              << "  --burst-fps <n>             Capture rate after input, 0 disables bursts (default: 30)\n"
+              << "  --cursor-fps <n>            Pointer polling rate for cursor messages, 0 disables (default: 60)\n"
+              << "  --seconds <n>               Benchmark duration (default: 10)\n"
+              << "  --display <name>            X display for the xshm source (default: $DISPLAY)\n"
+              << "  --monitor <n>               Monitor index for the xshm source (default: 0)\n"
+              << "  --draw                      Animate a test window on the xshm display while capturing\n"
+              << "  --record <path>             Record the generated frames for later replay\n";
+}
+
+int main(int argc, char** argv) {
+    std::string sourceType = "synthetic";
+    std::string replayPath;
+    std::string recordPath;
+    std::string displayName;
+    int monitor = 0;
+#ifdef HAVE_XSHM
+    bool scriptedDrawing = false;
+#endif
+    std::string mode = "jpeg";
+    std::string codecList = "jpeg";
+    std::string scene = "mixed";
+    int tileSize = 64;
+    int encodeThreads = 0;
+    int tileCacheMb = 32;
+    bool scrollDetection = true;
+    bool regionCoding = true;
+    int width = 1920;
+    int height = 1080;
+    int outWidth = 0;
+    int outHeight = 0;
+    int fps = 30;
+    int quality = 70;
+    int bitrateKbps = 0;
+    double psnrFloor = 0.0;
+    int seconds = 10;
+    int inputMs = 0;
+    double burstFps = ScreenCapture::BurstOptions().fps;
+    double cursorFps = 60.0;
+    CaptureRect viewport;
+    double thumbnailFps = 0.0;
+    std::string profileList;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--source" && hasValue) sourceType = argv[++i];
+        else if (arg == "--replay" && hasValue) { replayPath = argv[++i]; sourceType = "replay"; }
+        else if (arg == "--width" && hasValue) width = std::atoi(argv[++i]);
+        else if (arg == "--height" && hasValue) height = std::atoi(argv[++i]);
+        else if (arg == "--out-width" && hasValue) outWidth = std::atoi(argv[++i]);
+        else if (arg == "--out-height" && hasValue) outHeight = std::atoi(argv[++i]);
+        else if (arg == "--fps" && hasValue) fps = std::atoi(argv[++i]);
+        else if (arg == "--quality" && hasValue) quality = std::atoi(argv[++i]);
+        else if (arg == "--bitrate-kbps" && hasValue) bitrateKbps = std::atoi(argv[++i]);
+        else if (arg == "--psnr-floor" && hasValue) psnrFloor = std::atof(argv[++i]);
+        else if (arg == "--seconds" && hasValue) seconds = std::atoi(argv[++i]);
+        else if (arg == "--input-ms" && hasValue) inputMs = std::atoi(argv[++i]);
+        else if (arg == "--burst-fps" && hasValue) burstFps = std::atof(argv[++i]);
+        else if (arg == "--cursor-fps" && hasValue) cursorFps = std::atof(argv[++i]);
+        else if (arg == "--viewport" && hasValue) {
+            if (std::sscanf(argv[++i], "%d,%d,%d,%d", &viewport.x, &viewport.y, &viewport.width, &viewport.height) != 4) {
+                std::cerr << "Invalid viewport: " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--thumbnail-fps" && hasValue) thumbnailFps = std::atof(argv[++i]);
+        else if (arg == "--record" && hasValue) recordPath = argv[++i];
+        else if (arg == "--display" && hasValue) displayName = argv[++i];
+        else if (arg == "--monitor" && hasValue) monitor = std::atoi(argv[++i]);
+#ifdef HAVE_XSHM
+        else if (arg == "--draw") scriptedDrawing = true;
+#endif
+        else if (arg == "--mode" && hasValue) mode = argv[++i];
+        else if (arg == "--codecs" && hasValue) codecList = argv[++i];
+        else if (arg == "--profiles" && hasValue) profileList = argv[++i];
+        else if (arg == "--scene" && hasValue) scene = argv[++i];
+        else if (arg == "--tile-size" && hasValue) tileSize = std::atoi(argv[++i]);
+        else if (arg == "--encode-threads" && hasValue) encodeThreads = std::atoi(argv[++i]);
+        else if (arg == "--no-scroll-detection") scrollDetection = false;
+        else if (arg == "--no-region-coding") regionCoding = false;
+        else if (arg == "--tile-cache-mb" && hasValue) tileCacheMb = std::atoi(argv[++i]);
+        else {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (fps <= 0 || width <= 0 || height <= 0 || seconds <= 0) {
+        std::cerr << "Invalid benchmark parameters" << std::endl;
+        return 1;
+    }
+
+    ScreenCapture capture(1000 / fps, quality);
+    capture.setFrameRate(fps);
+    capture.setTargetBitrate(bitrateKbps);
+    capture.setPsnrFloor(psnrFloor);
+    ScreenCapture::BurstOptions burst;
+    burst.fps = burstFps;
+    capture.setBurstOptions(burst);
+    capture.setCursorRate(cursorFps);
+    if (encodeThreads > 0) {
+        capture.setEncodeThreads(encodeThreads);
+    }
+    if (outWidth > 0 || outHeight > 0) {
+        // An unset dimension does not constrain the fit
+        capture.setOutputSize(outWidth > 0 ? outWidth : 65535, outHeight > 0 ? outHeight : 65535);
+    }
+    capture.setViewport(viewport);
+    capture.setThumbnailOptions(320, 320, thumbnailFps);
+
+    if (sourceType == "replay") {
+        auto replay = std::make_unique<ReplayCaptureSource>(replayPath);
+        if (!replay->isOpen()) {
+            return 1;
+        }
+        capture.setCaptureSource(std::move(replay));
+    } else if (sourceType == "xshm") {
+#ifdef HAVE_XSHM
+        auto xshm = std::make_unique<XShmCaptureSource>(displayName);
+        if (!xshm->isOpen()) {
+            return 1;
+        }
+        capture.setCaptureSource(std::move(xshm));
+        capture.selectMonitor(monitor);
+#else
+        std::cerr << "This build has no XShm capture support" << std::endl;
+        return 1;
+#endif
+    } else {
+        // Static text stays on screen in every scene, only the named activity animates
+        SyntheticCaptureSource::Options options;
+        options.scrollingText = true;
+        options.scrollSpeed = (scene == "mixed" || scene == "scroll") ? options.scrollSpeed : 0;
+        options.movingWindows = scene == "mixed" || scene == "windows";
+        options.videoRegion = scene == "mixed" || scene == "video";
+        options.documentCount = scene == "switch" ? 3 : 1;
+        if (scene == "switch") options.scrollSpeed = 0;
+        capture.setCaptureSource(std::make_unique<SyntheticCaptureSource>(width, height, options));
+    }
+
+    if (!recordPath.empty()) {
+        capture.startRecording(recordPath);
+    }
+
+    if (mode == "tiles") {
+        capture.setTileOptions(tileSize, 150, scrollDetection, regionCoding);
+        capture.setEncodingMode(ScreenCapture::EncodingMode::TILES);
+    } else if (mode == "lossless") {
+        capture.setLosslessOptions(300, scrollDetection);
+        capture.setEncodingMode(ScreenCapture::EncodingMode::LOSSLESS);
+    } else if (mode == "video") {
+        capture.setVideoOptions(300);
+        capture.setEncodingMode(ScreenCapture::EncodingMode::VIDEO);
+    } else {
+        std::vector<FrameEncoder::Codec> codecs;
+        std::stringstream names(codecList);
+        std::string name;
+        while (std::getline(names, name, ',')) {
+            FrameEncoder::Codec codec;
+            if (!FrameEncoder::parseCodec(name, codec)) {
+                std::cerr << "Unknown codec: " << name << std::endl;
+                return 1;
+            }
+            codecs.push_back(codec);
+        }
+        capture.setImageCodecs(codecs);
+
+        std::vector<ScreenCapture::OutputProfile> profiles;
+        std::stringstream entries(profileList);
+        std::string entry;
+        while (std::getline(entries, entry, ',')) {
+            ScreenCapture::OutputProfile profile;
+            if (std::sscanf(entry.c_str(), "%dx%d@%d", &profile.maxWidth, &profile.maxHeight, &profile.quality) != 3) {
+                std::cerr << "Invalid profile: " << entry << std::endl;
+                return 1;
+            }
+            profile.codec = codecs.empty() ? FrameEncoder::Codec::JPEG : codecs.front();
+            profiles.push_back(profile);
+        }
+        capture.setOutputProfiles(profiles);
+    }
+
+    // One simulated client, packed the way ScreenSharing does it
+    std::unique_ptr<TileCache> tileCache;
+    if (tileCacheMb > 0) {
+        tileCache = std::make_unique<TileCache>(static_cast<size_t>(tileCacheMb) * 1024 * 1024, tileSize);
+        capture.setTileCacheQuery([&tileCache](uint64_t hash) { return tileCache->contains(hash); });
+    }
+    uint32_t tablesVersion = 0;
+    std::vector<uint8_t> message;
+    uint64_t wireBytes = 0;
+
+    // Stand-in for the socket send: touch every byte once
+    uint64_t checksum = 0;
+    capture.setFrameCallback([&](const ScreenCapture::FrameData& frame) {
+        if (frame.thumbnail) {
+            wireBytes += frame.thumbnail->size();
+            for (uint8_t b : *frame.thumbnail) checksum += b;
+        }
+
+        const std::vector<uint8_t>* data = frame.data.get();
+        if (frame.heartbeat) {
+            // The client is up to date, so it only gets the heartbeat message
+            frame_protocol::packHeartbeat(frame.width, frame.height, message);
+            data = &message;
+        } else if (frame.tiles) {
+            if (!packTileUpdate(*frame.tiles, tileCache.get(), tablesVersion, message)) {
+                capture.requestKeyframe();
+                return;
+            }
+            data = &message;
+        } else if (!frame.profileImages.empty()) {
+            // One simulated client per profile
+            for (const ScreenCapture::ProfileImage& entry : frame.profileImages) {
+                if (!entry.image) continue;
+                wireBytes += entry.image->size();
+                for (uint8_t b : *entry.image) checksum += b;
+            }
+            return;
+        }
+        if (!data) return;
+        wireBytes += data->size();
+        for (uint8_t b : *data) checksum += b;
+    });
+
+    // The simulated client draws the pointer, shapes are sent once per id
+    std::set<uint32_t> cursorShapes;
+    uint64_t cursorMessages = 0;
+    uint64_t cursorBytes = 0;
+    capture.setCursorCallback([&](const CursorEncoder::Update& cursor) {
+        bool newShape = cursor.shapeId != 0 && cursorShapes.insert(cursor.shapeId).second;
+        const std::vector<uint8_t>& data = newShape ? *cursor.withShape : *cursor.position;
+        cursorMessages++;
+        cursorBytes += data.size();
+        for (uint8_t b : data) checksum += b;
+    });
+
+    std::cout << "Benchmarking " << sourceType << " source "
+              << (sourceType == "replay" ? replayPath :
+                  sourceType == "xshm" ? "monitor " + std::to_string(monitor) :
+                  scene + " " + std::to_string(width) + "x" + std::to_string(height))
+              << " at " << fps << " fps, " << mode << " mode, quality " << quality << " for " << seconds << "s" << std::endl;
+
+    std::atomic<bool> drawing{true};
+    std::thread drawThread;
+#ifdef HAVE_XSHM
+    if (scriptedDrawing && sourceType == "xshm") {
+        drawThread = std::thread(drawLoop, displayName, std::cref(drawing));
+    }
+#endif
+
+    capture.start();
+    if (inputMs > 0) {
+        // Input lands at arbitrary points between capture ticks
+        auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while (std::chrono::steady_clock::now() < end) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(inputMs));
+            capture.triggerBurst();
+        }
+    } else {
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    }
+    capture.stop();
+
+    drawing = false;
+    if (drawThread.joinable()) {
+        drawThread.join();
+    }
+
+    ScreenCapture::Stats stats = capture.getStats();
+    double frames = static_cast<double>(std::max<uint64_t>(stats.frames, 1));
+
+    double captures = static_cast<double>(std::max<uint64_t>(stats.capturedFrames, 1));
+
+    std::cout << "frames:          " << stats.frames << " (" << stats.frames / static_cast<double>(seconds) << " fps)\n"
+              << "captured:        " << stats.capturedFrames << "\n"
+              << "dropped:         " << stats.droppedFrames << "\n"
+              << "failed captures: " << stats.failedCaptures << "\n"
+              << "unchanged:       " << stats.unchangedFrames << "\n"
+              << "heartbeats:      " << stats.heartbeats << "\n"
+              << "refinements:     " << stats.refinements << "\n"
+              << "copy rects:      " << stats.copyRects << "\n"
+              << "avg dirty area:  " << stats.totalDirtyFraction * 100.0 / frames << "%\n"
+              << "avg capture ms:  " << stats.totalCaptureMs / captures << "\n"
+              << "avg encode ms:   " << stats.totalEncodeMs / frames << "\n"
+              << "avg send ms:     " << stats.totalCallbackMs / frames << "\n"
+              << "missed ticks:    " << stats.missedTicks << "\n"
+              << "avg lateness ms: " << stats.totalLatenessMs / captures << " (max " << stats.maxLatenessMs << ")\n"
+              << "input bursts:    " << stats.bursts << " (avg delay ms "
+              << stats.totalBurstDelayMs / std::max<uint64_t>(stats.bursts, 1) << ")\n"
+              << "avg frame bytes: " << stats.totalBytes / frames << "\n"
+              << "avg quality:     " << stats.totalQuality / frames << "\n"
+              << "bandwidth kbps:  " << wireBytes * 8.0 / 1000.0 / seconds << "\n"
+              << "checksum:        " << checksum << "\n";
+
+    for (size_t i = 0; i < FrameEncoder::kCodecCount; i++) {
+        const FrameEncoder::Cost& cost = stats.codecCosts[i];
+        if (cost.frames > 0) {
+            std::string label = std::string(FrameEncoder::codecName(static_cast<FrameEncoder::Codec>(i))) + ":";
+            label.resize(std::max<size_t>(label.size() + 1, 17), ' ');
+            std::cout << label << cost.frames << " images, avg encode ms " << cost.totalMs / cost.frames
+                      << ", avg bytes " << cost.bytes / cost.frames << "\n";
+        }
+    }
+    if (stats.thumbnails > 0) {
+        std::cout << "thumbnails:      " << stats.thumbnails << ", avg bytes " << stats.thumbnailBytes / stats.thumbnails
+                  << ", " << stats.thumbnailBytes * 8.0 / 1000.0 / seconds << " kbps\n";
+    }
+    if (cursorMessages > 0) {
+        std::cout << "cursor:          " << cursorMessages << " messages (" << cursorMessages / static_cast<double>(seconds)
+                  << "/s), " << cursorShapes.size() << " shapes, " << cursorBytes * 8.0 / 1000.0 / seconds << " kbps\n";
+    }
+    if (mode == "tiles") {
+        std::cout << "tile codecs:     " << stats.paletteTiles << " palette, " << stats.textTiles << " text 4:4:4, "
+                  << stats.photoTiles << " photo 4:2:0, " << stats.videoTiles << " video\n";
+    }
+    if (tileCache && mode == "tiles") {
+        std::cout << "tile cache:      " << tileCache->size() << "/" << tileCache->capacity() << " slots, "
+                  << tileCache->getHits() << " hits, " << tileCache->getMisses() << " misses\n";
+    }
+    std::cout.flush();
+
+    return 0;
+}
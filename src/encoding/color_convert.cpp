@@ -0,0 +1,167 @@
+#include "color_convert.h"
+#include "frame_diff.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLOR_CONVERT_SSE2
+#endif
+
+namespace {
+    // BT.601 full-range coefficients in 8-bit fixed point, each row sums to 256 or 0
+    constexpr int kYR = 77, kYG = 150, kYB = 29;
+    constexpr int kUR = -43, kUG = -85, kUB = 128;
+    constexpr int kVR = 128, kVG = -107, kVB = -21;
+
+    inline uint8_t luma(int r, int g, int b) {
+        return static_cast<uint8_t>((kYR * r + kYG * g + kYB * b + 128) >> 8);
+    }
+
+    // Rounding by 127 keeps the largest weighted sum inside 16 bits for the SIMD path
+    inline uint8_t chroma(int r, int g, int b, int cr, int cg, int cb) {
+        return static_cast<uint8_t>(((cr * r + cg * g + cb * b + 127) >> 8) + 128);
+    }
+
+#if defined(COLOR_CONVERT_SSE2)
+    // Split 8 BGRA pixels into 16-bit B, G and R lanes
+    inline void unpackPixels(const uint8_t* p, __m128i& b, __m128i& g, __m128i& r) {
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+        b = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+        g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask), _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+        r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask), _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+    }
+
+    // Luma of 8 pixels, the unsigned sum tops out at 65408 so a logical shift is exact
+    inline __m128i luma8(__m128i b, __m128i g, __m128i r) {
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(kYR)), _mm_mullo_epi16(g, _mm_set1_epi16(kYG)));
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(kYB)));
+        return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(128)), 8);
+    }
+
+    // Chroma of 8 averaged pixels, weighted sums stay within +-32640
+    inline __m128i chroma8(__m128i b, __m128i g, __m128i r, int cr, int cg, int cb) {
+        __m128i sum = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(static_cast<short>(cr))),
+                                    _mm_mullo_epi16(g, _mm_set1_epi16(static_cast<short>(cg))));
+        sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(static_cast<short>(cb))));
+        sum = _mm_srai_epi16(_mm_add_epi16(sum, _mm_set1_epi16(127)), 8);
+        return _mm_add_epi16(sum, _mm_set1_epi16(128));
+    }
+
+    // Average 2x2 blocks from the per-column sums of two rows, 16-bit lanes in and 32-bit out
+    inline __m128i blockAverage(__m128i columnSums) {
+        __m128i sums = _mm_madd_epi16(columnSums, _mm_set1_epi16(1));
+        return _mm_srli_epi32(_mm_add_epi32(sums, _mm_set1_epi32(2)), 2);
+    }
+#endif
+
+    // Convert rows [firstRow, lastRow) into planes already sized for the image, firstRow is even
+    void convertRows(const uint8_t* bgra, int stride, int width, int height, int firstRow, int lastRow,
+                     YuvPlanes& out) {
+        int chromaWidth = out.chromaWidth();
+
+        for (int row = firstRow; row < lastRow; row += 2) {
+            // An odd last row pairs with itself
+            bool hasSecondRow = row + 1 < height;
+            const uint8_t* src0 = bgra + static_cast<size_t>(row) * stride;
+            const uint8_t* src1 = hasSecondRow ? src0 + stride : src0;
+            uint8_t* y0 = out.y.data() + static_cast<size_t>(row) * width;
+            uint8_t* y1 = y0 + width;
+            uint8_t* u = out.u.data() + static_cast<size_t>(row / 2) * chromaWidth;
+            uint8_t* v = out.v.data() + static_cast<size_t>(row / 2) * chromaWidth;
+            int x = 0;
+
+#if defined(COLOR_CONVERT_SSE2)
+            for (; x + 16 <= width; x += 16) {
+                __m128i luma0[2], luma1[2], blockB[2], blockG[2], blockR[2];
+                for (int half = 0; half < 2; half++) {
+                    __m128i b0, g0, r0, b1, g1, r1;
+                    unpackPixels(src0 + (x + half * 8) * 4, b0, g0, r0);
+                    unpackPixels(src1 + (x + half * 8) * 4, b1, g1, r1);
+                    luma0[half] = luma8(b0, g0, r0);
+                    luma1[half] = luma8(b1, g1, r1);
+                    blockB[half] = blockAverage(_mm_add_epi16(b0, b1));
+                    blockG[half] = blockAverage(_mm_add_epi16(g0, g1));
+                    blockR[half] = blockAverage(_mm_add_epi16(r0, r1));
+                }
+
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(luma0[0], luma0[1]));
+                if (hasSecondRow) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(luma1[0], luma1[1]));
+                }
+
+                __m128i b = _mm_packs_epi32(blockB[0], blockB[1]);
+                __m128i g = _mm_packs_epi32(blockG[0], blockG[1]);
+                __m128i r = _mm_packs_epi32(blockR[0], blockR[1]);
+                __m128i cb = chroma8(b, g, r, kUR, kUG, kUB);
+                __m128i cr = chroma8(b, g, r, kVR, kVG, kVB);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), _mm_packus_epi16(cb, cb));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_packus_epi16(cr, cr));
+            }
+#endif
+
+            // Scalar tail, an odd last column pairs with itself
+            for (; x < width; x += 2) {
+                int next = x + 1 < width ? x + 1 : x;
+                const uint8_t* p[4] = {src0 + x * 4, src0 + next * 4, src1 + x * 4, src1 + next * 4};
+
+                y0[x] = luma(p[0][2], p[0][1], p[0][0]);
+                if (next != x) y0[next] = luma(p[1][2], p[1][1], p[1][0]);
+                if (hasSecondRow) {
+                    y1[x] = luma(p[2][2], p[2][1], p[2][0]);
+                    if (next != x) y1[next] = luma(p[3][2], p[3][1], p[3][0]);
+                }
+
+                int b = (p[0][0] + p[1][0] + p[2][0] + p[3][0] + 2) >> 2;
+                int g = (p[0][1] + p[1][1] + p[2][1] + p[3][1] + 2) >> 2;
+                int r = (p[0][2] + p[1][2] + p[2][2] + p[3][2] + 2) >> 2;
+                u[x / 2] = chroma(r, g, b, kUR, kUG, kUB);
+                v[x / 2] = chroma(r, g, b, kVR, kVG, kVB);
+            }
+        }
+    }
+}
+
+void YuvPlanes::resize(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    y.resize(static_cast<size_t>(width) * height);
+    u.resize(static_cast<size_t>(chromaWidth()) * chromaHeight());
+    v.resize(u.size());
+}
+
+bool YuvPlanes::equals(const YuvPlanes& other) const {
+    if (width != other.width || height != other.height || y.empty()) {
+        return false;
+    }
+
+    // Each plane is contiguous, so compare it as a single row
+    return frame_diff::regionsEqual(y.data(), 0, other.y.data(), 0, static_cast<int>(y.size()), 1) &&
+           frame_diff::regionsEqual(u.data(), 0, other.u.data(), 0, static_cast<int>(u.size()), 1) &&
+           frame_diff::regionsEqual(v.data(), 0, other.v.data(), 0, static_cast<int>(v.size()), 1);
+}
+
+namespace color_convert {
+
+    void bgraToYuv420(const uint8_t* bgra, int stride, int width, int height, YuvPlanes& out) {
+        out.resize(width, height);
+        convertRows(bgra, stride, width, height, 0, height, out);
+    }
+
+    void bgraToYuv420(const uint8_t* bgra, int stride, int width, int height, YuvPlanes& out,
+                      ThreadPool& workers) {
+        out.resize(width, height);
+
+        // Even band heights keep each 2x2 chroma block inside one band
+        int bands = static_cast<int>(std::min<size_t>(workers.getThreadCount(), std::max(1, height / 64)));
+        int bandRows = ((height + bands - 1) / bands + 1) & ~1;
+        workers.parallelFor(static_cast<size_t>(bands), [&](size_t band) {
+            int firstRow = static_cast<int>(band) * bandRows;
+            int lastRow = std::min(height, firstRow + bandRows);
+            if (firstRow < lastRow) {
+                convertRows(bgra, stride, width, height, firstRow, lastRow, out);
+            }
+        });
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../utils/thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Planar YUV 4:2:0 image (JPEG full-range BT.601) with storage reused across frames
+struct YuvPlanes {
+    std::vector<uint8_t> y;
+    std::vector<uint8_t> u;
+    std::vector<uint8_t> v;
+    int width{0};
+    int height{0};
+
+    int chromaWidth() const { return (width + 1) / 2; }
+    int chromaHeight() const { return (height + 1) / 2; }
+
+    // Size the planes for an image, keeping existing capacity
+    void resize(int newWidth, int newHeight);
+
+    // Check whether two images of the same size hold identical samples
+    bool equals(const YuvPlanes& other) const;
+};
+
+/**
+ * Vectorized colour conversion kernels
+ */
+namespace color_convert {
+
+    // Convert top-down BGRA to planar YUV 4:2:0, chroma is the average of each 2x2 block
+    // Uses SSE2 where available, 16 pixels of two rows per step
+    void bgraToYuv420(const uint8_t* bgra, int stride, int width, int height, YuvPlanes& out);
+
+    // Same conversion with horizontal bands of rows spread across a thread pool
+    void bgraToYuv420(const uint8_t* bgra, int stride, int width, int height, YuvPlanes& out,
+                      ThreadPool& workers);
+}
@@ -0,0 +1,107 @@
+#include "cursor_encoder.h"
+#include "frame_protocol.h"
+#include <algorithm>
+#include <cmath>
+#include <zlib.h>
+
+using namespace frame_protocol;
+
+// Encode the pointer state
+bool CursorEncoder::update(const CursorState& cursor, double scaleX, double scaleY) {
+    bool shapeChanged = false;
+    bool hasShape = !cursor.pixels.empty();
+    if (hasShape != (_shapeId != 0) ||
+        (hasShape && (cursor.shapeSerial != _shapeSerial || scaleX != _shapeScaleX || scaleY != _shapeScaleY))) {
+        uint32_t previous = _shapeId;
+        encodeShape(cursor, scaleX, scaleY);
+        shapeChanged = _shapeId != previous;
+    }
+
+    int x = static_cast<int>(std::lround(cursor.x * scaleX));
+    int y = static_cast<int>(std::lround(cursor.y * scaleY));
+    x = std::clamp(x, -32768, 32767);
+    y = std::clamp(y, -32768, 32767);
+
+    if (_valid && !shapeChanged && x == _x && y == _y && cursor.visible == _visible) {
+        return false;
+    }
+
+    _valid = true;
+    _x = x;
+    _y = y;
+    _visible = cursor.visible;
+
+    _update.shapeId = _shapeId;
+    _update.position = pack(false);
+    _update.withShape = _shapeId != 0 ? pack(true) : _update.position;
+    return true;
+}
+
+// Scale and compress the shape
+void CursorEncoder::encodeShape(const CursorState& cursor, double scaleX, double scaleY) {
+    _shapeSerial = cursor.shapeSerial;
+    _shapeScaleX = scaleX;
+    _shapeScaleY = scaleY;
+    _shapeId = 0;
+    _shape.clear();
+    if (cursor.pixels.empty() || cursor.width <= 0 || cursor.height <= 0 ||
+        cursor.pixels.size() < static_cast<size_t>(cursor.width) * cursor.height * 4) {
+        return;
+    }
+
+    // Nearest neighbour keeps the one pixel outlines of cursors crisp
+    int width = std::clamp(static_cast<int>(std::lround(cursor.width * scaleX)), 1, 0xFFFF);
+    int height = std::clamp(static_cast<int>(std::lround(cursor.height * scaleY)), 1, 0xFFFF);
+    _rgba.resize(static_cast<size_t>(width) * height * 4);
+    for (int y = 0; y < height; y++) {
+        int srcY = std::min(cursor.height - 1, y * cursor.height / height);
+        for (int x = 0; x < width; x++) {
+            int srcX = std::min(cursor.width - 1, x * cursor.width / width);
+            const uint8_t* src = cursor.pixels.data() + (static_cast<size_t>(srcY) * cursor.width + srcX) * 4;
+            uint8_t* dst = _rgba.data() + (static_cast<size_t>(y) * width + x) * 4;
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst[3] = src[3];
+        }
+    }
+
+    MessageWriter writer(_shape);
+    writer.put16(static_cast<uint16_t>(width));
+    writer.put16(static_cast<uint16_t>(height));
+    writer.put16(static_cast<uint16_t>(std::clamp(static_cast<int>(cursor.hotX * scaleX), 0, width - 1)));
+    writer.put16(static_cast<uint16_t>(std::clamp(static_cast<int>(cursor.hotY * scaleY), 0, height - 1)));
+
+    size_t header = _shape.size();
+    uLongf compressedSize = compressBound(static_cast<uLong>(_rgba.size()));
+    _shape.resize(header + compressedSize);
+    if (compress2(_shape.data() + header, &compressedSize, _rgba.data(), static_cast<uLong>(_rgba.size()),
+                  Z_BEST_SPEED) != Z_OK) {
+        _shape.clear();
+        return;
+    }
+    _shape.resize(header + compressedSize);
+
+    // Content-derived, 0 is reserved for an unknown shape
+    _shapeId = static_cast<uint32_t>(crc32(0L, _shape.data(), static_cast<uInt>(_shape.size())));
+    if (_shapeId == 0) {
+        _shapeId = 1;
+    }
+}
+
+// Build a cursor message
+std::shared_ptr<const std::vector<uint8_t>> CursorEncoder::pack(bool includeShape) const {
+    auto message = std::make_shared<std::vector<uint8_t>>();
+    message->reserve(10 + (includeShape ? _shape.size() : 0));
+
+    MessageWriter writer(*message);
+    writer.put8(MESSAGE_CURSOR);
+    writer.put8(static_cast<uint8_t>((_visible ? CURSOR_FLAG_VISIBLE : 0) | (includeShape ? CURSOR_FLAG_SHAPE : 0)));
+    writer.put16(static_cast<uint16_t>(static_cast<int16_t>(_x)));
+    writer.put16(static_cast<uint16_t>(static_cast<int16_t>(_y)));
+    writer.put32(_shapeId);
+    if (includeShape) {
+        writer.putBytes(_shape.data(), _shape.size());
+    }
+    return message;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Turns polled pointer state into frame_protocol::MESSAGE_CURSOR messages
+ *
+ * Shapes are scaled to the output frame size, compressed once and identified by a hash
+ * of the result, so the same shape keeps its id across serials and sessions. Position
+ * updates without the shape are ten bytes.
+ */
+class CursorEncoder {
+public:
+    // The current pointer, with and without its shape attached
+    struct Update {
+        std::shared_ptr<const std::vector<uint8_t>> position;
+        std::shared_ptr<const std::vector<uint8_t>> withShape;
+        uint32_t shapeId{0};
+        int frameWidth{0};      // Size of the frames the position and shape are scaled to, set by the caller
+        int frameHeight{0};
+    };
+
+    // Encode the state at the frame's scale, false when clients would see no difference
+    bool update(const CursorState& cursor, double scaleX, double scaleY);
+
+    // Get the last encoded messages
+    const Update& getUpdate() const { return _update; }
+
+    // Encode the next state even if it did not change
+    void invalidate() { _valid = false; }
+
+private:
+    // Scale and compress the shape, shape id 0 when the source has none
+    void encodeShape(const CursorState& cursor, double scaleX, double scaleY);
+
+    // Build a message for the current state
+    std::shared_ptr<const std::vector<uint8_t>> pack(bool includeShape) const;
+
+    bool _valid{false};
+    int _x{0};
+    int _y{0};
+    bool _visible{false};
+
+    // Source shape and scale the current shape was made from
+    uint64_t _shapeSerial{0};
+    double _shapeScaleX{0.0};
+    double _shapeScaleY{0.0};
+    uint32_t _shapeId{0};
+    std::vector<uint8_t> _shape;    // Size, hotspot and compressed pixels
+    std::vector<uint8_t> _rgba;
+
+    Update _update;
+};
@@ -0,0 +1,94 @@
+#include "frame_diff.h"
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_DIFF_SSE2
+#endif
+
+namespace {
+    // Compare one row, returns true when every byte matches
+    inline bool rowEqual(const uint8_t* a, const uint8_t* b, int bytes) {
+        int i = 0;
+
+#if defined(__AVX2__)
+        __m256i acc = _mm256_setzero_si256();
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            acc = _mm256_or_si256(acc, _mm256_xor_si256(va, vb));
+        }
+        if (!_mm256_testz_si256(acc, acc)) return false;
+#elif defined(FRAME_DIFF_SSE2)
+        __m128i acc = _mm_setzero_si128();
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            acc = _mm_or_si128(acc, _mm_xor_si128(va, vb));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) return false;
+#endif
+
+        return i >= bytes || std::memcmp(a + i, b + i, bytes - i) == 0;
+    }
+
+    constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+
+    inline uint64_t rotl(uint64_t v, int r) {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    inline uint64_t load64(const uint8_t* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input) {
+        return rotl(acc + input * kPrime2, 31) * kPrime1;
+    }
+}
+
+namespace frame_diff {
+
+    bool regionsEqual(const uint8_t* a, int strideA, const uint8_t* b, int strideB,
+                      int rowBytes, int rows) {
+        for (int y = 0; y < rows; y++) {
+            if (!rowEqual(a + static_cast<size_t>(y) * strideA, b + static_cast<size_t>(y) * strideB, rowBytes)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t hashRegion(const uint8_t* data, int stride, int rowBytes, int rows) {
+        // Four independent lanes keep the multipliers busy
+        uint64_t lanes[4] = {kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1};
+
+        for (int y = 0; y < rows; y++) {
+            const uint8_t* row = data + static_cast<size_t>(y) * stride;
+            int i = 0;
+
+            for (; i + 32 <= rowBytes; i += 32) {
+                lanes[0] = round(lanes[0], load64(row + i));
+                lanes[1] = round(lanes[1], load64(row + i + 8));
+                lanes[2] = round(lanes[2], load64(row + i + 16));
+                lanes[3] = round(lanes[3], load64(row + i + 24));
+            }
+
+            for (; i < rowBytes; i++) {
+                lanes[i & 3] = round(lanes[i & 3], row[i]);
+            }
+        }
+
+        uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+        h ^= static_cast<uint64_t>(rowBytes) * kPrime1 + static_cast<uint64_t>(rows);
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        return h;
+    }
+}
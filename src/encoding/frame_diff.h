@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Vectorized pixel comparison kernels used for change detection
+ */
+namespace frame_diff {
+
+    // Check whether two equally sized pixel regions hold identical bytes
+    // Rows are compared with SSE2/AVX2 where available and stop at the first difference
+    bool regionsEqual(const uint8_t* a, int strideA, const uint8_t* b, int strideB,
+                      int rowBytes, int rows);
+
+    // 64-bit content hash of a pixel region, used to recognise recurring tiles
+    uint64_t hashRegion(const uint8_t* data, int stride, int rowBytes, int rows);
+}
@@ -0,0 +1,103 @@
+#include "frame_encoder.h"
+#include "jpeg_frame_encoder.h"
+#ifdef HAVE_WEBP
+#include "webp_frame_encoder.h"
+#endif
+#include <chrono>
+
+// Encode a frame and account its cost
+FrameEncoder::Buffer FrameEncoder::encode(const RawFrame& frame, int maxQuality, ThreadPool& workers, int& quality,
+                                          bool& unchanged) {
+    auto start = std::chrono::steady_clock::now();
+    unchanged = false;
+    quality = maxQuality;
+    Buffer image = encodeImage(frame, maxQuality, workers, quality, unchanged);
+
+    // A reused image cost nothing to send again
+    if (!unchanged) {
+        addCost(image, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return image;
+}
+
+// Encode a static frame and account its cost
+FrameEncoder::Buffer FrameEncoder::encodeStill(const RawFrame& frame, int quality, ThreadPool& workers) {
+    auto start = std::chrono::steady_clock::now();
+    Buffer image = encodeStillImage(frame, quality, workers);
+    if (image) {
+        addCost(image, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return image;
+}
+
+// Plain encoding for static frames
+FrameEncoder::Buffer FrameEncoder::encodeStillImage(const RawFrame& frame, int quality, ThreadPool& workers) {
+    int used = quality;
+    bool unchanged = false;
+    return encodeImage(frame, quality, workers, used, unchanged);
+}
+
+// Get the encode cost
+FrameEncoder::Cost FrameEncoder::getCost() const {
+    std::lock_guard<std::mutex> lock(_costMutex);
+    return _cost;
+}
+
+// Account one image
+void FrameEncoder::addCost(const Buffer& image, double ms) {
+    std::lock_guard<std::mutex> lock(_costMutex);
+    _cost.frames++;
+    _cost.bytes += image ? image->size() : 0;
+    _cost.totalMs += ms;
+}
+
+// Get a codec's name
+const char* FrameEncoder::codecName(Codec codec) {
+    switch (codec) {
+    case Codec::WEBP:
+        return "webp";
+    case Codec::WEBP_LOSSLESS:
+        return "webp_lossless";
+    default:
+        return "jpeg";
+    }
+}
+
+// Look up a codec by name
+bool FrameEncoder::parseCodec(const std::string& name, Codec& codec) {
+    for (size_t i = 0; i < kCodecCount; i++) {
+        if (name == codecName(static_cast<Codec>(i))) {
+            codec = static_cast<Codec>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check whether a codec is built in
+bool FrameEncoder::isAvailable(Codec codec) {
+    if (codec == Codec::JPEG) {
+        return true;
+    }
+#ifdef HAVE_WEBP
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Create an encoder for a codec
+std::unique_ptr<FrameEncoder> createFrameEncoder(FrameEncoder::Codec codec) {
+    switch (codec) {
+    case FrameEncoder::Codec::JPEG:
+        return std::make_unique<JpegFrameEncoder>();
+#ifdef HAVE_WEBP
+    case FrameEncoder::Codec::WEBP:
+        return std::make_unique<WebpFrameEncoder>(false);
+    case FrameEncoder::Codec::WEBP_LOSSLESS:
+        return std::make_unique<WebpFrameEncoder>(true);
+#endif
+    default:
+        return nullptr;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include "../utils/thread_pool.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class QualitySearch;
+
+/**
+ * Encodes whole frames as standalone images for clients that receive full frames
+ *
+ * Each codec is one implementation, chosen at run time so clients can be sent the
+ * format they decode best. Every encoder keeps its own encode cost, so codecs can be
+ * compared on the same content.
+ */
+class FrameEncoder {
+public:
+    // Encoded image, shared by every consumer without copying
+    using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // Image formats, a client names the ones it decodes when it starts sharing
+    enum class Codec : uint8_t {
+        JPEG,           // Baseline JPEG, decoded everywhere
+        WEBP,           // Lossy WebP, smaller than JPEG at the same visual quality
+        WEBP_LOSSLESS   // Lossless WebP, exact pixels at a higher encode cost
+    };
+
+    static constexpr size_t kCodecCount = 3;
+
+    // Work done since the encoder was created
+    struct Cost {
+        uint64_t frames{0};
+        uint64_t bytes{0};
+        double totalMs{0.0};
+    };
+
+    virtual ~FrameEncoder() = default;
+
+    // Get the codec this encoder produces
+    virtual Codec getCodec() const = 0;
+
+    // Encode a BGRA frame at no more than maxQuality (1-100), null on failure. quality
+    // receives the quality used; an encoder that sees the same pixels as last time may
+    // return its previous image and set unchanged
+    Buffer encode(const RawFrame& frame, int maxQuality, ThreadPool& workers, int& quality, bool& unchanged);
+
+    // Encode a static frame at the highest fidelity for quality, null when it would add nothing
+    Buffer encodeStill(const RawFrame& frame, int quality, ThreadPool& workers);
+
+    // Quality search for bitrate and PSNR targets, null when frames use the requested quality
+    virtual QualitySearch* getQualitySearch() { return nullptr; }
+
+    // Get the encode cost so far
+    Cost getCost() const;
+
+    // Get the name clients use for a codec
+    static const char* codecName(Codec codec);
+
+    // Look up a codec by name, false when unknown
+    static bool parseCodec(const std::string& name, Codec& codec);
+
+    // Check whether a codec is built in
+    static bool isAvailable(Codec codec);
+
+protected:
+    // Codec-specific work behind encode()
+    virtual Buffer encodeImage(const RawFrame& frame, int maxQuality, ThreadPool& workers, int& quality,
+                               bool& unchanged) = 0;
+
+    // Codec-specific work behind encodeStill(), plain encoding by default
+    virtual Buffer encodeStillImage(const RawFrame& frame, int quality, ThreadPool& workers);
+
+private:
+    // Account one encoded image
+    void addCost(const Buffer& image, double ms);
+
+    mutable std::mutex _costMutex;
+    Cost _cost;
+};
+
+// Create an encoder for a codec, null when it is not built in
+std::unique_ptr<FrameEncoder> createFrameEncoder(FrameEncoder::Codec codec);
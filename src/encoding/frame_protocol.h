@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Binary screen-sharing messages sent over the WebSocket binary channel
+ *
+ * Full frames are still sent as a bare image, so legacy clients keep working: JPEG (first
+ * byte 0xFF) unless the client negotiated WebP in start_sharing (a RIFF container, first
+ * byte 'R'). Every other message starts with a MessageType byte, which never collides
+ * with either. All multi-byte fields are little-endian.
+ *
+ * TileUpdate
+ *   u8  type = 0x01
+ *   u8  flags              TileFlags bitmask
+ *   u16 frameWidth
+ *   u16 frameHeight
+ *   u16 tileSize
+ *   u32 sequence
+ *   [TILE_FLAG_TABLES] u32 length + JPEG tables-only stream (SOI, DQT, DHT, EOI)
+ *   [TILE_FLAG_COPY] u16 copyCount, copyCount x { u16 srcX, u16 srcY, u16 x, u16 y, u16 width, u16 height }
+ *   u16 tileCount
+ *   tileCount x { u16 x, u16 y, u16 width, u16 height, u8 TileCodec,
+ *                 [TILE_FLAG_CACHE] u32 slot, u32 length, bytes }
+ *
+ * TILE_CODEC_JPEG_ABBREVIATED tiles omit DQT/DHT; clients rebuild a decodable stream by
+ * inserting the segments of the most recent tables stream right after the tile's SOI.
+ * The tables stream may define quantization tables 0-3; tiles of lower-quality regions
+ * such as video refer to tables 2 and 3 in their frame header.
+ *
+ * TILE_CODEC_PALETTE tiles are lossless, for text and flat UI:
+ *   u8  colorCount - 1
+ *   colorCount x { u8 r, u8 g, u8 b }
+ *   zlib stream (RFC 1950) of width x height u8 palette indices, row by row
+ *
+ * With TILE_FLAG_CACHE the client keeps every decoded tile in the given slot, replacing
+ * what was there, and TILE_CODEC_CACHED tiles (length 0) draw the slot's content at the
+ * new position. Tiles must be applied in message order. Slots are forgotten on reconnect.
+ *
+ * Copy rects move already displayed pixels (scrolling) and are applied in order before
+ * any tile; each reads its whole source before writing, like memmove.
+ *
+ * A refinement update (TILE_FLAG_REFINE) resends tiles of a static screen at higher
+ * quality. It carries no cache references; tiles the client already caches come with
+ * their existing slot and replace its content.
+ *
+ * Heartbeat
+ *   u8  type = 0x02
+ *   u16 frameWidth
+ *   u16 frameHeight
+ *
+ * Sent periodically while the screen is static and no frames are sent, so clients can
+ * tell an idle screen from a stalled connection. The displayed image stays as it is.
+ *
+ * LosslessFrame
+ *   u8  type = 0x03
+ *   u8  flags              LOSSLESS_FLAG_KEYFRAME
+ *   u16 frameWidth
+ *   u16 frameHeight
+ *   u32 sequence
+ *   u16 copyCount, copyCount x { u16 srcX, u16 srcY, u16 x, u16 y, u16 width, u16 height }
+ *   u16 x, u16 y, u16 width, u16 height    Changed rectangle, empty when only copies changed
+ *   u16 bandRows           Rows per band, the last band may be shorter
+ *   u8  bandCount
+ *   bandCount x { u32 length, zlib stream (RFC 1950) of bandRows x width x { u8 r, u8 g, u8 b } }
+ *
+ * A keyframe covers the whole frame and its bands hold the pixels. Otherwise the copy
+ * rects are applied first, as in a TileUpdate, then each value is the XOR of the pixel
+ * with the result and pixels outside the rectangle are unchanged. Clients must apply
+ * every frame since the last keyframe, in order.
+ *
+ * VideoFrame
+ *   u8  type = 0x04
+ *   u8  flags              VIDEO_FLAG_KEYFRAME
+ *   u16 frameWidth
+ *   u16 frameHeight
+ *   u32 sequence
+ *   H.264 Annex B byte stream up to the end of the message
+ *
+ * Each message is one access unit of a Constrained Baseline stream, so there are no
+ * B-frames and it can be decoded as it arrives (WebCodecs: avc format "annexb"). A
+ * keyframe starts with SPS and PPS followed by an IDR picture. Like lossless frames,
+ * clients must decode every frame since the last keyframe, in order. Samples are full
+ * range BT.601, as in JPEG, and frameWidth and frameHeight are rounded down to even.
+ *
+ * Cursor
+ *   u8  type = 0x05
+ *   u8  flags              CursorFlags bitmask
+ *   i16 x, i16 y           Hotspot position in frame pixels, may lie outside the frame
+ *   u32 shapeId            0 when the shape is unknown, draw a default pointer
+ *   [CURSOR_FLAG_SHAPE] u16 width, u16 height, u16 hotX, u16 hotY,
+ *                       zlib stream (RFC 1950) of width x height x { u8 r, u8 g, u8 b, u8 a } up to the end
+ *
+ * Frames never contain the pointer; clients that asked for cursor messages draw it
+ * themselves. Shapes are scaled like the frames and straight alpha. Clients keep every
+ * shape by id until they reconnect, and a shape is only attached the first time a
+ * client needs its id. Cursor messages are sent independently of frames, at a higher rate.
+ *
+ * Viewport
+ *   u8  type = 0x06
+ *   u16 x, u16 y, u16 width, u16 height    Part of the screen the following frames show
+ *   u16 screenWidth
+ *   u16 screenHeight
+ *
+ * Sent ahead of the first frame showing a different part of the screen than the client
+ * last heard of; until the first one, frames show the whole screen. Frames, heartbeats
+ * and cursor positions are in the viewport scaled to frameWidth x frameHeight. The
+ * viewport is shared: with several clients it covers every client's requested rectangle.
+ *
+ * Thumbnail
+ *   u8  type = 0x07
+ *   u16 width
+ *   u16 height
+ *   JPEG image of the whole screen up to the end of the message
+ *
+ * Sent at a low rate while a viewport is set, to clients that asked for one, whenever the
+ * screen outside or inside the viewport has changed.
+ */
+namespace frame_protocol {
+
+    enum MessageType : uint8_t {
+        MESSAGE_TILE_UPDATE = 0x01,
+        MESSAGE_HEARTBEAT = 0x02,
+        MESSAGE_LOSSLESS_FRAME = 0x03,
+        MESSAGE_VIDEO_FRAME = 0x04,
+        MESSAGE_CURSOR = 0x05,
+        MESSAGE_VIEWPORT = 0x06,
+        MESSAGE_THUMBNAIL = 0x07
+    };
+
+    enum LosslessFlags : uint8_t {
+        LOSSLESS_FLAG_KEYFRAME = 0x01   // Pixels of the whole frame, not a delta
+    };
+
+    enum VideoFlags : uint8_t {
+        VIDEO_FLAG_KEYFRAME = 0x01      // Starts with an IDR picture, decodable on its own
+    };
+
+    enum CursorFlags : uint8_t {
+        CURSOR_FLAG_VISIBLE = 0x01,     // Draw the pointer, otherwise hide it
+        CURSOR_FLAG_SHAPE = 0x02        // The shape for shapeId follows
+    };
+
+    enum TileFlags : uint8_t {
+        TILE_FLAG_KEYFRAME = 0x01,  // Every tile of the frame is present
+        TILE_FLAG_TABLES = 0x02,    // A new JPEG tables stream precedes the tiles
+        TILE_FLAG_CACHE = 0x04,     // Tiles carry client cache slots
+        TILE_FLAG_COPY = 0x08,      // Copy rects precede the tiles
+        TILE_FLAG_REFINE = 0x10     // Higher-quality resend of unchanged tiles
+    };
+
+    enum TileCodec : uint8_t {
+        TILE_CODEC_JPEG_ABBREVIATED = 0x01,  // JPEG without tables, use the shared tables
+        TILE_CODEC_JPEG = 0x02,              // Self-contained JPEG
+        TILE_CODEC_CACHED = 0x03,            // Copy of a tile in the client's cache slot
+        TILE_CODEC_PALETTE = 0x04            // Palette and zlib-compressed indices, lossless
+    };
+
+    // Appends little-endian fields to a message buffer
+    class MessageWriter {
+    public:
+        explicit MessageWriter(std::vector<uint8_t>& buffer) : _buffer(buffer) {}
+
+        void put8(uint8_t value) { _buffer.push_back(value); }
+
+        void put16(uint16_t value) {
+            _buffer.push_back(static_cast<uint8_t>(value & 0xFF));
+            _buffer.push_back(static_cast<uint8_t>(value >> 8));
+        }
+
+        void put32(uint32_t value) {
+            put16(static_cast<uint16_t>(value & 0xFFFF));
+            put16(static_cast<uint16_t>(value >> 16));
+        }
+
+        void putBytes(const uint8_t* data, size_t size) {
+            _buffer.insert(_buffer.end(), data, data + size);
+        }
+
+        // Reserve a u16 to be filled in later, returns its offset
+        size_t reserve16() {
+            size_t offset = _buffer.size();
+            put16(0);
+            return offset;
+        }
+
+        void patch16(size_t offset, uint16_t value) {
+            _buffer[offset] = static_cast<uint8_t>(value & 0xFF);
+            _buffer[offset + 1] = static_cast<uint8_t>(value >> 8);
+        }
+
+        size_t size() const { return _buffer.size(); }
+
+    private:
+        std::vector<uint8_t>& _buffer;
+    };
+
+    // Build a HEARTBEAT message
+    inline void packHeartbeat(int frameWidth, int frameHeight, std::vector<uint8_t>& message) {
+        message.clear();
+        MessageWriter writer(message);
+        writer.put8(MESSAGE_HEARTBEAT);
+        writer.put16(static_cast<uint16_t>(frameWidth));
+        writer.put16(static_cast<uint16_t>(frameHeight));
+    }
+
+    // Build a VIEWPORT message
+    inline void packViewport(int x, int y, int width, int height, int screenWidth, int screenHeight,
+                             std::vector<uint8_t>& message) {
+        message.clear();
+        MessageWriter writer(message);
+        writer.put8(MESSAGE_VIEWPORT);
+        writer.put16(static_cast<uint16_t>(x));
+        writer.put16(static_cast<uint16_t>(y));
+        writer.put16(static_cast<uint16_t>(width));
+        writer.put16(static_cast<uint16_t>(height));
+        writer.put16(static_cast<uint16_t>(screenWidth));
+        writer.put16(static_cast<uint16_t>(screenHeight));
+    }
+}
@@ -0,0 +1,321 @@
+#include "frame_scaler.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FRAME_SCALER_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRAME_SCALER_SSE2
+#endif
+
+namespace {
+    // Average pixel pairs of a vertically averaged row: out[i] = avg(in[2i], in[2i + 1])
+    inline void halveRow(const uint8_t* top, const uint8_t* bottom, uint8_t* out, int outWidth) {
+        int x = 0;
+
+#if defined(__AVX2__)
+        for (; x + 8 <= outWidth; x += 8) {
+            const uint8_t* a = top + x * 8;
+            const uint8_t* b = bottom + x * 8;
+            __m256i v0 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b)));
+            __m256i v1 = _mm256_avg_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + 32)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 32)));
+            // Split even and odd pixels, shuffle_ps works per 128-bit lane so fix the order after
+            __m256 even = _mm256_shuffle_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1), _MM_SHUFFLE(2, 0, 2, 0));
+            __m256 odd = _mm256_shuffle_ps(_mm256_castsi256_ps(v0), _mm256_castsi256_ps(v1), _MM_SHUFFLE(3, 1, 3, 1));
+            __m256i sum = _mm256_avg_epu8(_mm256_castps_si256(even), _mm256_castps_si256(odd));
+            sum = _mm256_permute4x64_epi64(sum, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * 4), sum);
+        }
+#endif
+
+#if defined(FRAME_SCALER_SSE2)
+        for (; x + 4 <= outWidth; x += 4) {
+            const uint8_t* a = top + x * 8;
+            const uint8_t* b = bottom + x * 8;
+            __m128i v0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b)));
+            __m128i v1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16)));
+            __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4),
+                             _mm_avg_epu8(_mm_castps_si128(even), _mm_castps_si128(odd)));
+        }
+#endif
+
+        // Scalar tail, rounding like the SIMD average
+        for (; x < outWidth; x++) {
+            const uint8_t* a = top + x * 8;
+            const uint8_t* b = bottom + x * 8;
+            for (int c = 0; c < 4; c++) {
+                int left = (a[c] + b[c] + 1) >> 1;
+                int right = (a[c + 4] + b[c + 4] + 1) >> 1;
+                out[x * 4 + c] = static_cast<uint8_t>((left + right + 1) >> 1);
+            }
+        }
+    }
+
+    // Blend two rows: out = a + (b - a) * weight / 128, 7-bit weights keep products in 16 bits
+    inline void blendRows(const uint8_t* a, const uint8_t* b, uint8_t* out, int bytes, int weight) {
+        int i = 0;
+
+#if defined(__AVX2__)
+        const __m256i zero256 = _mm256_setzero_si256();
+        const __m256i w256 = _mm256_set1_epi16(static_cast<short>(weight));
+        for (; i + 32 <= bytes; i += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            __m256i alo = _mm256_unpacklo_epi8(va, zero256);
+            __m256i ahi = _mm256_unpackhi_epi8(va, zero256);
+            __m256i dlo = _mm256_sub_epi16(_mm256_unpacklo_epi8(vb, zero256), alo);
+            __m256i dhi = _mm256_sub_epi16(_mm256_unpackhi_epi8(vb, zero256), ahi);
+            alo = _mm256_add_epi16(alo, _mm256_srai_epi16(_mm256_mullo_epi16(dlo, w256), 7));
+            ahi = _mm256_add_epi16(ahi, _mm256_srai_epi16(_mm256_mullo_epi16(dhi, w256), 7));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(alo, ahi));
+        }
+#endif
+
+#if defined(FRAME_SCALER_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i w = _mm_set1_epi16(static_cast<short>(weight));
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            __m128i alo = _mm_unpacklo_epi8(va, zero);
+            __m128i ahi = _mm_unpackhi_epi8(va, zero);
+            __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(vb, zero), alo);
+            __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(vb, zero), ahi);
+            alo = _mm_add_epi16(alo, _mm_srai_epi16(_mm_mullo_epi16(dlo, w), 7));
+            ahi = _mm_add_epi16(ahi, _mm_srai_epi16(_mm_mullo_epi16(dhi, w), 7));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(alo, ahi));
+        }
+#endif
+
+        for (; i < bytes; i++) {
+            out[i] = static_cast<uint8_t>(a[i] + (((b[i] - a[i]) * weight) >> 7));
+        }
+    }
+
+    // Map a source coordinate range onto the output, widened for filter support and rounding
+    inline void mapSpan(int start, int length, int srcSize, int dstSize, int& outStart, int& outLength) {
+        int64_t first = static_cast<int64_t>(start) * dstSize / srcSize - 2;
+        int64_t last = (static_cast<int64_t>(start + length) * dstSize + srcSize - 1) / srcSize + 2;
+        first = std::max<int64_t>(first, 0);
+        last = std::min<int64_t>(last, dstSize);
+        outStart = static_cast<int>(first);
+        outLength = static_cast<int>(std::max<int64_t>(last - first, 0));
+    }
+}
+
+void FrameScaler::setTargetSize(int maxWidth, int maxHeight) {
+    _maxWidth = std::max(maxWidth, 0);
+    _maxHeight = std::max(maxHeight, 0);
+}
+
+void FrameScaler::setScaleFactor(double factor) {
+    _scaleFactor = std::clamp(factor, 0.05, 1.0);
+}
+
+void FrameScaler::getOutputSize(int width, int height, int& outWidth, int& outHeight) const {
+    outWidth = width;
+    outHeight = height;
+    if (width <= 0 || height <= 0) return;
+
+    double scale = _scaleFactor;
+    if (_maxWidth > 0 && _maxHeight > 0 && (width > _maxWidth || height > _maxHeight)) {
+        scale *= std::min(static_cast<double>(_maxWidth) / width, static_cast<double>(_maxHeight) / height);
+    }
+    if (scale >= 1.0) return;
+
+    // Keep sizes even for chroma-subsampled encoders
+    outWidth = std::max(2, static_cast<int>(width * scale + 0.5) & ~1);
+    outHeight = std::max(2, static_cast<int>(height * scale + 0.5) & ~1);
+    outWidth = std::min(outWidth, width);
+    outHeight = std::min(outHeight, height);
+}
+
+bool FrameScaler::needsScaling(int width, int height) const {
+    int outWidth, outHeight;
+    getOutputSize(width, height, outWidth, outHeight);
+    return outWidth != width || outHeight != height;
+}
+
+void FrameScaler::setCrop(const CaptureRect& crop) {
+    _crop = crop;
+}
+
+CaptureRect FrameScaler::clipCrop(int width, int height) const {
+    int left = std::max(_crop.x, 0);
+    int top = std::max(_crop.y, 0);
+    int right = std::min(_crop.x + _crop.width, width);
+    int bottom = std::min(_crop.y + _crop.height, height);
+    if (_crop.width <= 0 || _crop.height <= 0 || right <= left || bottom <= top) {
+        return {0, 0, width, height};
+    }
+    return {left, top, right - left, bottom - top};
+}
+
+bool FrameScaler::scale(const RawFrame& input, RawFrame& output) {
+    CaptureRect region = clipCrop(input.width, input.height);
+    bool cropped = region.width != input.width || region.height != input.height;
+    bool cropMoved = region.x != _lastCrop.x || region.y != _lastCrop.y ||
+                     region.width != _lastCrop.width || region.height != _lastCrop.height;
+    _lastCrop = region;
+
+    int outWidth, outHeight;
+    getOutputSize(region.width, region.height, outWidth, outHeight);
+    if (!cropped && outWidth == input.width && outHeight == input.height) {
+        return false;
+    }
+
+    // The output buffer persists, so an unchanged frame only needs its metadata refreshed;
+    // a moved crop shows other pixels even when nothing on screen changed
+    bool sameGeometry = !cropMoved && output.width == outWidth && output.height == outHeight &&
+                        output.pixels.size() == static_cast<size_t>(outWidth) * outHeight * 4;
+    bool unchanged = sameGeometry && input.dirtyRectsValid && input.dirtyRects.empty();
+
+    output.width = outWidth;
+    output.height = outHeight;
+    output.stride = outWidth * 4;
+    output.sequence = input.sequence;
+    output.timestamp = input.timestamp;
+    output.sourceGeneration = 0;
+    output.pixels.resize(static_cast<size_t>(output.stride) * outHeight);
+
+    output.dirtyRects.clear();
+    output.dirtyRectsValid = input.dirtyRectsValid && sameGeometry;
+    if (output.dirtyRectsValid) {
+        for (const CaptureRect& rect : input.dirtyRects) {
+            // Damage outside the crop is dropped, the rest is moved to the crop's origin
+            int left = std::max(rect.x, region.x) - region.x;
+            int top = std::max(rect.y, region.y) - region.y;
+            int right = std::min(rect.x + rect.width, region.x + region.width) - region.x;
+            int bottom = std::min(rect.y + rect.height, region.y + region.height) - region.y;
+            if (right <= left || bottom <= top) {
+                continue;
+            }
+
+            CaptureRect mapped{left, top, right - left, bottom - top};
+            if (outWidth != region.width || outHeight != region.height) {
+                mapSpan(left, right - left, region.width, outWidth, mapped.x, mapped.width);
+                mapSpan(top, bottom - top, region.height, outHeight, mapped.y, mapped.height);
+            }
+            if (mapped.width > 0 && mapped.height > 0) {
+                output.dirtyRects.push_back(mapped);
+            }
+        }
+    }
+
+    if (unchanged) {
+        return true;
+    }
+
+    // Box-halve while the source is at least twice the target
+    const uint8_t* src = input.pixels.data() + static_cast<size_t>(region.y) * input.stride +
+                         static_cast<size_t>(region.x) * 4;
+    int srcStride = input.stride;
+    int srcWidth = region.width;
+    int srcHeight = region.height;
+    int level = 0;
+    while (srcWidth >= outWidth * 2 && srcHeight >= outHeight * 2) {
+        std::vector<uint8_t>& dst = _levels[level];
+        halve(src, srcStride, srcWidth, srcHeight, dst);
+        src = dst.data();
+        srcWidth /= 2;
+        srcHeight /= 2;
+        srcStride = srcWidth * 4;
+        level ^= 1;
+    }
+
+    if (srcWidth == outWidth && srcHeight == outHeight) {
+        for (int y = 0; y < outHeight; y++) {
+            std::memcpy(output.pixels.data() + static_cast<size_t>(y) * output.stride,
+                        src + static_cast<size_t>(y) * srcStride, static_cast<size_t>(outWidth) * 4);
+        }
+        return true;
+    }
+
+    resample(src, srcStride, srcWidth, srcHeight, output.pixels.data(), output.stride, outWidth, outHeight);
+    return true;
+}
+
+void FrameScaler::halve(const uint8_t* src, int srcStride, int width, int height, std::vector<uint8_t>& dst) {
+    int outWidth = width / 2;
+    int outHeight = height / 2;
+    dst.resize(static_cast<size_t>(outWidth) * outHeight * 4);
+
+    for (int y = 0; y < outHeight; y++) {
+        const uint8_t* top = src + static_cast<size_t>(y * 2) * srcStride;
+        halveRow(top, top + srcStride, dst.data() + static_cast<size_t>(y) * outWidth * 4, outWidth);
+    }
+}
+
+void FrameScaler::resample(const uint8_t* src, int srcStride, int srcWidth, int srcHeight,
+                           uint8_t* dst, int dstStride, int dstWidth, int dstHeight) {
+    // Sample at pixel centres in 8.8 fixed point, clamping the last tap inside the image
+    auto samplePosition = [](int index, int srcSize, int dstSize, int& base, int& weight) {
+        int64_t position = ((2 * static_cast<int64_t>(index) + 1) * srcSize * 256) / (2 * dstSize) - 128;
+        position = std::max<int64_t>(position, 0);
+        base = static_cast<int>(position >> 8);
+        weight = static_cast<int>(position & 255);
+        if (base >= srcSize - 1) {
+            base = std::max(srcSize - 2, 0);
+            weight = srcSize > 1 ? 256 : 0;
+        }
+    };
+
+    // Per column: left tap weight for each of the 4 channels, then the right tap weight
+    _columnIndex.resize(dstWidth);
+    _columnWeights.resize(static_cast<size_t>(dstWidth) * 8);
+    for (int x = 0; x < dstWidth; x++) {
+        int base, weight;
+        samplePosition(x, srcWidth, dstWidth, base, weight);
+        _columnIndex[x] = base;
+        for (int c = 0; c < 4; c++) {
+            _columnWeights[x * 8 + c] = static_cast<uint16_t>(256 - weight);
+            _columnWeights[x * 8 + 4 + c] = static_cast<uint16_t>(weight);
+        }
+    }
+
+    size_t rowBytes = static_cast<size_t>(srcWidth) * 4;
+    // Pad so the last column's second tap can be read even when it has zero weight
+    _blendedRow.resize(rowBytes + 8);
+
+#if defined(FRAME_SCALER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(128);
+#endif
+
+    for (int y = 0; y < dstHeight; y++) {
+        int base, weight;
+        samplePosition(y, srcHeight, dstHeight, base, weight);
+        const uint8_t* top = src + static_cast<size_t>(base) * srcStride;
+        const uint8_t* bottom = srcHeight > 1 ? top + srcStride : top;
+        blendRows(top, bottom, _blendedRow.data(), static_cast<int>(rowBytes), (weight + 1) >> 1);
+
+        uint8_t* out = dst + static_cast<size_t>(y) * dstStride;
+        const uint8_t* row = _blendedRow.data();
+        for (int x = 0; x < dstWidth; x++) {
+            const uint8_t* p = row + static_cast<size_t>(_columnIndex[x]) * 4;
+            const uint16_t* weights = &_columnWeights[static_cast<size_t>(x) * 8];
+
+#if defined(FRAME_SCALER_SSE2)
+            // Both taps as 16-bit lanes, weights never sum above 256 so products fit
+            __m128i taps = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), zero);
+            __m128i products = _mm_mullo_epi16(taps, _mm_loadu_si128(reinterpret_cast<const __m128i*>(weights)));
+            __m128i sum = _mm_add_epi16(products, _mm_srli_si128(products, 8));
+            sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 8);
+            int packed = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+            std::memcpy(out + x * 4, &packed, 4);
+#else
+            for (int c = 0; c < 4; c++) {
+                out[x * 4 + c] = static_cast<uint8_t>((p[c] * weights[c] + p[c + 4] * weights[4 + c] + 128) >> 8);
+            }
+#endif
+        }
+    }
+}
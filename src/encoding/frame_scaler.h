@@ -0,0 +1,63 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Downscales BGRA frames to fit a requested output size, preserving aspect ratio
+ *
+ * An optional crop limits the output to part of the input, for clients viewing a region
+ * of the screen; the crop is fitted to the output size on its own.
+ * While the source is at least twice the target it is halved with a 2x2 box filter,
+ * then a bilinear pass produces the exact size. Both passes are vectorized with
+ * SSE2/AVX2, so the cost is roughly one read of the source frame.
+ */
+class FrameScaler {
+public:
+    // Fit frames inside maxWidth x maxHeight, 0 in either dimension disables scaling
+    void setTargetSize(int maxWidth, int maxHeight);
+
+    // Shrink the fitted size further by a factor in (0, 1], 1 keeps the fitted size
+    void setScaleFactor(double factor);
+
+    // Scale only this part of the input, an empty rect (or one outside the input) keeps all of it
+    void setCrop(const CaptureRect& crop);
+
+    // Get the part of the input the last scaled frame showed, clipped to the input
+    const CaptureRect& getLastCrop() const { return _lastCrop; }
+
+    // Compute the output size for an input size, never larger than the input
+    void getOutputSize(int width, int height, int& outWidth, int& outHeight) const;
+
+    // Check whether frames of this size would be scaled at all
+    bool needsScaling(int width, int height) const;
+
+    // Crop and scale a frame into output, mapping its dirty rects; false when neither is needed
+    bool scale(const RawFrame& input, RawFrame& output);
+
+private:
+    // Clip the crop to an input size, the whole input when nothing is left
+    CaptureRect clipCrop(int width, int height) const;
+
+    // Halve a BGRA image with a 2x2 box filter
+    static void halve(const uint8_t* src, int srcStride, int width, int height, std::vector<uint8_t>& dst);
+
+    // Bilinear resample to the exact output size
+    void resample(const uint8_t* src, int srcStride, int srcWidth, int srcHeight,
+                  uint8_t* dst, int dstStride, int dstWidth, int dstHeight);
+
+    int _maxWidth{0};
+    int _maxHeight{0};
+    double _scaleFactor{1.0};
+    CaptureRect _crop;
+    CaptureRect _lastCrop;
+
+    // Ping-pong buffers for the halving levels
+    std::vector<uint8_t> _levels[2];
+
+    // Bilinear sampling tables and the vertically blended row
+    std::vector<int> _columnIndex;
+    std::vector<uint16_t> _columnWeights;
+    std::vector<uint8_t> _blendedRow;
+};
@@ -0,0 +1,322 @@
+#include "jpeg_encoder_pool.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+namespace {
+    // Idle buffers kept for reuse, enough for queued frames plus the bands of one frame
+    constexpr size_t kMaxFreeBuffers = 16;
+
+    // 4:2:0 MCUs are 16x16 pixels
+    constexpr int kMcuSize = 16;
+
+    // Smaller bands spend more on per-band setup than they save
+    constexpr int kMinBandRows = 128;
+}
+
+struct JpegEncoderPool::State {
+    std::mutex mutex;
+    std::vector<void*> idleHandles;
+    size_t handleCount{0};
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> freeBuffers;
+
+    ~State() {
+#ifdef HAVE_TURBOJPEG
+        for (void* handle : idleHandles) {
+            tjDestroy(handle);
+        }
+#endif
+    }
+};
+
+// Constructor
+JpegEncoderPool::JpegEncoderPool() : _state(std::make_shared<State>()) {}
+
+// Destructor
+JpegEncoderPool::~JpegEncoderPool() = default;
+
+// Get the number of compressor handles
+size_t JpegEncoderPool::getHandleCount() const {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    return _state->handleCount;
+}
+
+// Take an idle handle or create one
+void* JpegEncoderPool::acquireHandle() {
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        if (!_state->idleHandles.empty()) {
+            void* handle = _state->idleHandles.back();
+            _state->idleHandles.pop_back();
+            return handle;
+        }
+    }
+
+#ifdef HAVE_TURBOJPEG
+    void* handle = tjInitCompress();
+    if (!handle) {
+        std::cerr << "TurboJPEG initialization failed" << std::endl;
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    _state->handleCount++;
+    return handle;
+#else
+    return nullptr;
+#endif
+}
+
+// Return a handle to the pool
+void JpegEncoderPool::releaseHandle(void* handle) {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    _state->idleHandles.push_back(handle);
+}
+
+// Take a recycled output buffer or create one
+std::unique_ptr<std::vector<uint8_t>> JpegEncoderPool::takeBuffer() {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    if (_state->freeBuffers.empty()) {
+        return std::make_unique<std::vector<uint8_t>>();
+    }
+
+    std::unique_ptr<std::vector<uint8_t>> buffer = std::move(_state->freeBuffers.back());
+    _state->freeBuffers.pop_back();
+    return buffer;
+}
+
+// Share a finished buffer
+JpegEncoderPool::Buffer JpegEncoderPool::share(std::unique_ptr<std::vector<uint8_t>> buffer) {
+    std::weak_ptr<State> weakState = _state;
+    return Buffer(buffer.release(), [weakState](const std::vector<uint8_t>* released) {
+        std::unique_ptr<std::vector<uint8_t>> owned(const_cast<std::vector<uint8_t>*>(released));
+        if (std::shared_ptr<State> state = weakState.lock()) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->freeBuffers.size() < kMaxFreeBuffers) {
+                state->freeBuffers.push_back(std::move(owned));
+            }
+        }
+    });
+}
+
+// Return an unshared buffer to the pool
+void JpegEncoderPool::recycle(std::unique_ptr<std::vector<uint8_t>> buffer) {
+    std::lock_guard<std::mutex> lock(_state->mutex);
+    if (buffer && _state->freeBuffers.size() < kMaxFreeBuffers) {
+        _state->freeBuffers.push_back(std::move(buffer));
+    }
+}
+
+// Compress a band of rows as a standalone JPEG
+std::unique_ptr<std::vector<uint8_t>> JpegEncoderPool::compressRows(const YuvPlanes& planes, int firstRow,
+                                                                    int rows, int quality) {
+#ifdef HAVE_TURBOJPEG
+    void* handle = acquireHandle();
+    if (!handle) {
+        return nullptr;
+    }
+
+    // Worst-case size, so TurboJPEG never has to grow the buffer; capacity survives recycling
+    std::unique_ptr<std::vector<uint8_t>> output = takeBuffer();
+    unsigned long bound = tjBufSize(planes.width, rows, TJSAMP_420);
+    output->resize(bound);
+
+    unsigned char* jpegBuf = output->data();
+    unsigned long jpegSize = bound;
+    int chromaWidth = planes.chromaWidth();
+    const unsigned char* planePointers[3] = {
+        planes.y.data() + static_cast<size_t>(firstRow) * planes.width,
+        planes.u.data() + static_cast<size_t>(firstRow / 2) * chromaWidth,
+        planes.v.data() + static_cast<size_t>(firstRow / 2) * chromaWidth};
+    int strides[3] = {planes.width, chromaWidth, chromaWidth};
+
+    // The planes are already subsampled, so TurboJPEG skips its own colour conversion
+    int result = tjCompressFromYUVPlanes(handle, planePointers, planes.width, strides, rows,
+                                         TJSAMP_420, &jpegBuf, &jpegSize, quality,
+                                         TJFLAG_FASTDCT | TJFLAG_NOREALLOC);
+    if (result != 0 || jpegBuf != output->data() || jpegSize == 0) {
+        std::cerr << "JPEG compression failed: " << tjGetErrorStr2(handle) << std::endl;
+        releaseHandle(handle);
+        recycle(std::move(output));
+        return nullptr;
+    }
+    releaseHandle(handle);
+
+    output->resize(jpegSize);
+    return output;
+#else
+    std::cerr << "YUV JPEG compression requires TurboJPEG" << std::endl;
+    return nullptr;
+#endif
+}
+
+// Compress YUV planes to JPEG
+JpegEncoderPool::Buffer JpegEncoderPool::compress(const YuvPlanes& planes, int quality) {
+    std::unique_ptr<std::vector<uint8_t>> output = compressRows(planes, 0, planes.height, quality);
+    return output ? share(std::move(output)) : nullptr;
+}
+
+// Compress BGRA pixels to a 4:4:4 JPEG
+JpegEncoderPool::Buffer JpegEncoderPool::compressBgra(const uint8_t* pixels, int stride, int width, int height,
+                                                      int quality) {
+#ifdef HAVE_TURBOJPEG
+    void* handle = acquireHandle();
+    if (!handle) {
+        return nullptr;
+    }
+
+    std::unique_ptr<std::vector<uint8_t>> output = takeBuffer();
+    unsigned long bound = tjBufSize(width, height, TJSAMP_444);
+    output->resize(bound);
+
+    // Accurate DCT, this frame is sent once and stays on screen
+    unsigned char* jpegBuf = output->data();
+    unsigned long jpegSize = bound;
+    int result = tjCompress2(handle, pixels, width, stride, height, TJPF_BGRX, &jpegBuf, &jpegSize,
+                             TJSAMP_444, quality, TJFLAG_NOREALLOC);
+    if (result != 0 || jpegBuf != output->data() || jpegSize == 0) {
+        std::cerr << "JPEG compression failed: " << tjGetErrorStr2(handle) << std::endl;
+        releaseHandle(handle);
+        recycle(std::move(output));
+        return nullptr;
+    }
+    releaseHandle(handle);
+
+    output->resize(jpegSize);
+    return share(std::move(output));
+#else
+    (void)pixels;
+    (void)stride;
+    (void)width;
+    (void)height;
+    (void)quality;
+    return nullptr;
+#endif
+}
+
+// Compress YUV planes to JPEG in parallel bands
+JpegEncoderPool::Buffer JpegEncoderPool::compress(const YuvPlanes& planes, int quality, ThreadPool& workers) {
+    // Bands are whole MCU rows, and one band must fit the 16-bit restart interval
+    int mcuColumns = (planes.width + kMcuSize - 1) / kMcuSize;
+    int mcuRows = (planes.height + kMcuSize - 1) / kMcuSize;
+    int bands = static_cast<int>(std::min<size_t>(workers.getThreadCount(), planes.height / kMinBandRows));
+    if (bands < 2 || mcuColumns > 0xFFFF) {
+        return compress(planes, quality);
+    }
+
+    int bandMcuRows = std::min((mcuRows + bands - 1) / bands, 0xFFFF / mcuColumns);
+    bands = (mcuRows + bandMcuRows - 1) / bandMcuRows;
+    int bandRows = bandMcuRows * kMcuSize;
+
+    std::vector<std::unique_ptr<std::vector<uint8_t>>> parts(bands);
+    workers.parallelFor(static_cast<size_t>(bands), [&](size_t band) {
+        int firstRow = static_cast<int>(band) * bandRows;
+        parts[band] = compressRows(planes, firstRow, std::min(bandRows, planes.height - firstRow), quality);
+    });
+
+    std::unique_ptr<std::vector<uint8_t>> output = takeBuffer();
+    bool joined = joinBands(parts, planes.height, static_cast<uint16_t>(bandMcuRows * mcuColumns), *output);
+    for (auto& part : parts) {
+        recycle(std::move(part));
+    }
+
+    if (!joined) {
+        std::cerr << "Failed to join JPEG bands" << std::endl;
+        recycle(std::move(output));
+        return nullptr;
+    }
+    return share(std::move(output));
+}
+
+// Splice standalone band JPEGs into one image
+bool JpegEncoderPool::joinBands(const std::vector<std::unique_ptr<std::vector<uint8_t>>>& parts, int height,
+                                uint16_t restartInterval, std::vector<uint8_t>& output) {
+    size_t total = 16;
+    std::vector<size_t> scanStarts(parts.size());
+    size_t sofOffset = 0;
+    size_t sosOffset = 0;
+
+    for (size_t i = 0; i < parts.size(); i++) {
+        if (!parts[i]) {
+            return false;
+        }
+
+        size_t sof = 0;
+        size_t sos = 0;
+        if (!findScan(*parts[i], sof, sos, scanStarts[i])) {
+            return false;
+        }
+        if (i == 0) {
+            sofOffset = sof;
+            sosOffset = sos;
+        }
+        total += parts[i]->size() + 2;
+    }
+
+    // Headers and scan header of the first band, with the full height and a restart interval
+    const std::vector<uint8_t>& first = *parts[0];
+    output.clear();
+    output.reserve(total);
+    output.insert(output.end(), first.begin(), first.begin() + sosOffset);
+    output[sofOffset + 5] = static_cast<uint8_t>(height >> 8);
+    output[sofOffset + 6] = static_cast<uint8_t>(height & 0xFF);
+
+    const uint8_t restartSegment[6] = {0xFF, 0xDD, 0x00, 0x04,
+                                       static_cast<uint8_t>(restartInterval >> 8),
+                                       static_cast<uint8_t>(restartInterval & 0xFF)};
+    output.insert(output.end(), restartSegment, restartSegment + 6);
+    output.insert(output.end(), first.begin() + sosOffset, first.begin() + scanStarts[0]);
+
+    // Each band's entropy-coded data starts with fresh DC predictors, exactly like after RSTn
+    for (size_t i = 0; i < parts.size(); i++) {
+        const std::vector<uint8_t>& part = *parts[i];
+        output.insert(output.end(), part.begin() + scanStarts[i], part.end() - 2);
+        if (i + 1 < parts.size()) {
+            output.push_back(0xFF);
+            output.push_back(static_cast<uint8_t>(0xD0 + (i & 7)));
+        }
+    }
+
+    output.push_back(0xFF);
+    output.push_back(0xD9);
+    return true;
+}
+
+// Locate the frame header, the scan header and the entropy-coded data of a baseline JPEG
+bool JpegEncoderPool::findScan(const std::vector<uint8_t>& jpeg, size_t& sofOffset, size_t& sosOffset,
+                               size_t& scanStart) {
+    size_t size = jpeg.size();
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8 || jpeg[size - 2] != 0xFF || jpeg[size - 1] != 0xD9) {
+        return false;
+    }
+
+    bool haveFrame = false;
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (jpeg[pos] != 0xFF) {
+            return false;
+        }
+
+        uint8_t marker = jpeg[pos + 1];
+        size_t length = (static_cast<size_t>(jpeg[pos + 2]) << 8) | jpeg[pos + 3];
+        if (pos + 2 + length > size) {
+            return false;
+        }
+
+        if (marker == 0xC0) {
+            sofOffset = pos;
+            haveFrame = true;
+        } else if (marker == 0xDA) {
+            sosOffset = pos;
+            scanStart = pos + 2 + length;
+            return haveFrame && scanStart <= size - 2;
+        }
+        pos += 2 + length;
+    }
+
+    return false;
+}
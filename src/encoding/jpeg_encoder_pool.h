@@ -0,0 +1,73 @@
+#pragma once
+
+#include "color_convert.h"
+#include "../utils/thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Long-lived TurboJPEG compressors shared by the encoding threads
+ *
+ * Handles are created on first use and reused, so there is one per thread that encodes
+ * concurrently. Each frame is written with TJFLAG_NOREALLOC into a pooled output buffer
+ * sized by tjBufSize and handed out as shared immutable data; the buffer returns to the
+ * pool when the last consumer releases it.
+ */
+class JpegEncoderPool {
+public:
+    // Encoded JPEG, shared by every consumer without copying
+    using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    JpegEncoderPool();
+    ~JpegEncoderPool();
+
+    // Prevent copying
+    JpegEncoderPool(const JpegEncoderPool&) = delete;
+    JpegEncoderPool& operator=(const JpegEncoderPool&) = delete;
+
+    // Compress YUV 4:2:0 planes, null on failure; safe to call from several threads
+    Buffer compress(const YuvPlanes& planes, int quality);
+
+    // Compress horizontal bands on a thread pool and join them into one baseline JPEG
+    // Bands are MCU-row aligned and separated by restart markers, so any decoder reads the result
+    Buffer compress(const YuvPlanes& planes, int quality, ThreadPool& workers);
+
+    // Compress BGRA pixels without chroma subsampling, for sharp text in still frames
+    Buffer compressBgra(const uint8_t* pixels, int stride, int width, int height, int quality);
+
+    // Get the number of compressor handles created so far
+    size_t getHandleCount() const;
+
+private:
+    struct State;
+
+    // Take an idle handle or create one
+    void* acquireHandle();
+
+    // Return a handle for the next caller
+    void releaseHandle(void* handle);
+
+    // Take a recycled output buffer or create one
+    std::unique_ptr<std::vector<uint8_t>> takeBuffer();
+
+    // Share a finished buffer, recycling it once every consumer is done
+    Buffer share(std::unique_ptr<std::vector<uint8_t>> buffer);
+
+    // Return an unshared buffer to the pool
+    void recycle(std::unique_ptr<std::vector<uint8_t>> buffer);
+
+    // Compress rows [firstRow, firstRow + rows) as a standalone JPEG, firstRow is even
+    std::unique_ptr<std::vector<uint8_t>> compressRows(const YuvPlanes& planes, int firstRow, int rows, int quality);
+
+    // Splice band JPEGs into one image with a restart marker between bands
+    static bool joinBands(const std::vector<std::unique_ptr<std::vector<uint8_t>>>& parts, int height,
+                          uint16_t restartInterval, std::vector<uint8_t>& output);
+
+    // Find the SOF0 and SOS segments and the start of the entropy-coded data
+    static bool findScan(const std::vector<uint8_t>& jpeg, size_t& sofOffset, size_t& sosOffset, size_t& scanStart);
+
+    // Outstanding buffers keep a weak reference so they can outlive the pool
+    std::shared_ptr<State> _state;
+};
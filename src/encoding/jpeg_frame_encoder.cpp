@@ -0,0 +1,164 @@
+#include "jpeg_frame_encoder.h"
+#include <atomic>
+#include <iostream>
+
+// Add GDI+ support for fallback JPEG compression
+#if defined(NO_TURBOJPEG) && defined(_WIN32)
+#include <Windows.h>
+#include <gdiplus.h>
+#pragma comment(lib, "gdiplus.lib")
+using namespace Gdiplus;
+
+// GDI+ initialization
+static class GdiPlusInitializer {
+public:
+    GdiPlusInitializer() {
+        Gdiplus::GdiplusStartupInput gdiplusStartupInput;
+        Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
+    }
+    ~GdiPlusInitializer() {
+        Gdiplus::GdiplusShutdown(gdiplusToken);
+    }
+private:
+    ULONG_PTR gdiplusToken;
+} gdiPlusInit;
+
+// Helper function to get encoder CLSID
+static int GetEncoderClsid(const WCHAR* format, CLSID* pClsid) {
+    UINT num = 0;          // number of image encoders
+    UINT size = 0;         // size of the image encoder array in bytes
+
+    Gdiplus::GetImageEncodersSize(&num, &size);
+    if (size == 0)
+        return -1;
+
+    Gdiplus::ImageCodecInfo* pImageCodecInfo = (Gdiplus::ImageCodecInfo*)(malloc(size));
+    if (pImageCodecInfo == NULL)
+        return -1;
+
+    Gdiplus::GetImageEncoders(num, size, pImageCodecInfo);
+
+    for (UINT j = 0; j < num; ++j) {
+        if (wcscmp(pImageCodecInfo[j].MimeType, format) == 0) {
+            *pClsid = pImageCodecInfo[j].Clsid;
+            free(pImageCodecInfo);
+            return j;
+        }
+    }
+
+    free(pImageCodecInfo);
+    return -1;
+}
+#endif
+
+// Get the quality search
+QualitySearch* JpegFrameEncoder::getQualitySearch() {
+#ifdef HAVE_TURBOJPEG
+    return &_qualitySearch;
+#else
+    return nullptr;
+#endif
+}
+
+// Encode a frame
+FrameEncoder::Buffer JpegFrameEncoder::encodeImage(const RawFrame& frame, int maxQuality, ThreadPool& workers,
+                                                   int& quality, bool& unchanged) {
+#ifdef HAVE_TURBOJPEG
+    // One colour conversion feeds both change detection and the encoder
+    YuvPlanes& planes = _yuvPlanes[_yuvCurrent];
+    color_convert::bgraToYuv420(frame.pixels.data(), frame.stride, frame.width, frame.height, planes, workers);
+    bool same = planes.equals(_yuvPlanes[_yuvCurrent ^ 1]);
+    _yuvCurrent ^= 1;
+
+    // Sources without damage tracking are compared here; a new quality applies from the next change
+    if (!frame.dirtyRectsValid && same && _last) {
+        unchanged = true;
+        quality = _lastQuality;
+        return _last;
+    }
+
+    // The requested quality caps any bitrate or PSNR target
+    _last = _qualitySearch.encode(planes, maxQuality, _pool, workers, quality);
+#else
+    _last = compressFallback(frame, maxQuality);
+    quality = maxQuality;
+#endif
+    _lastQuality = quality;
+    return _last;
+}
+
+// Encode a static frame
+FrameEncoder::Buffer JpegFrameEncoder::encodeStillImage(const RawFrame& frame, int quality, ThreadPool& workers) {
+#ifdef HAVE_TURBOJPEG
+    // Full-resolution chroma keeps coloured text sharp
+    Buffer image = _pool.compressBgra(frame.pixels.data(), frame.stride, frame.width, frame.height, quality);
+#else
+    Buffer image = compressFallback(frame, quality);
+#endif
+    if (!image || image->empty()) {
+        return nullptr;
+    }
+    _last = image;
+    _lastQuality = quality;
+    return image;
+}
+
+// Compress raw pixels to JPEG without TurboJPEG
+FrameEncoder::Buffer JpegFrameEncoder::compressFallback(const RawFrame& frame, int quality) {
+    std::vector<uint8_t> jpegData;
+
+#if defined(_WIN32) && defined(NO_TURBOJPEG)
+    // GDI+ fallback implementation
+    // Create a GDI+ bitmap from raw data
+    Gdiplus::Bitmap bitmap(frame.width, frame.height, frame.stride, PixelFormat32bppARGB,
+                           const_cast<BYTE*>(frame.pixels.data()));
+
+    // Setup encoder parameters for JPEG quality
+    Gdiplus::EncoderParameters encoderParams;
+    encoderParams.Count = 1;
+    encoderParams.Parameter[0].Guid = Gdiplus::EncoderQuality;
+    encoderParams.Parameter[0].Type = Gdiplus::EncoderParameterValueTypeLong;
+    encoderParams.Parameter[0].NumberOfValues = 1;
+    ULONG qualityValue = quality;
+    encoderParams.Parameter[0].Value = &qualityValue;
+
+    // Get JPEG encoder CLSID
+    CLSID jpegClsid;
+    GetEncoderClsid(L"image/jpeg", &jpegClsid);
+
+    // Create a memory stream to save the JPEG
+    IStream* stream = NULL;
+    if (CreateStreamOnHGlobal(NULL, TRUE, &stream) == S_OK) {
+        // Save bitmap to stream as JPEG
+        if (bitmap.Save(stream, &jpegClsid, &encoderParams) == Gdiplus::Ok) {
+            // Get stream size
+            STATSTG stats;
+            if (stream->Stat(&stats, STATFLAG_NONAME) == S_OK) {
+                // Copy stream data to vector
+                LARGE_INTEGER seekPos = {0};
+                stream->Seek(seekPos, STREAM_SEEK_SET, NULL);
+
+                jpegData.resize(stats.cbSize.LowPart);
+                ULONG bytesRead;
+                stream->Read(jpegData.data(), stats.cbSize.LowPart, &bytesRead);
+            }
+        }
+
+        // Release stream
+        stream->Release();
+    }
+#else
+    (void)frame;
+    (void)quality;
+    // Every frame ends up here, the log only needs to hear it once
+    static std::atomic<bool> reported{false};
+    if (!reported.exchange(true)) {
+        std::cerr << "No JPEG encoder available in this build" << std::endl;
+    }
+#endif
+
+    if (jpegData.empty()) {
+        return nullptr;
+    }
+    return std::make_shared<const std::vector<uint8_t>>(std::move(jpegData));
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "frame_encoder.h"
+#include "color_convert.h"
+#include "jpeg_encoder_pool.h"
+#include "quality_search.h"
+
+/**
+ * Whole frames as baseline JPEG
+ *
+ * With TurboJPEG one colour conversion feeds both change detection and parallel band
+ * encoding, and the quality of each frame can follow a bitrate or PSNR target. Without
+ * it frames go through the platform encoder (GDI+ on Windows) at the requested quality.
+ */
+class JpegFrameEncoder : public FrameEncoder {
+public:
+    // Get the codec
+    Codec getCodec() const override { return Codec::JPEG; }
+
+    // Quality search, TurboJPEG builds only
+    QualitySearch* getQualitySearch() override;
+
+protected:
+    // Encode a frame, reusing the last image when the pixels did not change
+    Buffer encodeImage(const RawFrame& frame, int maxQuality, ThreadPool& workers, int& quality,
+                       bool& unchanged) override;
+
+    // Encode without chroma subsampling, so coloured text stays sharp
+    Buffer encodeStillImage(const RawFrame& frame, int quality, ThreadPool& workers) override;
+
+private:
+    // Compress BGRA pixels with the platform fallback encoder
+    static Buffer compressFallback(const RawFrame& frame, int quality);
+
+    // Persistent TurboJPEG handles and output buffers
+    JpegEncoderPool _pool;
+    QualitySearch _qualitySearch;
+
+    // Colour-converted planes of the current and previous frame
+    YuvPlanes _yuvPlanes[2];
+    int _yuvCurrent{0};
+
+    // Last image, returned again while the planes do not change
+    Buffer _last;
+    int _lastQuality{0};
+};
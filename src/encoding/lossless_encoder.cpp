@@ -0,0 +1,275 @@
+#include "lossless_encoder.h"
+#include "frame_diff.h"
+#include "frame_protocol.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+using namespace frame_protocol;
+
+namespace {
+    // Bands shorter than this give zlib too little history to find repeats in
+    constexpr int kMinBandRows = 64;
+
+    // Columns are trimmed in strips of this many pixels
+    constexpr int kColumnStrip = 16;
+
+    // Grid of changed areas handed to scroll detection
+    constexpr int kMotionTileSize = 64;
+}
+
+// Constructor
+LosslessEncoder::LosslessEncoder(int keyframeInterval) : _keyframeInterval(keyframeInterval) {}
+
+// Destructor
+LosslessEncoder::~LosslessEncoder() {
+    for (void* deflater : _deflaters) {
+        z_stream* stream = static_cast<z_stream*>(deflater);
+        deflateEnd(stream);
+        delete stream;
+    }
+}
+
+// Bound the source's damage
+bool LosslessEncoder::damageBounds(const RawFrame& frame, CaptureRect& bounds) {
+    bounds = CaptureRect{0, 0, frame.width, frame.height};
+    if (!frame.dirtyRectsValid) {
+        return true;
+    }
+
+    int x0 = frame.width;
+    int y0 = frame.height;
+    int x1 = 0;
+    int y1 = 0;
+    for (const CaptureRect& dirty : frame.dirtyRects) {
+        x0 = std::min(x0, std::max(0, dirty.x));
+        y0 = std::min(y0, std::max(0, dirty.y));
+        x1 = std::max(x1, std::min(frame.width, dirty.x + dirty.width));
+        y1 = std::max(y1, std::min(frame.height, dirty.y + dirty.height));
+    }
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+
+    bounds = CaptureRect{x0, y0, x1 - x0, y1 - y0};
+    return true;
+}
+
+// Find scrolled content
+void LosslessEncoder::findCopies(const RawFrame& frame, const CaptureRect& bounds) {
+    int columns = (frame.width + kMotionTileSize - 1) / kMotionTileSize;
+    int rows = (frame.height + kMotionTileSize - 1) / kMotionTileSize;
+    _changedTiles.assign(static_cast<size_t>(columns) * rows, 0);
+
+    int changedCount = 0;
+    for (int r = bounds.y / kMotionTileSize; r * kMotionTileSize < bounds.y + bounds.height; r++) {
+        for (int c = bounds.x / kMotionTileSize; c * kMotionTileSize < bounds.x + bounds.width; c++) {
+            int x = c * kMotionTileSize;
+            int y = r * kMotionTileSize;
+            int w = std::min(kMotionTileSize, frame.width - x);
+            int h = std::min(kMotionTileSize, frame.height - y);
+            if (!frame_diff::regionsEqual(frame.pixels.data() + static_cast<size_t>(y) * frame.stride + x * 4, frame.stride,
+                                          _reference.data() + (static_cast<size_t>(y) * _referenceWidth + x) * 4,
+                                          _referenceWidth * 4, w * 4, h)) {
+                _changedTiles[r * columns + c] = 1;
+                changedCount++;
+            }
+        }
+    }
+
+    // A scroll large enough to pay off spans several tiles
+    if (changedCount >= 2) {
+        _motionEstimator.estimate(_reference.data(), frame, _changedTiles, kMotionTileSize, _copies);
+        applyCopyRects(_reference.data(), _referenceWidth * 4, _copies);
+    }
+}
+
+// Find the changed rectangle
+bool LosslessEncoder::findChangedRect(const RawFrame& frame, const CaptureRect& bounds, CaptureRect& rect) const {
+    int x0 = bounds.x;
+    int y0 = bounds.y;
+    int x1 = bounds.x + bounds.width;
+    int y1 = bounds.y + bounds.height;
+
+    auto regionChanged = [&](int x, int y, int w, int h) {
+        return !frame_diff::regionsEqual(frame.pixels.data() + static_cast<size_t>(y) * frame.stride + x * 4, frame.stride,
+                                         _reference.data() + (static_cast<size_t>(y) * _referenceWidth + x) * 4,
+                                         _referenceWidth * 4, w * 4, h);
+    };
+
+    // Damage is often reported generously, trim unchanged rows and then column strips
+    while (y0 < y1 && !regionChanged(x0, y0, x1 - x0, 1)) y0++;
+    while (y1 > y0 && !regionChanged(x0, y1 - 1, x1 - x0, 1)) y1--;
+    if (y0 == y1) {
+        return false;
+    }
+
+    while (x1 - x0 > kColumnStrip && !regionChanged(x0, y0, kColumnStrip, y1 - y0)) x0 += kColumnStrip;
+    while (x1 - x0 > kColumnStrip && !regionChanged(x1 - kColumnStrip, y0, kColumnStrip, y1 - y0)) x1 -= kColumnStrip;
+
+    rect.x = x0;
+    rect.y = y0;
+    rect.width = x1 - x0;
+    rect.height = y1 - y0;
+    return true;
+}
+
+// Delta and compress one band
+bool LosslessEncoder::encodeBand(const RawFrame& frame, const CaptureRect& rect, int firstRow, int rows, bool keyframe,
+                                 size_t band) {
+    std::vector<uint8_t>& delta = _bandDeltas[band];
+    delta.resize(static_cast<size_t>(rect.width) * rows * 3);
+
+    uint8_t* out = delta.data();
+    for (int row = rect.y + firstRow; row < rect.y + firstRow + rows; row++) {
+        const uint8_t* src = frame.pixels.data() + static_cast<size_t>(row) * frame.stride + rect.x * 4;
+        uint8_t* ref = _reference.data() + (static_cast<size_t>(row) * _referenceWidth + rect.x) * 4;
+
+        // Keyframes XOR with nothing, which leaves the pixels
+        if (keyframe) {
+            for (int x = 0; x < rect.width; x++, src += 4, out += 3) {
+                out[0] = src[2];
+                out[1] = src[1];
+                out[2] = src[0];
+            }
+        } else {
+            for (int x = 0; x < rect.width; x++, src += 4, ref += 4, out += 3) {
+                out[0] = static_cast<uint8_t>(src[2] ^ ref[2]);
+                out[1] = static_cast<uint8_t>(src[1] ^ ref[1]);
+                out[2] = static_cast<uint8_t>(src[0] ^ ref[0]);
+            }
+        }
+
+        std::memcpy(_reference.data() + (static_cast<size_t>(row) * _referenceWidth + rect.x) * 4,
+                    frame.pixels.data() + static_cast<size_t>(row) * frame.stride + rect.x * 4,
+                    static_cast<size_t>(rect.width) * 4);
+    }
+
+    z_stream* stream = static_cast<z_stream*>(_deflaters[band]);
+    deflateReset(stream);
+
+    std::vector<uint8_t>& output = _bandOutputs[band];
+    output.resize(deflateBound(stream, static_cast<uLong>(delta.size())));
+    stream->next_in = delta.data();
+    stream->avail_in = static_cast<uInt>(delta.size());
+    stream->next_out = output.data();
+    stream->avail_out = static_cast<uInt>(output.size());
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        return false;
+    }
+    output.resize(stream->total_out);
+    return true;
+}
+
+// Encode a frame
+bool LosslessEncoder::encode(const RawFrame& frame, ThreadPool& workers, std::vector<uint8_t>& message) {
+    if (frame.width <= 0 || frame.height <= 0 || frame.width > 0xFFFF || frame.height > 0xFFFF) {
+        return false;
+    }
+
+    bool sizeChanged = frame.width != _referenceWidth || frame.height != _referenceHeight;
+    bool keyframe = _forceKeyframe || sizeChanged ||
+                    (_keyframeInterval > 0 && _framesSinceKeyframe >= _keyframeInterval);
+
+    CaptureRect rect{0, 0, frame.width, frame.height};
+    _copies.clear();
+    if (keyframe) {
+        _referenceWidth = frame.width;
+        _referenceHeight = frame.height;
+        _reference.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+    } else {
+        CaptureRect bounds;
+        if (!damageBounds(frame, bounds)) {
+            _framesSinceKeyframe++;
+            return false;
+        }
+
+        // Scrolled content moves in the reference first, so only the exposed strip differs
+        if (_motionEstimation) {
+            findCopies(frame, bounds);
+        }
+        if (!findChangedRect(frame, bounds, rect)) {
+            if (_copies.empty()) {
+                _framesSinceKeyframe++;
+                return false;
+            }
+            rect = CaptureRect{};
+        }
+    }
+
+    // One band per thread, unless that makes the bands too short
+    int bandCount = 0;
+    int bandRows = 0;
+    if (rect.height > 0) {
+        bandCount = std::clamp(rect.height / kMinBandRows, 1, static_cast<int>(std::min<size_t>(workers.getThreadCount(), 255)));
+        bandRows = (rect.height + bandCount - 1) / bandCount;
+        bandCount = (rect.height + bandRows - 1) / bandRows;
+    }
+
+    // Streams are created once, here, and reset for every band
+    while (_deflaters.size() < static_cast<size_t>(bandCount)) {
+        z_stream* stream = new z_stream();
+        if (deflateInit(stream, Z_BEST_SPEED) != Z_OK) {
+            std::cerr << "zlib initialization failed" << std::endl;
+            delete stream;
+            return false;
+        }
+        _deflaters.push_back(stream);
+        _bandDeltas.emplace_back();
+        _bandOutputs.emplace_back();
+    }
+
+    std::atomic<bool> failed{false};
+    workers.parallelFor(static_cast<size_t>(bandCount), [&](size_t band) {
+        int firstRow = static_cast<int>(band) * bandRows;
+        if (!encodeBand(frame, rect, firstRow, std::min(bandRows, rect.height - firstRow), keyframe, band)) {
+            failed = true;
+        }
+    });
+
+    // The reference may be partly updated, only a keyframe can resynchronise clients
+    if (failed) {
+        std::cerr << "Lossless frame compression failed" << std::endl;
+        _forceKeyframe = true;
+        return false;
+    }
+
+    message.clear();
+    MessageWriter writer(message);
+    writer.put8(MESSAGE_LOSSLESS_FRAME);
+    writer.put8(keyframe ? LOSSLESS_FLAG_KEYFRAME : 0);
+    writer.put16(static_cast<uint16_t>(frame.width));
+    writer.put16(static_cast<uint16_t>(frame.height));
+    writer.put32(static_cast<uint32_t>(frame.sequence));
+    writer.put16(static_cast<uint16_t>(_copies.size()));
+    for (const CopyRect& copy : _copies) {
+        writer.put16(static_cast<uint16_t>(copy.srcX));
+        writer.put16(static_cast<uint16_t>(copy.srcY));
+        writer.put16(static_cast<uint16_t>(copy.x));
+        writer.put16(static_cast<uint16_t>(copy.y));
+        writer.put16(static_cast<uint16_t>(copy.width));
+        writer.put16(static_cast<uint16_t>(copy.height));
+    }
+    writer.put16(static_cast<uint16_t>(rect.x));
+    writer.put16(static_cast<uint16_t>(rect.y));
+    writer.put16(static_cast<uint16_t>(rect.width));
+    writer.put16(static_cast<uint16_t>(rect.height));
+    writer.put16(static_cast<uint16_t>(bandRows));
+    writer.put8(static_cast<uint8_t>(bandCount));
+    for (int band = 0; band < bandCount; band++) {
+        const std::vector<uint8_t>& output = _bandOutputs[band];
+        writer.put32(static_cast<uint32_t>(output.size()));
+        writer.putBytes(output.data(), output.size());
+    }
+
+    if (keyframe) {
+        _forceKeyframe = false;
+        _framesSinceKeyframe = 0;
+    } else {
+        _framesSinceKeyframe++;
+    }
+    _lastKeyframe = keyframe;
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include "../utils/thread_pool.h"
+#include "motion_estimator.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Lossless delta encoder producing frame_protocol::MESSAGE_LOSSLESS_FRAME messages
+ *
+ * Every frame is XORed with the previous one, so unchanged pixels become zero runs that
+ * zlib collapses even at its fastest level. Scrolled content is found first and sent as
+ * copy rects, so only the exposed strip differs. Only the changed rectangle is sent,
+ * split into horizontal bands that are compressed in parallel. Keyframes carry the
+ * pixels themselves and are sent periodically and on request.
+ */
+class LosslessEncoder {
+public:
+    explicit LosslessEncoder(int keyframeInterval = 300);
+    ~LosslessEncoder();
+
+    // Prevent copying
+    LosslessEncoder(const LosslessEncoder&) = delete;
+    LosslessEncoder& operator=(const LosslessEncoder&) = delete;
+
+    // Encode a frame against the previous one, returns false when there is nothing to send
+    bool encode(const RawFrame& frame, ThreadPool& workers, std::vector<uint8_t>& message);
+
+    // Send the whole frame next time
+    void requestKeyframe() { _forceKeyframe = true; }
+
+    // Frames between forced keyframes (0 disables periodic keyframes)
+    void setKeyframeInterval(int frames) { _keyframeInterval = frames; }
+
+    // Detect scrolling and send it as copy rects
+    void setMotionEstimation(bool enabled) { _motionEstimation = enabled; }
+
+    // Whether the last encoded message was a keyframe
+    bool lastWasKeyframe() const { return _lastKeyframe; }
+
+private:
+    // Bounding box of the source's damage, the whole frame when it does not track damage
+    static bool damageBounds(const RawFrame& frame, CaptureRect& bounds);
+
+    // Find scrolled content and apply it to the reference
+    void findCopies(const RawFrame& frame, const CaptureRect& bounds);
+
+    // Rectangle within bounds that differs from the reference, false when nothing does
+    bool findChangedRect(const RawFrame& frame, const CaptureRect& bounds, CaptureRect& rect) const;
+
+    // XOR rows of a band with the reference, update the reference and compress the band
+    bool encodeBand(const RawFrame& frame, const CaptureRect& rect, int firstRow, int rows, bool keyframe,
+                    size_t band);
+
+    int _keyframeInterval;
+    int _framesSinceKeyframe{0};
+    bool _forceKeyframe{true};
+    bool _lastKeyframe{false};
+
+    // Previous frame, tightly packed BGRA
+    std::vector<uint8_t> _reference;
+    int _referenceWidth{0};
+    int _referenceHeight{0};
+
+    // Scroll detection against the reference frame
+    bool _motionEstimation{true};
+    MotionEstimator _motionEstimator;
+    std::vector<uint8_t> _changedTiles;
+    std::vector<CopyRect> _copies;
+
+    // One zlib stream and its buffers per band
+    std::vector<void*> _deflaters;
+    std::vector<std::vector<uint8_t>> _bandDeltas;
+    std::vector<std::vector<uint8_t>> _bandOutputs;
+};
@@ -0,0 +1,344 @@
+#include "motion_estimator.h"
+#include "frame_diff.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    constexpr uint64_t kColumnPrime = 0x9E3779B185EBCA87ull;
+
+    inline uint32_t loadPixel(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // Final avalanche so similar columns do not produce similar hashes
+    inline uint64_t finishHash(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xC2B2AE3D27D4EB4Full;
+        h ^= h >> 29;
+        return h;
+    }
+}
+
+// Apply copy rects in order
+void applyCopyRects(uint8_t* pixels, int stride, const std::vector<CopyRect>& copies) {
+    for (const CopyRect& copy : copies) {
+        size_t rowBytes = static_cast<size_t>(copy.width) * 4;
+
+        // Walk rows away from the overlap so every source row is read before it is overwritten
+        bool upward = copy.srcY >= copy.y;
+        for (int i = 0; i < copy.height; i++) {
+            int row = upward ? i : copy.height - 1 - i;
+            uint8_t* dst = pixels + static_cast<size_t>(copy.y + row) * stride + copy.x * 4;
+            const uint8_t* src = pixels + static_cast<size_t>(copy.srcY + row) * stride + copy.srcX * 4;
+            std::memmove(dst, src, rowBytes);
+        }
+    }
+}
+
+// Constructor
+MotionEstimator::MotionEstimator(int minRun) : _minRun(std::max(2, minRun)) {
+}
+
+// Find scrolled content in changed tiles
+void MotionEstimator::estimate(const uint8_t* previous, const RawFrame& current,
+                               const std::vector<uint8_t>& changedTiles, int tileSize,
+                               std::vector<CopyRect>& copies) {
+    copies.clear();
+
+    int columns = (current.width + tileSize - 1) / tileSize;
+    int rows = (current.height + tileSize - 1) / tileSize;
+    if (changedTiles.size() < static_cast<size_t>(columns) * rows) {
+        return;
+    }
+
+    findRegions(changedTiles, columns, rows, tileSize, current.width, current.height);
+
+    for (Region region : _regions) {
+        if (!narrowRegion(previous, current, region)) continue;
+
+        if (findVerticalShift(previous, current, region, copies)) continue;
+
+        // Other activity next to the scrolled area spoils whole-region hashes, retry per tile column
+        bool found = false;
+        for (int x = region.x0 - region.x0 % tileSize; x < region.x1 && region.x1 - region.x0 > tileSize; x += tileSize) {
+            Region strip{std::max(x, region.x0), region.y0, std::min(x + tileSize, region.x1), region.y1};
+            if (narrowRegion(previous, current, strip)) {
+                found |= findVerticalShift(previous, current, strip, copies);
+            }
+        }
+        if (found || findHorizontalShift(previous, current, region, copies)) continue;
+
+        for (int y = region.y0 - region.y0 % tileSize; y < region.y1 && region.y1 - region.y0 > tileSize; y += tileSize) {
+            Region band{region.x0, std::max(y, region.y0), region.x1, std::min(y + tileSize, region.y1)};
+            if (narrowRegion(previous, current, band)) {
+                findHorizontalShift(previous, current, band, copies);
+            }
+        }
+    }
+}
+
+// Group changed tiles into bounding boxes
+void MotionEstimator::findRegions(const std::vector<uint8_t>& changedTiles, int columns, int rows, int tileSize,
+                                  int width, int height) {
+    _regions.clear();
+    _visited.assign(static_cast<size_t>(columns) * rows, 0);
+
+    for (int start = 0; start < columns * rows; start++) {
+        if (!changedTiles[start] || _visited[start]) continue;
+
+        // Flood fill 4-connected changed tiles
+        int c0 = columns, r0 = rows, c1 = -1, r1 = -1;
+        _componentStack.clear();
+        _componentStack.push_back(start);
+        _visited[start] = 1;
+
+        while (!_componentStack.empty()) {
+            int index = _componentStack.back();
+            _componentStack.pop_back();
+
+            int c = index % columns;
+            int r = index / columns;
+            c0 = std::min(c0, c);
+            c1 = std::max(c1, c);
+            r0 = std::min(r0, r);
+            r1 = std::max(r1, r);
+
+            const int neighbours[4] = {
+                c > 0 ? index - 1 : -1,
+                c + 1 < columns ? index + 1 : -1,
+                r > 0 ? index - columns : -1,
+                r + 1 < rows ? index + columns : -1
+            };
+            for (int next : neighbours) {
+                if (next >= 0 && changedTiles[next] && !_visited[next]) {
+                    _visited[next] = 1;
+                    _componentStack.push_back(next);
+                }
+            }
+        }
+
+        _regions.push_back({c0 * tileSize, r0 * tileSize,
+                            std::min(width, (c1 + 1) * tileSize), std::min(height, (r1 + 1) * tileSize)});
+    }
+
+    // Merge overlapping boxes so copies of one region never touch another
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < _regions.size() && !merged; i++) {
+            for (size_t j = i + 1; j < _regions.size(); j++) {
+                Region& a = _regions[i];
+                const Region& b = _regions[j];
+                if (a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1) {
+                    a = {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+                    _regions.erase(_regions.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Shrink a region to its differing pixels
+bool MotionEstimator::narrowRegion(const uint8_t* previous, const RawFrame& current, Region& region) const {
+    int previousStride = current.width * 4;
+    Region narrowed{region.x1, region.y1, region.x0, region.y0};
+
+    for (int y = region.y0; y < region.y1; y++) {
+        const uint8_t* a = previous + static_cast<size_t>(y) * previousStride;
+        const uint8_t* b = current.pixels.data() + static_cast<size_t>(y) * current.stride;
+
+        if (frame_diff::regionsEqual(a + region.x0 * 4, previousStride, b + region.x0 * 4, current.stride,
+                                     (region.x1 - region.x0) * 4, 1)) {
+            continue;
+        }
+
+        int left = region.x0;
+        while (left < narrowed.x0 && loadPixel(a + left * 4) == loadPixel(b + left * 4)) left++;
+
+        int right = region.x1 - 1;
+        while (right >= narrowed.x1 && loadPixel(a + right * 4) == loadPixel(b + right * 4)) right--;
+
+        narrowed.x0 = std::min(narrowed.x0, left);
+        narrowed.x1 = std::max(narrowed.x1, right + 1);
+        narrowed.y0 = std::min(narrowed.y0, y);
+        narrowed.y1 = y + 1;
+    }
+
+    if (narrowed.x0 >= narrowed.x1 || narrowed.y0 >= narrowed.y1) {
+        return false;
+    }
+
+    region = narrowed;
+    return true;
+}
+
+// Pick the most agreed line offset
+int MotionEstimator::voteShift(const std::vector<uint64_t>& before, const std::vector<uint64_t>& after) {
+    // Only lines that occur once in the previous frame give an unambiguous position
+    _lineIndex.clear();
+    for (int i = 0; i < static_cast<int>(before.size()); i++) {
+        auto [it, inserted] = _lineIndex.emplace(before[i], i);
+        if (!inserted) {
+            it->second = -1;
+        }
+    }
+
+    _votes.clear();
+    int moved = 0;
+    for (int j = 0; j < static_cast<int>(after.size()); j++) {
+        auto it = _lineIndex.find(after[j]);
+        if (it == _lineIndex.end() || it->second < 0 || it->second == j) continue;
+
+        _votes[it->second - j]++;
+        moved++;
+    }
+
+    int bestShift = 0;
+    int bestVotes = 0;
+    for (const auto& [shift, votes] : _votes) {
+        if (votes > bestVotes) {
+            bestShift = shift;
+            bestVotes = votes;
+        }
+    }
+
+    // Require a clear majority of the lines that moved at all
+    if (bestVotes < 4 || bestVotes * 2 < moved) {
+        return 0;
+    }
+    return bestShift;
+}
+
+// Detect a vertical shift
+bool MotionEstimator::findVerticalShift(const uint8_t* previous, const RawFrame& current, const Region& region,
+                                        std::vector<CopyRect>& copies) {
+    int previousStride = current.width * 4;
+    int width = region.x1 - region.x0;
+    int height = region.y1 - region.y0;
+    int rowBytes = width * 4;
+    if (height < _minRun) {
+        return false;
+    }
+
+    _beforeHashes.resize(height);
+    _afterHashes.resize(height);
+    for (int i = 0; i < height; i++) {
+        int y = region.y0 + i;
+        _beforeHashes[i] = frame_diff::hashRegion(previous + static_cast<size_t>(y) * previousStride + region.x0 * 4,
+                                                  previousStride, rowBytes, 1);
+        _afterHashes[i] = frame_diff::hashRegion(current.pixels.data() + static_cast<size_t>(y) * current.stride +
+                                                 region.x0 * 4, current.stride, rowBytes, 1);
+    }
+
+    // Row i of the current frame shows row i + shift of the previous one
+    int shift = voteShift(_beforeHashes, _afterHashes);
+    if (shift == 0) {
+        return false;
+    }
+
+    size_t firstCopy = copies.size();
+    int begin = std::max(0, -shift);
+    int end = std::min(height, height - shift);
+
+    for (int i = begin; i < end;) {
+        if (_afterHashes[i] != _beforeHashes[i + shift]) {
+            i++;
+            continue;
+        }
+
+        int runStart = i;
+        while (i < end && _afterHashes[i] == _beforeHashes[i + shift]) i++;
+        int runLength = i - runStart;
+        if (runLength < _minRun) continue;
+
+        int dstY = region.y0 + runStart;
+        int srcY = dstY + shift;
+
+        // Hashes only nominate runs, copies must be exact
+        if (!frame_diff::regionsEqual(current.pixels.data() + static_cast<size_t>(dstY) * current.stride + region.x0 * 4,
+                                      current.stride,
+                                      previous + static_cast<size_t>(srcY) * previousStride + region.x0 * 4,
+                                      previousStride, rowBytes, runLength)) {
+            continue;
+        }
+
+        copies.push_back({region.x0, srcY, region.x0, dstY, width, runLength});
+    }
+
+    // Content moving down is copied bottom run first so no run overwrites another's source
+    if (shift < 0) {
+        std::reverse(copies.begin() + firstCopy, copies.end());
+    }
+
+    return copies.size() > firstCopy;
+}
+
+// Detect a horizontal shift
+bool MotionEstimator::findHorizontalShift(const uint8_t* previous, const RawFrame& current, const Region& region,
+                                          std::vector<CopyRect>& copies) {
+    int previousStride = current.width * 4;
+    int width = region.x1 - region.x0;
+    int height = region.y1 - region.y0;
+    if (width < _minRun) {
+        return false;
+    }
+
+    // Column hashes are accumulated row by row to stay cache friendly
+    _beforeHashes.assign(width, kColumnPrime);
+    _afterHashes.assign(width, kColumnPrime);
+    for (int y = region.y0; y < region.y1; y++) {
+        const uint8_t* a = previous + static_cast<size_t>(y) * previousStride + region.x0 * 4;
+        const uint8_t* b = current.pixels.data() + static_cast<size_t>(y) * current.stride + region.x0 * 4;
+        for (int i = 0; i < width; i++) {
+            _beforeHashes[i] = (_beforeHashes[i] ^ loadPixel(a + i * 4)) * kColumnPrime;
+            _afterHashes[i] = (_afterHashes[i] ^ loadPixel(b + i * 4)) * kColumnPrime;
+        }
+    }
+    for (int i = 0; i < width; i++) {
+        _beforeHashes[i] = finishHash(_beforeHashes[i]);
+        _afterHashes[i] = finishHash(_afterHashes[i]);
+    }
+
+    int shift = voteShift(_beforeHashes, _afterHashes);
+    if (shift == 0) {
+        return false;
+    }
+
+    size_t firstCopy = copies.size();
+    int begin = std::max(0, -shift);
+    int end = std::min(width, width - shift);
+
+    for (int i = begin; i < end;) {
+        if (_afterHashes[i] != _beforeHashes[i + shift]) {
+            i++;
+            continue;
+        }
+
+        int runStart = i;
+        while (i < end && _afterHashes[i] == _beforeHashes[i + shift]) i++;
+        int runLength = i - runStart;
+        if (runLength < _minRun) continue;
+
+        int dstX = region.x0 + runStart;
+        int srcX = dstX + shift;
+
+        if (!frame_diff::regionsEqual(current.pixels.data() + static_cast<size_t>(region.y0) * current.stride + dstX * 4,
+                                      current.stride,
+                                      previous + static_cast<size_t>(region.y0) * previousStride + srcX * 4,
+                                      previousStride, runLength * 4, height)) {
+            continue;
+        }
+
+        copies.push_back({srcX, region.y0, dstX, region.y0, runLength, height});
+    }
+
+    if (shift < 0) {
+        std::reverse(copies.begin() + firstCopy, copies.end());
+    }
+
+    return copies.size() > firstCopy;
+}
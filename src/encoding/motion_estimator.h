@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Copy of a rectangle from (srcX, srcY) to (x, y) within the previous frame
+struct CopyRect {
+    int srcX{0};
+    int srcY{0};
+    int x{0};
+    int y{0};
+    int width{0};
+    int height{0};
+};
+
+// Apply copy rects in order to a BGRA image, each behaving like memmove
+void applyCopyRects(uint8_t* pixels, int stride, const std::vector<CopyRect>& copies);
+
+/**
+ * Detects scrolled content between consecutive frames
+ *
+ * Changed tiles are grouped into regions, each region is narrowed to the pixels that
+ * actually changed, and row (or column) hashes of the previous and current frame vote
+ * for a vertical (or horizontal) shift. Runs of rows that match exactly under the
+ * winning shift become copy rects, so only the newly exposed strip needs encoding.
+ */
+class MotionEstimator {
+public:
+    // Shifted runs shorter than minRun rows or columns are not worth a copy
+    explicit MotionEstimator(int minRun = 16);
+
+    // Find copies that turn the previous frame into the current one within changed tiles
+    // previous is tightly packed with the current frame's dimensions
+    void estimate(const uint8_t* previous, const RawFrame& current, const std::vector<uint8_t>& changedTiles,
+                  int tileSize, std::vector<CopyRect>& copies);
+
+private:
+    struct Region {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+    };
+
+    // Group changed tiles into non-overlapping pixel bounding boxes
+    void findRegions(const std::vector<uint8_t>& changedTiles, int columns, int rows, int tileSize,
+                     int width, int height);
+
+    // Shrink a region to the pixels that differ, false when nothing differs
+    bool narrowRegion(const uint8_t* previous, const RawFrame& current, Region& region) const;
+
+    // Detect a vertical shift inside a region and append its copies
+    bool findVerticalShift(const uint8_t* previous, const RawFrame& current, const Region& region,
+                           std::vector<CopyRect>& copies);
+
+    // Detect a horizontal shift inside a region and append its copies
+    bool findHorizontalShift(const uint8_t* previous, const RawFrame& current, const Region& region,
+                             std::vector<CopyRect>& copies);
+
+    // Pick the offset most lines agree on, 0 when there is no clear winner
+    int voteShift(const std::vector<uint64_t>& before, const std::vector<uint64_t>& after);
+
+    int _minRun;
+    std::vector<Region> _regions;
+
+    // Scratch state reused between frames
+    std::vector<int> _componentStack;
+    std::vector<uint8_t> _visited;
+    std::vector<uint64_t> _beforeHashes;
+    std::vector<uint64_t> _afterHashes;
+    std::unordered_map<uint64_t, int> _lineIndex;
+    std::unordered_map<int, int> _votes;
+};
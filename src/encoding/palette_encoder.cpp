@@ -0,0 +1,112 @@
+#include "palette_encoder.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <zlib.h>
+
+namespace {
+    constexpr uint32_t kEmpty = 0xFFFFFFFF;
+
+    inline size_t hashColor(uint32_t color) {
+        return (color * 0x9E3779B1u) >> 22;
+    }
+}
+
+// Constructor
+PaletteEncoder::PaletteEncoder()
+    : _hashColors(kHashSize, kEmpty), _hashIndices(kHashSize, 0) {
+    // Index maps of text compress well even at the fastest level
+    z_stream* stream = new z_stream();
+    if (deflateInit(stream, Z_BEST_SPEED) != Z_OK) {
+        std::cerr << "zlib initialization failed" << std::endl;
+        delete stream;
+        return;
+    }
+    _deflater = stream;
+}
+
+// Destructor
+PaletteEncoder::~PaletteEncoder() {
+    if (_deflater) {
+        z_stream* stream = static_cast<z_stream*>(_deflater);
+        deflateEnd(stream);
+        delete stream;
+    }
+}
+
+// Encode a region as palette and compressed indices
+bool PaletteEncoder::encode(const uint8_t* pixels, int stride, int width, int height, int maxColours,
+                            std::vector<uint8_t>& out) {
+    if (!_deflater || width <= 0 || height <= 0) {
+        return false;
+    }
+    maxColours = std::clamp(maxColours, 1, 256);
+
+    // Only the slots used by the previous region need clearing
+    for (uint32_t color : _palette) {
+        size_t slot = hashColor(color);
+        while (_hashColors[slot] != kEmpty) {
+            _hashColors[slot] = kEmpty;
+            slot = (slot + 1) & (kHashSize - 1);
+        }
+    }
+    _palette.clear();
+    _indices.resize(static_cast<size_t>(width) * height);
+
+    uint8_t* index = _indices.data();
+    uint32_t lastColor = kEmpty;
+    uint8_t lastIndex = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* p = pixels + static_cast<size_t>(y) * stride;
+        for (int x = 0; x < width; x++, p += 4) {
+            uint32_t color;
+            std::memcpy(&color, p, 4);
+            color &= 0x00FFFFFF;
+
+            // Runs of one colour skip the lookup
+            if (color != lastColor) {
+                size_t slot = hashColor(color);
+                while (_hashColors[slot] != kEmpty && _hashColors[slot] != color) {
+                    slot = (slot + 1) & (kHashSize - 1);
+                }
+                if (_hashColors[slot] == kEmpty) {
+                    if (static_cast<int>(_palette.size()) >= maxColours) {
+                        return false;
+                    }
+                    _hashColors[slot] = color;
+                    _hashIndices[slot] = static_cast<uint8_t>(_palette.size());
+                    _palette.push_back(color);
+                }
+                lastColor = color;
+                lastIndex = _hashIndices[slot];
+            }
+            *index++ = lastIndex;
+        }
+    }
+
+    // Palette as RGB, then the zlib stream of indices
+    out.clear();
+    out.push_back(static_cast<uint8_t>(_palette.size() - 1));
+    for (uint32_t color : _palette) {
+        out.push_back(static_cast<uint8_t>(color >> 16));
+        out.push_back(static_cast<uint8_t>(color >> 8));
+        out.push_back(static_cast<uint8_t>(color));
+    }
+
+    z_stream* stream = static_cast<z_stream*>(_deflater);
+    deflateReset(stream);
+    size_t header = out.size();
+    out.resize(header + deflateBound(stream, static_cast<uLong>(_indices.size())));
+
+    stream->next_in = _indices.data();
+    stream->avail_in = static_cast<uInt>(_indices.size());
+    stream->next_out = out.data() + header;
+    stream->avail_out = static_cast<uInt>(out.size() - header);
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        std::cerr << "Palette compression failed" << std::endl;
+        return false;
+    }
+
+    out.resize(header + stream->total_out);
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Lossless encoder for regions with few colours, such as text and flat UI
+ *
+ * Produces the frame_protocol::TILE_CODEC_PALETTE payload: the palette followed by a
+ * zlib stream of one index byte per pixel. Glyph edges stay exact, and flat areas and
+ * repeated glyph rows compress far better than they would as JPEG.
+ */
+class PaletteEncoder {
+public:
+    PaletteEncoder();
+    ~PaletteEncoder();
+
+    // Prevent copying
+    PaletteEncoder(const PaletteEncoder&) = delete;
+    PaletteEncoder& operator=(const PaletteEncoder&) = delete;
+
+    // Encode a BGRA region, false when it has more than maxColours colours (at most 256)
+    bool encode(const uint8_t* pixels, int stride, int width, int height, int maxColours,
+                std::vector<uint8_t>& out);
+
+private:
+    // Colour to palette index, open addressing over 24-bit colours
+    static constexpr size_t kHashSize = 1024;
+    std::vector<uint32_t> _hashColors;
+    std::vector<uint8_t> _hashIndices;
+
+    std::vector<uint32_t> _palette;
+    std::vector<uint8_t> _indices;
+
+    void* _deflater{nullptr};
+};
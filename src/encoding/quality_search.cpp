@@ -0,0 +1,253 @@
+#include "quality_search.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+namespace {
+    constexpr int kMinQuality = 10;
+    constexpr int kMaxAttempts = 3;
+
+    // Aim a little under the budget so frame-to-frame noise rarely overshoots it,
+    // and stop searching once a frame uses most of it
+    constexpr double kBudgetAim = 0.92;
+    constexpr double kBudgetAccept = 0.80;
+
+    // Frames this far above the PSNR floor are spending bytes for nothing
+    constexpr double kPsnrMargin = 1.0;
+
+    // Starting slopes, typical of desktop content
+    constexpr double kDefaultSizeSlope = -0.55;
+    constexpr double kDefaultPsnrSlope = 0.2;
+
+    // libjpeg's quantizer scale in percent for a quality setting
+    double quantizerScale(int quality) {
+        double scale = quality < 50 ? 5000.0 / quality : 200.0 - 2.0 * quality;
+        return std::max(scale, 1.0);
+    }
+
+    // Inverse of quantizerScale
+    int qualityForScale(double scale) {
+        double quality = scale >= 100.0 ? 5000.0 / scale : (200.0 - scale) / 2.0;
+        return static_cast<int>(std::lround(std::clamp(quality, 1.0, 100.0)));
+    }
+
+    // Quality at which a frame of knownBytes at knownQuality would shrink or grow to targetBytes
+    int predictQuality(double knownBytes, int knownQuality, double targetBytes, double slope) {
+        double logScale = std::log(quantizerScale(knownQuality)) + std::log(targetBytes / knownBytes) / slope;
+        return qualityForScale(std::exp(logScale));
+    }
+}
+
+// Constructor
+QualitySearch::QualitySearch() : _sizeSlope(kDefaultSizeSlope), _psnrSlope(kDefaultPsnrSlope) {}
+
+// Destructor
+QualitySearch::~QualitySearch() {
+#ifdef HAVE_TURBOJPEG
+    if (_decompressor) {
+        tjDestroy(_decompressor);
+    }
+#endif
+}
+
+// Encode at the requested quality
+void QualitySearch::setFixed() {
+    _goal = Goal::FIXED;
+}
+
+// Aim for a byte budget per frame
+void QualitySearch::setByteBudget(size_t bytes) {
+    _goal = bytes > 0 ? Goal::BYTES : Goal::FIXED;
+    _byteBudget = bytes;
+}
+
+// Aim for a PSNR floor
+void QualitySearch::setPsnrFloor(double psnrDb) {
+    _goal = psnrDb > 0.0 ? Goal::PSNR : Goal::FIXED;
+    _psnrFloor = psnrDb;
+}
+
+// Forget the model
+void QualitySearch::reset() {
+    _haveModel = false;
+    _sizeSlope = kDefaultSizeSlope;
+    _psnrSlope = kDefaultPsnrSlope;
+}
+
+// Mean absolute luma gradient on a sparse grid
+double QualitySearch::measureActivity(const YuvPlanes& planes) {
+    // Every fourth row and column sees enough of the content at a sixteenth of the cost
+    const int step = 4;
+    uint64_t sum = 0;
+    uint64_t samples = 0;
+    for (int y = 1; y < planes.height; y += step) {
+        const uint8_t* row = planes.y.data() + static_cast<size_t>(y) * planes.width;
+        const uint8_t* above = row - planes.width;
+        for (int x = 1; x < planes.width; x += step) {
+            sum += std::abs(row[x] - row[x - 1]) + std::abs(row[x] - above[x]);
+            samples++;
+        }
+    }
+
+    // Flat frames still cost headers and DC coefficients
+    return samples > 0 ? 1.0 + static_cast<double>(sum) / samples : 1.0;
+}
+
+// Luma PSNR of an encoded frame
+double QualitySearch::measurePsnr(const YuvPlanes& planes, const std::vector<uint8_t>& jpeg) {
+#ifdef HAVE_TURBOJPEG
+    if (!_decompressor) {
+        _decompressor = tjInitDecompress();
+        if (!_decompressor) {
+            std::cerr << "TurboJPEG decompressor initialization failed" << std::endl;
+            return 0.0;
+        }
+    }
+
+    // Grayscale output skips the chroma IDCT and colour conversion
+    _decodedLuma.resize(planes.y.size());
+    if (tjDecompress2(_decompressor, jpeg.data(), static_cast<unsigned long>(jpeg.size()), _decodedLuma.data(),
+                      planes.width, planes.width, planes.height, TJPF_GRAY, TJFLAG_FASTDCT) != 0) {
+        std::cerr << "JPEG decompression failed: " << tjGetErrorStr2(_decompressor) << std::endl;
+        return 0.0;
+    }
+
+    uint64_t squaredError = 0;
+    for (size_t i = 0; i < _decodedLuma.size(); i++) {
+        int diff = static_cast<int>(_decodedLuma[i]) - planes.y[i];
+        squaredError += static_cast<uint64_t>(diff * diff);
+    }
+
+    if (squaredError == 0) {
+        return 99.0;
+    }
+    double mse = static_cast<double>(squaredError) / _decodedLuma.size();
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+#else
+    (void)planes;
+    (void)jpeg;
+    return 0.0;
+#endif
+}
+
+// Encode at the quality the goal calls for
+JpegEncoderPool::Buffer QualitySearch::encode(const YuvPlanes& planes, int maxQuality, JpegEncoderPool& pool,
+                                              ThreadPool& workers, int& quality) {
+    maxQuality = std::clamp(maxQuality, 1, 100);
+    int minQuality = std::min(kMinQuality, maxQuality);
+    quality = maxQuality;
+
+    if (_goal == Goal::FIXED) {
+        return pool.compress(planes, quality, workers);
+    }
+
+    // Predict from the previous frame, scaled by how much busier or larger this one is
+    double pixels = static_cast<double>(planes.width) * planes.height;
+    double activity = measureActivity(planes) * pixels;
+    int candidate = maxQuality;
+    if (_haveModel && _goal == Goal::BYTES) {
+        double expectedBytes = _lastBytes * activity / _lastActivity;
+        candidate = predictQuality(expectedBytes, _lastQuality, _byteBudget * kBudgetAim, _sizeSlope);
+    } else if (_haveModel) {
+        // Give back the last frame's surplus, content changes show up in the measurement
+        double surplus = _lastPsnr - (_psnrFloor + kPsnrMargin);
+        candidate = _lastQuality - (surplus > 0.0 ? static_cast<int>(surplus / _psnrSlope) : 0);
+    }
+
+    // Qualities that could still be the answer
+    int low = minQuality;
+    int high = maxQuality;
+
+    JpegEncoderPool::Buffer best;       // Meets the goal
+    JpegEncoderPool::Buffer fallback;   // Closest miss
+    int bestQuality = 0;
+    int fallbackQuality = 0;
+    double bestPsnr = 0.0;
+    double fallbackPsnr = 0.0;
+    int previousQuality = 0;
+    double previousMeasure = 0.0;
+
+    for (int attempt = 0; attempt < kMaxAttempts && low <= high; attempt++) {
+        int q = std::clamp(candidate, low, high);
+        JpegEncoderPool::Buffer encoded = pool.compress(planes, q, workers);
+        if (!encoded) {
+            break;
+        }
+
+        double bytes = static_cast<double>(encoded->size());
+        if (_goal == Goal::BYTES) {
+            // Two sizes of the same frame pin down the content's slope
+            if (previousQuality != 0 && quantizerScale(q) != quantizerScale(previousQuality)) {
+                double slope = std::log(bytes / previousMeasure) /
+                               std::log(quantizerScale(q) / quantizerScale(previousQuality));
+                _sizeSlope = std::clamp(slope, -1.5, -0.1);
+            }
+            previousQuality = q;
+            previousMeasure = bytes;
+
+            if (bytes <= _byteBudget) {
+                if (!best || q > bestQuality) {
+                    best = encoded;
+                    bestQuality = q;
+                }
+                low = q + 1;
+                if (bytes >= _byteBudget * kBudgetAccept) break;
+            } else {
+                if (!fallback || bytes < fallback->size()) {
+                    fallback = encoded;
+                    fallbackQuality = q;
+                }
+                high = q - 1;
+            }
+            candidate = predictQuality(bytes, q, _byteBudget * kBudgetAim, _sizeSlope);
+        } else {
+            double psnr = measurePsnr(planes, *encoded);
+            if (previousQuality != 0 && q != previousQuality) {
+                _psnrSlope = std::clamp((psnr - previousMeasure) / (q - previousQuality), 0.05, 2.0);
+            }
+            previousQuality = q;
+            previousMeasure = psnr;
+
+            if (psnr >= _psnrFloor) {
+                if (!best || q < bestQuality) {
+                    best = encoded;
+                    bestQuality = q;
+                    bestPsnr = psnr;
+                }
+                high = q - 1;
+                if (psnr < _psnrFloor + kPsnrMargin) break;
+            } else {
+                if (!fallback || q > fallbackQuality) {
+                    fallback = encoded;
+                    fallbackQuality = q;
+                    fallbackPsnr = psnr;
+                }
+                low = q + 1;
+            }
+            candidate = q + static_cast<int>(std::lround((_psnrFloor + kPsnrMargin / 2.0 - psnr) / _psnrSlope));
+        }
+    }
+
+    // Over budget even at the lowest quality, or under the floor even at the highest
+    if (!best) {
+        best = fallback;
+        bestQuality = fallbackQuality;
+        bestPsnr = fallbackPsnr;
+    }
+    if (!best) {
+        return nullptr;
+    }
+
+    quality = bestQuality;
+    _haveModel = true;
+    _lastQuality = bestQuality;
+    _lastBytes = static_cast<double>(best->size());
+    _lastActivity = activity;
+    _lastPsnr = bestPsnr;
+    return best;
+}
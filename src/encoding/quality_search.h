@@ -0,0 +1,73 @@
+#pragma once
+
+#include "color_convert.h"
+#include "jpeg_encoder_pool.h"
+#include "../utils/thread_pool.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * Picks the JPEG quality of each frame to meet a byte budget or a PSNR floor
+ *
+ * Encoded size follows a power law of the quantizer scale whose exponent depends on the
+ * content, so the search works in log space: it predicts from the previous frame's choice
+ * and the change in luma activity, then refines with secant steps inside a shrinking
+ * bracket. At most kMaxAttempts encodes are spent on one frame.
+ */
+class QualitySearch {
+public:
+    enum class Goal {
+        FIXED,      // Encode at the requested quality
+        BYTES,      // Largest quality whose frame fits the byte budget
+        PSNR        // Smallest quality whose luma PSNR reaches the floor
+    };
+
+    QualitySearch();
+    ~QualitySearch();
+
+    // Prevent copying
+    QualitySearch(const QualitySearch&) = delete;
+    QualitySearch& operator=(const QualitySearch&) = delete;
+
+    // Encode every frame at the requested quality
+    void setFixed();
+
+    // Aim for frames of at most this many bytes
+    void setByteBudget(size_t bytes);
+
+    // Aim for at least this luma PSNR in dB
+    void setPsnrFloor(double psnrDb);
+
+    Goal getGoal() const { return _goal; }
+
+    // Encode planes at the quality the goal calls for, never above maxQuality
+    JpegEncoderPool::Buffer encode(const YuvPlanes& planes, int maxQuality, JpegEncoderPool& pool,
+                                   ThreadPool& workers, int& quality);
+
+    // Forget what was learned from previous frames
+    void reset();
+
+private:
+    // Sampled mean absolute luma gradient, a cheap predictor of coded size
+    static double measureActivity(const YuvPlanes& planes);
+
+    // Decode the luma of a JPEG and compare it to the source plane
+    double measurePsnr(const YuvPlanes& planes, const std::vector<uint8_t>& jpeg);
+
+    Goal _goal{Goal::FIXED};
+    size_t _byteBudget{0};
+    double _psnrFloor{0.0};
+
+    // Model learned from the last encoded frame
+    bool _haveModel{false};
+    int _lastQuality{0};
+    double _lastBytes{0.0};
+    double _lastActivity{0.0};
+    double _lastPsnr{0.0};
+    double _sizeSlope;      // d ln(bytes) / d ln(quantizer scale), negative
+    double _psnrSlope;      // dB per quality step
+
+    // Luma decoded for PSNR measurement
+    void* _decompressor{nullptr};
+    std::vector<uint8_t> _decodedLuma;
+};
@@ -0,0 +1,166 @@
+#include "rate_controller.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Degradation ladder relative to the session settings, mildest first
+    struct Step {
+        double quality;
+        double fps;
+        double scale;
+    };
+
+    constexpr Step kLadder[] = {
+        {1.00, 1.00, 1.00},
+        {0.85, 1.00, 1.00},
+        {0.70, 1.00, 1.00},
+        {0.70, 0.67, 1.00},
+        {0.60, 0.50, 1.00},
+        {0.60, 0.50, 0.75},
+        {0.50, 0.33, 0.75},
+        {0.50, 0.33, 0.50},
+        {0.40, 0.25, 0.50},
+    };
+    constexpr int kMaxLevel = static_cast<int>(sizeof(kLadder) / sizeof(kLadder[0])) - 1;
+
+    constexpr int kMinQuality = 20;
+    constexpr double kMinFps = 1.0;
+
+    // Decisions are made on half-second windows
+    constexpr std::chrono::milliseconds kInterval{500};
+
+    // Headroom intervals needed before stepping back up, and cool-down after stepping down
+    constexpr int kIntervalsBeforeStepUp = 4;
+    constexpr int kIntervalsAfterStepDown = 2;
+
+    inline double smooth(double current, double sample, double weight) {
+        return current <= 0.0 ? sample : current + (sample - current) * weight;
+    }
+}
+
+// Constructor
+RateController::RateController(double latencyBudgetMs)
+    : _latencyBudgetMs(std::max(10.0, latencyBudgetMs)) {
+    applyLevel();
+}
+
+// Set the latency budget
+void RateController::setLatencyBudget(double latencyBudgetMs) {
+    _latencyBudgetMs = std::max(10.0, latencyBudgetMs);
+}
+
+// Set the best settings the controller may choose
+void RateController::setLimits(int maxQuality, double maxFps) {
+    _maxQuality = maxQuality;
+    _maxFps = std::max(kMinFps, maxFps);
+    applyLevel();
+}
+
+// Record a sent message
+void RateController::onFrameSent(size_t bytes, double sendMs) {
+    _intervalBytes += bytes;
+    _maxSendMs = std::max(_maxSendMs, sendMs);
+    _haveSamples = true;
+}
+
+// Record TCP connection info
+void RateController::onNetworkInfo(double rttMs, uint64_t bytesInFlight) {
+    _rttMs = smooth(_rttMs, rttMs, 0.25);
+
+    // A sample right after a send always shows that frame in flight, only a standing queue adds latency
+    _bytesInFlight = _haveNetworkInfo ? std::min(_bytesInFlight, bytesInFlight) : bytesInFlight;
+    _haveNetworkInfo = true;
+    _haveSamples = true;
+}
+
+// Record client decode time
+void RateController::onClientFeedback(double decodeMs) {
+    _decodeMs = smooth(_decodeMs, std::max(0.0, decodeMs), 0.25);
+}
+
+// Re-evaluate the target
+bool RateController::update(std::chrono::steady_clock::time_point now) {
+    if (_intervalStart == std::chrono::steady_clock::time_point{}) {
+        _intervalStart = now;
+        return false;
+    }
+
+    double elapsed = std::chrono::duration<double>(now - _intervalStart).count();
+    if (now - _intervalStart < kInterval) {
+        return false;
+    }
+
+    int previousLevel = _level;
+
+    // An idle client gives nothing to judge
+    if (_haveSamples) {
+        _throughputBytesPerSec = smooth(_throughputBytesPerSec, _intervalBytes / elapsed, 0.5);
+
+        // Data the socket accepted but the client has not acknowledged still has to drain
+        double queueMs = _throughputBytesPerSec > 0.0 ? _bytesInFlight * 1000.0 / _throughputBytesPerSec : 0.0;
+        double latencyMs = _rttMs / 2.0 + queueMs + _maxSendMs + _decodeMs;
+        bool queueGrowing = _bytesInFlight > _previousBytesInFlight && queueMs > _latencyBudgetMs / 2.0;
+
+        _stats.latencyMs = latencyMs;
+        _stats.throughputKbps = _throughputBytesPerSec * 8.0 / 1000.0;
+        _stats.rttMs = _rttMs;
+        _stats.decodeMs = _decodeMs;
+
+        if (_holdIntervals > 0) {
+            _holdIntervals--;
+        }
+
+        if (latencyMs > _latencyBudgetMs || queueGrowing) {
+            // Step down, twice as far when far over budget, then let the queue drain
+            _goodIntervals = 0;
+            if (_holdIntervals == 0 && _level < kMaxLevel) {
+                _level = std::min(kMaxLevel, _level + (latencyMs > 2.0 * _latencyBudgetMs ? 2 : 1));
+                _holdIntervals = kIntervalsAfterStepDown;
+            }
+        } else if (latencyMs < _latencyBudgetMs / 2.0) {
+            if (++_goodIntervals >= kIntervalsBeforeStepUp && _level > 0) {
+                _level--;
+                _goodIntervals = 0;
+            }
+        } else {
+            _goodIntervals = 0;
+        }
+    }
+
+    _intervalStart = now;
+    _intervalBytes = 0;
+    _maxSendMs = 0.0;
+    _previousBytesInFlight = _bytesInFlight;
+    _bytesInFlight = 0;
+    _haveNetworkInfo = false;
+    _haveSamples = false;
+
+    if (_level == previousLevel) {
+        return false;
+    }
+    applyLevel();
+    return true;
+}
+
+// Pace frames to the target rate
+bool RateController::shouldSend(std::chrono::steady_clock::time_point now) {
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / _target.fps));
+
+    // Capture ticks jitter, so accept a frame slightly early rather than skip it
+    if (now + period / 4 < _nextSend) {
+        return false;
+    }
+
+    _nextSend = std::max(_nextSend, now - period) + period;
+    return true;
+}
+
+// Recompute the target for the current level
+void RateController::applyLevel() {
+    const Step& step = kLadder[_level];
+    _target.quality = std::min(_maxQuality, std::max(kMinQuality, static_cast<int>(std::lround(_maxQuality * step.quality))));
+    _target.fps = std::max(kMinFps, _maxFps * step.fps);
+    _target.scale = step.scale;
+    _stats.level = _level;
+}
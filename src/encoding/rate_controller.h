@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Closed-loop stream settings for one client
+ *
+ * Every interval the controller estimates how long a frame takes to reach the client from
+ * socket send blocking, TCP round-trip time and bytes in flight, and client-reported decode
+ * time. Over the latency budget it steps down a ladder that trades quality, then frame
+ * rate, then resolution; with sustained headroom it climbs back one step at a time.
+ */
+class RateController {
+public:
+    // Settings the client should currently receive
+    struct Target {
+        int quality{70};
+        double fps{10.0};
+        double scale{1.0};      // Fraction of the session's output size
+    };
+
+    // Measurements of the last interval
+    struct Stats {
+        double latencyMs{0.0};
+        double throughputKbps{0.0};
+        double rttMs{0.0};
+        double decodeMs{0.0};
+        int level{0};           // 0 is the session's full settings
+    };
+
+    explicit RateController(double latencyBudgetMs = 150.0);
+
+    // Set the end-to-end latency the controller aims to stay under
+    void setLatencyBudget(double latencyBudgetMs);
+    double getLatencyBudget() const { return _latencyBudgetMs; }
+
+    // Set the session's settings, the best the controller will ever choose
+    void setLimits(int maxQuality, double maxFps);
+
+    // Record one message handed to the socket and how long send() blocked
+    void onFrameSent(size_t bytes, double sendMs);
+
+    // Record TCP connection info polled from the socket
+    void onNetworkInfo(double rttMs, uint64_t bytesInFlight);
+
+    // Record the client's reported time to decode and draw a frame
+    void onClientFeedback(double decodeMs);
+
+    // Re-evaluate at most once per interval, true when the target changed
+    bool update(std::chrono::steady_clock::time_point now);
+
+    // Check whether a frame may go out now under the target frame rate
+    bool shouldSend(std::chrono::steady_clock::time_point now);
+
+    Target getTarget() const { return _target; }
+    Stats getStats() const { return _stats; }
+
+private:
+    // Recompute the target for the current ladder level
+    void applyLevel();
+
+    double _latencyBudgetMs;
+    int _maxQuality{70};
+    double _maxFps{10.0};
+    int _level{0};
+    Target _target;
+    Stats _stats;
+
+    // Accumulated over the current interval
+    std::chrono::steady_clock::time_point _intervalStart{};
+    uint64_t _intervalBytes{0};
+    double _maxSendMs{0.0};
+    uint64_t _bytesInFlight{0};          // Lowest sample, the queue that never drained
+    uint64_t _previousBytesInFlight{0};
+    bool _haveNetworkInfo{false};
+    bool _haveSamples{false};
+
+    // Smoothed inputs
+    double _rttMs{0.0};
+    double _decodeMs{0.0};
+    double _throughputBytesPerSec{0.0};
+
+    // Hysteresis between steps
+    int _goodIntervals{0};
+    int _holdIntervals{0};
+
+    // Pacing for the target frame rate
+    std::chrono::steady_clock::time_point _nextSend{};
+};
@@ -0,0 +1,52 @@
+#include "region_classifier.h"
+#include <bitset>
+#include <cstring>
+
+namespace {
+    // Sample every second row and column, enough to tell content apart at a quarter of the cost
+    constexpr int kStep = 2;
+
+    // Regions whose sampled neighbours are mostly identical are text or UI
+    constexpr double kFlatFraction = 0.5;
+
+    // Photographic regions that changed in this many of the last 8 frames are video
+    constexpr int kVideoChanges = 5;
+
+    inline uint32_t loadColor(const uint8_t* p) {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value & 0x00FFFFFF;
+    }
+}
+
+namespace region_classifier {
+
+    // Classify a region
+    Content classify(const uint8_t* pixels, int stride, int width, int height, uint8_t recentChanges) {
+        int pairs = 0;
+        int identical = 0;
+
+        // Horizontal and vertical neighbours of each sample, anti-aliased text still has
+        // long runs of background between glyph edges while gradients and noise have none
+        for (int y = 0; y + 1 < height; y += kStep) {
+            const uint8_t* row = pixels + static_cast<size_t>(y) * stride;
+            const uint8_t* below = row + stride;
+            for (int x = 0; x + 1 < width; x += kStep) {
+                uint32_t color = loadColor(row + x * 4);
+                identical += (color == loadColor(row + (x + 1) * 4)) + (color == loadColor(below + x * 4));
+                pairs += 2;
+            }
+        }
+
+        if (pairs == 0 || identical >= pairs * kFlatFraction) {
+            return Content::TEXT;
+        }
+
+        return isAnimated(recentChanges) ? Content::VIDEO : Content::PHOTO;
+    }
+
+    // Check for frequent changes
+    bool isAnimated(uint8_t recentChanges) {
+        return static_cast<int>(std::bitset<8>(recentChanges).count()) >= kVideoChanges;
+    }
+}
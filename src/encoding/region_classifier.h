@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * Fast content classification of screen regions, used to pick a codec per tile
+ */
+namespace region_classifier {
+
+    enum class Content : uint8_t {
+        TEXT,       // Text and UI: flat runs of identical pixels and sharp edges
+        PHOTO,      // Photographic: smooth gradients, few repeated neighbours
+        VIDEO       // Photographic and changing in most recent frames
+    };
+
+    // Classify a BGRA region from a sparse sample of its pixels
+    // recentChanges is a bitmask of the last frames the region changed in, bit 0 the newest
+    Content classify(const uint8_t* pixels, int stride, int width, int height, uint8_t recentChanges);
+
+    // Check whether a region changed in most recent frames, like video or animation
+    bool isAnimated(uint8_t recentChanges);
+}
@@ -0,0 +1,53 @@
+#include "tile_cache.h"
+#include <algorithm>
+
+// Constructor
+TileCache::TileCache(size_t budgetBytes, int tileSize) {
+    size_t tileBytes = static_cast<size_t>(std::max(1, tileSize)) * std::max(1, tileSize) * 4;
+    _capacity = std::max<size_t>(1, budgetBytes / tileBytes);
+}
+
+// Find a cached tile
+int64_t TileCache::lookup(uint64_t hash) {
+    auto it = _index.find(hash);
+    if (it == _index.end()) {
+        _misses++;
+        return -1;
+    }
+
+    // Move to the front without invalidating the stored iterator
+    _lru.splice(_lru.begin(), _lru, it->second);
+    _hits++;
+    return it->second->slot;
+}
+
+// Assign a slot for a new tile
+uint32_t TileCache::insert(uint64_t hash) {
+    auto existing = _index.find(hash);
+    if (existing != _index.end()) {
+        _lru.splice(_lru.begin(), _lru, existing->second);
+        return existing->second->slot;
+    }
+
+    uint32_t slot;
+    if (_index.size() < _capacity) {
+        slot = _nextSlot++;
+    } else {
+        // Reuse the least recently used slot; the client overwrites it in place
+        Entry victim = _lru.back();
+        _lru.pop_back();
+        _index.erase(victim.hash);
+        slot = victim.slot;
+    }
+
+    _lru.push_front({hash, slot});
+    _index[hash] = _lru.begin();
+    return slot;
+}
+
+// Forget all tiles
+void TileCache::clear() {
+    _lru.clear();
+    _index.clear();
+    _nextSlot = 0;
+}
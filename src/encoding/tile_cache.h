@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+
+/**
+ * Server-side mirror of a client's tile cache
+ *
+ * The client keeps decoded tiles in numbered slots. The server decides which slot
+ * each new tile goes to, evicting the least recently used one when the budget is
+ * full, so both sides stay in sync without extra messages.
+ */
+class TileCache {
+public:
+    // Budget is the client memory allowed for decoded BGRA tiles
+    TileCache(size_t budgetBytes, int tileSize);
+
+    // Find the slot holding a tile and mark it most recently used, -1 when absent
+    int64_t lookup(uint64_t hash);
+
+    // Check for a tile without touching recency
+    bool contains(uint64_t hash) const { return _index.find(hash) != _index.end(); }
+
+    // Assign a slot for a tile the client is about to receive
+    uint32_t insert(uint64_t hash);
+
+    // Forget everything, e.g. when the client reconnects
+    void clear();
+
+    size_t size() const { return _index.size(); }
+    size_t capacity() const { return _capacity; }
+
+    // Lookup statistics
+    uint64_t getHits() const { return _hits; }
+    uint64_t getMisses() const { return _misses; }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint32_t slot;
+    };
+
+    size_t _capacity;
+    uint32_t _nextSlot{0};
+    uint64_t _hits{0};
+    uint64_t _misses{0};
+
+    // Most recently used at the front
+    std::list<Entry> _lru;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> _index;
+};
@@ -0,0 +1,522 @@
+#include "tile_encoder.h"
+#include "frame_diff.h"
+#include "frame_protocol.h"
+#include "tile_cache.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_set>
+#ifdef HAVE_TURBOJPEG
+#include <turbojpeg.h>
+#endif
+
+using namespace frame_protocol;
+
+namespace {
+    // Text and UI tiles with more colours than this are anti-aliased or shaded enough for JPEG
+    constexpr int kMaxPaletteColors = 64;
+
+    // Video tiles are watched in motion, so they tolerate a much coarser quantizer
+    constexpr int kVideoQualityPercent = 60;
+    constexpr int kMinVideoQuality = 20;
+
+    // Quantization tables of video tiles follow the two of the tile quality
+    constexpr int kVideoTableOffset = 2;
+
+#ifdef HAVE_TURBOJPEG
+    // Split a baseline JPEG into a tables-only stream and the remaining abbreviated stream
+    bool splitJpegTables(const uint8_t* jpeg, size_t size,
+                         std::vector<uint8_t>& body, std::vector<uint8_t>& tables) {
+        body.clear();
+        tables.clear();
+
+        if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) {
+            return false;
+        }
+
+        body.insert(body.end(), jpeg, jpeg + 2);
+        tables.insert(tables.end(), jpeg, jpeg + 2);
+
+        size_t pos = 2;
+        while (pos + 4 <= size) {
+            if (jpeg[pos] != 0xFF) return false;
+
+            uint8_t marker = jpeg[pos + 1];
+            size_t length = (static_cast<size_t>(jpeg[pos + 2]) << 8) | jpeg[pos + 3];
+
+            // Entropy-coded data follows SOS, copy the rest verbatim
+            if (marker == 0xDA) {
+                body.insert(body.end(), jpeg + pos, jpeg + size);
+                tables.push_back(0xFF);
+                tables.push_back(0xD9);
+                return true;
+            }
+
+            if (pos + 2 + length > size) return false;
+
+            std::vector<uint8_t>& target = (marker == 0xDB || marker == 0xC4) ? tables : body;
+            target.insert(target.end(), jpeg + pos, jpeg + pos + 2 + length);
+            pos += 2 + length;
+        }
+
+        return false;
+    }
+#endif
+
+    // Append every segment with the given marker from a tables-only stream
+    void appendSegments(const std::vector<uint8_t>& tables, uint8_t marker, std::vector<uint8_t>& out) {
+        size_t pos = 2;
+        while (pos + 4 <= tables.size() && tables[pos] == 0xFF && tables[pos + 1] != 0xD9) {
+            size_t length = (static_cast<size_t>(tables[pos + 2]) << 8) | tables[pos + 3];
+            if (pos + 2 + length > tables.size()) return;
+
+            if (tables[pos + 1] == marker) {
+                out.insert(out.end(), tables.begin() + pos, tables.begin() + pos + 2 + length);
+            }
+            pos += 2 + length;
+        }
+    }
+
+    // Renumber the quantization tables defined by DQT segments
+    void offsetQuantTables(std::vector<uint8_t>& dqt, int offset) {
+        size_t pos = 0;
+        while (pos + 4 <= dqt.size()) {
+            size_t end = std::min(dqt.size(), pos + 2 + ((static_cast<size_t>(dqt[pos + 2]) << 8) | dqt[pos + 3]));
+            for (size_t p = pos + 4; p < end; ) {
+                bool precise = (dqt[p] >> 4) != 0;
+                dqt[p] = static_cast<uint8_t>(dqt[p] + offset);
+                p += 1 + (precise ? 128 : 64);
+            }
+            pos = end;
+        }
+    }
+
+#ifdef HAVE_TURBOJPEG
+    // Point the components of an abbreviated stream's frame header at renumbered tables
+    bool offsetFrameQuantTables(std::vector<uint8_t>& body, int offset) {
+        size_t pos = 2;
+        while (pos + 4 <= body.size() && body[pos] == 0xFF) {
+            uint8_t marker = body[pos + 1];
+            size_t length = (static_cast<size_t>(body[pos + 2]) << 8) | body[pos + 3];
+
+            // Baseline or progressive frame header: precision, height, width, component count
+            if (marker == 0xC0 || marker == 0xC2) {
+                size_t components = pos + 9 < body.size() ? body[pos + 9] : 0;
+                if (components == 0 || pos + 10 + components * 3 > body.size()) return false;
+                for (size_t i = 0; i < components; i++) {
+                    body[pos + 10 + i * 3 + 2] = static_cast<uint8_t>(body[pos + 10 + i * 3 + 2] + offset);
+                }
+                return true;
+            }
+            if (marker == 0xDA) return false;
+            pos += 2 + length;
+        }
+        return false;
+    }
+#endif
+}
+
+// Constructor
+TileEncoder::TileEncoder(int tileSize, int keyframeInterval)
+    : _tileSize(std::max(16, tileSize)), _keyframeInterval(keyframeInterval) {
+#ifdef HAVE_TURBOJPEG
+    _compressor = tjInitCompress();
+    if (!_compressor) {
+        std::cerr << "TurboJPEG initialization failed" << std::endl;
+    }
+
+    // Worst case for a full tile, so TurboJPEG writes in place and never allocates
+    _tileBuffer.resize(tjBufSize(_tileSize, _tileSize, TJSAMP_444));
+#else
+    std::cerr << "Tile encoding requires TurboJPEG" << std::endl;
+#endif
+}
+
+// Destructor
+TileEncoder::~TileEncoder() {
+#ifdef HAVE_TURBOJPEG
+    if (_compressor) {
+        tjDestroy(_compressor);
+    }
+#endif
+}
+
+// Compare a tile against the reference frame
+bool TileEncoder::tileChanged(const RawFrame& frame, int x, int y, int w, int h) const {
+    const uint8_t* current = frame.pixels.data() + static_cast<size_t>(y) * frame.stride + x * 4;
+    const uint8_t* previous = _reference.data() + (static_cast<size_t>(y) * _referenceWidth + x) * 4;
+
+    return !frame_diff::regionsEqual(current, frame.stride, previous, _referenceWidth * 4, w * 4, h);
+}
+
+// Flag tiles touched by the source's dirty rects
+void TileEncoder::markDirtyTiles(const RawFrame& frame, int columns, int rows) {
+    std::fill(_dirtyTiles.begin(), _dirtyTiles.end(), 0);
+
+    for (const CaptureRect& rect : frame.dirtyRects) {
+        int c0 = std::max(0, rect.x / _tileSize);
+        int r0 = std::max(0, rect.y / _tileSize);
+        int c1 = std::min(columns - 1, (rect.x + rect.width - 1) / _tileSize);
+        int r1 = std::min(rows - 1, (rect.y + rect.height - 1) / _tileSize);
+
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                _dirtyTiles[r * columns + c] = 1;
+            }
+        }
+    }
+}
+
+// Copy a tile into the reference frame
+void TileEncoder::updateReference(const RawFrame& frame, int x, int y, int w, int h) {
+    for (int row = y; row < y + h; row++) {
+        std::memcpy(_reference.data() + (static_cast<size_t>(row) * _referenceWidth + x) * 4,
+                    frame.pixels.data() + static_cast<size_t>(row) * frame.stride + x * 4,
+                    static_cast<size_t>(w) * 4);
+    }
+}
+
+// Combine the shared tables
+void TileEncoder::rebuildTables() {
+    std::vector<uint8_t> tables = {0xFF, 0xD8};
+    std::vector<uint8_t> baseHuffman;
+    std::vector<uint8_t> videoHuffman;
+    appendSegments(_baseTables, 0xDB, tables);
+    appendSegments(_baseTables, 0xC4, baseHuffman);
+    appendSegments(_videoTables, 0xC4, videoHuffman);
+
+    // One stream serves both qualities as long as their Huffman tables agree, which
+    // TurboJPEG's standard tables always do
+    _videoTablesShared = !_videoTables.empty() && (_baseTables.empty() || baseHuffman == videoHuffman);
+    if (_videoTablesShared) {
+        std::vector<uint8_t> videoQuant;
+        appendSegments(_videoTables, 0xDB, videoQuant);
+        offsetQuantTables(videoQuant, kVideoTableOffset);
+        tables.insert(tables.end(), videoQuant.begin(), videoQuant.end());
+    }
+
+    const std::vector<uint8_t>& huffman = _baseTables.empty() ? videoHuffman : baseHuffman;
+    tables.insert(tables.end(), huffman.begin(), huffman.end());
+    tables.push_back(0xFF);
+    tables.push_back(0xD9);
+
+    _tables = std::make_shared<const std::vector<uint8_t>>(std::move(tables));
+    _tablesVersion++;
+}
+
+// Encode one tile
+bool TileEncoder::encodeTile(const RawFrame& frame, int quality, uint8_t recentChanges, TileFrame::Tile& tile) {
+#ifdef HAVE_TURBOJPEG
+    if (!_regionCoding) {
+        _lastTileCounts.photo++;
+        return encodeJpegTile(frame, quality, TJSAMP_420, false, tile);
+    }
+
+    const uint8_t* src = frame.pixels.data() + static_cast<size_t>(tile.y) * frame.stride + tile.x * 4;
+    int videoQuality = std::max(std::min(quality, kMinVideoQuality), quality * kVideoQualityPercent / 100);
+    switch (region_classifier::classify(src, frame.stride, tile.width, tile.height, recentChanges)) {
+    case region_classifier::Content::TEXT:
+        // Exact glyphs when the palette is small, otherwise full-resolution chroma; mostly flat
+        // tiles with many colours that keep changing are usually the edge of a video
+        if (_paletteEncoder.encode(src, frame.stride, tile.width, tile.height, kMaxPaletteColors, tile.data)) {
+            tile.codec = TILE_CODEC_PALETTE;
+            _lastTileCounts.palette++;
+            return true;
+        }
+        if (!region_classifier::isAnimated(recentChanges)) {
+            _lastTileCounts.text++;
+            return encodeJpegTile(frame, quality, TJSAMP_444, false, tile);
+        }
+        _lastTileCounts.video++;
+        return encodeJpegTile(frame, videoQuality, TJSAMP_420, true, tile);
+
+    case region_classifier::Content::VIDEO:
+        _lastTileCounts.video++;
+        return encodeJpegTile(frame, videoQuality, TJSAMP_420, true, tile);
+
+    default:
+        _lastTileCounts.photo++;
+        return encodeJpegTile(frame, quality, TJSAMP_420, false, tile);
+    }
+#else
+    return false;
+#endif
+}
+
+// JPEG-encode one tile
+bool TileEncoder::encodeJpegTile(const RawFrame& frame, int quality, int subsampling, bool video, TileFrame::Tile& tile) {
+#ifdef HAVE_TURBOJPEG
+    unsigned char* jpegBuf = _tileBuffer.data();
+    unsigned long jpegSize = static_cast<unsigned long>(_tileBuffer.size());
+    const uint8_t* src = frame.pixels.data() + static_cast<size_t>(tile.y) * frame.stride + tile.x * 4;
+
+    // Encode straight from BGRX, no intermediate RGB copy
+    if (tjCompress2(_compressor, src, tile.width, frame.stride, tile.height, TJPF_BGRX, &jpegBuf, &jpegSize,
+                    subsampling, quality, TJFLAG_FASTDCT | TJFLAG_NOREALLOC) != 0) {
+        std::cerr << "Tile compression failed: " << tjGetErrorStr2(_compressor) << std::endl;
+        return false;
+    }
+
+    tile.codec = TILE_CODEC_JPEG;
+
+    if (splitJpegTables(jpegBuf, jpegSize, _jpegBody, _tileTables)) {
+        // First tile at a new quality defines its part of the shared tables
+        std::vector<uint8_t>& known = video ? _videoTables : _baseTables;
+        int& knownQuality = video ? _videoTablesQuality : _tablesQuality;
+        if (knownQuality != quality || known.empty()) {
+            known = _tileTables;
+            knownQuality = quality;
+            rebuildTables();
+        }
+
+        bool shared = _tileTables == known && (!video || _videoTablesShared);
+        if (shared && (!video || offsetFrameQuantTables(_jpegBody, kVideoTableOffset))) {
+            tile.codec = TILE_CODEC_JPEG_ABBREVIATED;
+            tile.data.assign(_jpegBody.begin(), _jpegBody.end());
+        }
+    }
+
+    if (tile.codec == TILE_CODEC_JPEG) {
+        tile.data.assign(jpegBuf, jpegBuf + jpegSize);
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Encode changed tiles of a frame
+bool TileEncoder::encode(const RawFrame& frame, int quality, TileFrame& out, const CachedPredicate& isCached) {
+    _lastTileCount = 0;
+    _lastCopyCount = 0;
+    _lastTileCounts = TileCounts();
+    out.tiles.clear();
+    out.copies.clear();
+
+    if (!_compressor || frame.width <= 0 || frame.height <= 0) {
+        return false;
+    }
+
+    bool sizeChanged = frame.width != _referenceWidth || frame.height != _referenceHeight;
+    bool keyframe = _forceKeyframe || sizeChanged ||
+                    (_keyframeInterval > 0 && _framesSinceKeyframe >= _keyframeInterval);
+
+    int columns = (frame.width + _tileSize - 1) / _tileSize;
+    int rows = (frame.height + _tileSize - 1) / _tileSize;
+
+    // Limit comparisons to damaged tiles when the source tracks damage
+    bool useDirtyTiles = !keyframe && frame.dirtyRectsValid;
+    if (useDirtyTiles) {
+        _dirtyTiles.resize(static_cast<size_t>(columns) * rows);
+        markDirtyTiles(frame, columns, rows);
+    }
+
+    if (keyframe) {
+        _referenceWidth = frame.width;
+        _referenceHeight = frame.height;
+        _reference.resize(static_cast<size_t>(frame.width) * frame.height * 4);
+    }
+
+    // Keyframes resend tiles whether they changed or not, so they leave the history alone
+    if (sizeChanged || _changeHistory.size() != static_cast<size_t>(columns) * rows) {
+        _changeHistory.assign(static_cast<size_t>(columns) * rows, 0);
+    } else if (!keyframe) {
+        for (uint8_t& history : _changeHistory) {
+            history = static_cast<uint8_t>(history << 1);
+        }
+    }
+
+    // Shift scrolled content in the reference first, so only exposed strips differ afterwards
+    bool useChangedTiles = !keyframe && _motionEstimation;
+    if (useChangedTiles) {
+        _changedTiles.assign(static_cast<size_t>(columns) * rows, 0);
+        int changedCount = 0;
+        for (int r = 0; r < rows; r++) {
+            for (int c = 0; c < columns; c++) {
+                if (useDirtyTiles && !_dirtyTiles[r * columns + c]) continue;
+
+                int x = c * _tileSize;
+                int y = r * _tileSize;
+                if (tileChanged(frame, x, y, std::min(_tileSize, frame.width - x), std::min(_tileSize, frame.height - y))) {
+                    _changedTiles[r * columns + c] = 1;
+                    changedCount++;
+                }
+            }
+        }
+
+        // A scroll large enough to pay off spans several tiles
+        if (changedCount >= 2) {
+            _motionEstimator.estimate(_reference.data(), frame, _changedTiles, _tileSize, out.copies);
+            applyCopyRects(_reference.data(), _referenceWidth * 4, out.copies);
+        }
+    }
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < columns; c++) {
+            if (useChangedTiles ? !_changedTiles[r * columns + c] : useDirtyTiles && !_dirtyTiles[r * columns + c]) {
+                continue;
+            }
+
+            int x = c * _tileSize;
+            int y = r * _tileSize;
+            int w = std::min(_tileSize, frame.width - x);
+            int h = std::min(_tileSize, frame.height - y);
+
+            if (!keyframe && !tileChanged(frame, x, y, w, h)) continue;
+
+            TileFrame::Tile tile;
+            tile.x = static_cast<uint16_t>(x);
+            tile.y = static_cast<uint16_t>(y);
+            tile.width = static_cast<uint16_t>(w);
+            tile.height = static_cast<uint16_t>(h);
+            tile.hash = frame_diff::hashRegion(frame.pixels.data() + static_cast<size_t>(y) * frame.stride + x * 4,
+                                               frame.stride, w * 4, h);
+
+            uint8_t& history = _changeHistory[r * columns + c];
+            if (!keyframe) {
+                history |= 1;
+            }
+
+            // Recurring content every client holds is referenced instead of encoded; keyframes
+            // encode it anyway so they can bring a client that joins later up to date
+            bool cached = !keyframe && isCached && isCached(tile.hash);
+            if (cached) {
+                tile.codec = TILE_CODEC_CACHED;
+            } else if (!encodeTile(frame, quality, history, tile)) {
+                continue;
+            }
+
+            updateReference(frame, x, y, w, h);
+            out.tiles.push_back(std::move(tile));
+        }
+    }
+
+    out.width = frame.width;
+    out.height = frame.height;
+    out.tileSize = _tileSize;
+    out.sequence = frame.sequence;
+    out.keyframe = keyframe;
+    out.tables = _tables;
+    out.tablesVersion = _tablesVersion;
+
+    if (out.tiles.empty() && out.copies.empty()) {
+        _framesSinceKeyframe++;
+        return false;
+    }
+
+    if (keyframe) {
+        _forceKeyframe = false;
+        _framesSinceKeyframe = 0;
+    } else {
+        _framesSinceKeyframe++;
+    }
+
+    _lastTileCount = static_cast<int>(out.tiles.size());
+    _lastCopyCount = static_cast<int>(out.copies.size());
+    return true;
+}
+
+// Total encoded payload
+size_t TileFrame::encodedBytes() const {
+    size_t total = 0;
+    for (const Tile& tile : tiles) {
+        total += tile.data.size();
+    }
+    return total;
+}
+
+// Build a per-client TILE_UPDATE message
+bool packTileUpdate(const TileFrame& frame, TileCache* cache, uint32_t& clientTablesVersion,
+                    std::vector<uint8_t>& message) {
+    // Skipped tiles can only be sent as references to the client's cache
+    for (const TileFrame::Tile& tile : frame.tiles) {
+        if (tile.data.empty() && (!cache || !cache->contains(tile.hash))) {
+            return false;
+        }
+    }
+
+    bool sendTables = frame.tables && (frame.keyframe || clientTablesVersion != frame.tablesVersion);
+
+    message.clear();
+    MessageWriter writer(message);
+    writer.put8(MESSAGE_TILE_UPDATE);
+    writer.put8((frame.keyframe ? TILE_FLAG_KEYFRAME : 0) |
+                (sendTables ? TILE_FLAG_TABLES : 0) |
+                (cache ? TILE_FLAG_CACHE : 0) |
+                (frame.copies.empty() ? 0 : TILE_FLAG_COPY) |
+                (frame.refinement ? TILE_FLAG_REFINE : 0));
+    writer.put16(static_cast<uint16_t>(frame.width));
+    writer.put16(static_cast<uint16_t>(frame.height));
+    writer.put16(static_cast<uint16_t>(frame.tileSize));
+    writer.put32(static_cast<uint32_t>(frame.sequence));
+
+    if (sendTables) {
+        writer.put32(static_cast<uint32_t>(frame.tables->size()));
+        writer.putBytes(frame.tables->data(), frame.tables->size());
+        clientTablesVersion = frame.tablesVersion;
+    }
+
+    if (!frame.copies.empty()) {
+        writer.put16(static_cast<uint16_t>(frame.copies.size()));
+        for (const CopyRect& copy : frame.copies) {
+            writer.put16(static_cast<uint16_t>(copy.srcX));
+            writer.put16(static_cast<uint16_t>(copy.srcY));
+            writer.put16(static_cast<uint16_t>(copy.x));
+            writer.put16(static_cast<uint16_t>(copy.y));
+            writer.put16(static_cast<uint16_t>(copy.width));
+            writer.put16(static_cast<uint16_t>(copy.height));
+        }
+    }
+
+    writer.put16(static_cast<uint16_t>(frame.tiles.size()));
+
+    auto putTileHeader = [&writer](const TileFrame::Tile& tile, uint8_t codec) {
+        writer.put16(tile.x);
+        writer.put16(tile.y);
+        writer.put16(tile.width);
+        writer.put16(tile.height);
+        writer.put8(codec);
+    };
+
+    // References go first so a slot reused later in this message is read before it is overwritten
+    std::vector<uint8_t> referenced(frame.tiles.size(), 0);
+    if (cache && !frame.refinement) {
+        for (size_t i = 0; i < frame.tiles.size(); i++) {
+            int64_t slot = cache->lookup(frame.tiles[i].hash);
+            if (slot < 0) continue;
+
+            putTileHeader(frame.tiles[i], TILE_CODEC_CACHED);
+            writer.put32(static_cast<uint32_t>(slot));
+            writer.put32(0);
+            referenced[i] = 1;
+        }
+    }
+
+    std::unordered_set<uint64_t> refreshed;
+    for (size_t i = 0; i < frame.tiles.size(); i++) {
+        if (referenced[i]) continue;
+
+        const TileFrame::Tile& tile = frame.tiles[i];
+
+        // Repeats of a tile stored earlier in this message become references too
+        bool refresh = frame.refinement && refreshed.insert(tile.hash).second;
+        if (cache && cache->contains(tile.hash) && !refresh) {
+            putTileHeader(tile, TILE_CODEC_CACHED);
+            writer.put32(static_cast<uint32_t>(cache->lookup(tile.hash)));
+            writer.put32(0);
+            continue;
+        }
+
+        // A refined tile overwrites the slot holding its lower-quality copy
+        putTileHeader(tile, tile.codec);
+        if (cache) {
+            int64_t slot = refresh ? cache->lookup(tile.hash) : -1;
+            writer.put32(static_cast<uint32_t>(slot >= 0 ? slot : cache->insert(tile.hash)));
+        }
+        writer.put32(static_cast<uint32_t>(tile.data.size()));
+        writer.putBytes(tile.data.data(), tile.data.size());
+    }
+
+    return true;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include "motion_estimator.h"
+#include "palette_encoder.h"
+#include "region_classifier.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class TileCache;
+
+// Tiles changed in one frame, packed into a message per client by packTileUpdate()
+struct TileFrame {
+    struct Tile {
+        uint16_t x;
+        uint16_t y;
+        uint16_t width;
+        uint16_t height;
+        uint64_t hash;
+        uint8_t codec;
+        std::vector<uint8_t> data;  // Left empty when every client already caches the tile
+    };
+
+    int width{0};
+    int height{0};
+    int tileSize{0};
+    uint64_t sequence{0};
+    bool keyframe{false};
+    bool refinement{false};     // Unchanged tiles resent at higher quality, replacing cached copies
+
+    // Shared JPEG tables for abbreviated tiles, bumped whenever they change. Quantization
+    // tables 0 and 1 are at the tile quality, 2 and 3 at the video quality.
+    std::shared_ptr<const std::vector<uint8_t>> tables;
+    uint32_t tablesVersion{0};
+
+    // Scrolled areas, applied on the client before the tiles
+    std::vector<CopyRect> copies;
+    std::vector<Tile> tiles;
+
+    // Total encoded tile payload
+    size_t encodedBytes() const;
+};
+
+// Build a TILE_UPDATE message for one client
+// With a cache, tiles the client holds are sent as slot references and new tiles are assigned slots.
+// clientTablesVersion tracks which JPEG tables the client has; returns false if the frame cannot be
+// represented for this client (a skipped tile it does not cache) and leaves the cache untouched.
+bool packTileUpdate(const TileFrame& frame, TileCache* cache, uint32_t& clientTablesVersion,
+                    std::vector<uint8_t>& message);
+
+/**
+ * Delta encoder that splits frames into fixed tiles and only encodes tiles that changed
+ * since the previous frame, producing frame_protocol::MESSAGE_TILE_UPDATE messages
+ *
+ * With region coding each changed tile is classified first: text and UI with few colours
+ * are sent losslessly as a palette, other text as JPEG 4:4:4 so coloured edges stay sharp,
+ * photographic tiles as JPEG 4:2:0, and tiles that keep changing like video at a lower
+ * quality.
+ */
+class TileEncoder {
+public:
+    // Tiles of each kind encoded in the last call to encode()
+    struct TileCounts {
+        int palette{0};
+        int text{0};
+        int photo{0};
+        int video{0};
+    };
+
+    explicit TileEncoder(int tileSize = 64, int keyframeInterval = 150);
+    ~TileEncoder();
+
+    // Prevent copying
+    TileEncoder(const TileEncoder&) = delete;
+    TileEncoder& operator=(const TileEncoder&) = delete;
+
+    // Returns true for tile hashes every client already caches
+    using CachedPredicate = std::function<bool(uint64_t)>;
+
+    // Encode the changed tiles of a frame, returns false when there is nothing to send
+    // Tiles matching isCached are hashed but not encoded, except in keyframes
+    bool encode(const RawFrame& frame, int quality, TileFrame& out, const CachedPredicate& isCached = nullptr);
+
+    // Send every tile with the next frame
+    void requestKeyframe() { _forceKeyframe = true; }
+
+    // Frames between forced keyframes (0 disables periodic keyframes)
+    void setKeyframeInterval(int frames) { _keyframeInterval = frames; }
+
+    // Detect scrolling and send it as copy rects
+    void setMotionEstimation(bool enabled) { _motionEstimation = enabled; }
+
+    // Pick the codec, subsampling and quality of each tile from its content
+    void setRegionCoding(bool enabled) { _regionCoding = enabled; }
+
+    // Forget which tiles changed recently, e.g. once the screen is static
+    void clearChangeHistory() { std::fill(_changeHistory.begin(), _changeHistory.end(), 0); }
+
+    int getTileSize() const { return _tileSize; }
+
+    // Tiles encoded in the last call to encode()
+    int getLastTileCount() const { return _lastTileCount; }
+
+    // Copy rects found in the last call to encode()
+    int getLastCopyCount() const { return _lastCopyCount; }
+
+    const TileCounts& getLastTileCounts() const { return _lastTileCounts; }
+
+private:
+    // Check whether a tile differs from the previous frame
+    bool tileChanged(const RawFrame& frame, int x, int y, int w, int h) const;
+
+    // Mark tiles overlapping the source's dirty rects
+    void markDirtyTiles(const RawFrame& frame, int columns, int rows);
+
+    // Choose a codec for a tile from its content and encode it
+    bool encodeTile(const RawFrame& frame, int quality, uint8_t recentChanges, TileFrame::Tile& tile);
+
+    // JPEG-encode a tile, stripping tables when they match the shared ones
+    bool encodeJpegTile(const RawFrame& frame, int quality, int subsampling, bool video, TileFrame::Tile& tile);
+
+    // Combine the tables of both qualities into the shared tables stream
+    void rebuildTables();
+
+    // Keep the changed tile as the new reference
+    void updateReference(const RawFrame& frame, int x, int y, int w, int h);
+
+    int _tileSize;
+    int _keyframeInterval;
+    int _framesSinceKeyframe{0};
+    bool _forceKeyframe{true};
+    int _lastTileCount{0};
+    int _lastCopyCount{0};
+    TileCounts _lastTileCounts;
+
+    // Previous frame, tightly packed BGRA
+    std::vector<uint8_t> _reference;
+    int _referenceWidth{0};
+    int _referenceHeight{0};
+
+    // Tiles the source reported as damaged in the current frame
+    std::vector<uint8_t> _dirtyTiles;
+
+    // Scroll detection against the reference frame
+    bool _motionEstimation{true};
+    MotionEstimator _motionEstimator;
+    std::vector<uint8_t> _changedTiles;
+
+    // Content-dependent coding, with a bitmask per tile of the last frames it changed in
+    bool _regionCoding{true};
+    std::vector<uint8_t> _changeHistory;
+    PaletteEncoder _paletteEncoder;
+
+    // Shared JPEG tables for abbreviated tile streams, built from the tables-only streams
+    // TurboJPEG writes at the tile quality and at the video quality
+    std::shared_ptr<const std::vector<uint8_t>> _tables;
+    uint32_t _tablesVersion{0};
+    int _tablesQuality{-1};
+    int _videoTablesQuality{-1};
+    std::vector<uint8_t> _baseTables;
+    std::vector<uint8_t> _videoTables;
+    bool _videoTablesShared{false};
+
+    // Scratch buffers
+    std::vector<uint8_t> _jpegBody;
+    std::vector<uint8_t> _tileTables;
+    std::vector<uint8_t> _tileBuffer;
+
+    void* _compressor{nullptr};
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../screen_capture/capture_source.h"
+#include "../utils/thread_pool.h"
+#include "color_convert.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * H.264 inter-frame encoder producing frame_protocol::MESSAGE_VIDEO_FRAME messages
+ *
+ * Wraps OpenH264 in its real-time screen content mode: Constrained Baseline, so no
+ * B-frames and no reordering delay, one access unit per captured frame. Bitrate follows
+ * an explicit target or, without one, the frame size, rate and JPEG-style quality, so
+ * rate control keeps working. Keyframes are sent periodically and on request. Without
+ * OpenH264 in the build every encode fails and video mode falls back to JPEG.
+ */
+class VideoEncoder {
+public:
+    explicit VideoEncoder(int keyframeInterval = 300);
+    ~VideoEncoder();
+
+    // Prevent copying
+    VideoEncoder(const VideoEncoder&) = delete;
+    VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+    // Encode a frame as one access unit at a quality (1-100) and frame rate, false when
+    // there is nothing to send: the pixels did not change or encoding failed
+    bool encode(const RawFrame& frame, int quality, double fps, ThreadPool& workers, std::vector<uint8_t>& message);
+
+    // Start the next frame with an IDR picture
+    void requestKeyframe() { _forceKeyframe = true; }
+
+    // Frames between forced keyframes (0 leaves it to the encoder)
+    void setKeyframeInterval(int frames);
+
+    // Aim for this bitrate instead of deriving it from the quality, 0 derives it
+    void setTargetBitrate(int kbps) { _targetBitrateKbps = kbps > 0 ? kbps : 0; }
+
+    // Whether the last encoded message was a keyframe
+    bool lastWasKeyframe() const { return _lastKeyframe; }
+
+    // Check whether H.264 is built in
+    static bool isAvailable();
+
+private:
+    // Create the encoder for a picture size
+    bool open(int width, int height, double fps, int bitrateKbps, int threads);
+
+    // Destroy the encoder
+    void close();
+
+    // Bitrate for a quality when no target is set
+    static int bitrateForQuality(int width, int height, double fps, int quality);
+
+    // Push a new bitrate and frame rate to the open encoder
+    void updateRate(double fps, int bitrateKbps);
+
+    void* _encoder{nullptr};
+    int _width{0};
+    int _height{0};
+    double _fps{0.0};
+    int _bitrateKbps{0};
+
+    int _keyframeInterval;
+    int _targetBitrateKbps{0};
+    bool _forceKeyframe{true};
+    bool _lastKeyframe{false};
+
+    // Colour-converted planes of the current and previous frame
+    YuvPlanes _yuvPlanes[2];
+    int _yuvCurrent{0};
+};
@@ -0,0 +1,132 @@
+#include "webp_frame_encoder.h"
+#include "frame_diff.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <webp/encode.h>
+
+namespace {
+    // Fastest methods, enough for real-time frames; stills can afford a better search
+    constexpr int kFrameMethod = 0;
+    constexpr int kStillMethod = 2;
+
+    // Lossless effort, low values are several times faster for little size
+    constexpr float kLosslessEffort = 10.0f;
+
+    // JPEG quality to the WebP quality reaching at least the same luma PSNR, measured on
+    // text, UI and video content and taking the most demanding of them
+    struct QualityPoint {
+        int jpeg;
+        float webp;
+    };
+    constexpr QualityPoint kQualityMap[] = {{0, 0.0f}, {50, 26.0f}, {70, 47.0f}, {85, 86.0f}, {100, 100.0f}};
+
+    // Map a JPEG quality, linear between the measured points
+    float webpQuality(int jpegQuality) {
+        int q = std::clamp(jpegQuality, 1, 100);
+        size_t i = 1;
+        while (kQualityMap[i].jpeg < q) i++;
+        const QualityPoint& a = kQualityMap[i - 1];
+        const QualityPoint& b = kQualityMap[i];
+        return a.webp + (b.webp - a.webp) * (q - a.jpeg) / (b.jpeg - a.jpeg);
+    }
+
+    // Append encoder output to a vector
+    int writeOutput(const uint8_t* data, size_t size, const WebPPicture* picture) {
+        std::vector<uint8_t>* output = static_cast<std::vector<uint8_t>*>(picture->custom_ptr);
+        output->insert(output->end(), data, data + size);
+        return 1;
+    }
+}
+
+// Constructor
+WebpFrameEncoder::WebpFrameEncoder(bool lossless) : _lossless(lossless) {}
+
+// Encode a frame
+FrameEncoder::Buffer WebpFrameEncoder::encodeImage(const RawFrame& frame, int maxQuality, ThreadPool& workers,
+                                                   int& quality, bool& unchanged) {
+    // Sources without damage tracking are compared here, the copy costs far less than an encode
+    size_t rowBytes = static_cast<size_t>(frame.width) * 4;
+    if (!frame.dirtyRectsValid) {
+        if (_last && frame.width == _lastWidth && frame.height == _lastHeight &&
+            frame_diff::regionsEqual(frame.pixels.data(), frame.stride, _lastPixels.data(), static_cast<int>(rowBytes),
+                                     static_cast<int>(rowBytes), frame.height)) {
+            unchanged = true;
+            quality = _lastQuality;
+            return _last;
+        }
+
+        _lastPixels.resize(rowBytes * frame.height);
+        for (int y = 0; y < frame.height; y++) {
+            std::memcpy(_lastPixels.data() + y * rowBytes, frame.pixels.data() + static_cast<size_t>(y) * frame.stride,
+                        rowBytes);
+        }
+        _lastWidth = frame.width;
+        _lastHeight = frame.height;
+    } else {
+        _lastWidth = 0;
+    }
+
+    quality = _lossless ? 100 : maxQuality;
+    _last = compress(frame, _lossless ? kLosslessEffort : webpQuality(maxQuality), kFrameMethod, false);
+    _lastQuality = quality;
+    return _last;
+}
+
+// Encode a static frame
+FrameEncoder::Buffer WebpFrameEncoder::encodeStillImage(const RawFrame& frame, int quality, ThreadPool& workers) {
+    // Lossless frames are already exact
+    if (_lossless) {
+        return nullptr;
+    }
+    Buffer image = compress(frame, webpQuality(quality), kStillMethod, true);
+    if (image) {
+        _last = image;
+        _lastQuality = quality;
+    }
+    return image;
+}
+
+// Compress a frame
+FrameEncoder::Buffer WebpFrameEncoder::compress(const RawFrame& frame, float quality, int method, bool sharpYuv) {
+    WebPConfig config;
+    if (!WebPConfigPreset(&config, WEBP_PRESET_DEFAULT, quality)) {
+        std::cerr << "WebP version mismatch" << std::endl;
+        return nullptr;
+    }
+    config.lossless = _lossless ? 1 : 0;
+    config.method = method;
+    config.use_sharp_yuv = sharpYuv ? 1 : 0;
+    config.thread_level = 1;
+
+    WebPPicture picture;
+    if (!WebPPictureInit(&picture)) {
+        return nullptr;
+    }
+    picture.width = frame.width;
+    picture.height = frame.height;
+    picture.use_argb = _lossless ? 1 : 0;
+
+    // Captured alpha is undefined, BGRX import makes every pixel opaque so no alpha plane is coded
+    if (!WebPPictureImportBGRX(&picture, frame.pixels.data(), frame.stride)) {
+        std::cerr << "WebP picture allocation failed" << std::endl;
+        return nullptr;
+    }
+
+    // The next image is usually close in size to the last one
+    auto output = std::make_shared<std::vector<uint8_t>>();
+    output->reserve(_last ? _last->size() + _last->size() / 4 : 0);
+    picture.writer = writeOutput;
+    picture.custom_ptr = output.get();
+
+    bool ok = WebPEncode(&config, &picture) != 0;
+    if (!ok) {
+        std::cerr << "WebP encoding failed: " << picture.error_code << std::endl;
+    }
+    WebPPictureFree(&picture);
+
+    if (!ok || output->empty()) {
+        return nullptr;
+    }
+    return output;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "frame_encoder.h"
+
+/**
+ * Whole frames as WebP, lossy or lossless
+ *
+ * Lossy frames use the fastest VP8 method with the requested JPEG quality mapped to the
+ * WebP quality that looks the same, so a client switching codecs keeps its picture and
+ * saves bandwidth. Lossless frames keep every pixel at a higher encode cost and suit
+ * text-heavy desktops at low frame rates.
+ */
+class WebpFrameEncoder : public FrameEncoder {
+public:
+    explicit WebpFrameEncoder(bool lossless);
+
+    // Get the codec
+    Codec getCodec() const override { return _lossless ? Codec::WEBP_LOSSLESS : Codec::WEBP; }
+
+protected:
+    // Encode a frame
+    Buffer encodeImage(const RawFrame& frame, int maxQuality, ThreadPool& workers, int& quality,
+                       bool& unchanged) override;
+
+    // Encode a static frame with sharper chroma and a slower method, nothing in lossless mode
+    Buffer encodeStillImage(const RawFrame& frame, int quality, ThreadPool& workers) override;
+
+private:
+    // Compress BGRA pixels, alpha is ignored
+    Buffer compress(const RawFrame& frame, float quality, int method, bool sharpYuv);
+
+    bool _lossless;
+
+    // Last frame and its image, returned again while sources without damage tracking repeat it
+    std::vector<uint8_t> _lastPixels;
+    int _lastWidth{0};
+    int _lastHeight{0};
+    Buffer _last;
+    int _lastQuality{0};
+};
@@ -0,0 +1,175 @@
+#include "capture_scheduler.h"
+#include <algorithm>
+#ifdef _WIN32
+#include <Windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+namespace {
+    constexpr double kMinFps = 0.1;
+    constexpr double kMaxFps = 240.0;
+
+    std::chrono::steady_clock::duration periodFor(double fps) {
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / fps));
+    }
+}
+
+// Constructor
+CaptureScheduler::CaptureScheduler(double fps)
+    : _fps(std::clamp(fps, kMinFps, kMaxFps)), _period(periodFor(_fps)) {
+}
+
+// Destructor
+CaptureScheduler::~CaptureScheduler() {
+    stop();
+}
+
+// Change the tick rate
+void CaptureScheduler::setFrameRate(double fps) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Clock::duration oldPeriod = _period;
+    bool bursting = rateAt(Clock::now()) > _fps;
+    _fps = std::clamp(fps, kMinFps, kMaxFps);
+    _period = periodFor(_fps);
+
+    // Re-base the pending deadline on the previous tick, a burst sets its own deadlines
+    if (!bursting) {
+        _nextDeadline += _period - oldPeriod;
+    }
+    _wake.notify_all();
+}
+
+// Get the tick rate
+double CaptureScheduler::getFrameRate() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _fps;
+}
+
+// Get the rate in effect now
+double CaptureScheduler::getCurrentFrameRate() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return rateAt(Clock::now());
+}
+
+// Rate at a point in time
+double CaptureScheduler::rateAt(Clock::time_point time) const {
+    if (_burstFps <= _fps || time >= _burstUntil + _burstDecay) {
+        return _fps;
+    }
+    if (time <= _burstUntil || _burstDecay.count() == 0) {
+        return _burstFps;
+    }
+
+    // Linear decay from the burst rate back to the base rate
+    double progress = std::chrono::duration<double>(time - _burstUntil) / _burstDecay;
+    return _burstFps + (_fps - _burstFps) * progress;
+}
+
+// Configure bursts
+void CaptureScheduler::setBurstProfile(double fps, std::chrono::milliseconds hold, std::chrono::milliseconds decay) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _burstFps = fps > 0.0 ? std::clamp(fps, kMinFps, kMaxFps) : 0.0;
+    _burstHold = std::max(hold, std::chrono::milliseconds(0));
+    _burstDecay = std::max(decay, std::chrono::milliseconds(0));
+}
+
+// Start a burst
+void CaptureScheduler::burst() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_stopped || _burstFps <= 0.0) {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    _burstUntil = now + _burstHold;
+
+    // Rapid input, like mouse motion, must not tick faster than the burst rate
+    Clock::time_point earliest = _lastTick + periodFor(std::max(_fps, _burstFps));
+    Clock::time_point deadline = std::max(now, earliest);
+    if (deadline < _nextDeadline) {
+        _nextDeadline = deadline;
+        _wake.notify_all();
+    }
+}
+
+// Check for a running burst
+bool CaptureScheduler::isBursting() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return rateAt(Clock::now()) > _fps;
+}
+
+// Start ticking
+void CaptureScheduler::start() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopped = false;
+    _stats = Stats();
+    _nextDeadline = Clock::now();
+    _lastTick = Clock::time_point{};
+    _burstUntil = Clock::time_point{};
+
+#ifdef _WIN32
+    // The default 15.6 ms timer tick cannot pace 60 or 120 fps
+    if (!_timerResolutionRaised) {
+        _timerResolutionRaised = timeBeginPeriod(1) == TIMERR_NOERROR;
+    }
+#endif
+}
+
+// Stop ticking
+void CaptureScheduler::stop() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stopped = true;
+    _wake.notify_all();
+
+#ifdef _WIN32
+    if (_timerResolutionRaised) {
+        timeEndPeriod(1);
+        _timerResolutionRaised = false;
+    }
+#endif
+}
+
+// Sleep until the next deadline
+bool CaptureScheduler::waitNextTick() {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Skip ticks that passed while the caller was busy, firing only the most recent one
+    Clock::time_point now = Clock::now();
+    Clock::duration period = periodFor(rateAt(now));
+    if (now - _nextDeadline >= period) {
+        auto missed = (now - _nextDeadline) / period;
+        _nextDeadline += missed * period;
+        _stats.missedTicks += static_cast<uint64_t>(missed);
+    }
+
+    // Waiting on an absolute deadline also wakes on stop() or a rate change
+    Clock::time_point deadline;
+    do {
+        deadline = _nextDeadline;
+        _wake.wait_until(lock, deadline, [this, deadline] {
+            return _stopped || _nextDeadline != deadline;
+        });
+    } while (!_stopped && _nextDeadline != deadline);
+
+    if (_stopped) {
+        return false;
+    }
+
+    double lateness = std::chrono::duration<double, std::milli>(Clock::now() - deadline).count();
+    _stats.ticks++;
+    _stats.totalLatenessMs += lateness;
+    _stats.maxLatenessMs = std::max(_stats.maxLatenessMs, lateness);
+
+    // Bursts shorten the period, the base period applies again once they have decayed
+    _lastTick = deadline;
+    _nextDeadline = deadline + (rateAt(deadline) > _fps ? periodFor(rateAt(deadline)) : _period);
+    return true;
+}
+
+// Get tick statistics
+CaptureScheduler::Stats CaptureScheduler::getStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Paces the capture stage from absolute deadlines
+ *
+ * Deadlines advance by an exact period on the steady clock, so timing errors do not
+ * accumulate. Ticks missed while the caller was busy are skipped instead of being
+ * fired back to back, and the lateness of every tick is recorded.
+ *
+ * A burst ticks right away and then runs at a higher rate for a short hold time, decaying
+ * linearly back to the base rate, so the effect of user input is captured promptly.
+ */
+class CaptureScheduler {
+public:
+    struct Stats {
+        uint64_t ticks{0};
+        uint64_t missedTicks{0};
+        double totalLatenessMs{0.0};
+        double maxLatenessMs{0.0};
+    };
+
+    explicit CaptureScheduler(double fps = 10.0);
+    ~CaptureScheduler();
+
+    // Prevent copying
+    CaptureScheduler(const CaptureScheduler&) = delete;
+    CaptureScheduler& operator=(const CaptureScheduler&) = delete;
+
+    // Change the tick rate, applied from the next deadline
+    void setFrameRate(double fps);
+    double getFrameRate() const;
+
+    // Get the rate in effect now, higher than the base rate during a burst
+    double getCurrentFrameRate() const;
+
+    // Configure bursts: their rate, how long it holds and how long it takes to decay, 0 fps disables
+    void setBurstProfile(double fps, std::chrono::milliseconds hold, std::chrono::milliseconds decay);
+
+    // Tick now, no sooner than one burst period after the last tick, and start a burst
+    void burst();
+
+    // Check whether a burst is raising the rate
+    bool isBursting() const;
+
+    // Anchor the first deadline at the current time
+    void start();
+
+    // Make waitNextTick() return false, waking a waiting thread
+    void stop();
+
+    // Sleep until the next deadline, false once stopped
+    bool waitNextTick();
+
+    Stats getStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Rate at a point in time, caller holds _mutex
+    double rateAt(Clock::time_point time) const;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _wake;
+    double _fps;
+    Clock::duration _period;
+    Clock::time_point _nextDeadline;
+    Clock::time_point _lastTick;
+
+    // Burst profile and the end of the current burst's hold time
+    double _burstFps{30.0};
+    Clock::duration _burstHold{std::chrono::milliseconds(300)};
+    Clock::duration _burstDecay{std::chrono::milliseconds(700)};
+    Clock::time_point _burstUntil{};
+    bool _stopped{true};
+    bool _timerResolutionRaised{false};
+    Stats _stats;
+};
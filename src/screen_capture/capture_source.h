@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <utility>
+#include <chrono>
+
+// Platform-neutral window handle (HWND on Windows, Window XID on X11)
+using WindowHandle = std::uintptr_t;
+
+// Rectangle in frame coordinates
+struct CaptureRect {
+    int x{0};
+    int y{0};
+    int width{0};
+    int height{0};
+};
+
+// Raw captured frame in top-down BGRA layout
+struct RawFrame {
+    std::vector<uint8_t> pixels;
+    int width{0};
+    int height{0};
+    int stride{0};
+    uint64_t sequence{0};
+    std::chrono::system_clock::time_point timestamp;
+
+    // Areas changed since the previous frame, only meaningful when dirtyRectsValid is set
+    // An empty valid list means the screen did not change at all
+    std::vector<CaptureRect> dirtyRects;
+    bool dirtyRectsValid{false};
+
+    // Tag written by the source so it can detect its own previous buffer and update it in place
+    uint64_t sourceGeneration{0};
+};
+
+// Mouse pointer reported by a source; captured frames never contain it
+struct CursorState {
+    int x{0};                       // Hotspot position relative to the captured area, may lie outside it
+    int y{0};
+    bool visible{false};
+
+    // Shape, only rewritten when the source's serial for it changes; no pixels when unknown
+    uint64_t shapeSerial{0};
+    int width{0};
+    int height{0};
+    int hotX{0};
+    int hotY{0};
+    std::vector<uint8_t> pixels;    // Top-down BGRA with straight alpha, width * 4 bytes per row
+};
+
+/**
+ * Source of raw desktop frames for ScreenCapture
+ * Implementations own any platform resources and may reuse them across grabs
+ */
+class CaptureSource {
+public:
+    virtual ~CaptureSource() = default;
+
+    // Capture the next frame into the given buffer, reusing its storage
+    virtual bool grab(RawFrame& frame) = 0;
+
+    // Update the pointer state of the previous call, false when the source cannot report it
+    virtual bool grabCursor(CursorState& cursor) { return false; }
+
+    // Get a short identifier for logging and stats
+    virtual std::string name() const = 0;
+
+    // Get available monitors
+    virtual std::vector<std::string> getMonitorInfo() { return {}; }
+
+    // Capture specific monitor
+    virtual void selectMonitor(int monitorIndex) {}
+
+    // Capture specific window
+    virtual bool selectWindow(WindowHandle windowHandle) { return false; }
+
+    // Get window list
+    virtual std::vector<std::pair<WindowHandle, std::string>> getWindowList() { return {}; }
+};
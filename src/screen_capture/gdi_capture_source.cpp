@@ -0,0 +1,342 @@
+#include "gdi_capture_source.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+// Get information about available monitors
+std::vector<std::string> GdiCaptureSource::getMonitorInfo() {
+    std::vector<std::string> monitors;
+
+    // Callback for EnumDisplayMonitors
+    auto monitorCallback = [](HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData) -> BOOL {
+        auto monitorsPtr = reinterpret_cast<std::vector<std::string>*>(dwData);
+
+        MONITORINFOEX monitorInfo;
+        monitorInfo.cbSize = sizeof(MONITORINFOEX);
+
+        if (GetMonitorInfo(hMonitor, &monitorInfo)) {
+            std::stringstream info;
+            info << "Monitor " << monitorsPtr->size() << ": "
+                 << monitorInfo.szDevice << " - "
+                 << (monitorInfo.dwFlags & MONITORINFOF_PRIMARY ? "Primary" : "Secondary") << " - "
+                 << "Resolution: " << (monitorInfo.rcMonitor.right - monitorInfo.rcMonitor.left)
+                 << "x" << (monitorInfo.rcMonitor.bottom - monitorInfo.rcMonitor.top);
+
+            monitorsPtr->push_back(info.str());
+        }
+
+        return TRUE; // Continue enumeration
+    };
+
+    // Enumerate monitors
+    EnumDisplayMonitors(NULL, NULL, monitorCallback, reinterpret_cast<LPARAM>(&monitors));
+
+    return monitors;
+}
+
+// Select monitor to capture
+void GdiCaptureSource::selectMonitor(int monitorIndex) {
+    _monitorIndex = monitorIndex;
+    _captureWindow = false;
+    _targetWindow = NULL;
+}
+
+// Select window to capture
+bool GdiCaptureSource::selectWindow(WindowHandle windowHandle) {
+    HWND hwnd = reinterpret_cast<HWND>(windowHandle);
+    if (!IsWindow(hwnd)) {
+        return false;
+    }
+
+    _targetWindow = hwnd;
+    _captureWindow = true;
+
+    return true;
+}
+
+// Get list of windows
+std::vector<std::pair<WindowHandle, std::string>> GdiCaptureSource::getWindowList() {
+    std::vector<std::pair<WindowHandle, std::string>> windows;
+
+    // Callback for EnumWindows
+    auto windowCallback = [](HWND hwnd, LPARAM lParam) -> BOOL {
+        auto windowsPtr = reinterpret_cast<std::vector<std::pair<WindowHandle, std::string>>*>(lParam);
+
+        // Skip invisible windows
+        if (!IsWindowVisible(hwnd)) {
+            return TRUE;
+        }
+
+        // Get window title
+        char title[256];
+        int length = GetWindowTextA(hwnd, title, sizeof(title));
+
+        if (length > 0) {
+            windowsPtr->push_back({reinterpret_cast<WindowHandle>(hwnd), std::string(title)});
+        }
+
+        return TRUE; // Continue enumeration
+    };
+
+    // Enumerate windows
+    EnumWindows(windowCallback, reinterpret_cast<LPARAM>(&windows));
+
+    return windows;
+}
+
+// Resolve the capture rectangle for the selected monitor
+RECT GdiCaptureSource::getMonitorRect() {
+    RECT rcClient;
+
+    // Get monitor bounds
+    int monitorCount = GetSystemMetrics(SM_CMONITORS);
+    if (_monitorIndex >= monitorCount) {
+        _monitorIndex = 0; // Default to primary monitor
+    }
+
+    if (_monitorIndex == 0) {
+        // Primary monitor
+        rcClient.left = 0;
+        rcClient.top = 0;
+        rcClient.right = GetSystemMetrics(SM_CXSCREEN);
+        rcClient.bottom = GetSystemMetrics(SM_CYSCREEN);
+        return rcClient;
+    }
+
+    // Specific monitor by index
+    // We need to enumerate monitors to find the correct one
+    struct MonitorData {
+        int targetIndex;
+        int currentIndex;
+        RECT bounds;
+        bool found;
+    };
+
+    MonitorData data = {_monitorIndex, 0, {0}, false};
+
+    auto monitorCallback = [](HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData) -> BOOL {
+        auto dataPtr = reinterpret_cast<MonitorData*>(dwData);
+
+        if (dataPtr->currentIndex == dataPtr->targetIndex) {
+            dataPtr->bounds = *lprcMonitor;
+            dataPtr->found = true;
+            return FALSE; // Stop enumeration
+        }
+
+        dataPtr->currentIndex++;
+        return TRUE; // Continue enumeration
+    };
+
+    EnumDisplayMonitors(NULL, NULL, monitorCallback, reinterpret_cast<LPARAM>(&data));
+
+    if (data.found) {
+        return data.bounds;
+    }
+
+    // Fallback to primary monitor
+    rcClient.left = 0;
+    rcClient.top = 0;
+    rcClient.right = GetSystemMetrics(SM_CXSCREEN);
+    rcClient.bottom = GetSystemMetrics(SM_CYSCREEN);
+    return rcClient;
+}
+
+// Capture the selected monitor or window into a BGRA buffer
+bool GdiCaptureSource::grab(RawFrame& frame) {
+    HDC hdcScreen = NULL;
+    HDC hdcMemDC = NULL;
+    HBITMAP hbmScreen = NULL;
+    HBITMAP hbmOld = NULL;
+    RECT rcClient;
+    bool success = false;
+
+    try {
+        // Get device context based on capture mode
+        if (_captureWindow && _targetWindow != NULL) {
+            // Capture specific window
+            hdcScreen = GetDC(_targetWindow);
+            GetClientRect(_targetWindow, &rcClient);
+            _captureOrigin = {0, 0};
+            ClientToScreen(_targetWindow, &_captureOrigin);
+        } else {
+            // Capture monitor or primary display
+            hdcScreen = CreateDC(TEXT("DISPLAY"), NULL, NULL, NULL);
+            rcClient = getMonitorRect();
+            _captureOrigin = {rcClient.left, rcClient.top};
+        }
+
+        if (!hdcScreen) {
+            throw std::runtime_error("Failed to get screen DC");
+        }
+
+        // Create a compatible DC
+        hdcMemDC = CreateCompatibleDC(hdcScreen);
+        if (!hdcMemDC) {
+            throw std::runtime_error("Failed to create compatible DC");
+        }
+
+        // Create a compatible bitmap
+        frame.width = rcClient.right - rcClient.left;
+        frame.height = rcClient.bottom - rcClient.top;
+        frame.stride = frame.width * 4;
+
+        hbmScreen = CreateCompatibleBitmap(hdcScreen, frame.width, frame.height);
+        if (!hbmScreen) {
+            throw std::runtime_error("Failed to create compatible bitmap");
+        }
+
+        // Select the bitmap into the compatible DC
+        hbmOld = (HBITMAP)SelectObject(hdcMemDC, hbmScreen);
+
+        // Copy from the screen DC to the memory DC
+        if (!BitBlt(hdcMemDC, 0, 0, frame.width, frame.height,
+                    hdcScreen, rcClient.left, rcClient.top, SRCCOPY | CAPTUREBLT)) {
+            throw std::runtime_error("BitBlt failed");
+        }
+
+        // Get the bitmap info
+        BITMAPINFOHEADER bi;
+        bi.biSize = sizeof(BITMAPINFOHEADER);
+        bi.biWidth = frame.width;
+        bi.biHeight = -frame.height;  // Negative height for top-down DIB
+        bi.biPlanes = 1;
+        bi.biBitCount = 32;
+        bi.biCompression = BI_RGB;
+        bi.biSizeImage = 0;
+        bi.biXPelsPerMeter = 0;
+        bi.biYPelsPerMeter = 0;
+        bi.biClrUsed = 0;
+        bi.biClrImportant = 0;
+
+        // Get the DIB bits into the reusable frame buffer
+        frame.pixels.resize(static_cast<size_t>(frame.stride) * frame.height);
+        GetDIBits(hdcMemDC, hbmScreen, 0, frame.height, frame.pixels.data(),
+                 (BITMAPINFO*)&bi, DIB_RGB_COLORS);
+
+        success = true;
+    } catch (const std::exception& e) {
+        std::cerr << "Error in screen capture: " << e.what() << std::endl;
+    }
+
+    // Cleanup
+    if (hbmOld) SelectObject(hdcMemDC, hbmOld);
+    if (hbmScreen) DeleteObject(hbmScreen);
+    if (hdcMemDC) DeleteDC(hdcMemDC);
+
+    if (_captureWindow && hdcScreen) {
+        ReleaseDC(_targetWindow, hdcScreen);
+    } else if (hdcScreen) {
+        DeleteDC(hdcScreen);
+    }
+
+    return success;
+}
+
+// Read the pointer position and, when it changed, its shape
+bool GdiCaptureSource::grabCursor(CursorState& cursor) {
+    CURSORINFO info = {};
+    info.cbSize = sizeof(info);
+    if (!GetCursorInfo(&info)) {
+        return false;
+    }
+
+    cursor.x = info.ptScreenPos.x - _captureOrigin.x;
+    cursor.y = info.ptScreenPos.y - _captureOrigin.y;
+    cursor.visible = (info.flags & CURSOR_SHOWING) != 0 && info.hCursor != NULL;
+
+    // Cursor handles are shared system resources, the same handle is the same shape
+    uint64_t serial = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(info.hCursor));
+    if (!cursor.visible || (serial == cursor.shapeSerial && !cursor.pixels.empty())) {
+        return true;
+    }
+
+    if (!readCursorShape(info.hCursor, cursor)) {
+        cursor.pixels.clear();
+        cursor.width = 0;
+        cursor.height = 0;
+        return true;
+    }
+    cursor.shapeSerial = serial;
+    return true;
+}
+
+// Convert a cursor's bitmaps to BGRA with straight alpha
+bool GdiCaptureSource::readCursorShape(HCURSOR handle, CursorState& cursor) {
+    ICONINFO icon = {};
+    if (!GetIconInfo(handle, &icon)) {
+        return false;
+    }
+
+    // Monochrome cursors stack the AND mask on top of the XOR mask in one bitmap
+    BITMAP mask = {};
+    GetObject(icon.hbmMask, sizeof(mask), &mask);
+    int width = mask.bmWidth;
+    int maskRows = mask.bmHeight;
+    int height = icon.hbmColor ? maskRows : maskRows / 2;
+    bool success = width > 0 && height > 0;
+
+    HDC hdc = CreateCompatibleDC(NULL);
+    BITMAPINFO bi = {};
+    bi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bi.bmiHeader.biWidth = width;
+    bi.bmiHeader.biPlanes = 1;
+    bi.bmiHeader.biBitCount = 32;
+    bi.bmiHeader.biCompression = BI_RGB;
+
+    // Masks read as 32 bpp: black where the bit is 0, white where it is 1
+    std::vector<uint8_t> maskBits(static_cast<size_t>(width) * std::max(maskRows, 0) * 4);
+    bi.bmiHeader.biHeight = -maskRows;
+    success = success && GetDIBits(hdc, icon.hbmMask, 0, maskRows, maskBits.data(), &bi, DIB_RGB_COLORS) != 0;
+
+    std::vector<uint8_t>& pixels = cursor.pixels;
+    if (success) {
+        pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+    }
+
+    if (success && icon.hbmColor) {
+        bi.bmiHeader.biHeight = -height;
+        success = GetDIBits(hdc, icon.hbmColor, 0, height, pixels.data(), &bi, DIB_RGB_COLORS) != 0;
+
+        // Cursors without an alpha channel take their transparency from the AND mask
+        bool hasAlpha = false;
+        for (size_t i = 3; i < pixels.size() && !hasAlpha; i += 4) {
+            hasAlpha = pixels[i] != 0;
+        }
+        if (success && !hasAlpha) {
+            for (size_t i = 0; i < pixels.size(); i += 4) {
+                pixels[i + 3] = maskBits[i] == 0 ? 0xFF : 0x00;
+            }
+        }
+    } else if (success) {
+        size_t xorOffset = static_cast<size_t>(width) * height * 4;
+        for (size_t i = 0; i < pixels.size(); i += 4) {
+            bool andBit = maskBits[i] != 0;
+            bool xorBit = maskBits[xorOffset + i] != 0;
+            if (!andBit) {
+                // Opaque black or white
+                uint8_t value = xorBit ? 0xFF : 0x00;
+                pixels[i] = pixels[i + 1] = pixels[i + 2] = value;
+                pixels[i + 3] = 0xFF;
+            } else if (xorBit) {
+                // Inverts the screen, which clients cannot do; black stays visible on most backgrounds
+                pixels[i + 3] = 0xFF;
+            }
+        }
+    }
+
+    DeleteDC(hdc);
+    DeleteObject(icon.hbmMask);
+    if (icon.hbmColor) {
+        DeleteObject(icon.hbmColor);
+    }
+
+    if (!success) {
+        return false;
+    }
+    cursor.width = width;
+    cursor.height = height;
+    cursor.hotX = static_cast<int>(icon.xHotspot);
+    cursor.hotY = static_cast<int>(icon.yHotspot);
+    return true;
+}
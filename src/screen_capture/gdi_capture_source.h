@@ -0,0 +1,39 @@
+#pragma once
+
+#include "capture_source.h"
+#include <Windows.h>
+
+/**
+ * Windows capture source using GDI BitBlt from the display DC
+ */
+class GdiCaptureSource : public CaptureSource {
+public:
+    GdiCaptureSource() = default;
+    ~GdiCaptureSource() override = default;
+
+    bool grab(RawFrame& frame) override;
+    std::string name() const override { return "gdi"; }
+
+    // BitBlt leaves the pointer out of frames, it is read separately here
+    bool grabCursor(CursorState& cursor) override;
+
+    std::vector<std::string> getMonitorInfo() override;
+    void selectMonitor(int monitorIndex) override;
+    bool selectWindow(WindowHandle windowHandle) override;
+    std::vector<std::pair<WindowHandle, std::string>> getWindowList() override;
+
+private:
+    // Resolve the capture rectangle for the selected monitor
+    RECT getMonitorRect();
+
+    // Read a cursor's hotspot and pixels
+    bool readCursorShape(HCURSOR handle, CursorState& cursor);
+
+    // Capture region
+    int _monitorIndex{0};
+    HWND _targetWindow{NULL};
+    bool _captureWindow{false};
+
+    // Screen position of the last captured area's top-left pixel
+    POINT _captureOrigin{0, 0};
+};
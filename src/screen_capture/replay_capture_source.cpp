@@ -0,0 +1,124 @@
+#include "replay_capture_source.h"
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    uint32_t readLE32(const char* p) {
+        const auto* b = reinterpret_cast<const unsigned char*>(p);
+        return b[0] | (b[1] << 8) | (b[2] << 16) | (static_cast<uint32_t>(b[3]) << 24);
+    }
+
+    void writeLE32(char* p, uint32_t v) {
+        p[0] = static_cast<char>(v & 0xFF);
+        p[1] = static_cast<char>((v >> 8) & 0xFF);
+        p[2] = static_cast<char>((v >> 16) & 0xFF);
+        p[3] = static_cast<char>((v >> 24) & 0xFF);
+    }
+}
+
+// Constructor
+ReplayCaptureSource::ReplayCaptureSource(const std::string& path, bool loop)
+    : _file(path, std::ios::binary), _path(path), _loop(loop) {
+    if (!_file.is_open()) {
+        std::cerr << "Could not open replay file: " << path << std::endl;
+        return;
+    }
+
+    char header[raw_frame_file::kHeaderSize];
+    if (!_file.read(header, sizeof(header)) ||
+        std::memcmp(header, raw_frame_file::kMagic, sizeof(raw_frame_file::kMagic)) != 0) {
+        std::cerr << "Invalid replay file header: " << path << std::endl;
+        return;
+    }
+
+    _width = static_cast<int>(readLE32(header + 8));
+    _height = static_cast<int>(readLE32(header + 12));
+
+    // Derive frame count from file size
+    _file.seekg(0, std::ios::end);
+    size_t bodySize = static_cast<size_t>(_file.tellg()) - raw_frame_file::kHeaderSize;
+    size_t frameSize = static_cast<size_t>(_width) * _height * 4;
+    _frameCount = frameSize > 0 ? bodySize / frameSize : 0;
+    _file.seekg(raw_frame_file::kHeaderSize, std::ios::beg);
+
+    _valid = _frameCount > 0;
+    if (!_valid) {
+        std::cerr << "Replay file contains no frames: " << path << std::endl;
+    }
+}
+
+// Describe the recorded monitor
+std::vector<std::string> ReplayCaptureSource::getMonitorInfo() {
+    std::stringstream info;
+    info << "Monitor 0: REPLAY " << _path << " - Primary - Resolution: " << _width << "x" << _height;
+    return {info.str()};
+}
+
+// Read the next recorded frame
+bool ReplayCaptureSource::grab(RawFrame& frame) {
+    if (!_valid) return false;
+
+    if (_nextFrame >= _frameCount) {
+        if (!_loop) return false;
+
+        _nextFrame = 0;
+        _file.clear();
+        _file.seekg(raw_frame_file::kHeaderSize, std::ios::beg);
+    }
+
+    frame.width = _width;
+    frame.height = _height;
+    frame.stride = _width * 4;
+    frame.pixels.resize(static_cast<size_t>(frame.stride) * _height);
+
+    if (!_file.read(reinterpret_cast<char*>(frame.pixels.data()), frame.pixels.size())) {
+        std::cerr << "Failed to read replay frame " << _nextFrame << std::endl;
+        return false;
+    }
+
+    _nextFrame++;
+    return true;
+}
+
+// Create a recording file
+bool RawFrameRecorder::open(const std::string& path, int width, int height) {
+    close();
+
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if (!_file.is_open()) {
+        std::cerr << "Could not create recording file: " << path << std::endl;
+        return false;
+    }
+
+    char header[raw_frame_file::kHeaderSize];
+    std::memcpy(header, raw_frame_file::kMagic, sizeof(raw_frame_file::kMagic));
+    writeLE32(header + 8, static_cast<uint32_t>(width));
+    writeLE32(header + 12, static_cast<uint32_t>(height));
+    _file.write(header, sizeof(header));
+
+    _width = width;
+    _height = height;
+    return static_cast<bool>(_file);
+}
+
+// Append one frame, dropping any row padding
+bool RawFrameRecorder::write(const RawFrame& frame) {
+    if (!_file.is_open() || frame.width != _width || frame.height != _height) {
+        return false;
+    }
+
+    for (int y = 0; y < frame.height; y++) {
+        _file.write(reinterpret_cast<const char*>(frame.pixels.data() + static_cast<size_t>(y) * frame.stride),
+                    static_cast<std::streamsize>(frame.width) * 4);
+    }
+
+    return static_cast<bool>(_file);
+}
+
+// Close the recording file
+void RawFrameRecorder::close() {
+    if (_file.is_open()) {
+        _file.close();
+    }
+}
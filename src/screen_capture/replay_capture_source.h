@@ -0,0 +1,68 @@
+#pragma once
+
+#include "capture_source.h"
+#include <fstream>
+
+/**
+ * Recorded raw frame file format
+ *   header: "XLRAW001" magic, uint32 width, uint32 height (little-endian)
+ *   body:   consecutive top-down BGRA frames of width * height * 4 bytes
+ */
+namespace raw_frame_file {
+    constexpr char kMagic[8] = {'X', 'L', 'R', 'A', 'W', '0', '0', '1'};
+    constexpr size_t kHeaderSize = 16;
+}
+
+/**
+ * Replays frames previously written by RawFrameRecorder
+ */
+class ReplayCaptureSource : public CaptureSource {
+public:
+    explicit ReplayCaptureSource(const std::string& path, bool loop = true);
+    ~ReplayCaptureSource() override = default;
+
+    // Check that the file was opened and has a valid header
+    bool isOpen() const { return _valid; }
+
+    bool grab(RawFrame& frame) override;
+    std::string name() const override { return "replay"; }
+
+    std::vector<std::string> getMonitorInfo() override;
+
+    // Number of frames in the recording
+    size_t getFrameCount() const { return _frameCount; }
+
+private:
+    std::ifstream _file;
+    std::string _path;
+    bool _loop;
+    bool _valid{false};
+    int _width{0};
+    int _height{0};
+    size_t _frameCount{0};
+    size_t _nextFrame{0};
+};
+
+/**
+ * Appends captured frames to a raw frame file for later replay
+ */
+class RawFrameRecorder {
+public:
+    RawFrameRecorder() = default;
+    ~RawFrameRecorder() { close(); }
+
+    // Create the file; all frames must then match the given size
+    bool open(const std::string& path, int width, int height);
+
+    // Append a frame
+    bool write(const RawFrame& frame);
+
+    void close();
+
+    bool isOpen() const { return _file.is_open(); }
+
+private:
+    std::ofstream _file;
+    int _width{0};
+    int _height{0};
+};
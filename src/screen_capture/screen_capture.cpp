@@ -1,64 +1,51 @@
 #include "screen_capture.h"
 #include <iostream>
-#ifdef HAVE_TURBOJPEG
-#include <turbojpeg.h>
-#endif
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include "../encoding/quality_search.h"
+#include "../encoding/frame_protocol.h"
 #include "../utils/base64.h"
+#include "synthetic_capture_source.h"
+#ifdef _WIN32
+#include "gdi_capture_source.h"
+#elif defined(HAVE_XSHM)
+#include "xshm_capture_source.h"
+#endif
 
-// Add GDI+ support for fallback JPEG compression
-#ifdef NO_TURBOJPEG
-#include <Windows.h>
-#include <gdiplus.h>
-#pragma comment(lib, "gdiplus.lib")
-using namespace Gdiplus;
-
-// GDI+ initialization
-static class GdiPlusInitializer {
-public:
-    GdiPlusInitializer() {
-        Gdiplus::GdiplusStartupInput gdiplusStartupInput;
-        Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
-    }
-    ~GdiPlusInitializer() {
-        Gdiplus::GdiplusShutdown(gdiplusToken);
-    }
-private:
-    ULONG_PTR gdiplusToken;
-} gdiPlusInit;
-
-// Helper function to get encoder CLSID
-int GetEncoderClsid(const WCHAR* format, CLSID* pClsid) {
-    UINT num = 0;          // number of image encoders
-    UINT size = 0;         // size of the image encoder array in bytes
-    
-    Gdiplus::GetImageEncodersSize(&num, &size);
-    if (size == 0)
-        return -1;
-    
-    Gdiplus::ImageCodecInfo* pImageCodecInfo = (Gdiplus::ImageCodecInfo*)(malloc(size));
-    if (pImageCodecInfo == NULL)
-        return -1;
-    
-    Gdiplus::GetImageEncoders(num, size, pImageCodecInfo);
-    
-    for (UINT j = 0; j < num; ++j) {
-        if (wcscmp(pImageCodecInfo[j].MimeType, format) == 0) {
-            *pClsid = pImageCodecInfo[j].Clsid;
-            free(pImageCodecInfo);
-            return j;
-        }
+// Create the default capture source for this platform
+std::unique_ptr<CaptureSource> createPlatformCaptureSource() {
+#ifdef _WIN32
+    return std::make_unique<GdiCaptureSource>();
+#else
+#ifdef HAVE_XSHM
+    auto xshm = std::make_unique<XShmCaptureSource>();
+    if (xshm->isOpen()) {
+        return xshm;
     }
-    
-    free(pImageCodecInfo);
-    return -1;
-}
 #endif
+    // No usable native capture backend, fall back to a synthetic desktop
+    std::cerr << "No native capture backend available, using synthetic desktop" << std::endl;
+    return std::make_unique<SyntheticCaptureSource>(1920, 1080);
+#endif
+}
+
+// Thumbnails only give context around a viewport, a low fixed quality is enough
+static constexpr int kThumbnailQuality = 50;
+
+// Default number of threads encoding one frame in bands, the encode thread included, leaving a
+// core for capture and delivery; the pool adds the others as workers, like setEncodeThreads()
+static int defaultEncodeThreads() {
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    return std::clamp(cores - 1, 1, 8);
+}
 
 // Constructor
-ScreenCapture::ScreenCapture(int captureIntervalMs, int quality)
-    : _captureIntervalMs(captureIntervalMs), _quality(quality) {
+ScreenCapture::ScreenCapture(int captureIntervalMs, int quality, std::unique_ptr<CaptureSource> source)
+    : _scheduler(1000.0 / std::max(1, captureIntervalMs)), _quality(quality),
+      _source(source ? std::move(source) : createPlatformCaptureSource()),
+      _encodeWorkers(std::make_unique<ThreadPool>(defaultEncodeThreads() - 1)) {
+    _frameEncoders[static_cast<size_t>(FrameEncoder::Codec::JPEG)] = createFrameEncoder(FrameEncoder::Codec::JPEG);
 }
 
 // Destructor
@@ -70,8 +57,47 @@ ScreenCapture::~ScreenCapture() {
 bool ScreenCapture::start() {
     if (_running) return true;
     
+    {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats = Stats();
+    }
+    {
+        // Encoders outlive sessions, their costs are reported from here on
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        for (size_t i = 0; i < FrameEncoder::kCodecCount; i++) {
+            _codecCostsAtStart[i] = _frameEncoders[i] ? _frameEncoders[i]->getCost() : FrameEncoder::Cost();
+        }
+        _profileCosts = {};
+    }
+    _burstRequestedNs = 0;
+    _cursorResend = true;
+    _cursorPending = false;
+    {
+        std::lock_guard<std::mutex> lock(_cursorMutex);
+        _cursorOutputs.clear();
+        _pendingCursors.clear();
+    }
+    
+    // Fresh pipeline state, no stage threads are running here
+    _freeFrames.clear();
+    _capturedFrames.clear();
+    _encodedFrames.clear();
+    _carriedDirtyRects.clear();
+    _hasCarriedDamage = false;
+    _thumbnailDirty = true;
+    _lastThumbnailTime = {};
+    _rawFramePool.clear();
+    for (size_t i = 0; i < kRawFramePoolSize; i++) {
+        _rawFramePool.push_back(std::make_unique<RawFrame>());
+        _freeFrames.tryPush(_rawFramePool.back().get());
+    }
+
     _running = true;
+    _scheduler.start();
+    _deliverThread = std::thread(&ScreenCapture::deliverLoop, this);
+    _encodeThread = std::thread(&ScreenCapture::encodeLoop, this);
     _captureThread = std::thread(&ScreenCapture::captureLoop, this);
+    _cursorThread = std::thread(&ScreenCapture::cursorLoop, this);
     
     return true;
 }
@@ -82,15 +108,21 @@ void ScreenCapture::stop() {
     
     _running = false;
     
-    // Wake up capture thread if it's waiting
+    // Wake up stages and callers waiting for a frame
+    _scheduler.stop();
+    _encodeSignal.notify();
+    _deliverSignal.notify();
+    _cursorSignal.notify();
     {
         std::lock_guard<std::mutex> lock(_frameMutex);
         _frameReady = true;
         _frameCondition.notify_one();
     }
     
-    if (_captureThread.joinable()) {
-        _captureThread.join();
+    for (std::thread* stage : {&_captureThread, &_encodeThread, &_deliverThread, &_cursorThread}) {
+        if (stage->joinable()) {
+            stage->join();
+        }
     }
 }
 
@@ -98,10 +130,26 @@ void ScreenCapture::stop() {
 nlohmann::json ScreenCapture::frameToJson(const FrameData& frame) {
     nlohmann::json jsonFrame;
     
-    // Base64 encode the JPEG data
-    std::string base64Data = base64_encode(frame.jpegData.data(), frame.jpegData.size());
+    // Tile frames are packed without a client cache
+    std::vector<uint8_t> packed;
+    const std::vector<uint8_t>* data = frame.data ? frame.data.get() : &packed;
+    if (frame.tiles) {
+        uint32_t tablesVersion = 0;
+        packTileUpdate(*frame.tiles, nullptr, tablesVersion, packed);
+        data = &packed;
+    }
+
+    // Base64 encode the encoded frame
+    std::string base64Data = base64_encode(data->data(), data->size());
     
     jsonFrame["data"] = base64Data;
+    jsonFrame["mode"] = frame.mode == EncodingMode::TILES ? "tiles" :
+                        frame.mode == EncodingMode::LOSSLESS ? "lossless" :
+                        frame.mode == EncodingMode::VIDEO ? "video" : "jpeg";
+    if (frame.mode == EncodingMode::JPEG) {
+        jsonFrame["codec"] = FrameEncoder::codecName(frame.codec);
+    }
+    jsonFrame["keyframe"] = frame.keyframe;
     jsonFrame["width"] = frame.width;
     jsonFrame["height"] = frame.height;
     jsonFrame["quality"] = frame.quality;
@@ -114,123 +162,578 @@ nlohmann::json ScreenCapture::frameToJson(const FrameData& frame) {
     return jsonFrame;
 }
 
+// Set encoding mode
+void ScreenCapture::setEncodingMode(EncodingMode mode) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+
+#ifndef HAVE_TURBOJPEG
+    if (mode == EncodingMode::TILES) {
+        std::cerr << "Tile encoding requires TurboJPEG, using full JPEG frames" << std::endl;
+        mode = EncodingMode::JPEG;
+    }
+#endif
+    if (mode == EncodingMode::VIDEO && !VideoEncoder::isAvailable()) {
+        std::cerr << "Video encoding requires OpenH264, using full JPEG frames" << std::endl;
+        mode = EncodingMode::JPEG;
+    }
+
+    _encodingMode = mode;
+
+    if (mode == EncodingMode::TILES && !_tileEncoder) {
+        _tileEncoder = std::make_unique<TileEncoder>();
+    }
+    if (mode == EncodingMode::LOSSLESS && !_losslessEncoder) {
+        _losslessEncoder = std::make_unique<LosslessEncoder>();
+    }
+    if (mode == EncodingMode::VIDEO && !_videoEncoder) {
+        _videoEncoder = std::make_unique<VideoEncoder>();
+    }
+}
+
+// Choose the whole-frame codecs
+void ScreenCapture::setImageCodecs(const std::vector<FrameEncoder::Codec>& codecs) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _imageCodecs.clear();
+    for (FrameEncoder::Codec codec : codecs) {
+        std::unique_ptr<FrameEncoder>& encoder = _frameEncoders[static_cast<size_t>(codec)];
+        if (!encoder) {
+            encoder = createFrameEncoder(codec);
+        }
+        if (!encoder) {
+            std::cerr << "Image codec not available: " << FrameEncoder::codecName(codec) << std::endl;
+            continue;
+        }
+        if (std::find(_imageCodecs.begin(), _imageCodecs.end(), codec) == _imageCodecs.end()) {
+            _imageCodecs.push_back(codec);
+        }
+    }
+    if (_imageCodecs.empty()) {
+        _imageCodecs.push_back(FrameEncoder::Codec::JPEG);
+    }
+}
+
+// Get the whole-frame codecs
+std::vector<FrameEncoder::Codec> ScreenCapture::getImageCodecs() {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    return _imageCodecs;
+}
+
+// Choose the output profiles
+void ScreenCapture::setOutputProfiles(const std::vector<OutputProfile>& profiles) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    std::vector<OutputProfile> available;
+    for (const OutputProfile& profile : profiles) {
+        if (!FrameEncoder::isAvailable(profile.codec)) {
+            std::cerr << "Image codec not available: " << FrameEncoder::codecName(profile.codec) << std::endl;
+            continue;
+        }
+        if (std::find(available.begin(), available.end(), profile) == available.end()) {
+            available.push_back(profile);
+        }
+    }
+
+    // Images kept for unchanged frames are stale once the other path has been encoding
+    if (available.empty() != _outputProfiles.empty()) {
+        _lastImages = {};
+        _profileEncoders.clear();
+        _profileLevels.clear();
+    }
+    _outputProfiles = std::move(available);
+}
+
+// Configure lossless mode
+void ScreenCapture::setLosslessOptions(int keyframeInterval, bool scrollDetection) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    if (!_losslessEncoder) {
+        _losslessEncoder = std::make_unique<LosslessEncoder>(keyframeInterval);
+    } else {
+        _losslessEncoder->setKeyframeInterval(keyframeInterval);
+    }
+    _losslessEncoder->setMotionEstimation(scrollDetection);
+}
+
+// Configure video mode
+void ScreenCapture::setVideoOptions(int keyframeInterval) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    if (!_videoEncoder) {
+        _videoEncoder = std::make_unique<VideoEncoder>(keyframeInterval);
+    } else {
+        _videoEncoder->setKeyframeInterval(keyframeInterval);
+    }
+}
+
+// Configure tile mode
+void ScreenCapture::setTileOptions(int tileSize, int keyframeInterval, bool scrollDetection, bool regionCoding) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    if (!_tileEncoder || _tileEncoder->getTileSize() != tileSize) {
+        _tileEncoder = std::make_unique<TileEncoder>(tileSize, keyframeInterval);
+    } else {
+        _tileEncoder->setKeyframeInterval(keyframeInterval);
+    }
+    _tileEncoder->setMotionEstimation(scrollDetection);
+    _tileEncoder->setRegionCoding(regionCoding);
+}
+
+// Set the number of threads encoding one frame
+void ScreenCapture::setEncodeThreads(int threads) {
+    if (_running) {
+        std::cerr << "Encode threads can only be changed while capture is stopped" << std::endl;
+        return;
+    }
+    _encodeWorkers = std::make_unique<ThreadPool>(static_cast<size_t>(std::clamp(threads, 1, 64) - 1));
+}
+
+// Limit the encoded frame size
+void ScreenCapture::setOutputSize(int maxWidth, int maxHeight) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _scaler.setTargetSize(maxWidth, maxHeight);
+}
+
+// Shrink the output size by a factor
+void ScreenCapture::setOutputScale(double factor) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _scaler.setScaleFactor(factor);
+}
+
+// Encode part of the screen
+void ScreenCapture::setViewport(const CaptureRect& viewport) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _scaler.setCrop(viewport);
+}
+
+// Configure whole-screen thumbnails
+void ScreenCapture::setThumbnailOptions(int maxWidth, int maxHeight, double fps) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _thumbnailScaler.setTargetSize(maxWidth, maxHeight);
+    _thumbnailFps = std::max(0.0, fps);
+    if (_thumbnailFps > 0.0 && !_thumbnailEncoder) {
+        _thumbnailEncoder = createFrameEncoder(FrameEncoder::Codec::JPEG);
+    }
+}
+
+// Size JPEG frames to a bitrate
+void ScreenCapture::setTargetBitrate(int kbps) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _targetBitrateKbps = std::max(kbps, 0);
+    for (FrameEncoder* encoder : getFrameEncoders()) {
+        QualitySearch* search = encoder->getQualitySearch();
+        if (search && _targetBitrateKbps == 0 && search->getGoal() == QualitySearch::Goal::BYTES) {
+            search->setFixed();
+        }
+    }
+}
+
+// Keep JPEG frames above a PSNR floor
+void ScreenCapture::setPsnrFloor(double psnrDb) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    if (psnrDb > 0.0) {
+        _targetBitrateKbps = 0;
+    }
+    _psnrFloor = std::max(psnrDb, 0.0);
+    for (FrameEncoder* encoder : getFrameEncoders()) {
+        QualitySearch* search = encoder->getQualitySearch();
+        if (search && psnrDb > 0.0) {
+            search->setPsnrFloor(psnrDb);
+        } else if (search && search->getGoal() == QualitySearch::Goal::PSNR) {
+            search->setFixed();
+        }
+    }
+}
+
+// Collect the whole-frame encoders
+std::vector<FrameEncoder*> ScreenCapture::getFrameEncoders() {
+    std::vector<FrameEncoder*> encoders;
+    for (std::unique_ptr<FrameEncoder>& encoder : _frameEncoders) {
+        if (encoder) {
+            encoders.push_back(encoder.get());
+        }
+    }
+    for (auto& [key, slot] : _profileEncoders) {
+        encoders.push_back(slot.encoder.get());
+    }
+    return encoders;
+}
+
+// Configure static screen handling
+void ScreenCapture::setIdleOptions(const IdleOptions& options) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _idleOptions = options;
+}
+
+// Configure input bursts
+void ScreenCapture::setBurstOptions(const BurstOptions& options) {
+    _scheduler.setBurstProfile(options.fps, std::chrono::milliseconds(options.holdMs),
+                               std::chrono::milliseconds(options.decayMs));
+}
+
+// Capture promptly after input
+void ScreenCapture::triggerBurst() {
+    if (!_running) {
+        return;
+    }
+
+    // Keep the earliest request so the delay covers the whole wait
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t expected = 0;
+    _burstRequestedNs.compare_exchange_strong(expected, now);
+
+    _idleCaptureIntervalMs = 0;
+    _scheduler.burst();
+}
+
+// Request a full frame
+void ScreenCapture::requestKeyframe() {
+    {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    if (_tileEncoder) {
+        _tileEncoder->requestKeyframe();
+    }
+        if (_losslessEncoder) {
+            _losslessEncoder->requestKeyframe();
+        }
+        if (_videoEncoder) {
+            _videoEncoder->requestKeyframe();
+        }
+    }
+
+    // A static screen is resent too, and capture wakes up from the idle rate
+    _resendRequested = true;
+    _cursorResend = true;
+    _idleCaptureIntervalMs = 0;
+}
+
+// Set the client tile cache query
+void ScreenCapture::setTileCacheQuery(TileEncoder::CachedPredicate query) {
+    std::lock_guard<std::mutex> lock(_encoderMutex);
+    _tileCacheQuery = std::move(query);
+}
+
+// Replace the frame source
+void ScreenCapture::setCaptureSource(std::unique_ptr<CaptureSource> source) {
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    _source = std::move(source);
+}
+
 // Select monitor to capture
 void ScreenCapture::selectMonitor(int monitorIndex) {
-    _monitorIndex = monitorIndex;
-    _captureWindow = false;
-    _targetWindow = NULL;
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    if (_source) {
+        _source->selectMonitor(monitorIndex);
+    }
 }
 
 // Get information about available monitors
 std::vector<std::string> ScreenCapture::getMonitorInfo() {
-    std::vector<std::string> monitors;
-    
-    // Callback for EnumDisplayMonitors
-    auto monitorCallback = [](HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData) -> BOOL {
-        auto monitorsPtr = reinterpret_cast<std::vector<std::string>*>(dwData);
-        
-        MONITORINFOEX monitorInfo;
-        monitorInfo.cbSize = sizeof(MONITORINFOEX);
-        
-        if (GetMonitorInfo(hMonitor, &monitorInfo)) {
-            std::stringstream info;
-            info << "Monitor " << monitorsPtr->size() << ": "
-                 << monitorInfo.szDevice << " - "
-                 << (monitorInfo.dwFlags & MONITORINFOF_PRIMARY ? "Primary" : "Secondary") << " - "
-                 << "Resolution: " << (monitorInfo.rcMonitor.right - monitorInfo.rcMonitor.left) 
-                 << "x" << (monitorInfo.rcMonitor.bottom - monitorInfo.rcMonitor.top);
-            
-            monitorsPtr->push_back(info.str());
-        }
-        
-        return TRUE; // Continue enumeration
-    };
-    
-    // Enumerate monitors
-    EnumDisplayMonitors(NULL, NULL, monitorCallback, reinterpret_cast<LPARAM>(&monitors));
-    
-    return monitors;
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    return _source ? _source->getMonitorInfo() : std::vector<std::string>();
 }
 
 // Select window to capture
-bool ScreenCapture::selectWindow(HWND windowHandle) {
-    if (!IsWindow(windowHandle)) {
-        return false;
-    }
-    
-    _targetWindow = windowHandle;
-    _captureWindow = true;
-    
-    return true;
+bool ScreenCapture::selectWindow(WindowHandle windowHandle) {
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    return _source && _source->selectWindow(windowHandle);
 }
 
 // Get list of windows
-std::vector<std::pair<HWND, std::string>> ScreenCapture::getWindowList() {
-    std::vector<std::pair<HWND, std::string>> windows;
-    
-    // Callback for EnumWindows
-    auto windowCallback = [](HWND hwnd, LPARAM lParam) -> BOOL {
-        auto windowsPtr = reinterpret_cast<std::vector<std::pair<HWND, std::string>>*>(lParam);
-        
-        // Skip invisible windows
-        if (!IsWindowVisible(hwnd)) {
-            return TRUE;
+std::vector<std::pair<WindowHandle, std::string>> ScreenCapture::getWindowList() {
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    return _source ? _source->getWindowList() : std::vector<std::pair<WindowHandle, std::string>>();
         }
         
-        // Get window title
-        char title[256];
-        int length = GetWindowTextA(hwnd, title, sizeof(title));
-        
-        if (length > 0) {
-            windowsPtr->push_back({hwnd, std::string(title)});
+// Start recording raw frames
+bool ScreenCapture::startRecording(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    _recorder.close();
+    _recordPath = path;
+    return !_recordPath.empty();
         }
         
-        return TRUE; // Continue enumeration
-    };
-    
-    // Enumerate windows
-    EnumWindows(windowCallback, reinterpret_cast<LPARAM>(&windows));
+// Stop recording raw frames
+void ScreenCapture::stopRecording() {
+    std::lock_guard<std::mutex> lock(_sourceMutex);
+    _recorder.close();
+    _recordPath.clear();
+}
     
-    return windows;
+// Get pipeline statistics
+ScreenCapture::Stats ScreenCapture::getStats() {
+    CaptureScheduler::Stats ticks = _scheduler.getStats();
+
+    std::array<FrameEncoder::Cost, FrameEncoder::kCodecCount> costs{};
+    {
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        for (size_t i = 0; i < FrameEncoder::kCodecCount; i++) {
+            if (_frameEncoders[i]) {
+                FrameEncoder::Cost cost = _frameEncoders[i]->getCost();
+                costs[i].frames = cost.frames - _codecCostsAtStart[i].frames;
+                costs[i].bytes = cost.bytes - _codecCostsAtStart[i].bytes;
+                costs[i].totalMs = cost.totalMs - _codecCostsAtStart[i].totalMs;
+            }
+            costs[i].frames += _profileCosts[i].frames;
+            costs[i].bytes += _profileCosts[i].bytes;
+            costs[i].totalMs += _profileCosts[i].totalMs;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    Stats stats = _stats;
+    stats.codecCosts = costs;
+    stats.missedTicks = ticks.missedTicks;
+    stats.totalLatenessMs = ticks.totalLatenessMs;
+    stats.maxLatenessMs = ticks.maxLatenessMs;
+    return stats;
 }
 
-// Main capture loop
+// Capture stage: grab a frame on every scheduler tick
 void ScreenCapture::captureLoop() {
+    std::chrono::steady_clock::time_point nextIdleGrab{};
+    // Only the encode stage returns buffers to the free ring, a failed grab keeps its buffer here
+    RawFrame* spare = nullptr;
+    while (_running && _scheduler.waitNextTick()) {
+        int64_t burstRequestedNs = _burstRequestedNs.exchange(0);
+        if (burstRequestedNs != 0) {
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            std::lock_guard<std::mutex> lock(_statsMutex);
+            _stats.bursts++;
+            _stats.totalBurstDelayMs += (now - burstRequestedNs) / 1e6;
+        }
+
+        // An idle screen is polled at a lower rate until something changes, input may
+        // not show up on the first frames after it so bursts are never throttled
+        int idleIntervalMs = _idleCaptureIntervalMs;
+        if (idleIntervalMs > 0 && !_scheduler.isBursting()) {
+            auto now = std::chrono::steady_clock::now();
+            if (now < nextIdleGrab) {
+                continue;
+            }
+            nextIdleGrab = now + std::chrono::milliseconds(idleIntervalMs);
+        }
+
+        if (!_capturedFrames.empty() || (!spare && !_freeFrames.tryPop(spare))) {
+            // The encoder has not taken the last frame yet, a new grab would only replace it;
+            // skip this tick and let the source keep accumulating damage
+            std::lock_guard<std::mutex> lock(_statsMutex);
+            _stats.droppedFrames++;
+        } else if (captureRaw(*spare)) {
+            _capturedFrames.tryPush(spare);
+            spare = nullptr;
+            _encodeSignal.notify();
+        }
+    }
+}
+
+// Encode stage: encode the newest captured frame
+void ScreenCapture::encodeLoop() {
     while (_running) {
-        auto startTime = std::chrono::steady_clock::now();
-        
-        // Capture frame
-        FrameData frame = captureScreen();
+        {
+            std::unique_lock<std::mutex> lock(_encodeSignal.mutex);
+            _encodeSignal.condition.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return !_capturedFrames.empty() || !_running;
+            });
+        }
+
+        // Older queued frames are stale, only the newest is worth encoding
+        RawFrame* frame = nullptr;
+        RawFrame* next = nullptr;
+        int dropped = 0;
+        while (_capturedFrames.tryPop(next)) {
+            if (frame) {
+                carryDamage(*frame);
+                _freeFrames.tryPush(frame);
+                dropped++;
+            }
+            frame = next;
+        }
+        if (!frame) continue;
+
+        // Delivery is behind, encoding now would only queue more stale output
+        if (_encodedFrames.full()) {
+            carryDamage(*frame);
+            _freeFrames.tryPush(frame);
+            dropped++;
+        } else {
+            applyCarriedDamage(*frame);
+            FrameData encoded = encodeFrame(*frame);
+            _freeFrames.tryPush(frame);
+
+            _encodedFrames.tryPush(std::move(encoded));
+            _deliverSignal.notify();
+        }
+
+        if (dropped > 0) {
+            std::lock_guard<std::mutex> lock(_statsMutex);
+            _stats.droppedFrames += dropped;
+        }
+    }
+}
+
+// Delivery stage: hand encoded frames to the callback
+void ScreenCapture::deliverLoop() {
+    while (_running) {
+        {
+            std::unique_lock<std::mutex> lock(_deliverSignal.mutex);
+            _deliverSignal.condition.wait_for(lock, std::chrono::milliseconds(100), [this] {
+                return !_encodedFrames.empty() || _cursorPending || !_running;
+            });
+        }
+
+        // Pointer updates go out ahead of frames, they are tiny and only the latest matters
+        if (_cursorPending.exchange(false)) {
+            std::map<std::pair<int, int>, CursorEncoder::Update> cursors;
+            {
+                std::lock_guard<std::mutex> lock(_cursorMutex);
+                cursors.swap(_pendingCursors);
+            }
+            if (_cursorCallback) {
+                for (const auto& [size, cursor] : cursors) {
+                _cursorCallback(cursor);
+            }
+        }
+        }
+
+        FrameData frame;
+        FrameEncoder::Buffer thumbnail;
+        while (_running && _encodedFrames.tryPop(frame)) {
+            // A newer thumbnail replaces older ones, a dropped one goes out with the next frame
+            if (frame.thumbnail) {
+                thumbnail = frame.thumbnail;
+            }
+
+            // Only whole JPEG-mode frames stand alone, so a newer one makes older ones redundant;
+            // tile updates, lossless deltas and H.264 access units build on the frames before them
+            // and are always delivered, load is shed by skipping frames before they are encoded
+            if (frame.mode == EncodingMode::JPEG && !frame.tiles && !_encodedFrames.empty()) {
+                std::lock_guard<std::mutex> lock(_statsMutex);
+                _stats.droppedFrames++;
+                continue;
+            }
+            frame.thumbnail = std::move(thumbnail);
         
-        // Notify callback
-        if (_frameCallback && !frame.jpegData.empty()) {
+            if (_frameCallback && ((frame.data && !frame.data->empty()) || frame.tiles || frame.heartbeat ||
+                                   frame.thumbnail)) {
+            auto callbackStart = std::chrono::steady_clock::now();
             _frameCallback(frame);
+
+            std::lock_guard<std::mutex> lock(_statsMutex);
+            _stats.totalCallbackMs += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - callbackStart).count();
         }
         
         // Store latest frame
-        {
             std::lock_guard<std::mutex> lock(_frameMutex);
             _latestFrame = std::move(frame);
             _frameReady = true;
             _frameCondition.notify_one();
         }
-        
-        // Calculate time to wait
-        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - startTime).count();
-        
-        int waitTime = _captureIntervalMs - static_cast<int>(elapsedTime);
-        
-        if (waitTime > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(waitTime));
         }
+}
+
+// Cursor stage: poll the pointer at its own rate
+void ScreenCapture::cursorLoop() {
+    CursorState state;
+    std::map<std::pair<int, int>, CursorEncoder> encoders;    // By frame size
+    while (_running) {
+        double fps = _cursorFps;
+        auto interval = fps > 0.0 ? std::chrono::microseconds(static_cast<int64_t>(1e6 / fps))
+                                  : std::chrono::microseconds(100000);
+        {
+            std::unique_lock<std::mutex> lock(_cursorSignal.mutex);
+            _cursorSignal.condition.wait_for(lock, interval, [this] { return !_running; });
+        }
+        if (!_running || fps <= 0.0 || !_cursorCallback) {
+            continue;
+        }
+
+        bool grabbed = false;
+        {
+            std::lock_guard<std::mutex> lock(_sourceMutex);
+            grabbed = _source && _source->grabCursor(state);
+        }
+        if (!grabbed) {
+            continue;
+        }
+
+        std::vector<CursorOutput> outputs;
+        {
+            std::lock_guard<std::mutex> lock(_cursorMutex);
+            outputs = _cursorOutputs;
+        }
+        for (auto it = encoders.begin(); it != encoders.end();) {
+            bool listed = std::any_of(outputs.begin(), outputs.end(), [&it](const CursorOutput& output) {
+                return it->first == std::make_pair(output.frameWidth, output.frameHeight);
+            });
+            it = listed ? std::next(it) : encoders.erase(it);
+        }
+
+        // Positions are relative to the viewport, like the frames, and scaled to each frame size
+        bool resend = _cursorResend.exchange(false);
+        state.x -= _cursorOffsetX;
+        state.y -= _cursorOffsetY;
+        std::vector<CursorEncoder::Update> updates;
+        for (const CursorOutput& output : outputs) {
+            CursorEncoder& encoder = encoders[{output.frameWidth, output.frameHeight}];
+            if (resend) {
+                encoder.invalidate();
+            }
+            if (encoder.update(state, output.scaleX, output.scaleY)) {
+                updates.push_back(encoder.getUpdate());
+                updates.back().frameWidth = output.frameWidth;
+                updates.back().frameHeight = output.frameHeight;
+            }
+        }
+        if (updates.empty()) {
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_cursorMutex);
+            for (CursorEncoder::Update& update : updates) {
+                _pendingCursors[{update.frameWidth, update.frameHeight}] = std::move(update);
+            }
+        }
+        _cursorPending = true;
+        _deliverSignal.notify();
+
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats.cursorUpdates += updates.size();
+    }
+}
+
+// Remember the damage of a frame that will not be encoded
+void ScreenCapture::carryDamage(const RawFrame& skipped) {
+    if (!skipped.dirtyRectsValid) {
+        _carriedDirtyValid = false;
+    } else {
+        _carriedDirtyRects.insert(_carriedDirtyRects.end(), skipped.dirtyRects.begin(), skipped.dirtyRects.end());
     }
+    _hasCarriedDamage = true;
+}
+
+// Merge damage of skipped frames into the frame about to be encoded
+void ScreenCapture::applyCarriedDamage(RawFrame& raw) {
+    if (!_hasCarriedDamage) {
+        return;
+    }
+
+    if (!_carriedDirtyValid) {
+        raw.dirtyRectsValid = false;
+    } else if (raw.dirtyRectsValid) {
+        raw.dirtyRects.insert(raw.dirtyRects.end(), _carriedDirtyRects.begin(), _carriedDirtyRects.end());
+    }
+
+    _carriedDirtyRects.clear();
+    _carriedDirtyValid = true;
+    _hasCarriedDamage = false;
 }
 
 // Capture a single frame now
 ScreenCapture::FrameData ScreenCapture::captureFrame() {
     if (_running) {
-        // Wait for next frame from capture thread
+        // Wait for next frame from capture thread, a static screen is resent for it
+        _resendRequested = true;
+        _idleCaptureIntervalMs = 0;
         std::unique_lock<std::mutex> lock(_frameMutex);
         _frameReady = false;
         _frameCondition.wait(lock, [this] { return _frameReady || !_running; });
@@ -242,242 +745,543 @@ ScreenCapture::FrameData ScreenCapture::captureFrame() {
     }
 }
 
-// Internal screen capture implementation
+// Capture and encode synchronously
 ScreenCapture::FrameData ScreenCapture::captureScreen() {
+    if (!captureRaw(_rawFrame)) {
     FrameData frame;
+    frame.width = 0;
+    frame.height = 0;
     frame.quality = _quality;
     frame.timestamp = std::chrono::system_clock::now();
+        return frame;
+    }
+
+    // The caller wants an image even if the screen has not changed
+    _resendRequested = true;
+    return encodeFrame(_rawFrame);
+}
     
-    HDC hdcScreen;
-    HDC hdcMemDC = NULL;
-    HBITMAP hbmScreen = NULL;
-    RECT rcClient;
+// Grab a raw frame from the source
+bool ScreenCapture::captureRaw(RawFrame& raw) {
+    auto captureStart = std::chrono::steady_clock::now();
+    bool captured = false;
+    {
+        std::lock_guard<std::mutex> lock(_sourceMutex);
+
+        // Sources without damage tracking leave this unset
+        raw.dirtyRects.clear();
+        raw.dirtyRectsValid = false;
+
+        if (!_source) {
+            std::cerr << "Error in screen capture: no capture source" << std::endl;
+        } else if (_source->grab(raw)) {
+            captured = true;
+            raw.sequence = ++_sequence;
+            raw.timestamp = std::chrono::system_clock::now();
     
-    try {
-        // Get device context based on capture mode
-        if (_captureWindow && _targetWindow != NULL) {
-            // Capture specific window
-            hdcScreen = GetDC(_targetWindow);
-            GetClientRect(_targetWindow, &rcClient);
-        } else {
-            // Capture monitor or primary display
-            hdcScreen = CreateDC(TEXT("DISPLAY"), NULL, NULL, NULL);
-            
-            // Get monitor bounds
-            int monitorCount = GetSystemMetrics(SM_CMONITORS);
-            if (_monitorIndex >= monitorCount) {
-                _monitorIndex = 0; // Default to primary monitor
+            if (!_recordPath.empty()) {
+                if (!_recorder.isOpen()) {
+                    _recorder.open(_recordPath, raw.width, raw.height);
             }
-            
-            if (_monitorIndex == 0) {
-                // Primary monitor
-                rcClient.left = 0;
-                rcClient.top = 0;
-                rcClient.right = GetSystemMetrics(SM_CXSCREEN);
-                rcClient.bottom = GetSystemMetrics(SM_CYSCREEN);
-            } else {
-                // Specific monitor by index
-                // We need to enumerate monitors to find the correct one
-                struct MonitorData {
-                    int targetIndex;
-                    int currentIndex;
-                    RECT bounds;
-                    bool found;
-                };
-                
-                MonitorData data = {_monitorIndex, 0, {0}, false};
-                
-                auto monitorCallback = [](HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData) -> BOOL {
-                    auto dataPtr = reinterpret_cast<MonitorData*>(dwData);
-                    
-                    if (dataPtr->currentIndex == dataPtr->targetIndex) {
-                        dataPtr->bounds = *lprcMonitor;
-                        dataPtr->found = true;
-                        return FALSE; // Stop enumeration
-                    }
-                    
-                    dataPtr->currentIndex++;
-                    return TRUE; // Continue enumeration
-                };
-                
-                EnumDisplayMonitors(NULL, NULL, monitorCallback, reinterpret_cast<LPARAM>(&data));
-                
-                if (data.found) {
-                    rcClient = data.bounds;
-                } else {
-                    // Fallback to primary monitor
-                    rcClient.left = 0;
-                    rcClient.top = 0;
-                    rcClient.right = GetSystemMetrics(SM_CXSCREEN);
-                    rcClient.bottom = GetSystemMetrics(SM_CYSCREEN);
+                _recorder.write(raw);
                 }
             }
         }
-        
-        // Create a compatible DC
-        hdcMemDC = CreateCompatibleDC(hdcScreen);
-        if (!hdcMemDC) {
-            throw std::runtime_error("Failed to create compatible DC");
+
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    if (captured) {
+        _stats.capturedFrames++;
+        _stats.totalCaptureMs += std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - captureStart).count();
+    } else {
+        _stats.failedCaptures++;
+    }
+    return captured;
+}
+
+// Encode a raw frame
+ScreenCapture::FrameData ScreenCapture::encodeFrame(const RawFrame& captured) {
+    auto encodeStart = std::chrono::steady_clock::now();
+
+    FrameData frame;
+    bool resend = _resendRequested.exchange(false);
+
+    // Crop to the viewport and downscale to the requested output size, the encoders only see the result
+    const RawFrame* scaled = &captured;
+    CaptureRect viewport;
+    {
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        if (_scaler.scale(captured, _scaledFrame)) {
+            scaled = &_scaledFrame;
         }
-        
-        // Create a compatible bitmap
-        frame.width = rcClient.right - rcClient.left;
-        frame.height = rcClient.bottom - rcClient.top;
-        
-        hbmScreen = CreateCompatibleBitmap(hdcScreen, frame.width, frame.height);
-        if (!hbmScreen) {
-            throw std::runtime_error("Failed to create compatible bitmap");
+        viewport = _scaler.getLastCrop();
+        if (viewport.width != captured.width || viewport.height != captured.height) {
+            frame.viewport = viewport;
+            encodeThumbnail(captured, resend, frame);
         }
-        
-        // Select the bitmap into the compatible DC
-        HBITMAP hbmOld = (HBITMAP)SelectObject(hdcMemDC, hbmScreen);
-        
-        // Copy from the screen DC to the memory DC
-        if (!BitBlt(hdcMemDC, 0, 0, frame.width, frame.height,
-                    hdcScreen, rcClient.left, rcClient.top, SRCCOPY | CAPTUREBLT)) {
-            throw std::runtime_error("BitBlt failed");
+    }
+    const RawFrame& raw = *scaled;
+    _screenWidth = captured.width;
+    _screenHeight = captured.height;
+
+    frame.width = raw.width;
+    frame.height = raw.height;
+    frame.screenWidth = captured.width;
+    frame.screenHeight = captured.height;
+    frame.quality = _quality;
+    frame.mode = _encodingMode;
+    frame.timestamp = raw.timestamp;
+    frame.burst = _scheduler.isBursting();
+
+    // Sources that track damage report an empty list when nothing changed
+    bool sourceStatic = raw.dirtyRectsValid && raw.dirtyRects.empty();
+    bool unchanged = false;
+    TileEncoder::TileCounts tileCounts;
+
+        if (frame.mode == EncodingMode::TILES) {
+        // Only changed tiles are sent; an empty result means nothing to send. A frame the
+        // source reports static has none, so skip the tile scan unless a keyframe is due
+            std::lock_guard<std::mutex> lock(_encoderMutex);
+            auto tiles = std::make_shared<TileFrame>();
+        if (_tileEncoder && (!sourceStatic || resend) &&
+            _tileEncoder->encode(raw, frame.quality, *tiles, _tileCacheQuery)) {
+                frame.keyframe = tiles->keyframe;
+                frame.tiles = std::move(tiles);
+            tileCounts = _tileEncoder->getLastTileCounts();
+            }
+            unchanged = !frame.tiles;
+    } else if (frame.mode == EncodingMode::LOSSLESS) {
+        // Exact deltas against the previous frame, so every client has to apply all of them
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        auto message = std::make_shared<std::vector<uint8_t>>();
+        if (_losslessEncoder && (!sourceStatic || resend) &&
+            _losslessEncoder->encode(raw, *_encodeWorkers, *message)) {
+            frame.keyframe = _losslessEncoder->lastWasKeyframe();
+            frame.data = std::move(message);
         }
-        
-        // Get the bitmap info
-        BITMAPINFOHEADER bi;
-        bi.biSize = sizeof(BITMAPINFOHEADER);
-        bi.biWidth = frame.width;
-        bi.biHeight = -frame.height;  // Negative height for top-down DIB
-        bi.biPlanes = 1;
-        bi.biBitCount = 32;
-        bi.biCompression = BI_RGB;
-        bi.biSizeImage = 0;
-        bi.biXPelsPerMeter = 0;
-        bi.biYPelsPerMeter = 0;
-        bi.biClrUsed = 0;
-        bi.biClrImportant = 0;
-        
-        // Get the DIB bits
-        BYTE* lpBits = new BYTE[frame.width * frame.height * 4];
-        GetDIBits(hdcMemDC, hbmScreen, 0, frame.height, lpBits,
-                 (BITMAPINFO*)&bi, DIB_RGB_COLORS);
-        
-        // Compress to JPEG
-        frame.jpegData = compressToJpeg(lpBits, frame.width, frame.height, 
-                                        frame.width * 4, frame.quality);
-        
-        // Cleanup
-        delete[] lpBits;
-        SelectObject(hdcMemDC, hbmOld);
-        DeleteObject(hbmScreen);
-        DeleteDC(hdcMemDC);
-        
-        if (_captureWindow) {
-            ReleaseDC(_targetWindow, hdcScreen);
+        frame.quality = 100;
+        unchanged = !frame.data;
+    } else if (frame.mode == EncodingMode::VIDEO) {
+        // Inter-coded like lossless frames; the quality sets the bitrate unless a target is given
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        auto message = std::make_shared<std::vector<uint8_t>>();
+        if (_videoEncoder && (!sourceStatic || resend)) {
+            _videoEncoder->setTargetBitrate(_targetBitrateKbps);
+            if (_videoEncoder->encode(raw, frame.quality, _scheduler.getFrameRate(), *_encodeWorkers, *message)) {
+                frame.keyframe = _videoEncoder->lastWasKeyframe();
+                frame.data = std::move(message);
+            }
+        }
+        unchanged = !frame.data;
         } else {
-            DeleteDC(hdcScreen);
+            std::lock_guard<std::mutex> lock(_encoderMutex);
+        if (_outputProfiles.empty()) {
+        encodeImages(raw, frame, unchanged);
+        } else {
+            encodeProfiles(raw, frame, unchanged);
         }
+    }
+
+    // The pointer follows every frame size clients receive
+    if (viewport.width > 0 && viewport.height > 0) {
+        std::vector<CursorOutput> outputs;
+        outputs.push_back({raw.width, raw.height, static_cast<double>(raw.width) / viewport.width,
+                           static_cast<double>(raw.height) / viewport.height});
+        for (const ProfileImage& entry : frame.profileImages) {
+            bool listed = std::any_of(outputs.begin(), outputs.end(), [&entry](const CursorOutput& output) {
+                return output.frameWidth == entry.width && output.frameHeight == entry.height;
+            });
+            if (!listed && entry.image) {
+                outputs.push_back({entry.width, entry.height, static_cast<double>(entry.width) / viewport.width,
+                                   static_cast<double>(entry.height) / viewport.height});
+            }
+        }
+        _cursorOffsetX = viewport.x;
+        _cursorOffsetY = viewport.y;
+        std::lock_guard<std::mutex> lock(_cursorMutex);
+        _cursorOutputs = std::move(outputs);
+    }
         
-    } catch (const std::exception& e) {
-        std::cerr << "Error in screen capture: " << e.what() << std::endl;
-        
-        // Cleanup on error
-        if (hbmScreen) DeleteObject(hbmScreen);
-        if (hdcMemDC) DeleteDC(hdcMemDC);
+    handleStaticFrame(raw, unchanged, resend, frame);
+
+    auto encodeEnd = std::chrono::steady_clock::now();
         
-        if (_captureWindow && hdcScreen) {
-            ReleaseDC(_targetWindow, hdcScreen);
-        } else if (hdcScreen) {
-            DeleteDC(hdcScreen);
+    std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats.frames++;
+    _stats.totalBytes += frame.tiles ? frame.tiles->encodedBytes() : frame.data ? frame.data->size() : 0;
+    _stats.totalQuality += frame.quality;
+        _stats.copyRects += frame.tiles ? frame.tiles->copies.size() : 0;
+    _stats.paletteTiles += tileCounts.palette;
+    _stats.textTiles += tileCounts.text;
+    _stats.photoTiles += tileCounts.photo;
+    _stats.videoTiles += tileCounts.video;
+        _stats.totalEncodeMs += std::chrono::duration<double, std::milli>(encodeEnd - encodeStart).count();
+
+        if (unchanged) {
+            _stats.unchangedFrames++;
         }
+    if (frame.heartbeat) {
+        _stats.heartbeats++;
+    }
+    if (frame.refinement) {
+        _stats.refinements++;
+    }
+    if (frame.thumbnail) {
+        _stats.thumbnails++;
+        _stats.thumbnailBytes += frame.thumbnail->size();
     }
+
+        // Fraction of the frame reported as changed by the source
+        double dirtyArea = 1.0;
+    if (raw.dirtyRectsValid && raw.width > 0 && raw.height > 0) {
+            double pixels = 0.0;
+        for (const CaptureRect& rect : raw.dirtyRects) {
+                pixels += static_cast<double>(rect.width) * rect.height;
+            }
+        dirtyArea = std::min(1.0, pixels / (static_cast<double>(raw.width) * raw.height));
+        }
+        _stats.totalDirtyFraction += dirtyArea;
     
     return frame;
 }
 
-// Compress raw pixels to JPEG
-std::vector<uint8_t> ScreenCapture::compressToJpeg(BYTE* data, int width, int height, 
-                                                 int stride, int quality) {
-    std::vector<uint8_t> jpegData;
-    
-#ifdef HAVE_TURBOJPEG
-    tjhandle jpegCompressor = tjInitCompress();
-    
-    if (!jpegCompressor) {
-        std::cerr << "TurboJPEG initialization failed" << std::endl;
-        return jpegData;
+// Encode a whole-screen thumbnail
+void ScreenCapture::encodeThumbnail(const RawFrame& captured, bool force, FrameData& frame) {
+    if (!captured.dirtyRectsValid || !captured.dirtyRects.empty()) {
+        _thumbnailDirty = true;
     }
-    
-    unsigned char* jpegBuf = NULL;
-    unsigned long jpegSize = 0;
-    
-    // Convert BGRA to RGB for libjpeg
-    std::vector<uint8_t> rgbData(width * height * 3);
-    
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            BYTE* pixel = data + y * stride + x * 4;
-            int rgbIndex = (y * width + x) * 3;
-            
-            // BGRA to RGB conversion
-            rgbData[rgbIndex] = pixel[2];     // R
-            rgbData[rgbIndex + 1] = pixel[1]; // G
-            rgbData[rgbIndex + 2] = pixel[0]; // B
+    if (_thumbnailFps <= 0.0 || !_thumbnailEncoder || (!_thumbnailDirty && !force)) {
+        return;
+    }
+
+    // Thumbnails of a changing screen are rate limited, a new client gets one right away
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - _lastThumbnailTime < std::chrono::duration<double>(1.0 / _thumbnailFps)) {
+        return;
+    }
+
+    const RawFrame* image = &captured;
+    if (_thumbnailScaler.scale(captured, _thumbnailFrame)) {
+        image = &_thumbnailFrame;
+    }
+
+    int quality = kThumbnailQuality;
+    bool unchanged = false;
+    FrameEncoder::Buffer jpeg = _thumbnailEncoder->encode(*image, kThumbnailQuality, *_encodeWorkers, quality, unchanged);
+    if (!jpeg) {
+        return;
+    }
+
+    auto message = std::make_shared<std::vector<uint8_t>>();
+    message->reserve(5 + jpeg->size());
+    frame_protocol::MessageWriter writer(*message);
+    writer.put8(frame_protocol::MESSAGE_THUMBNAIL);
+    writer.put16(static_cast<uint16_t>(image->width));
+    writer.put16(static_cast<uint16_t>(image->height));
+    writer.putBytes(jpeg->data(), jpeg->size());
+
+    frame.thumbnail = std::move(message);
+    _thumbnailDirty = false;
+    _lastThumbnailTime = now;
+}
+
+// Encode a whole frame in every image codec
+void ScreenCapture::encodeImages(const RawFrame& raw, FrameData& frame, bool& unchanged) {
+    FrameEncoder::Codec primary = _imageCodecs.front();
+    frame.codec = primary;
+
+    bool reusable = _lastImageWidth == raw.width && _lastImageHeight == raw.height;
+    for (FrameEncoder::Codec codec : _imageCodecs) {
+        reusable &= _lastImages[static_cast<size_t>(codec)] != nullptr;
+    }
+
+    // Nothing was damaged since the last frame, so the previous images are still exact;
+    // a new quality applies from the next change, a static screen gets the refinement instead
+    unchanged = reusable && raw.dirtyRectsValid && raw.dirtyRects.empty();
+
+    if (!unchanged) {
+        size_t byteBudget = frameByteBudget();
+
+        // The first codec's encoder may find the pixels unchanged, then the others are skipped
+        int requested = frame.quality;
+        for (FrameEncoder::Codec codec : _imageCodecs) {
+            FrameEncoder& encoder = *_frameEncoders[static_cast<size_t>(codec)];
+            QualitySearch* search = encoder.getQualitySearch();
+            if (search && byteBudget > 0) {
+                search->setByteBudget(byteBudget);
+            }
+
+            int quality = requested;
+            bool same = false;
+            frame.images[static_cast<size_t>(codec)] = encoder.encode(raw, requested, *_encodeWorkers, quality, same);
+            if (codec == primary) {
+                frame.quality = quality;
+                unchanged = same && reusable;
+                if (unchanged) {
+                    break;
+                }
+            }
         }
     }
-    
-    // Compress to JPEG
-    int result = tjCompress2(jpegCompressor, rgbData.data(), width, 0, height,
-                            TJPF_RGB, &jpegBuf, &jpegSize, TJSAMP_420, quality,
-                            TJFLAG_FASTDCT);
-    
-    if (result == 0 && jpegBuf && jpegSize > 0) {
-        jpegData.resize(jpegSize);
-        std::memcpy(jpegData.data(), jpegBuf, jpegSize);
+
+    if (unchanged) {
+        frame.images = _lastImages;
+        frame.quality = _lastImageQuality;
     } else {
-        std::cerr << "JPEG compression failed: " << tjGetErrorStr2(jpegCompressor) << std::endl;
+        _lastImages = frame.images;
+        _lastImageQuality = frame.quality;
+        _lastImageWidth = raw.width;
+        _lastImageHeight = raw.height;
     }
-    
-    if (jpegBuf) {
-        tjFree(jpegBuf);
+    frame.data = frame.images[static_cast<size_t>(primary)];
+}
+
+// Encode a whole frame once per output profile
+void ScreenCapture::encodeProfiles(const RawFrame& raw, FrameData& frame, bool& unchanged) {
+    size_t byteBudget = frameByteBudget();
+    unchanged = true;
+
+    // Size of each profile's level, the output frame fitted to its size and scale
+    std::vector<std::pair<int, int>> sizes(_outputProfiles.size());
+    for (size_t i = 0; i < _outputProfiles.size(); i++) {
+        FrameScaler fit;
+        fit.setTargetSize(_outputProfiles[i].maxWidth, _outputProfiles[i].maxHeight);
+        fit.setScaleFactor(_outputProfiles[i].scale);
+        fit.getOutputSize(raw.width, raw.height, sizes[i].first, sizes[i].second);
     }
-    
-    tjDestroy(jpegCompressor);
-#else
-    // GDI+ fallback implementation
-    // Create a GDI+ bitmap from raw data
-    Gdiplus::Bitmap bitmap(width, height, stride, PixelFormat32bppARGB, data);
-    
-    // Setup encoder parameters for JPEG quality
-    Gdiplus::EncoderParameters encoderParams;
-    encoderParams.Count = 1;
-    encoderParams.Parameter[0].Guid = Gdiplus::EncoderQuality;
-    encoderParams.Parameter[0].Type = Gdiplus::EncoderParameterValueTypeLong;
-    encoderParams.Parameter[0].NumberOfValues = 1;
-    ULONG qualityValue = quality;
-    encoderParams.Parameter[0].Value = &qualityValue;
-    
-    // Get JPEG encoder CLSID
-    CLSID jpegClsid;
-    GetEncoderClsid(L"image/jpeg", &jpegClsid);
-    
-    // Create a memory stream to save the JPEG
-    IStream* stream = NULL;
-    if (CreateStreamOnHGlobal(NULL, TRUE, &stream) == S_OK) {
-        // Save bitmap to stream as JPEG
-        if (bitmap.Save(stream, &jpegClsid, &encoderParams) == Gdiplus::Ok) {
-            // Get stream size
-            STATSTG stats;
-            if (stream->Stat(&stats, STATFLAG_NONAME) == S_OK) {
-                // Copy stream data to vector
-                LARGE_INTEGER seekPos = {0};
-                stream->Seek(seekPos, STREAM_SEEK_SET, NULL);
-                
-                jpegData.resize(stats.cbSize.LowPart);
-                ULONG bytesRead;
-                stream->Read(jpegData.data(), stats.cbSize.LowPart, &bytesRead);
+    for (auto it = _profileLevels.begin(); it != _profileLevels.end();) {
+        bool used = std::find(sizes.begin(), sizes.end(), it->first) != sizes.end();
+        it = used ? std::next(it) : _profileLevels.erase(it);
+    }
+    for (const auto& size : sizes) {
+        _profileLevels[size];
+    }
+
+    // Scale each level from the next larger one, so every size costs about one read of a smaller frame
+    const RawFrame* larger = &raw;
+    for (auto& [size, level] : _profileLevels) {
+        std::pair<int, int> source(larger->width, larger->height);
+        if (level.source != source) {
+            // Scaled from another level than last time, nothing in the old output carries over
+            level.frame = RawFrame();
+            level.source = source;
+        }
+        level.scaler.setTargetSize(size.first, size.second);
+        level.image = level.scaler.scale(*larger, level.frame) ? &level.frame : larger;
+        larger = level.image;
+    }
+
+    // Encode each distinct level, quality and codec once, profiles sharing one share its image
+    for (auto& [key, slot] : _profileEncoders) {
+        slot.used = false;
+    }
+    frame.profileImages.clear();
+    _profileKeys.clear();
+    int firstQuality = frame.quality;
+    for (size_t i = 0; i < _outputProfiles.size(); i++) {
+        const OutputProfile& profile = _outputProfiles[i];
+        ProfileKey key(sizes[i].first, sizes[i].second, profile.quality, profile.codec);
+        ProfileEncoder& slot = _profileEncoders[key];
+        if (!slot.used) {
+            slot.used = true;
+            if (!slot.encoder) {
+                slot.encoder = createFrameEncoder(profile.codec);
+                QualitySearch* search = slot.encoder->getQualitySearch();
+                if (search && _psnrFloor > 0.0) {
+                    search->setPsnrFloor(_psnrFloor);
+                }
             }
+            slot.image = _profileLevels[sizes[i]].image;
+
+            // An undamaged level keeps its image, a new quality applies from the next change
+            const RawFrame& image = *slot.image;
+            bool reusable = slot.lastImage && slot.lastWidth == image.width && slot.lastHeight == image.height;
+            bool same = reusable && image.dirtyRectsValid && image.dirtyRects.empty();
+            if (!same) {
+                QualitySearch* search = slot.encoder->getQualitySearch();
+                if (search && byteBudget > 0) {
+                    search->setByteBudget(byteBudget);
+                }
+
+                FrameEncoder::Cost before = slot.encoder->getCost();
+                int quality = profile.quality;
+                bool encoderSame = false;
+                FrameEncoder::Buffer encoded = slot.encoder->encode(image, profile.quality, *_encodeWorkers, quality,
+                                                                    encoderSame);
+                FrameEncoder::Cost after = slot.encoder->getCost();
+                FrameEncoder::Cost& cost = _profileCosts[static_cast<size_t>(profile.codec)];
+                cost.frames += after.frames - before.frames;
+                cost.bytes += after.bytes - before.bytes;
+                cost.totalMs += after.totalMs - before.totalMs;
+
+                same = encoderSame && reusable;
+                if (!same && encoded) {
+                    slot.lastImage = std::move(encoded);
+                    slot.lastQuality = quality;
+                    slot.lastWidth = image.width;
+                    slot.lastHeight = image.height;
+                }
+            }
+            unchanged &= same;
         }
-        
-        // Release stream
-        stream->Release();
+
+        if (i == 0) {
+            firstQuality = slot.lastQuality;
+        }
+        frame.profileImages.push_back({profile, slot.lastImage, slot.lastWidth, slot.lastHeight});
+        _profileKeys.push_back(key);
     }
-#endif
-    
-    return jpegData;
-}
\ No newline at end of file
+
+    // Profiles nobody uses any more
+    for (auto it = _profileEncoders.begin(); it != _profileEncoders.end();) {
+        it = it->second.used ? std::next(it) : _profileEncoders.erase(it);
+    }
+
+    const ProfileImage& first = frame.profileImages.front();
+    frame.data = first.image;
+    frame.codec = first.profile.codec;
+    frame.quality = firstQuality;
+    frame.width = first.width;
+    frame.height = first.height;
+}
+
+// Budget one frame under the bitrate target
+size_t ScreenCapture::frameByteBudget() {
+    // Bursts are short and mostly unchanged frames, the base rate sets the budget
+    if (_targetBitrateKbps <= 0) {
+        return 0;
+    }
+    double fps = std::max(1.0, _scheduler.getFrameRate());
+    return static_cast<size_t>(_targetBitrateKbps * 125.0 / fps);
+}
+
+// Decide what to send for a possibly unchanged frame
+void ScreenCapture::handleStaticFrame(const RawFrame& raw, bool unchanged, bool resend, FrameData& frame) {
+    auto now = std::chrono::steady_clock::now();
+    IdleOptions options;
+    {
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        options = _idleOptions;
+    }
+
+    if (!unchanged) {
+        _staticSince = now;
+        _lastSendTime = now;
+        _refined = false;
+        _idleCaptureIntervalMs = 0;
+        return;
+    }
+
+    bool idle = now - _staticSince >= std::chrono::milliseconds(options.idleDelayMs);
+    _idleCaptureIntervalMs = idle && options.idleFps > 0.0 ? std::max(1, static_cast<int>(1000.0 / options.idleFps)) : 0;
+
+    // Once idle, send the screen again at high quality so text is crisp
+    if (idle && !_refined && options.refineQuality > 0) {
+        _refined = true;
+        if (encodeRefinement(raw, options.refineQuality, frame)) {
+            _lastSendTime = now;
+            return;
+        }
+    }
+
+    // Otherwise clients only hear that the stream is alive, unless one asked for the image
+    if (resend || (options.heartbeatMs > 0 && now - _lastSendTime >= std::chrono::milliseconds(options.heartbeatMs))) {
+        frame.heartbeat = true;
+        _lastSendTime = now;
+        return;
+    }
+
+    frame.data.reset();
+    frame.images = {};
+    frame.profileImages.clear();
+}
+
+// Encode the static screen at high quality
+bool ScreenCapture::encodeRefinement(const RawFrame& raw, int quality, FrameData& frame) {
+    if (frame.mode == EncodingMode::LOSSLESS) {
+        // Already exact
+        return false;
+    } else if (frame.mode == EncodingMode::VIDEO) {
+        // A keyframe at the refinement quality replaces the blur left by rate control
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        auto message = std::make_shared<std::vector<uint8_t>>();
+        if (!_videoEncoder) {
+            return false;
+        }
+        _videoEncoder->setTargetBitrate(0);
+        _videoEncoder->requestKeyframe();
+        if (!_videoEncoder->encode(raw, quality, _scheduler.getFrameRate(), *_encodeWorkers, *message)) {
+            return false;
+        }
+        frame.keyframe = _videoEncoder->lastWasKeyframe();
+        frame.data = std::move(message);
+    } else if (frame.mode == EncodingMode::TILES) {
+        // Every tile again, replacing the clients' cached copies instead of referencing them
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        auto tiles = std::make_shared<TileFrame>();
+        if (!_tileEncoder) {
+            return false;
+        }
+
+        // Nothing on a static screen is video, every tile gets the refinement quality
+        _tileEncoder->clearChangeHistory();
+        _tileEncoder->requestKeyframe();
+        if (!_tileEncoder->encode(raw, quality, *tiles)) {
+            return false;
+        }
+        tiles->refinement = true;
+        frame.keyframe = tiles->keyframe;
+        frame.tiles = std::move(tiles);
+    } else if (!frame.profileImages.empty()) {
+        // Every profile's best still at its own size; nothing to refine when profiles were
+        // switched off since the frame was encoded
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        if (_profileKeys.size() != frame.profileImages.size() ||
+            std::any_of(_profileKeys.begin(), _profileKeys.end(),
+                        [this](const ProfileKey& key) { return _profileEncoders.count(key) == 0; })) {
+            return false;
+        }
+
+        bool improved = false;
+        for (auto& [key, slot] : _profileEncoders) {
+            if (FrameEncoder::Buffer still = slot.encoder->encodeStill(*slot.image, quality, *_encodeWorkers)) {
+                slot.lastImage = std::move(still);
+                slot.lastQuality = quality;
+                improved = true;
+            }
+        }
+        if (!improved) {
+            return false;
+        }
+        for (size_t i = 0; i < frame.profileImages.size(); i++) {
+            frame.profileImages[i].image = _profileEncoders[_profileKeys[i]].lastImage;
+        }
+        frame.data = frame.profileImages.front().image;
+    } else {
+        // Every codec's best still, codecs that cannot improve on their frame resend it
+        std::lock_guard<std::mutex> lock(_encoderMutex);
+        std::array<FrameEncoder::Buffer, FrameEncoder::kCodecCount> refined = _lastImages;
+        bool improved = false;
+        for (FrameEncoder::Codec codec : _imageCodecs) {
+            size_t index = static_cast<size_t>(codec);
+            if (FrameEncoder::Buffer still = _frameEncoders[index]->encodeStill(raw, quality, *_encodeWorkers)) {
+                refined[index] = std::move(still);
+                improved = true;
+            }
+        }
+
+        size_t primary = static_cast<size_t>(_imageCodecs.front());
+        if (!improved || !refined[primary]) {
+            return false;
+        }
+        frame.images = refined;
+        frame.data = refined[primary];
+        frame.codec = _imageCodecs.front();
+        _lastImages = refined;
+        _lastImageQuality = quality;
+    }
+
+    frame.quality = quality;
+    frame.refinement = true;
+    return true;
+}
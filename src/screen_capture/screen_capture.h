@@ -1,93 +1,498 @@
 #pragma once
 
-#include <Windows.h>
+#include "capture_source.h"
+#include "replay_capture_source.h"
+#include "capture_scheduler.h"
+#include "../encoding/tile_encoder.h"
+#include "../encoding/frame_scaler.h"
+#include "../encoding/frame_encoder.h"
+#include "../encoding/lossless_encoder.h"
+#include "../encoding/video_encoder.h"
+#include "../encoding/cursor_encoder.h"
+#include "../utils/spsc_ring.h"
+#include "../utils/thread_pool.h"
+#include <array>
 #include <vector>
+#include <map>
+#include <tuple>
 #include <functional>
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <memory>
 #include <condition_variable>
 #include <chrono>
+#include <algorithm>
 #include <string>
 #include <nlohmann/json.hpp>
 
+/**
+ * Captures and encodes the desktop for screen sharing
+ *
+ * Capture, encoding and delivery run as separate threads connected by bounded SPSC
+ * rings, so the frame rate is limited by the slowest stage rather than their sum.
+ * Stale frames are dropped between stages; their damage is folded into the next frame.
+ * While the screen is static no frames are sent apart from periodic heartbeats and one
+ * high-quality refinement, and capture slows down until something changes. Remote input
+ * triggers a burst: an immediate capture followed by a short period at a higher rate.
+ */
 class ScreenCapture {
 public:
+    // How captured frames are encoded for clients
+    enum class EncodingMode {
+        JPEG,       // Whole frame as a bare image, JPEG or another codec, see setImageCodecs()
+        TILES,      // Changed tiles only, see frame_protocol.h
+        LOSSLESS,   // Exact deltas against the previous frame, see frame_protocol.h
+        VIDEO       // H.264 access units, see frame_protocol.h
+    };
+
+    // A whole-frame output in JPEG mode, clients asking for the same one share its image
+    struct OutputProfile {
+        int maxWidth = 0;               // Fitted inside this size as well as the output size, 0 for the output size
+        int maxHeight = 0;
+        double scale = 1.0;             // Fraction of the fitted size, used by rate control
+        int quality = 70;
+        FrameEncoder::Codec codec = FrameEncoder::Codec::JPEG;
+
+        bool operator==(const OutputProfile& other) const {
+            return maxWidth == other.maxWidth && maxHeight == other.maxHeight && scale == other.scale &&
+                   quality == other.quality && codec == other.codec;
+        }
+
+        bool operator<(const OutputProfile& other) const {
+            return std::tie(maxWidth, maxHeight, scale, quality, codec) <
+                   std::tie(other.maxWidth, other.maxHeight, other.scale, other.quality, other.codec);
+        }
+    };
+
+    // One output profile's image in a frame
+    struct ProfileImage {
+        OutputProfile profile;
+        FrameEncoder::Buffer image;
+        int width{0};
+        int height{0};
+    };
+
     struct FrameData {
-        std::vector<uint8_t> jpegData;
+        FrameEncoder::Buffer data;  // Image in the first codec, lossless or video message shared by all consumers, null in tile mode
+        std::array<FrameEncoder::Buffer, FrameEncoder::kCodecCount> images;  // Whole-frame image per codec, by codec
+        std::vector<ProfileImage> profileImages;  // Whole-frame image per output profile, see setOutputProfiles()
+        std::shared_ptr<const TileFrame> tiles;  // Changed tiles, packed per client with packTileUpdate()
+        FrameEncoder::Buffer thumbnail; // Thumbnail message of the whole screen while a viewport is set, null otherwise
         int width;
         int height;
         int quality;
+        CaptureRect viewport;           // Part of the captured screen the frame shows, empty for all of it
+        int screenWidth{0};             // Captured size the viewport is in
+        int screenHeight{0};
+        EncodingMode mode{EncodingMode::JPEG};
+        FrameEncoder::Codec codec{FrameEncoder::Codec::JPEG};  // Codec of the image in data
+        bool keyframe{true};
+        bool heartbeat{false};          // Screen unchanged; JPEG data repeats the last frame for clients that missed it
+        bool refinement{false};         // Static screen resent at higher quality, every client should get it
+        bool burst{false};              // Captured in the burst after remote input
         std::chrono::system_clock::time_point timestamp;
+
+        // Get the image in a codec, the image in data when that codec was not encoded
+        const FrameEncoder::Buffer& imageFor(FrameEncoder::Codec imageCodec) const {
+            const FrameEncoder::Buffer& image = images[static_cast<size_t>(imageCodec)];
+            return image ? image : data;
+        }
+
+        // Get an output profile's image, null when the profile was not encoded
+        const ProfileImage* findProfile(const OutputProfile& profile) const {
+            for (const ProfileImage& entry : profileImages) {
+                if (entry.profile == profile) {
+                    return &entry;
+                }
+            }
+            return nullptr;
+        }
     };
 
-    // Constructor
-    explicit ScreenCapture(int captureIntervalMs = 100, int quality = 70);
-    
+    // Accumulated pipeline timings since start()
+    struct Stats {
+        uint64_t capturedFrames{0};
+        uint64_t frames{0};             // Frames encoded
+        uint64_t droppedFrames{0};
+        uint64_t failedCaptures{0};
+        uint64_t unchangedFrames{0};
+        uint64_t heartbeats{0};
+        uint64_t refinements{0};
+        uint64_t copyRects{0};
+        uint64_t paletteTiles{0};       // Tiles by content class and codec, see TileEncoder
+        uint64_t textTiles{0};
+        uint64_t photoTiles{0};
+        uint64_t videoTiles{0};
+        double totalDirtyFraction{0.0};
+        uint64_t totalBytes{0};
+        double totalQuality{0.0};       // Sum of the JPEG quality of encoded frames
+        double totalCaptureMs{0.0};
+        double totalEncodeMs{0.0};
+        double totalCallbackMs{0.0};
+
+        // Capture tick timing from the scheduler
+        uint64_t missedTicks{0};
+        double totalLatenessMs{0.0};
+        double maxLatenessMs{0.0};
+
+        // Captures triggered by input and their delay from the first input they cover
+        uint64_t bursts{0};
+        double totalBurstDelayMs{0.0};
+
+        // Pointer changes handed to the cursor callback
+        uint64_t cursorUpdates{0};
+
+        // Whole-screen thumbnails sent while a viewport is set
+        uint64_t thumbnails{0};
+        uint64_t thumbnailBytes{0};
+
+        // Whole-frame encode cost per codec, by codec
+        std::array<FrameEncoder::Cost, FrameEncoder::kCodecCount> codecCosts{};
+    };
+
+    // Behaviour while the screen is static
+    struct IdleOptions {
+        int heartbeatMs = 1000;         // Heartbeat period while nothing is sent, 0 disables
+        int idleDelayMs = 500;          // Static time after which the screen counts as idle
+        int refineQuality = 95;         // Quality of the refinement sent once idle, 0 disables it
+        double idleFps = 5.0;           // Capture rate while idle, 0 keeps the full rate
+    };
+
+    // Capture rate after remote input
+    struct BurstOptions {
+        double fps = 30.0;              // Rate right after input, 0 disables bursts
+        int holdMs = 300;               // Time at the burst rate after the last input
+        int decayMs = 700;              // Time to fall back to the configured rate
+    };
+
+    // Constructor, capturing from the platform source unless another one is given
+    explicit ScreenCapture(int captureIntervalMs = 100, int quality = 70, std::unique_ptr<CaptureSource> source = nullptr);
+
     // Destructor
     ~ScreenCapture();
-    
+
     // Start capture
     bool start();
-    
+
     // Stop capture
     void stop();
-    
+
     // Check if capture is running
     bool isRunning() const { return _running; }
-    
-    // Set frame callback
-    void setFrameCallback(std::function<void(const FrameData&)> callback) { 
-        _frameCallback = std::move(callback); 
+
+    // Set frame callback, called from the delivery thread
+    void setFrameCallback(std::function<void(const FrameData&)> callback) {
+        _frameCallback = std::move(callback);
+    }
+
+    // Set pointer callback, called from the delivery thread with the latest pointer whenever it changes
+    void setCursorCallback(std::function<void(const CursorEncoder::Update&)> callback) {
+        _cursorCallback = std::move(callback);
     }
-    
+
+    // Poll the pointer this often, independently of the frame rate; 0 stops cursor updates
+    void setCursorRate(double fps) { _cursorFps = std::max(0.0, fps); }
+
+    // Send the pointer again for every frame size, e.g. after a client's frame size changed
+    void resendCursor() { _cursorResend = true; }
+
+    // Set capture rate
+    void setFrameRate(double fps) { _scheduler.setFrameRate(fps); }
+
     // Set capture interval
-    void setCaptureInterval(int intervalMs) { _captureIntervalMs = intervalMs; }
-    
-    // Set JPEG quality
+    void setCaptureInterval(int intervalMs) { setFrameRate(1000.0 / std::max(1, intervalMs)); }
+
+    // Set JPEG quality, the upper limit when a bitrate or PSNR target is set
     void setQuality(int quality) { _quality = quality; }
-    
+
+    // Size JPEG frames to a bitrate at the current frame rate instead of a fixed quality, 0 disables
+    void setTargetBitrate(int kbps);
+
+    // Use the lowest JPEG quality that keeps luma PSNR above a floor, 0 disables
+    void setPsnrFloor(double psnrDb);
+
+    // Set encoding mode
+    void setEncodingMode(EncodingMode mode);
+    EncodingMode getEncodingMode() const { return _encodingMode; }
+
+    // Configure tile mode (takes effect for the next frame)
+    void setTileOptions(int tileSize, int keyframeInterval, bool scrollDetection = true, bool regionCoding = true);
+
+    // Encode whole frames in these codecs, the first fills FrameData::data (takes effect for the next frame)
+    // Codecs that are not built in are skipped, JPEG is used when none is left
+    void setImageCodecs(const std::vector<FrameEncoder::Codec>& codecs);
+    std::vector<FrameEncoder::Codec> getImageCodecs();
+
+    // In JPEG mode, encode each of these profiles once per frame instead of the image codecs; each
+    // distinct size is scaled from the next larger one, and the first profile fills FrameData::data.
+    // Profiles in codecs that are not built in are skipped, an empty list returns to the image codecs
+    // (takes effect for the next frame)
+    void setOutputProfiles(const std::vector<OutputProfile>& profiles);
+
+    // Configure lossless mode (takes effect for the next frame)
+    void setLosslessOptions(int keyframeInterval, bool scrollDetection = true);
+
+    // Configure video mode (takes effect for the next frame)
+    void setVideoOptions(int keyframeInterval);
+
+    // Encode large JPEG frames as parallel bands on this many threads, only while stopped
+    void setEncodeThreads(int threads);
+
+    // Downscale frames to fit maxWidth x maxHeight before encoding, 0 keeps native size
+    void setOutputSize(int maxWidth, int maxHeight);
+
+    // Shrink the output size further by a factor in (0, 1], used by rate control
+    void setOutputScale(double factor);
+
+    // Encode only this part of the captured screen, fitted to the output size; an empty rect encodes all of it
+    void setViewport(const CaptureRect& viewport);
+
+    // While a viewport is set, also send a whole-screen JPEG thumbnail fitting maxWidth x maxHeight
+    // at this rate, 0 fps disables thumbnails
+    void setThumbnailOptions(int maxWidth, int maxHeight, double fps);
+
+    // Get the size of the last captured frame, before any viewport or scaling
+    std::pair<int, int> getScreenSize() const { return {_screenWidth, _screenHeight}; }
+
+    // Configure heartbeats, refinement and capture rate for static screens
+    void setIdleOptions(const IdleOptions& options);
+
+    // Configure the capture rate after remote input
+    void setBurstOptions(const BurstOptions& options);
+
+    // Capture now and at the burst rate for a while, called after injecting input
+    void triggerBurst();
+
+    // Send a full frame next time, even while the screen is static
+    void requestKeyframe();
+
+    // Tell the tile encoder which tile hashes every client already caches
+    void setTileCacheQuery(TileEncoder::CachedPredicate query);
+
+    // Replace the frame source (platform capture by default)
+    void setCaptureSource(std::unique_ptr<CaptureSource> source);
+
     // Get single frame immediately
     FrameData captureFrame();
-    
+
     // Convert FrameData to JSON
     static nlohmann::json frameToJson(const FrameData& frame);
-    
+
     // Capture specific monitor
     void selectMonitor(int monitorIndex);
-    
+
     // Get available monitors
     std::vector<std::string> getMonitorInfo();
-    
+
     // Capture specific window
-    bool selectWindow(HWND windowHandle);
-    
+    bool selectWindow(WindowHandle windowHandle);
+
     // Get window list
-    std::vector<std::pair<HWND, std::string>> getWindowList();
-    
+    std::vector<std::pair<WindowHandle, std::string>> getWindowList();
+
+    // Record raw captured frames to disk for ReplayCaptureSource
+    bool startRecording(const std::string& path);
+    void stopRecording();
+
+    // Get pipeline statistics
+    Stats getStats();
+
 private:
-    // Capture methods
+    // Wakes a pipeline stage waiting on its input ring
+    struct StageSignal {
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        void notify() {
+            { std::lock_guard<std::mutex> lock(mutex); }
+            condition.notify_one();
+        }
+    };
+
+    // Pipeline stages, one thread each
     void captureLoop();
+    void encodeLoop();
+    void deliverLoop();
+
+    // Poll the pointer and pass changes to the delivery stage
+    void cursorLoop();
+
+    // Grab a raw frame from the source
+    bool captureRaw(RawFrame& raw);
+
+    // Encode a raw frame for clients
+    FrameData encodeFrame(const RawFrame& captured);
+
+    // Capture and encode on the calling thread
     FrameData captureScreen();
-    
-    // Compress frame to JPEG
-    std::vector<uint8_t> compressToJpeg(BYTE* data, int width, int height, int stride, int quality);
-    
+
+    // Fold the damage of a skipped frame into the pending damage
+    void carryDamage(const RawFrame& skipped);
+
+    // Add the pending damage to the next frame to encode
+    void applyCarriedDamage(RawFrame& raw);
+
+    // Track how long the screen has been static and turn an unchanged frame into
+    // a refinement, a heartbeat or nothing
+    void handleStaticFrame(const RawFrame& raw, bool unchanged, bool resend, FrameData& frame);
+
+    // Encode the static screen at the refinement quality
+    bool encodeRefinement(const RawFrame& raw, int quality, FrameData& frame);
+
+    // Encode a thumbnail of the whole captured frame when one is due or forced (caller holds _encoderMutex)
+    void encodeThumbnail(const RawFrame& captured, bool force, FrameData& frame);
+
+    // Encode a whole frame in every image codec; unchanged is set when the first codec's
+    // encoder found the pixels unchanged and the last images were reused (caller holds _encoderMutex)
+    void encodeImages(const RawFrame& raw, FrameData& frame, bool& unchanged);
+
+    // Encode a whole frame once per distinct output profile; unchanged is set when every
+    // profile's last image was reused (caller holds _encoderMutex)
+    void encodeProfiles(const RawFrame& raw, FrameData& frame, bool& unchanged);
+
+    // Byte budget of one whole frame under the bitrate target, 0 without one
+    size_t frameByteBudget();
+
+    // Every whole-frame encoder, by codec and per output profile (caller holds _encoderMutex)
+    std::vector<FrameEncoder*> getFrameEncoders();
+
     // Capture state
     std::atomic<bool> _running{false};
     std::thread _captureThread;
+    std::thread _encodeThread;
+    std::thread _deliverThread;
+    std::thread _cursorThread;
     std::function<void(const FrameData&)> _frameCallback;
-    int _captureIntervalMs;
+    CaptureScheduler _scheduler;
     int _quality;
-    
-    // Capture region
-    int _monitorIndex{0};
-    HWND _targetWindow{NULL};
-    bool _captureWindow{false};
-    
+
+    // Frame source and its reusable raw buffer for synchronous captures
+    std::unique_ptr<CaptureSource> _source;
+    std::mutex _sourceMutex;
+    RawFrame _rawFrame;
+    uint64_t _sequence{0};
+
+    // Raw buffers cycle capture -> encode -> capture, encoded frames go on to delivery
+    static constexpr size_t kRawFramePoolSize = 3;
+    std::vector<std::unique_ptr<RawFrame>> _rawFramePool;
+    SpscRing<RawFrame*> _freeFrames{kRawFramePoolSize};
+    SpscRing<RawFrame*> _capturedFrames{kRawFramePoolSize};
+    SpscRing<FrameData> _encodedFrames{2};
+    StageSignal _encodeSignal;
+    StageSignal _deliverSignal;
+
+    // A frame size clients receive, the pointer is encoded for each
+    struct CursorOutput {
+        int frameWidth;
+        int frameHeight;
+        double scaleX;                          // Frame size over viewport size
+        double scaleY;
+    };
+
+    // Pointer polling; the latest update per frame size waits for the delivery stage, older ones are replaced
+    std::function<void(const CursorEncoder::Update&)> _cursorCallback;
+    std::atomic<double> _cursorFps{0.0};
+    std::atomic<int> _cursorOffsetX{0};         // Viewport origin in captured pixels
+    std::atomic<int> _cursorOffsetY{0};
+    std::atomic<bool> _cursorResend{true};
+    std::atomic<bool> _cursorPending{false};
+    StageSignal _cursorSignal;
+    std::mutex _cursorMutex;
+    std::vector<CursorOutput> _cursorOutputs;
+    std::map<std::pair<int, int>, CursorEncoder::Update> _pendingCursors;
+
+    // Damage of frames dropped before encoding (encode thread only)
+    std::vector<CaptureRect> _carriedDirtyRects;
+    bool _carriedDirtyValid{true};
+    bool _hasCarriedDamage{false};
+
+    // Encoder state
+    std::atomic<EncodingMode> _encodingMode{EncodingMode::JPEG};
+    std::unique_ptr<TileEncoder> _tileEncoder;
+    std::unique_ptr<LosslessEncoder> _losslessEncoder;
+    std::unique_ptr<VideoEncoder> _videoEncoder;
+    TileEncoder::CachedPredicate _tileCacheQuery;
+    FrameScaler _scaler;
+    RawFrame _scaledFrame;
+    std::atomic<int> _screenWidth{0};
+    std::atomic<int> _screenHeight{0};
+
+    // Whole-screen thumbnails while a viewport is set, with their own scaler and JPEG encoder
+    FrameScaler _thumbnailScaler;
+    RawFrame _thumbnailFrame;
+    std::unique_ptr<FrameEncoder> _thumbnailEncoder;
+    double _thumbnailFps{0.0};
+    bool _thumbnailDirty{true};     // The screen changed since the last thumbnail (encode thread only)
+    std::chrono::steady_clock::time_point _lastThumbnailTime{};
+    std::mutex _encoderMutex;
+
+    // Whole-frame encoders by codec, created when a codec is first used; bands of a frame run on the workers
+    std::array<std::unique_ptr<FrameEncoder>, FrameEncoder::kCodecCount> _frameEncoders;
+    std::vector<FrameEncoder::Codec> _imageCodecs{FrameEncoder::Codec::JPEG};
+    std::array<FrameEncoder::Cost, FrameEncoder::kCodecCount> _codecCostsAtStart{};
+    std::unique_ptr<ThreadPool> _encodeWorkers;
+
+    // Output profiles in JPEG mode. Each distinct size is one level of a scale pyramid built per frame,
+    // largest first, and each distinct size, quality and codec has one encoder (encode thread only,
+    // apart from the profile list and clearing when profiles are switched on or off)
+    struct ProfileLevel {
+        FrameScaler scaler;
+        RawFrame frame;
+        const RawFrame* image{nullptr};         // frame, or the larger level when no scaling was needed
+        std::pair<int, int> source{0, 0};       // Size of the level it was scaled from
+    };
+    struct ProfileEncoder {
+        std::unique_ptr<FrameEncoder> encoder;
+        const RawFrame* image{nullptr};         // Level encoded in the current frame
+        FrameEncoder::Buffer lastImage;
+        int lastQuality{0};
+        int lastWidth{0};
+        int lastHeight{0};
+        bool used{false};
+    };
+    using ProfileKey = std::tuple<int, int, int, FrameEncoder::Codec>;   // Level size, quality, codec
+    std::vector<OutputProfile> _outputProfiles;
+    std::map<std::pair<int, int>, ProfileLevel, std::greater<>> _profileLevels;
+    std::map<ProfileKey, ProfileEncoder> _profileEncoders;
+    std::vector<ProfileKey> _profileKeys;   // Encoder of each profile image of the last frame
+    std::array<FrameEncoder::Cost, FrameEncoder::kCodecCount> _profileCosts{};
+
+    // Bitrate target for each codec's quality search, PSNR floor for encoders created later
+    int _targetBitrateKbps{0};
+    double _psnrFloor{0.0};
+
+    // Last images, reused while the source reports no damage
+    std::array<FrameEncoder::Buffer, FrameEncoder::kCodecCount> _lastImages;
+    int _lastImageQuality{0};
+    int _lastImageWidth{0};
+    int _lastImageHeight{0};
+
+    // Static screen handling (encode thread only, apart from the atomics)
+    IdleOptions _idleOptions;
+    std::chrono::steady_clock::time_point _staticSince{};
+    std::chrono::steady_clock::time_point _lastSendTime{};
+    bool _refined{false};
+    std::atomic<bool> _resendRequested{true};
+    std::atomic<int> _idleCaptureIntervalMs{0};   // Nonzero while idle, read by the capture thread
+
+    // Steady clock time of the last burst not yet followed by a capture, 0 if none
+    std::atomic<int64_t> _burstRequestedNs{0};
+
+    // Optional raw frame recording
+    std::string _recordPath;
+    RawFrameRecorder _recorder;
+
+    // Statistics
+    Stats _stats;
+    std::mutex _statsMutex;
+
     // Synchronization
     std::mutex _frameMutex;
     std::condition_variable _frameCondition;
     bool _frameReady{false};
     FrameData _latestFrame;
-};
\ No newline at end of file
+};
+
+// Create the default capture source for this platform
+std::unique_ptr<CaptureSource> createPlatformCaptureSource();
@@ -0,0 +1,175 @@
+#include "shared_capture_source.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace {
+    // Hub frame numbers are unique across hubs and far above the generations sources count
+    // from 1, so a buffer never mistakes another source's frame for one of ours
+    std::atomic<uint64_t> g_nextFrameNumber{uint64_t{1} << 48};
+
+    // Copy rows of a rectangle between BGRA buffers
+    void copyRect(const RawFrame& src, RawFrame& dst, const CaptureRect& rect) {
+        for (int y = rect.y; y < rect.y + rect.height; y++) {
+            std::memcpy(dst.pixels.data() + static_cast<size_t>(y) * dst.stride + static_cast<size_t>(rect.x) * 4,
+                        src.pixels.data() + static_cast<size_t>(y) * src.stride + static_cast<size_t>(rect.x) * 4,
+                        static_cast<size_t>(rect.width) * 4);
+        }
+    }
+}
+
+// Constructor
+CaptureHub::CaptureHub(std::unique_ptr<CaptureSource> source) : _source(std::move(source)) {}
+
+// Hand out the newest frame
+bool CaptureHub::grab(RawFrame& frame, uint64_t& lastNumber) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_source) {
+        return false;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (_number == 0 || now - _grabTime >= kReuseWindow) {
+        _frame.dirtyRects.clear();
+        _frame.dirtyRectsValid = false;
+        if (!_source->grab(_frame)) {
+            return false;
+        }
+
+        _number = g_nextFrameNumber++;
+        _grabTime = now;
+        _history.push_back({_number, _frame.dirtyRects, _frame.dirtyRectsValid});
+        while (_history.size() > kHistorySize) {
+            _history.pop_front();
+        }
+    }
+
+    // A buffer holding an earlier frame of this hub only needs what changed since
+    std::vector<CaptureRect> stale;
+    bool incremental = frame.width == _frame.width && frame.height == _frame.height &&
+                       frame.stride == _frame.width * 4 && damageSince(frame.sourceGeneration, stale);
+
+    frame.width = _frame.width;
+    frame.height = _frame.height;
+    frame.stride = _frame.width * 4;
+    frame.pixels.resize(static_cast<size_t>(frame.stride) * frame.height);
+    if (incremental) {
+        for (const CaptureRect& rect : stale) {
+            copyRect(_frame, frame, rect);
+        }
+    } else {
+        copyRect(_frame, frame, {0, 0, _frame.width, _frame.height});
+    }
+    frame.sourceGeneration = _number;
+
+    // The caller's damage is relative to the last frame it was handed, not to this buffer
+    frame.dirtyRects.clear();
+    frame.dirtyRectsValid = damageSince(lastNumber, frame.dirtyRects);
+    if (!frame.dirtyRectsValid) {
+        frame.dirtyRects.clear();
+    }
+    lastNumber = _number;
+    return true;
+}
+
+// Collect damage after a hub frame
+bool CaptureHub::damageSince(uint64_t since, std::vector<CaptureRect>& rects) const {
+    if (since == _number) {
+        return true;
+    }
+
+    // Only frames still in the history have every later grab's damage recorded
+    auto it = std::find_if(_history.begin(), _history.end(), [since](const Grab& grab) { return grab.number == since; });
+    if (since == 0 || it == _history.end()) {
+        return false;
+    }
+
+    for (++it; it != _history.end(); ++it) {
+        if (!it->dirtyRectsValid) {
+            return false;
+        }
+        rects.insert(rects.end(), it->dirtyRects.begin(), it->dirtyRects.end());
+    }
+    return true;
+}
+
+// Update the pointer state
+bool CaptureHub::grabCursor(CursorState& cursor) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _source && _source->grabCursor(cursor);
+}
+
+// Get the source name
+std::string CaptureHub::name() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _source ? _source->name() : std::string();
+}
+
+// Get available monitors
+std::vector<std::string> CaptureHub::getMonitorInfo() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _source ? _source->getMonitorInfo() : std::vector<std::string>();
+}
+
+// Get window list
+std::vector<std::pair<WindowHandle, std::string>> CaptureHub::getWindowList() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _source ? _source->getWindowList() : std::vector<std::pair<WindowHandle, std::string>>();
+}
+
+// Constructor
+SharedCaptureSource::SharedCaptureSource(std::shared_ptr<CaptureHub> hub) : _hub(std::move(hub)) {}
+
+// Grab through the hub
+bool SharedCaptureSource::grab(RawFrame& frame) {
+    return _hub->grab(frame, _lastNumber);
+}
+
+// Read the pointer through the hub
+bool SharedCaptureSource::grabCursor(CursorState& cursor) {
+    return _hub->grabCursor(cursor);
+}
+
+// Name the shared source after the real one
+std::string SharedCaptureSource::name() const {
+    return "shared " + _hub->name();
+}
+
+// Get available monitors
+std::vector<std::string> SharedCaptureSource::getMonitorInfo() {
+    return _hub->getMonitorInfo();
+}
+
+// Get window list
+std::vector<std::pair<WindowHandle, std::string>> SharedCaptureSource::getWindowList() {
+    return _hub->getWindowList();
+}
+
+// Open a target's shared source
+std::unique_ptr<CaptureSource> CaptureSourcePool::open(const std::string& target, const Factory& factory) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Forget targets nobody captures any more
+    for (auto it = _hubs.begin(); it != _hubs.end();) {
+        it = it->second.expired() ? _hubs.erase(it) : std::next(it);
+    }
+
+    std::shared_ptr<CaptureHub> hub = _hubs[target].lock();
+    if (!hub) {
+        std::unique_ptr<CaptureSource> source = factory();
+        if (!source) {
+            _hubs.erase(target);
+            return nullptr;
+        }
+        hub = std::make_shared<CaptureHub>(std::move(source));
+        _hubs[target] = hub;
+    }
+    return std::make_unique<SharedCaptureSource>(std::move(hub));
+}
+
+// Count captured targets
+size_t CaptureSourcePool::getTargetCount() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return static_cast<size_t>(std::count_if(_hubs.begin(), _hubs.end(),
+                                             [](const auto& entry) { return !entry.second.expired(); }));
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "capture_source.h"
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * One capture source shared by every session watching the same monitor or window
+ *
+ * A grab reuses the last frame when another session grabbed it moments ago, so sessions
+ * at different rates cost one capture per distinct tick instead of one each. The real
+ * source always updates the hub's own buffer, keeping its damage tracking incremental.
+ */
+class CaptureHub {
+public:
+    explicit CaptureHub(std::unique_ptr<CaptureSource> source);
+
+    // Copy the newest frame into frame, reporting the damage since the hub frame lastNumber;
+    // lastNumber receives the frame handed out
+    bool grab(RawFrame& frame, uint64_t& lastNumber);
+
+    // Update the pointer state from the real source
+    bool grabCursor(CursorState& cursor);
+
+    // Get the real source's name
+    std::string name();
+
+    // Get available monitors
+    std::vector<std::string> getMonitorInfo();
+
+    // Get window list
+    std::vector<std::pair<WindowHandle, std::string>> getWindowList();
+
+private:
+    // Damage reported by one grab of the real source
+    struct Grab {
+        uint64_t number;
+        std::vector<CaptureRect> dirtyRects;
+        bool dirtyRectsValid;
+    };
+
+    // Collect the damage of every grab after the hub frame since, false when it is unknown
+    bool damageSince(uint64_t since, std::vector<CaptureRect>& rects) const;
+
+    // Grabs this close together are served from one capture
+    static constexpr std::chrono::milliseconds kReuseWindow{8};
+
+    // Grabs whose damage is kept for sessions that fell behind
+    static constexpr size_t kHistorySize = 16;
+
+    std::mutex _mutex;
+    std::unique_ptr<CaptureSource> _source;
+    RawFrame _frame;
+    uint64_t _number{0};
+    std::chrono::steady_clock::time_point _grabTime{};
+    std::deque<Grab> _history;
+};
+
+/**
+ * A session's handle on a CaptureHub
+ *
+ * Each handle reports the damage since its own previous frame, and a buffer that still
+ * holds an earlier hub frame only has the areas changed since then copied. Monitor and
+ * window selection would move every session on the hub, so it is ignored here; sessions
+ * change targets by opening a handle on another hub.
+ */
+class SharedCaptureSource : public CaptureSource {
+public:
+    explicit SharedCaptureSource(std::shared_ptr<CaptureHub> hub);
+    ~SharedCaptureSource() override = default;
+
+    bool grab(RawFrame& frame) override;
+    bool grabCursor(CursorState& cursor) override;
+    std::string name() const override;
+
+    std::vector<std::string> getMonitorInfo() override;
+    std::vector<std::pair<WindowHandle, std::string>> getWindowList() override;
+
+private:
+    std::shared_ptr<CaptureHub> _hub;
+    uint64_t _lastNumber{0};
+};
+
+/**
+ * Hands out shared capture sources by target, such as "monitor_1" or a window id
+ *
+ * A hub lives while any session holds a handle on it.
+ */
+class CaptureSourcePool {
+public:
+    using Factory = std::function<std::unique_ptr<CaptureSource>()>;
+
+    // Get a handle on the target's source, creating it with factory when no session uses it;
+    // null when the factory cannot open the target
+    std::unique_ptr<CaptureSource> open(const std::string& target, const Factory& factory);
+
+    // Get the number of targets currently captured
+    size_t getTargetCount();
+
+private:
+    std::mutex _mutex;
+    std::map<std::string, std::weak_ptr<CaptureHub>> _hubs;
+};
@@ -0,0 +1,237 @@
+#include "synthetic_capture_source.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+namespace {
+    constexpr int kGlyphCount = 64;
+    constexpr int kGlyphWidth = 8;
+    constexpr int kGlyphHeight = 12;
+    constexpr int kLineHeight = 16;
+
+    // Pointer path: one turn every kCursorPeriod polls
+    constexpr int kCursorPeriod = 180;
+    constexpr int kArrowWidth = 12;
+    constexpr int kArrowHeight = 19;
+
+    // Small integer hash used to derive deterministic content
+    inline uint32_t mix(uint32_t a, uint32_t b) {
+        uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u);
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        return h;
+    }
+
+    inline void storePixel(uint8_t* p, uint32_t color) {
+        p[0] = color & 0xFF;          // B
+        p[1] = (color >> 8) & 0xFF;   // G
+        p[2] = (color >> 16) & 0xFF;  // R
+        p[3] = 0xFF;                  // A
+    }
+}
+
+// Constructor
+SyntheticCaptureSource::SyntheticCaptureSource(int width, int height)
+    : SyntheticCaptureSource(width, height, Options()) {
+}
+
+// Constructor with scene options
+SyntheticCaptureSource::SyntheticCaptureSource(int width, int height, const Options& options)
+    : _width(width), _height(height), _options(options) {
+    // Diagonal gradient wallpaper
+    _wallpaper.resize(static_cast<size_t>(_width) * _height * 4);
+    for (int y = 0; y < _height; y++) {
+        uint8_t* row = _wallpaper.data() + static_cast<size_t>(y) * _width * 4;
+        for (int x = 0; x < _width; x++) {
+            uint32_t r = 20 + (x * 40) / std::max(1, _width);
+            uint32_t g = 60 + (y * 60) / std::max(1, _height);
+            uint32_t b = 110 + ((x + y) * 80) / std::max(1, _width + _height);
+            storePixel(row + x * 4, (r << 16) | (g << 8) | b);
+        }
+    }
+
+    // Random but fixed glyph shapes with a blank first row and column
+    _glyphs.resize(kGlyphCount * kGlyphHeight);
+    for (int g = 0; g < kGlyphCount; g++) {
+        for (int row = 0; row < kGlyphHeight; row++) {
+            uint8_t bits = 0;
+            if (row >= 2 && row < kGlyphHeight - 2) {
+                bits = static_cast<uint8_t>(mix(g, row) & 0x7E);
+            }
+            _glyphs[g * kGlyphHeight + row] = bits;
+        }
+    }
+}
+
+// Describe the virtual monitor
+std::vector<std::string> SyntheticCaptureSource::getMonitorInfo() {
+    std::stringstream info;
+    info << "Monitor 0: SYNTHETIC - Primary - Resolution: " << _width << "x" << _height;
+    return {info.str()};
+}
+
+// Generate the next frame
+bool SyntheticCaptureSource::grab(RawFrame& frame) {
+    uint64_t t = _frameIndex++;
+
+    frame.width = _width;
+    frame.height = _height;
+    frame.stride = _width * 4;
+    frame.pixels.resize(_wallpaper.size());
+    std::memcpy(frame.pixels.data(), _wallpaper.data(), _wallpaper.size());
+
+    if (_options.scrollingText) {
+        drawTextWindow(frame, _width / 16, _height / 10, _width / 2, (_height * 7) / 10, t);
+    }
+
+    if (_options.movingWindows) {
+        int w = _width / 4;
+        int h = _height / 4;
+        int rangeX = std::max(1, _width - w);
+        int rangeY = std::max(1, _height - h);
+
+        // Triangle-wave paths so windows bounce between desktop edges
+        int ax = static_cast<int>((t * 7) % (2 * rangeX));
+        int ay = static_cast<int>((t * 3) % (2 * rangeY));
+        drawMovingWindow(frame, ax < rangeX ? ax : 2 * rangeX - ax,
+                         ay < rangeY ? ay : 2 * rangeY - ay, w, h, 0xE8E8E8);
+
+        int bx = static_cast<int>((t * 5 + rangeX / 2) % (2 * rangeX));
+        int by = static_cast<int>((t * 4 + rangeY / 3) % (2 * rangeY));
+        drawMovingWindow(frame, bx < rangeX ? bx : 2 * rangeX - bx,
+                         by < rangeY ? by : 2 * rangeY - by, w, h, 0xF4F0D8);
+    }
+
+    if (_options.videoRegion) {
+        drawVideoRegion(frame, (_width * 5) / 8, (_height * 5) / 8, _width / 3, _height / 3, t);
+    }
+
+    return true;
+}
+
+// Report the pointer
+bool SyntheticCaptureSource::grabCursor(CursorState& cursor) {
+    uint64_t t = _cursorIndex++;
+    double angle = 2.0 * 3.14159265358979 * static_cast<double>(t % kCursorPeriod) / kCursorPeriod;
+    cursor.x = _width / 2 + static_cast<int>(std::cos(angle) * _height / 4);
+    cursor.y = _height / 2 + static_cast<int>(std::sin(angle) * _height / 4);
+    cursor.visible = true;
+
+    // Same rectangle as the document window in grab()
+    bool overText = _options.scrollingText && cursor.x >= _width / 16 && cursor.x < _width / 16 + _width / 2 &&
+                    cursor.y >= _height / 10 && cursor.y < _height / 10 + (_height * 7) / 10;
+    uint64_t serial = overText ? 2 : 1;
+    if (serial == cursor.shapeSerial && !cursor.pixels.empty()) {
+        return true;
+    }
+
+    cursor.shapeSerial = serial;
+    cursor.width = overText ? 7 : kArrowWidth;
+    cursor.height = overText ? 17 : kArrowHeight;
+    cursor.pixels.assign(static_cast<size_t>(cursor.width) * cursor.height * 4, 0);
+    for (int y = 0; y < cursor.height; y++) {
+        for (int x = 0; x < cursor.width; x++) {
+            uint32_t color;
+            if (overText) {
+                // Serifs at both ends of a one pixel stem
+                bool serif = y == 0 || y == cursor.height - 1;
+                if (!serif && x != cursor.width / 2) continue;
+                color = 0x000000;
+            } else {
+                // Black outline around a white triangle
+                int edge = std::min(y, kArrowWidth - 1) * 2 / 3;
+                if (y >= kArrowHeight - 3 || x > edge) continue;
+                color = x == 0 || x == edge || y == kArrowHeight - 4 ? 0x000000 : 0xFFFFFF;
+            }
+            storePixel(cursor.pixels.data() + (static_cast<size_t>(y) * cursor.width + x) * 4, color);
+        }
+    }
+    cursor.hotX = overText ? cursor.width / 2 : 0;
+    cursor.hotY = overText ? cursor.height / 2 : 0;
+    return true;
+}
+
+// Fill a clipped rectangle with a solid colour
+void SyntheticCaptureSource::fillRect(RawFrame& frame, int x, int y, int w, int h, uint32_t color) {
+    int x0 = std::max(0, x), y0 = std::max(0, y);
+    int x1 = std::min(frame.width, x + w), y1 = std::min(frame.height, y + h);
+    for (int row = y0; row < y1; row++) {
+        uint8_t* p = frame.pixels.data() + static_cast<size_t>(row) * frame.stride + x0 * 4;
+        for (int col = x0; col < x1; col++, p += 4) {
+            storePixel(p, color);
+        }
+    }
+}
+
+// Document window whose text scrolls by scrollSpeed pixels per frame
+void SyntheticCaptureSource::drawTextWindow(RawFrame& frame, int x, int y, int w, int h, uint64_t t) {
+    fillRect(frame, x, y, w, 24, 0x2B579A);
+    fillRect(frame, x, y + 24, w, h - 24, 0xFFFFFF);
+
+    int textTop = y + 24 + 8;
+    int textLeft = x + 12;
+    int columns = std::max(0, (w - 24) / kGlyphWidth);
+    uint64_t scroll = t * _options.scrollSpeed;
+
+    // Each document is a distant part of the same endless text
+    if (_options.documentCount > 1) {
+        uint64_t document = (t / std::max(1, _options.switchInterval)) % _options.documentCount;
+        scroll += document * 1000000;
+    }
+
+    for (int row = textTop; row < std::min(frame.height, y + h - 8); row++) {
+        uint64_t docY = (row - textTop) + scroll;
+        uint32_t line = static_cast<uint32_t>(docY / kLineHeight);
+        int glyphRow = static_cast<int>(docY % kLineHeight);
+        if (glyphRow >= kGlyphHeight) continue;
+
+        // Ragged right margin so lines look like prose
+        int lineLength = columns - static_cast<int>(mix(line, 0xABCD) % std::max(1, columns / 3 + 1));
+        uint8_t* p = frame.pixels.data() + static_cast<size_t>(row) * frame.stride;
+
+        for (int col = 0; col < lineLength; col++) {
+            uint32_t h32 = mix(line, col);
+            if ((h32 & 7) == 0) continue; // Word gap
+
+            uint8_t bits = _glyphs[(h32 >> 3) % kGlyphCount * kGlyphHeight + glyphRow];
+            int px = textLeft + col * kGlyphWidth;
+            for (int b = 0; b < kGlyphWidth && px + b < frame.width; b++) {
+                if (bits & (0x80 >> b)) {
+                    storePixel(p + (px + b) * 4, 0x202020);
+                }
+            }
+        }
+    }
+}
+
+// Application window with a title bar and some static content
+void SyntheticCaptureSource::drawMovingWindow(RawFrame& frame, int x, int y, int w, int h, uint32_t color) {
+    fillRect(frame, x, y, w, h, 0x404040);
+    fillRect(frame, x + 1, y + 1, w - 2, 22, 0x3C3C8C);
+    fillRect(frame, x + 1, y + 23, w - 2, h - 24, color);
+    for (int i = 0; i < 6; i++) {
+        fillRect(frame, x + 16, y + 40 + i * 28, (w - 32) / (1 + i % 3), 14, 0x8090A0);
+    }
+}
+
+// Plasma-like region where every pixel changes every frame
+void SyntheticCaptureSource::drawVideoRegion(RawFrame& frame, int x, int y, int w, int h, uint64_t t) {
+    int x0 = std::max(0, x), y0 = std::max(0, y);
+    int x1 = std::min(frame.width, x + w), y1 = std::min(frame.height, y + h);
+    uint32_t phase = static_cast<uint32_t>(t * 3);
+
+    for (int row = y0; row < y1; row++) {
+        uint8_t* p = frame.pixels.data() + static_cast<size_t>(row) * frame.stride + x0 * 4;
+        for (int col = x0; col < x1; col++, p += 4) {
+            uint32_t u = static_cast<uint32_t>(col - x0);
+            uint32_t v = static_cast<uint32_t>(row - y0);
+            uint32_t noise = mix(u >> 2, (v >> 2) ^ (phase << 8)) & 0x1F;
+            p[0] = static_cast<uint8_t>((u + phase * 2) ^ v);
+            p[1] = static_cast<uint8_t>(((u * v) >> 6) + phase + noise);
+            p[2] = static_cast<uint8_t>((v + phase) * 2 + noise);
+            p[3] = 0xFF;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "capture_source.h"
+
+/**
+ * Deterministic synthetic desktop generator for headless benchmarking
+ * Every frame is a pure function of its sequence number, so runs are reproducible
+ */
+class SyntheticCaptureSource : public CaptureSource {
+public:
+    struct Options {
+        bool scrollingText = true;   // Document window scrolling vertically
+        bool movingWindows = true;   // Windows dragged around the desktop
+        bool videoRegion = true;     // Fully changing video-like rectangle
+        int scrollSpeed = 4;         // Pixels scrolled per frame
+        int documentCount = 1;       // Documents the text window cycles through, like switching tabs
+        int switchInterval = 30;     // Frames between document switches
+    };
+
+    SyntheticCaptureSource(int width, int height);
+    SyntheticCaptureSource(int width, int height, const Options& options);
+    ~SyntheticCaptureSource() override = default;
+
+    bool grab(RawFrame& frame) override;
+    std::string name() const override { return "synthetic"; }
+
+    // Pointer circling the desktop centre, an I-beam over the document window; it moves
+    // with every call rather than every frame, like a real pointer over a static screen
+    bool grabCursor(CursorState& cursor) override;
+
+    std::vector<std::string> getMonitorInfo() override;
+
+    // Restart generation from the first frame
+    void reset() {
+        _frameIndex = 0;
+        _cursorIndex = 0;
+    }
+
+private:
+    // Scene elements drawn on top of the wallpaper
+    void drawTextWindow(RawFrame& frame, int x, int y, int w, int h, uint64_t t);
+    void drawMovingWindow(RawFrame& frame, int x, int y, int w, int h, uint32_t color);
+    void drawVideoRegion(RawFrame& frame, int x, int y, int w, int h, uint64_t t);
+    void fillRect(RawFrame& frame, int x, int y, int w, int h, uint32_t color);
+
+    int _width;
+    int _height;
+    Options _options;
+    uint64_t _frameIndex{0};
+    uint64_t _cursorIndex{0};
+
+    // Static background shared by all frames
+    std::vector<uint8_t> _wallpaper;
+
+    // 8x12 bitmaps for the synthetic glyph set, one row per byte
+    std::vector<uint8_t> _glyphs;
+};
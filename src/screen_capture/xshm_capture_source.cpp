@@ -0,0 +1,539 @@
+#include "xshm_capture_source.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xrandr.h>
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#endif
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace {
+    // Last X protocol error code, so a vanished window does not abort the process
+    std::atomic<int> g_lastXError{0};
+
+    int recordXError(Display* display, XErrorEvent* event) {
+        g_lastXError = event->error_code;
+        return 0;
+    }
+}
+
+// Shared-memory image state
+struct XShmCaptureSource::ShmImage {
+    XImage* image{nullptr};
+    XShmSegmentInfo info{};
+    bool attached{false};
+
+    // Pixmap over the same segment for partial read-back, when the server supports it
+    Pixmap pixmap{0};
+    GC gc{nullptr};
+};
+
+// Constructor
+XShmCaptureSource::XShmCaptureSource(const std::string& displayName)
+    : _shm(std::make_unique<ShmImage>()) {
+    Display* display = XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
+    if (!display) {
+        std::cerr << "Could not open X display: "
+                  << (displayName.empty() ? "$DISPLAY" : displayName) << std::endl;
+        return;
+    }
+
+    if (!XShmQueryExtension(display)) {
+        std::cerr << "MIT-SHM extension not available on X display" << std::endl;
+        XCloseDisplay(display);
+        return;
+    }
+
+    XSetErrorHandler(recordXError);
+
+    _display = display;
+    _screen = DefaultScreen(display);
+    _root = RootWindow(display, _screen);
+
+#ifdef HAVE_XDAMAGE
+    int damageErrorBase = 0;
+    if (XDamageQueryExtension(display, &_damageEventBase, &damageErrorBase)) {
+        _damage = XDamageCreate(display, _root, XDamageReportNonEmpty);
+    } else {
+        std::cerr << "XDamage not available, capturing full frames" << std::endl;
+    }
+
+    int fixesEventBase = 0;
+    int fixesErrorBase = 0;
+    int fixesMajor = 0;
+    int fixesMinor = 0;
+    _cursorImages = XFixesQueryExtension(display, &fixesEventBase, &fixesErrorBase) &&
+                    XFixesQueryVersion(display, &fixesMajor, &fixesMinor) && fixesMajor >= 1;
+#endif
+}
+
+// Destructor
+XShmCaptureSource::~XShmCaptureSource() {
+    destroyImage();
+
+#ifdef HAVE_XDAMAGE
+    if (_damage) {
+        XDamageDestroy(_display, _damage);
+    }
+#endif
+
+    if (_display) {
+        XCloseDisplay(_display);
+    }
+}
+
+// Monitor rectangles from RandR, or the whole root window without it
+std::vector<XShmCaptureSource::Region> XShmCaptureSource::getMonitorRegions() {
+    std::vector<Region> regions;
+    if (!_display) return regions;
+
+    int eventBase = 0, errorBase = 0;
+    if (XRRQueryExtension(_display, &eventBase, &errorBase)) {
+        int count = 0;
+        XRRMonitorInfo* monitors = XRRGetMonitors(_display, _root, True, &count);
+
+        for (int i = 0; i < count; i++) {
+            regions.push_back({monitors[i].x, monitors[i].y, monitors[i].width, monitors[i].height});
+        }
+
+        if (monitors) {
+            XRRFreeMonitors(monitors);
+        }
+    }
+
+    if (regions.empty()) {
+        regions.push_back({0, 0, DisplayWidth(_display, _screen), DisplayHeight(_display, _screen)});
+    }
+
+    return regions;
+}
+
+// Get information about available monitors
+std::vector<std::string> XShmCaptureSource::getMonitorInfo() {
+    std::vector<std::string> monitors;
+    std::vector<Region> regions = getMonitorRegions();
+
+    for (size_t i = 0; i < regions.size(); i++) {
+        std::stringstream info;
+        info << "Monitor " << i << ": " << DisplayString(_display) << " - "
+             << (i == 0 ? "Primary" : "Secondary") << " - "
+             << "Resolution: " << regions[i].width << "x" << regions[i].height;
+        monitors.push_back(info.str());
+    }
+
+    return monitors;
+}
+
+// Select monitor to capture
+void XShmCaptureSource::selectMonitor(int monitorIndex) {
+    _monitorIndex = monitorIndex;
+    _captureWindow = false;
+    _targetWindow = 0;
+}
+
+// Select window to capture
+bool XShmCaptureSource::selectWindow(WindowHandle windowHandle) {
+    if (!_display) return false;
+
+    XWindowAttributes attributes;
+    g_lastXError = 0;
+    if (!XGetWindowAttributes(_display, static_cast<Window>(windowHandle), &attributes) || g_lastXError) {
+        return false;
+    }
+
+    _targetWindow = windowHandle;
+    _captureWindow = true;
+
+    return true;
+}
+
+// Get a window title
+std::string XShmCaptureSource::getWindowTitle(WindowHandle window) {
+    std::string title;
+
+    Atom netWmName = XInternAtom(_display, "_NET_WM_NAME", False);
+    Atom utf8String = XInternAtom(_display, "UTF8_STRING", False);
+    Atom actualType;
+    int actualFormat;
+    unsigned long itemCount, bytesAfter;
+    unsigned char* data = nullptr;
+
+    if (XGetWindowProperty(_display, static_cast<Window>(window), netWmName, 0, 1024, False, utf8String,
+                           &actualType, &actualFormat, &itemCount, &bytesAfter, &data) == Success && data) {
+        title.assign(reinterpret_cast<char*>(data), itemCount);
+        XFree(data);
+    }
+
+    if (title.empty()) {
+        char* name = nullptr;
+        if (XFetchName(_display, static_cast<Window>(window), &name) && name) {
+            title = name;
+            XFree(name);
+        }
+    }
+
+    return title;
+}
+
+// Get list of windows
+std::vector<std::pair<WindowHandle, std::string>> XShmCaptureSource::getWindowList() {
+    std::vector<std::pair<WindowHandle, std::string>> windows;
+    if (!_display) return windows;
+
+    std::vector<Window> candidates;
+
+    // Prefer the window manager's client list
+    Atom clientList = XInternAtom(_display, "_NET_CLIENT_LIST", True);
+    Atom actualType;
+    int actualFormat;
+    unsigned long itemCount, bytesAfter;
+    unsigned char* data = nullptr;
+
+    if (clientList != None &&
+        XGetWindowProperty(_display, _root, clientList, 0, 4096, False, XA_WINDOW,
+                           &actualType, &actualFormat, &itemCount, &bytesAfter, &data) == Success && data) {
+        Window* list = reinterpret_cast<Window*>(data);
+        candidates.assign(list, list + itemCount);
+        XFree(data);
+    } else {
+        // No window manager (e.g. bare Xvfb), walk top-level windows instead
+        Window rootReturn, parentReturn;
+        Window* children = nullptr;
+        unsigned int childCount = 0;
+
+        if (XQueryTree(_display, _root, &rootReturn, &parentReturn, &children, &childCount)) {
+            candidates.assign(children, children + childCount);
+            if (children) XFree(children);
+        }
+    }
+
+    g_lastXError = 0;
+    for (Window window : candidates) {
+        // Skip invisible windows
+        XWindowAttributes attributes;
+        if (!XGetWindowAttributes(_display, window, &attributes) || attributes.map_state != IsViewable) {
+            continue;
+        }
+
+        std::string title = getWindowTitle(window);
+        if (!title.empty()) {
+            windows.push_back({static_cast<WindowHandle>(window), title});
+        }
+    }
+
+    return windows;
+}
+
+// Resolve the rectangle to read from the root window
+bool XShmCaptureSource::resolveRegion(Region& region) {
+    int rootWidth = DisplayWidth(_display, _screen);
+    int rootHeight = DisplayHeight(_display, _screen);
+
+    if (_captureWindow && _targetWindow != 0) {
+        XWindowAttributes attributes;
+        Window child;
+        int x = 0, y = 0;
+
+        g_lastXError = 0;
+        if (!XGetWindowAttributes(_display, static_cast<Window>(_targetWindow), &attributes) ||
+            !XTranslateCoordinates(_display, static_cast<Window>(_targetWindow), _root, 0, 0, &x, &y, &child) ||
+            g_lastXError) {
+            std::cerr << "Target window is no longer available" << std::endl;
+            return false;
+        }
+
+        region = {x, y, attributes.width, attributes.height};
+    } else {
+        std::vector<Region> monitors = getMonitorRegions();
+        if (_monitorIndex < 0 || _monitorIndex >= static_cast<int>(monitors.size())) {
+            _monitorIndex = 0; // Default to primary monitor
+        }
+        region = monitors[_monitorIndex];
+    }
+
+    // Clip to the root window, XShmGetImage fails on out-of-bounds reads
+    int x0 = std::max(0, region.x);
+    int y0 = std::max(0, region.y);
+    int x1 = std::min(rootWidth, region.x + region.width);
+    int y1 = std::min(rootHeight, region.y + region.height);
+    region = {x0, y0, x1 - x0, y1 - y0};
+
+    return region.width > 0 && region.height > 0;
+}
+
+// Create the shared image for the given size, reusing the current one when possible
+bool XShmCaptureSource::ensureImage(int width, int height) {
+    if (_shm->image && _shm->image->width == width && _shm->image->height == height) {
+        return true;
+    }
+
+    destroyImage();
+
+    XImage* image = XShmCreateImage(_display, DefaultVisual(_display, _screen), DefaultDepth(_display, _screen),
+                                    ZPixmap, nullptr, &_shm->info, width, height);
+    if (!image) {
+        std::cerr << "XShmCreateImage failed" << std::endl;
+        return false;
+    }
+
+    if (image->bits_per_pixel != 32) {
+        std::cerr << "Unsupported X visual: " << image->bits_per_pixel << " bits per pixel" << std::endl;
+        XDestroyImage(image);
+        return false;
+    }
+
+    _shm->info.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(image->bytes_per_line) * image->height,
+                              IPC_CREAT | 0600);
+    if (_shm->info.shmid < 0) {
+        std::cerr << "shmget failed for capture segment" << std::endl;
+        XDestroyImage(image);
+        return false;
+    }
+
+    _shm->info.shmaddr = image->data = static_cast<char*>(shmat(_shm->info.shmid, nullptr, 0));
+    _shm->info.readOnly = False;
+    _shm->image = image;
+
+    g_lastXError = 0;
+    if (_shm->info.shmaddr == reinterpret_cast<char*>(-1) || !XShmAttach(_display, &_shm->info)) {
+        std::cerr << "Failed to attach capture segment" << std::endl;
+        destroyImage();
+        return false;
+    }
+    XSync(_display, False);
+    _shm->attached = g_lastXError == 0;
+
+    // Mark for removal now so the segment is freed even if the process dies
+    shmctl(_shm->info.shmid, IPC_RMID, nullptr);
+
+    if (!_shm->attached) {
+        std::cerr << "X server could not attach capture segment" << std::endl;
+        destroyImage();
+        return false;
+    }
+
+    // Damaged areas are copied into a pixmap sharing the segment, so only they cross into it
+    int major = 0, minor = 0;
+    Bool sharedPixmaps = False;
+    if (_damage && XShmQueryVersion(_display, &major, &minor, &sharedPixmaps) && sharedPixmaps &&
+        XShmPixmapFormat(_display) == ZPixmap) {
+        _shm->pixmap = XShmCreatePixmap(_display, _root, _shm->info.shmaddr, &_shm->info,
+                                        width, height, DefaultDepth(_display, _screen));
+
+        XGCValues values;
+        values.subwindow_mode = IncludeInferiors;
+        _shm->gc = XCreateGC(_display, _shm->pixmap, GCSubwindowMode, &values);
+    }
+
+    _fullRefresh = true;
+    return true;
+}
+
+// Release the shared image and segment
+void XShmCaptureSource::destroyImage() {
+    if (!_shm || !_shm->image) return;
+
+    if (_shm->gc) {
+        XFreeGC(_display, _shm->gc);
+    }
+
+    if (_shm->pixmap) {
+        XFreePixmap(_display, _shm->pixmap);
+    }
+
+    if (_shm->attached) {
+        XShmDetach(_display, &_shm->info);
+        XSync(_display, False);
+    }
+
+    if (_shm->info.shmaddr && _shm->info.shmaddr != reinterpret_cast<char*>(-1)) {
+        shmdt(_shm->info.shmaddr);
+    }
+
+    // Data belongs to the segment, not to Xlib
+    _shm->image->data = nullptr;
+    XDestroyImage(_shm->image);
+
+    *_shm = ShmImage();
+}
+
+// Collect damaged rectangles since the last call
+bool XShmCaptureSource::fetchDamage(const Region& region, std::vector<CaptureRect>& rects) {
+#ifdef HAVE_XDAMAGE
+    // Drain damage notifications, the accumulated region is what matters
+    XEvent event;
+    while (XPending(_display)) {
+        XNextEvent(_display, &event);
+    }
+
+    XserverRegion damaged = XFixesCreateRegion(_display, nullptr, 0);
+    XDamageSubtract(_display, _damage, None, damaged);
+
+    int count = 0;
+    XRectangle* boxes = XFixesFetchRegion(_display, damaged, &count);
+
+    for (int i = 0; i < count; i++) {
+        // Clip to the capture region and make region-relative
+        int x0 = std::max<int>(boxes[i].x, region.x);
+        int y0 = std::max<int>(boxes[i].y, region.y);
+        int x1 = std::min<int>(boxes[i].x + boxes[i].width, region.x + region.width);
+        int y1 = std::min<int>(boxes[i].y + boxes[i].height, region.y + region.height);
+
+        if (x1 > x0 && y1 > y0) {
+            rects.push_back({x0 - region.x, y0 - region.y, x1 - x0, y1 - y0});
+        }
+    }
+
+    if (boxes) XFree(boxes);
+    XFixesDestroyRegion(_display, damaged);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Read back damaged rectangles into the shared segment
+bool XShmCaptureSource::readBack(const Region& region, const std::vector<CaptureRect>& rects) {
+    g_lastXError = 0;
+
+    if (!_shm->pixmap) {
+        // No shared pixmaps, fall back to one full-region read
+        return XShmGetImage(_display, static_cast<Window>(_root), _shm->image, region.x, region.y, AllPlanes) &&
+               !g_lastXError;
+    }
+
+    for (const CaptureRect& rect : rects) {
+        XCopyArea(_display, static_cast<Window>(_root), _shm->pixmap, _shm->gc,
+                  region.x + rect.x, region.y + rect.y, rect.width, rect.height, rect.x, rect.y);
+    }
+
+    // Wait for the copies to land in the segment
+    XSync(_display, False);
+    return !g_lastXError;
+}
+
+// Capture the selected region with a single shared-memory read
+bool XShmCaptureSource::grab(RawFrame& frame) {
+    if (!_display) return false;
+
+    Region region;
+    if (!resolveRegion(region) || !ensureImage(region.width, region.height)) {
+        return false;
+    }
+
+    if (region.x != _lastRegion.x || region.y != _lastRegion.y ||
+        region.width != _lastRegion.width || region.height != _lastRegion.height) {
+        _fullRefresh = true;
+    }
+
+    // Always fetch so damage does not accumulate across a full refresh
+    std::vector<CaptureRect>& dirty = frame.dirtyRects;
+    dirty.clear();
+    bool tracked = _damage != 0 && fetchDamage(region, dirty);
+
+    if (!tracked || _fullRefresh) {
+        g_lastXError = 0;
+        if (!XShmGetImage(_display, static_cast<Window>(_root), _shm->image, region.x, region.y, AllPlanes) ||
+            g_lastXError) {
+            std::cerr << "XShmGetImage failed" << std::endl;
+            return false;
+        }
+
+        dirty.assign(1, CaptureRect{0, 0, region.width, region.height});
+    } else if (!dirty.empty() && !readBack(region, dirty)) {
+        std::cerr << "Damage read-back failed" << std::endl;
+        _fullRefresh = true;
+        return false;
+    }
+
+    _fullRefresh = false;
+    _lastRegion = region;
+
+    // ZPixmap at 32 bpp is BGRX on little-endian hosts, matching RawFrame
+    const char* src = _shm->image->data;
+    int srcStride = _shm->image->bytes_per_line;
+
+    // Buffers holding our previous output only need the damaged areas refreshed
+    bool incremental = tracked && _generation != 0 && frame.sourceGeneration == _generation &&
+                       frame.width == region.width && frame.height == region.height;
+
+    frame.width = region.width;
+    frame.height = region.height;
+    frame.stride = region.width * 4;
+    frame.pixels.resize(static_cast<size_t>(frame.stride) * frame.height);
+
+    if (incremental) {
+        for (const CaptureRect& rect : dirty) {
+            for (int y = rect.y; y < rect.y + rect.height; y++) {
+                std::memcpy(frame.pixels.data() + static_cast<size_t>(y) * frame.stride + rect.x * 4,
+                            src + static_cast<size_t>(y) * srcStride + rect.x * 4,
+                            static_cast<size_t>(rect.width) * 4);
+            }
+        }
+    } else if (srcStride == frame.stride) {
+        std::memcpy(frame.pixels.data(), src, frame.pixels.size());
+    } else {
+        for (int y = 0; y < frame.height; y++) {
+            std::memcpy(frame.pixels.data() + static_cast<size_t>(y) * frame.stride,
+                        src + static_cast<size_t>(y) * srcStride, frame.stride);
+        }
+    }
+
+    frame.dirtyRectsValid = tracked;
+    frame.sourceGeneration = ++_generation;
+
+    return true;
+}
+
+// Read the pointer position and, when it changed, its shape
+bool XShmCaptureSource::grabCursor(CursorState& cursor) {
+#ifdef HAVE_XDAMAGE
+    if (!_display || !_cursorImages) return false;
+
+    XFixesCursorImage* image = XFixesGetCursorImage(_display);
+    if (!image) {
+        return false;
+    }
+
+    // Relative to the area of the last grab, so it matches the frames
+    cursor.x = image->x - _lastRegion.x;
+    cursor.y = image->y - _lastRegion.y;
+    cursor.visible = true;
+
+    if (image->cursor_serial != cursor.shapeSerial || cursor.pixels.empty()) {
+        cursor.shapeSerial = image->cursor_serial;
+        cursor.width = image->width;
+        cursor.height = image->height;
+        cursor.hotX = image->xhot;
+        cursor.hotY = image->yhot;
+
+        // One premultiplied ARGB pixel per unsigned long, whatever its size
+        size_t count = static_cast<size_t>(image->width) * image->height;
+        cursor.pixels.resize(count * 4);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t argb = static_cast<uint32_t>(image->pixels[i]);
+            uint32_t alpha = argb >> 24;
+            uint8_t* p = cursor.pixels.data() + i * 4;
+            for (int c = 0; c < 3; c++) {
+                uint32_t value = (argb >> (c * 8)) & 0xFF;
+                p[c] = static_cast<uint8_t>(alpha ? std::min<uint32_t>(255, (value * 255 + alpha / 2) / alpha) : 0);
+            }
+            p[3] = static_cast<uint8_t>(alpha);
+        }
+    }
+
+    XFree(image);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -1,12 +1,33 @@
 #include "screen_sharing.h"
+#include "encoding/frame_protocol.h"
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <climits>
+#include <cstdlib>
 #include <sstream>
 
+namespace {
+    // Tell a client which part of the screen a frame shows
+    FrameEncoder::Buffer packViewportMessage(const ScreenCapture::FrameData& frame) {
+        CaptureRect rect = frame.viewport;
+        if (rect.width <= 0 || rect.height <= 0) {
+            rect = {0, 0, frame.screenWidth, frame.screenHeight};
+        }
+        std::vector<uint8_t> message;
+        frame_protocol::packViewport(rect.x, rect.y, rect.width, rect.height, frame.screenWidth, frame.screenHeight,
+                                     message);
+        return std::make_shared<const std::vector<uint8_t>>(std::move(message));
+    }
+}
+
 // Constructor
-ScreenSharing::ScreenSharing() {
-    _screenCapture = std::make_unique<ScreenCapture>();
+ScreenSharing::ScreenSharing(CaptureSourcePool* sources) : _sources(sources) {
+    std::unique_ptr<CaptureSource> source;
+    if (_sources) {
+        source = _sources->open(_captureTarget, [] { return createPlatformCaptureSource(); });
+    }
+    _screenCapture = std::make_unique<ScreenCapture>(100, 70, std::move(source));
     _inputHandler = std::make_unique<InputHandler>();
 }
 
@@ -31,20 +52,39 @@ bool ScreenSharing::startSharing(int width, int height, int quality, int fps) {
     _width = width;
     _height = height;
     _quality = quality;
-    _fps = fps;
+    _fps = std::clamp(fps, 1, 240);
     
     // Configure screen capture
     _screenCapture->setQuality(quality);
-    _screenCapture->setCaptureInterval(1000 / fps);
+    _screenCapture->setFrameRate(_fps);
+    _screenCapture->setOutputSize(width, height);
+    _screenCapture->setOutputScale(1.0);
+    _screenCapture->setEncodingMode(_encodingMode);
+    _encodingMode = _screenCapture->getEncodingMode();
+    _screenCapture->requestKeyframe();
     
-    // Set frame callback
+    // Deliver frames to each client
     _screenCapture->setFrameCallback([this](const ScreenCapture::FrameData& frame) {
-        if (_frameCallback) {
-            // Call the user-provided callback with the JPEG data
-            _frameCallback(frame.jpegData, frame.width, frame.height);
-        }
+        deliverFrame(frame);
+    });
+    
+    // Pointer updates bypass the frames
+    _screenCapture->setCursorCallback([this](const CursorEncoder::Update& cursor) {
+        deliverCursor(cursor);
+    });
+    
+    // Tiles every client already holds are referenced instead of encoded
+    _screenCapture->setTileCacheQuery([this](uint64_t hash) {
+        return allViewersCache(hash);
     });
     
+    {
+        std::lock_guard<std::mutex> viewersLock(_viewersMutex);
+        resetViewers();
+        resetRateControl();
+    }
+    updateOutputs();
+    
     // Start capture
     if (!_screenCapture->start()) {
         std::cerr << "Failed to start screen capture" << std::endl;
@@ -53,9 +93,6 @@ bool ScreenSharing::startSharing(int width, int height, int quality, int fps) {
     
     _isSharing = true;
     
-    // Start processing thread
-    _processingThread = std::thread(&ScreenSharing::processingLoop, this);
-    
     return true;
 }
 
@@ -69,10 +106,834 @@ void ScreenSharing::stopSharing() {
     
     // Stop screen capture
     _screenCapture->stop();
+}
+
+// Set encoding mode
+bool ScreenSharing::setEncodingMode(const std::string& mode, int tileSize, int keyframeInterval, bool regionCoding) {
+    // Mode changes and session starts from different clients go through one at a time
+    std::lock_guard<std::mutex> sessionLock(_mutex);
+    
+    if (mode == "jpeg") {
+        _encodingMode = ScreenCapture::EncodingMode::JPEG;
+    } else if (mode == "tiles") {
+        if (tileSize < 16 || tileSize > 256 || tileSize % 16 != 0) {
+            std::cerr << "Invalid tile size: " << tileSize << std::endl;
+            return false;
+        }
+        _encodingMode = ScreenCapture::EncodingMode::TILES;
+        _screenCapture->setTileOptions(tileSize, keyframeInterval, true, regionCoding);
+        
+        // Cache slots are sized for one tile size
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        if (tileSize != _tileSize) {
+            _tileSize = tileSize;
+            resetViewers();
+        }
+    } else if (mode == "lossless") {
+        _encodingMode = ScreenCapture::EncodingMode::LOSSLESS;
+        _screenCapture->setLosslessOptions(keyframeInterval);
+    } else if (mode == "video") {
+        _encodingMode = ScreenCapture::EncodingMode::VIDEO;
+        _screenCapture->setVideoOptions(keyframeInterval);
+    } else {
+        std::cerr << "Unknown encoding mode: " << mode << std::endl;
+        return false;
+    }
+    
+    if (_isSharing) {
+        _screenCapture->setEncodingMode(_encodingMode);
+        _encodingMode = _screenCapture->getEncodingMode();
+        _screenCapture->requestKeyframe();
+        
+        // Cached frames of the old mode cannot bring a client up to date any more
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        _joinFrames.clear();
+    }
+    
+    // Output profiles only apply to whole frames
+    updateOutputs();
+    return true;
+}
+
+// Get current encoding mode name
+std::string ScreenSharing::getEncodingMode() const {
+    switch (_encodingMode) {
+    case ScreenCapture::EncodingMode::TILES:
+        return "tiles";
+    case ScreenCapture::EncodingMode::LOSSLESS:
+        return "lossless";
+    case ScreenCapture::EncodingMode::VIDEO:
+        return "video";
+    default:
+        return "jpeg";
+    }
+}
+
+// Enable or disable rate control
+void ScreenSharing::setAdaptive(bool adaptive) {
+    std::lock_guard<std::mutex> lock(_viewersMutex);
+    _adaptive = adaptive;
+    resetRateControl();
+}
+
+// Set the latency budget
+void ScreenSharing::setLatencyBudget(double latencyBudgetMs) {
+    std::lock_guard<std::mutex> lock(_viewersMutex);
+    _latencyBudgetMs = std::max(10.0, latencyBudgetMs);
+    resetRateControl();
+}
+
+// Register a client
+void ScreenSharing::addViewer(ViewerId id) {
+    std::vector<FrameEncoder::Codec> codecs;
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        Viewer& viewer = _viewers[id];
+        if (_tileCacheBudget > 0) {
+            viewer.tileCache = std::make_unique<TileCache>(_tileCacheBudget, _tileSize);
+        }
+        viewer.rate.setLatencyBudget(_latencyBudgetMs);
+        viewer.rate.setLimits(_quality, _fps);
+        _rateDirty = true;
+        codecs = collectImageCodecs();
+    }
+    
+    // Bring the new client up to date, in JPEG until it names its codecs
+    _screenCapture->setImageCodecs(codecs);
+    updateOutputs();
+    catchUp(id);
+}
+
+// Forget a client
+void ScreenSharing::removeViewer(ViewerId id) {
+    std::vector<FrameEncoder::Codec> codecs;
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        handOverSession(id);
+        _viewers.erase(id);
+        
+        // The slowest client may have left
+        _rateDirty = true;
+        codecs = collectImageCodecs();
+        
+        bool cursorViewers = std::any_of(_viewers.begin(), _viewers.end(),
+                                         [](const auto& entry) { return entry.second.cursor; });
+        if (!cursorViewers) {
+            _screenCapture->setCursorRate(0.0);
+        }
+    }
+    
+    // Stop encoding formats nobody decodes any more, the viewport may grow back to the whole screen
+    _screenCapture->setImageCodecs(codecs);
+    updateOutputs();
+}
+
+// Count clients
+size_t ScreenSharing::getViewerCount() {
+    std::lock_guard<std::mutex> lock(_viewersMutex);
+    return _viewers.size();
+}
+
+// Check for other watching clients
+bool ScreenSharing::isWatchedByOthers(ViewerId id) const {
+    return std::any_of(_viewers.begin(), _viewers.end(), [id](const auto& entry) {
+        return entry.first != id && entry.second.watching;
+    });
+}
+
+// Pass the session on to another watching client
+void ScreenSharing::handOverSession(ViewerId id) {
+    auto it = _viewers.find(id);
+    if (it == _viewers.end() || !it->second.owner) {
+        return;
+    }
+    it->second.owner = false;
+    
+    auto next = std::find_if(_viewers.begin(), _viewers.end(), [id](const auto& entry) {
+        return entry.first != id && entry.second.watching;
+    });
+    if (next != _viewers.end()) {
+        next->second.owner = true;
+    }
+}
+
+// Check a client's right to change the session
+bool ScreenSharing::canConfigure(ViewerId id) {
+    if (!_isSharing) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(_viewersMutex);
+    auto it = _viewers.find(id);
+    return it != _viewers.end() && it->second.owner;
+}
+
+// Enable cursor messages for a client
+void ScreenSharing::setCursorUpdates(ViewerId id, bool enabled, double fps) {
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        auto it = _viewers.find(id);
+        if (it != _viewers.end()) {
+            it->second.cursor = enabled;
+        }
+        
+        // One poll rate serves every client
+        if (enabled) {
+            _cursorFps = std::clamp(fps, 0.0, 240.0);
+        }
+        bool cursorViewers = std::any_of(_viewers.begin(), _viewers.end(),
+                                         [](const auto& entry) { return entry.second.cursor; });
+        _screenCapture->setCursorRate(cursorViewers ? _cursorFps : 0.0);
+    }
     
-    // Join processing thread
-    if (_processingThread.joinable()) {
-        _processingThread.join();
+    // The pointer is sent again so the client does not wait for it to move
+    if (enabled) {
+        _screenCapture->resendCursor();
+    }
+}
+
+// Set a client's viewport
+void ScreenSharing::setViewport(ViewerId id, const CaptureRect& viewport, int displayWidth, int displayHeight,
+                                bool thumbnail) {
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        auto it = _viewers.find(id);
+        if (it == _viewers.end()) {
+            return;
+        }
+        bool empty = viewport.width <= 0 || viewport.height <= 0;
+        it->second.viewport = empty ? CaptureRect() : viewport;
+        it->second.displayWidth = std::max(displayWidth, 0);
+        it->second.displayHeight = std::max(displayHeight, 0);
+        it->second.thumbnail = thumbnail;
+    }
+    
+    updateOutputs();
+}
+
+// Combine the clients' viewports and output profiles
+void ScreenSharing::updateOutputs() {
+    CaptureRect crop;
+    int outputWidth = _width;
+    int outputHeight = _height;
+    bool thumbnails = false;
+    double thumbnailFps = 0.0;
+    int thumbnailSize = 0;
+    std::vector<ScreenCapture::OutputProfile> profiles;
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        thumbnailFps = _thumbnailFps;
+        thumbnailSize = _thumbnailSize;
+        
+        // Encoding is shared, so the crop covers every client's viewport and a client
+        // without one needs the whole screen; the output fits the largest client
+        bool cropped = !_viewers.empty();
+        int left = INT_MAX, top = INT_MAX, right = INT_MIN, bottom = INT_MIN;
+        if (!_viewers.empty()) {
+            outputWidth = 0;
+            outputHeight = 0;
+        }
+        for (const auto& [id, viewer] : _viewers) {
+            auto [boxWidth, boxHeight] = getOutputBox(viewer);
+            outputWidth = std::max(outputWidth, boxWidth);
+            outputHeight = std::max(outputHeight, boxHeight);
+            
+            const CaptureRect& rect = viewer.viewport;
+            if (rect.width <= 0 || rect.height <= 0) {
+                cropped = false;
+                continue;
+            }
+            left = std::min(left, rect.x);
+            top = std::min(top, rect.y);
+            right = std::max(right, rect.x + rect.width);
+            bottom = std::max(bottom, rect.y + rect.height);
+            thumbnails |= viewer.thumbnail;
+        }
+        
+        if (cropped) {
+            crop = {left, top, right - left, bottom - top};
+        } else {
+            thumbnails = false;
+        }
+        
+        profiles = collectProfiles();
+        _appliedProfiles = profiles;
+    }
+    
+    // The encode stage takes the lock order encoder -> viewers, so update it outside the lock
+    _screenCapture->setViewport(crop);
+    _screenCapture->setOutputSize(outputWidth, outputHeight);
+    _screenCapture->setThumbnailOptions(thumbnailSize, thumbnailSize, thumbnails ? thumbnailFps : 0.0);
+    _screenCapture->setOutputProfiles(profiles);
+}
+
+// Get a client's output size
+std::pair<int, int> ScreenSharing::getOutputBox(const Viewer& viewer) const {
+    // A client viewing part of the screen shows it at its display size
+    bool viewport = viewer.viewport.width > 0 && viewer.viewport.height > 0;
+    if (viewport && viewer.displayWidth > 0 && viewer.displayHeight > 0) {
+        return {viewer.displayWidth, viewer.displayHeight};
+    }
+    return {viewer.width > 0 ? viewer.width : _width, viewer.height > 0 ? viewer.height : _height};
+}
+
+// Assign the clients' output profiles
+std::vector<ScreenCapture::OutputProfile> ScreenSharing::collectProfiles() {
+    // Tile, lossless and video deltas build on every earlier frame, so those streams stay shared
+    std::vector<ScreenCapture::OutputProfile> profiles;
+    if (_encodingMode != ScreenCapture::EncodingMode::JPEG) {
+        return profiles;
+    }
+    
+    // Rate control steps through a short ladder, so clients mostly fall into a few profiles
+    for (auto& [id, viewer] : _viewers) {
+        ScreenCapture::OutputProfile& profile = viewer.profile;
+        std::tie(profile.maxWidth, profile.maxHeight) = getOutputBox(viewer);
+        profile.codec = viewer.codec;
+        profile.quality = viewer.quality > 0 ? viewer.quality : _quality;
+        profile.scale = 1.0;
+        if (_adaptive) {
+            RateController::Target target = viewer.rate.getTarget();
+            profile.quality = target.quality;
+            profile.scale = target.scale;
+        }
+        profiles.push_back(profile);
+    }
+    std::sort(profiles.begin(), profiles.end());
+    profiles.erase(std::unique(profiles.begin(), profiles.end()), profiles.end());
+    return profiles;
+}
+
+// Pick a client's whole-frame codec
+FrameEncoder::Codec ScreenSharing::negotiateCodec(ViewerId id, const std::vector<std::string>& codecs) {
+    FrameEncoder::Codec chosen = FrameEncoder::Codec::JPEG;
+    for (const std::string& name : codecs) {
+        FrameEncoder::Codec codec;
+        if (FrameEncoder::parseCodec(name, codec) && FrameEncoder::isAvailable(codec)) {
+            chosen = codec;
+            break;
+        }
+    }
+    
+    std::vector<FrameEncoder::Codec> active;
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        auto it = _viewers.find(id);
+        if (it == _viewers.end()) {
+            return chosen;
+        }
+        if (it->second.codec != chosen) {
+            it->second.codec = chosen;
+            it->second.current = false;
+        }
+        active = collectImageCodecs();
+    }
+    
+    // The encode stage takes the lock order encoder -> viewers, so update it outside the lock
+    _screenCapture->setImageCodecs(active);
+    updateOutputs();
+    return chosen;
+}
+
+// Collect the clients' codecs
+std::vector<FrameEncoder::Codec> ScreenSharing::collectImageCodecs() const {
+    bool used[FrameEncoder::kCodecCount] = {};
+    used[static_cast<size_t>(FrameEncoder::Codec::JPEG)] = _viewers.empty();
+    for (const auto& [id, viewer] : _viewers) {
+        used[static_cast<size_t>(viewer.codec)] = true;
+    }
+    
+    std::vector<FrameEncoder::Codec> codecs;
+    for (size_t i = 0; i < FrameEncoder::kCodecCount; i++) {
+        if (used[i]) {
+            codecs.push_back(static_cast<FrameEncoder::Codec>(i));
+        }
+    }
+    return codecs;
+}
+
+// Set the per-client tile cache budget
+void ScreenSharing::setTileCacheBudget(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        if (bytes == _tileCacheBudget) {
+            return;
+        }
+        _tileCacheBudget = bytes;
+        resetViewers();
+    }
+    
+    _screenCapture->requestKeyframe();
+}
+
+// Reset every client's tile state
+void ScreenSharing::resetViewers() {
+    for (auto& [id, viewer] : _viewers) {
+        viewer.tileCache.reset();
+        if (_tileCacheBudget > 0) {
+            viewer.tileCache = std::make_unique<TileCache>(_tileCacheBudget, _tileSize);
+        }
+        viewer.tablesVersion = 0;
+        viewer.needsKeyframe = true;
+        viewer.current = false;
+        viewer.sentViewport = CaptureRect();
+    }
+    _joinFrames.clear();
+}
+
+// Restart every client's rate controller from the session settings
+void ScreenSharing::resetRateControl() {
+    for (auto& [id, viewer] : _viewers) {
+        viewer.rate = RateController(_latencyBudgetMs);
+        viewer.rate.setLimits(viewer.quality > 0 ? viewer.quality : _quality, _fps);
+    }
+    
+    // Force the next frame to push settings, the session may have changed them directly
+    _appliedQuality = -1;
+    _rateDirty = true;
+}
+
+// Combine the clients' rate targets
+bool ScreenSharing::updateRateTargets(std::chrono::steady_clock::time_point now, int& quality, double& fps,
+                                      double& scale, std::vector<ScreenCapture::OutputProfile>& profiles) {
+    bool changed = _rateDirty;
+    _rateDirty = false;
+    
+    quality = _quality;
+    fps = _fps;
+    scale = 1.0;
+    profiles.clear();
+    
+    if (_adaptive && !_viewers.empty()) {
+        for (auto& [id, viewer] : _viewers) {
+            double rttMs = 0.0;
+            uint64_t bytesInFlight = 0;
+            if (_networkInfoCallback && _networkInfoCallback(id, rttMs, bytesInFlight)) {
+                viewer.rate.onNetworkInfo(rttMs, bytesInFlight);
+            }
+            changed |= viewer.rate.update(now);
+        }
+        if (!changed) {
+            return false;
+        }
+        
+        // JPEG frames are paced per client and capture runs at the fastest rate, each client's quality
+        // and scale go into its output profile. Tile, lossless and video encoding is shared, so quality
+        // and scale follow the slowest client and the deltas need every frame
+        bool perClient = _encodingMode == ScreenCapture::EncodingMode::JPEG;
+        quality = 100;
+        fps = perClient ? 0.0 : 240.0;
+        for (const auto& [id, viewer] : _viewers) {
+            RateController::Target target = viewer.rate.getTarget();
+            quality = std::min(quality, target.quality);
+            fps = perClient ? std::max(fps, target.fps) : std::min(fps, target.fps);
+            scale = perClient ? 1.0 : std::min(scale, target.scale);
+        }
+    }
+    
+    if (!changed) {
+        return false;
+    }
+    profiles = collectProfiles();
+    if (quality == _appliedQuality && fps == _appliedFps && scale == _appliedScale && profiles == _appliedProfiles) {
+        return false;
+    }
+    
+    _appliedQuality = quality;
+    _appliedFps = fps;
+    _appliedScale = scale;
+    _appliedProfiles = profiles;
+    return true;
+}
+
+// Push encoder settings to the capture pipeline
+void ScreenSharing::applyRateTargets(int quality, double fps, double scale,
+                                     const std::vector<ScreenCapture::OutputProfile>& profiles) {
+    _screenCapture->setQuality(quality);
+    _screenCapture->setFrameRate(fps);
+    _screenCapture->setOutputScale(scale);
+    _screenCapture->setOutputProfiles(profiles);
+}
+
+// Check whether every client caches a tile
+bool ScreenSharing::allViewersCache(uint64_t hash) {
+    std::lock_guard<std::mutex> lock(_viewersMutex);
+    if (_viewers.empty()) {
+        return false;
+    }
+    
+    for (const auto& [id, viewer] : _viewers) {
+        if (!viewer.tileCache || !viewer.tileCache->contains(hash)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Send a frame to every client
+void ScreenSharing::deliverFrame(const ScreenCapture::FrameData& frame) {
+    if (!_sendCallback) {
+        return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    
+    // A static screen sends a tiny heartbeat instead of frames, one per frame size clients receive
+    std::vector<std::pair<std::pair<int, int>, std::shared_ptr<const std::vector<uint8_t>>>> heartbeats;
+    auto heartbeatFor = [&heartbeats](int width, int height) {
+        for (const auto& [size, message] : heartbeats) {
+            if (size == std::make_pair(width, height)) {
+                return message;
+            }
+        }
+        std::vector<uint8_t> message;
+        frame_protocol::packHeartbeat(width, height, message);
+        heartbeats.emplace_back(std::make_pair(width, height), std::make_shared<const std::vector<uint8_t>>(std::move(message)));
+        return heartbeats.back().second;
+    };
+    
+    // A client hears which part of the screen the frames show before its first frame of a new viewport
+    std::shared_ptr<const std::vector<uint8_t>> viewport = packViewportMessage(frame);
+    
+    // Only thumbnails changed, the frame itself has nothing to send
+    bool thumbnailOnly = !frame.tiles && !frame.heartbeat && (!frame.data || frame.data->empty());
+    
+    // JPEG frames are shared by every viewer, tile updates are packed per viewer
+    std::vector<std::pair<ViewerId, std::shared_ptr<const std::vector<uint8_t>>>> messages;
+    bool keyframeNeeded = false;
+    
+    // Cursor positions are in frame pixels, so a client whose frame size changed needs the pointer again
+    bool cursorResend = false;
+    auto frameSent = [&cursorResend](Viewer& viewer, int width, int height) {
+        if (viewer.frameWidth != width || viewer.frameHeight != height) {
+            viewer.frameWidth = width;
+            viewer.frameHeight = height;
+            cursorResend |= viewer.cursor;
+        }
+    };
+    
+    // Queue the viewport message when a client has not seen the frame's viewport yet
+    auto announceViewport = [&](ViewerId id, Viewer& viewer) {
+        const CaptureRect& sent = viewer.sentViewport;
+        if (sent.x != frame.viewport.x || sent.y != frame.viewport.y ||
+            sent.width != frame.viewport.width || sent.height != frame.viewport.height) {
+            messages.emplace_back(id, viewport);
+            viewer.sentViewport = frame.viewport;
+        }
+    };
+    
+    // Catch-up sends for joining clients wait until this frame is out
+    std::unique_lock<std::mutex> deliveryLock(_deliveryMutex);
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        recordJoinFrame(frame);
+        for (auto& [id, viewer] : _viewers) {
+            if (viewer.joining) {
+                continue;
+            }
+            if (frame.thumbnail && viewer.thumbnail) {
+                messages.emplace_back(id, frame.thumbnail);
+            }
+            if (thumbnailOnly) {
+                continue;
+            }
+            
+            if (frame.mode == ScreenCapture::EncodingMode::LOSSLESS || frame.mode == ScreenCapture::EncodingMode::VIDEO) {
+                // Deltas only apply on top of everything since the client's keyframe
+                if (frame.heartbeat) {
+                    messages.emplace_back(id, heartbeatFor(frame.width, frame.height));
+                } else if (viewer.needsKeyframe && !frame.keyframe) {
+                    keyframeNeeded = true;
+                } else if (frame.data) {
+                    announceViewport(id, viewer);
+                    messages.emplace_back(id, frame.data);
+                    frameSent(viewer, frame.width, frame.height);
+                    viewer.needsKeyframe = false;
+                }
+                continue;
+            }
+            
+            if (!frame.tiles) {
+                // A client whose profile changed gets its first image in the next frame
+                FrameEncoder::Buffer image;
+                int width = 0;
+                int height = 0;
+                if (!findImage(frame, viewer, image, width, height)) {
+                    viewer.current = false;
+                    continue;
+                }
+                if (frame.heartbeat && (viewer.current || !image)) {
+                    messages.emplace_back(id, heartbeatFor(width, height));
+                } else if (image && (frame.heartbeat || frame.refinement || !_adaptive ||
+                                     (frame.burst && viewer.rate.getStats().level == 0) || viewer.rate.shouldSend(now))) {
+                    // Full frames are self-contained, so each client can skip to its own rate;
+                    // once the screen is static, clients that skipped its last change catch up.
+                    // Input bursts go to every client that is not being throttled
+                    announceViewport(id, viewer);
+                    messages.emplace_back(id, image);
+                    frameSent(viewer, width, height);
+                    viewer.current = true;
+                } else {
+                    viewer.current = false;
+                }
+                continue;
+            }
+            
+            // Tile updates only make sense on top of a keyframe
+            if (viewer.needsKeyframe && !frame.keyframe) {
+                keyframeNeeded = true;
+                continue;
+            }
+            
+            std::vector<uint8_t> message;
+            if (!packTileUpdate(*frame.tiles, viewer.tileCache.get(), viewer.tablesVersion, message)) {
+                // A skipped tile this client lost, resynchronise it
+                viewer.needsKeyframe = true;
+                keyframeNeeded = true;
+                continue;
+            }
+            
+            viewer.needsKeyframe = false;
+            announceViewport(id, viewer);
+            messages.emplace_back(id, std::make_shared<const std::vector<uint8_t>>(std::move(message)));
+            frameSent(viewer, frame.width, frame.height);
+        }
+    }
+    
+    if (keyframeNeeded) {
+        _screenCapture->requestKeyframe();
+    }
+    if (cursorResend) {
+        _screenCapture->resendCursor();
+    }
+    
+    // Send outside the viewers lock so a slow client does not block messages, joining clients wait for it
+    std::vector<double> sendMs(messages.size());
+    for (size_t i = 0; i < messages.size(); i++) {
+        auto sendStart = std::chrono::steady_clock::now();
+        _sendCallback(messages[i].first, *messages[i].second);
+        sendMs[i] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sendStart).count();
+    }
+    deliveryLock.unlock();
+    
+    int quality = 0;
+    double fps = 0.0;
+    double scale = 1.0;
+    std::vector<ScreenCapture::OutputProfile> profiles;
+    bool retarget = false;
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        for (size_t i = 0; i < messages.size(); i++) {
+            auto it = _viewers.find(messages[i].first);
+            if (it != _viewers.end()) {
+                it->second.rate.onFrameSent(messages[i].second->size(), sendMs[i]);
+            }
+        }
+        retarget = updateRateTargets(std::chrono::steady_clock::now(), quality, fps, scale, profiles);
+    }
+    
+    if (retarget) {
+        applyRateTargets(quality, fps, scale, profiles);
+    }
+}
+
+// Pick a client's whole image
+bool ScreenSharing::findImage(const ScreenCapture::FrameData& frame, const Viewer& viewer, FrameEncoder::Buffer& image,
+                              int& width, int& height) {
+    // Each client gets the image of its output profile, or in its own codec without profiles
+    const ScreenCapture::ProfileImage* profiled = frame.findProfile(viewer.profile);
+    if (!frame.profileImages.empty() && !profiled) {
+        return false;
+    }
+    image = profiled ? profiled->image : frame.imageFor(viewer.codec);
+    width = profiled ? profiled->width : frame.width;
+    height = profiled ? profiled->height : frame.height;
+    return true;
+}
+
+// Keep the frames a joining client catches up from
+void ScreenSharing::recordJoinFrame(const ScreenCapture::FrameData& frame) {
+    if (frame.mode == ScreenCapture::EncodingMode::JPEG) {
+        // Whole frames stand alone; heartbeats and refinements carry the latest images too
+        bool images = (frame.data && !frame.data->empty()) ||
+                      std::any_of(frame.profileImages.begin(), frame.profileImages.end(),
+                                  [](const ScreenCapture::ProfileImage& entry) { return entry.image != nullptr; });
+        if (images) {
+            _joinFrames.assign(1, frame);
+        }
+        return;
+    }
+    
+    // Heartbeats and thumbnails leave the stream where it was
+    size_t bytes = frame.tiles ? frame.tiles->encodedBytes() : frame.data ? frame.data->size() : 0;
+    if (!frame.tiles && bytes == 0) {
+        return;
+    }
+    
+    if (frame.keyframe) {
+        _joinFrames.assign(1, frame);
+        _joinKeyframeBytes = bytes;
+        _joinDeltaBytes = 0;
+        _joinReplayable = true;
+        return;
+    }
+    
+    // Deltas only apply on top of their keyframe. Once they outgrow it, replaying them costs a joining
+    // client more than a fresh keyframe, so it gets the cached keyframe alone and waits for the next one
+    if (_joinFrames.empty() || _joinFrames.front().mode != frame.mode) {
+        _joinFrames.clear();
+        return;
+    }
+    _joinDeltaBytes += bytes;
+    if (!_joinReplayable || _joinDeltaBytes > _joinKeyframeBytes) {
+        _joinFrames.resize(1);
+        _joinReplayable = false;
+        return;
+    }
+    _joinFrames.push_back(frame);
+}
+
+// Bring a joining client up to date
+void ScreenSharing::catchUp(ViewerId id) {
+    bool caughtUp = false;
+    bool cursorResend = false;
+    {
+        // Live frames for this client queue up behind the cached ones
+        std::lock_guard<std::mutex> deliveryLock(_deliveryMutex);
+        std::vector<std::shared_ptr<const std::vector<uint8_t>>> messages;
+        {
+            std::lock_guard<std::mutex> lock(_viewersMutex);
+            auto it = _viewers.find(id);
+            if (it == _viewers.end()) {
+                return;
+            }
+            bool joining = it->second.joining;
+            it->second.joining = false;
+            
+            if (_sendCallback && _isSharing && !_joinFrames.empty()) {
+                Viewer& viewer = it->second;
+                CaptureRect sentViewport = viewer.sentViewport;
+                int frameWidth = viewer.frameWidth;
+                int frameHeight = viewer.frameHeight;
+                auto queue = [&](const ScreenCapture::FrameData& frame, const FrameEncoder::Buffer& message,
+                                 int width, int height) {
+                    if (sentViewport.x != frame.viewport.x || sentViewport.y != frame.viewport.y ||
+                        sentViewport.width != frame.viewport.width || sentViewport.height != frame.viewport.height) {
+                        messages.push_back(packViewportMessage(frame));
+                        sentViewport = frame.viewport;
+                    }
+                    messages.push_back(message);
+                    frameWidth = width;
+                    frameHeight = height;
+                };
+                
+                const ScreenCapture::FrameData& latest = _joinFrames.back();
+                if (latest.mode == ScreenCapture::EncodingMode::JPEG) {
+                    // The latest image in the client's profile; a client without any frame yet gets the
+                    // closest size in its codec meanwhile, and its own profile follows in the next frame
+                    FrameEncoder::Buffer image;
+                    int width = 0;
+                    int height = 0;
+                    caughtUp = findImage(latest, viewer, image, width, height) && image;
+                    if (caughtUp && !viewer.current) {
+                        queue(latest, image, width, height);
+                        viewer.current = true;
+                    } else if (!caughtUp && viewer.frameWidth == 0) {
+                        image.reset();
+                        for (const ScreenCapture::ProfileImage& entry : latest.profileImages) {
+                            if (entry.image && entry.profile.codec == viewer.codec &&
+                                (!image || std::abs(entry.width - viewer.profile.maxWidth) <
+                                           std::abs(width - viewer.profile.maxWidth))) {
+                                image = entry.image;
+                                width = entry.width;
+                                height = entry.height;
+                            }
+                        }
+                        if (image) {
+                            queue(latest, image, width, height);
+                        }
+                    }
+                } else if (joining && viewer.needsKeyframe) {
+                    // The keyframe and every delta since, packed as the other clients received them;
+                    // without the deltas the stale keyframe shows the screen until a fresh one arrives
+                    uint32_t tablesVersion = viewer.tablesVersion;
+                    bool packed = true;
+                    for (const ScreenCapture::FrameData& frame : _joinFrames) {
+                        FrameEncoder::Buffer message = frame.data;
+                        if (frame.tiles) {
+                            std::vector<uint8_t> update;
+                            if (!packTileUpdate(*frame.tiles, viewer.tileCache.get(), tablesVersion, update)) {
+                                packed = false;
+                                break;
+                            }
+                            message = std::make_shared<const std::vector<uint8_t>>(std::move(update));
+                        }
+                        queue(frame, message, frame.width, frame.height);
+                    }
+                    
+                    if (packed) {
+                        viewer.tablesVersion = tablesVersion;
+                        viewer.needsKeyframe = !_joinReplayable;
+                        caughtUp = _joinReplayable;
+                    } else {
+                        // A delta references a tile only the earlier clients cache; the slots the replay
+                        // assigned never reach this client, so its mirror starts over at the keyframe
+                        messages.clear();
+                        if (viewer.tileCache) {
+                            viewer.tileCache->clear();
+                        }
+                    }
+                } else {
+                    caughtUp = !viewer.needsKeyframe;
+                }
+                
+                if (!messages.empty()) {
+                    viewer.sentViewport = sentViewport;
+                    cursorResend = viewer.cursor && (frameWidth != viewer.frameWidth || frameHeight != viewer.frameHeight);
+                    viewer.frameWidth = frameWidth;
+                    viewer.frameHeight = frameHeight;
+                }
+            }
+        }
+        
+        for (const auto& message : messages) {
+            _sendCallback(id, *message);
+        }
+    }
+    
+    if (cursorResend) {
+        _screenCapture->resendCursor();
+    }
+    
+    // Otherwise the client waits for a keyframe, which in JPEG mode only clients without the image receive
+    if (!caughtUp) {
+        _screenCapture->requestKeyframe();
+    }
+}
+
+// Send the pointer to clients
+void ScreenSharing::deliverCursor(const CursorEncoder::Update& cursor) {
+    if (!_sendCallback) {
+        return;
+    }
+    
+    // Each client gets the pointer scaled to the frames it receives, the shape goes along the first time it needs it
+    std::vector<std::pair<ViewerId, std::shared_ptr<const std::vector<uint8_t>>>> messages;
+    {
+        std::lock_guard<std::mutex> lock(_viewersMutex);
+        for (auto& [id, viewer] : _viewers) {
+            if (!viewer.cursor || viewer.frameWidth != cursor.frameWidth || viewer.frameHeight != cursor.frameHeight) {
+                continue;
+            }
+            if (cursor.shapeId != 0 && viewer.cursorShapes.insert(cursor.shapeId).second) {
+                messages.emplace_back(id, cursor.withShape);
+            } else {
+                messages.emplace_back(id, cursor.position);
+            }
+        }
+    }
+    
+    for (const auto& [id, message] : messages) {
+        _sendCallback(id, *message);
     }
 }
 
@@ -90,7 +951,24 @@ bool ScreenSharing::selectMonitor(int monitorIndex) {
         return false;
     }
     
-    _screenCapture->selectMonitor(monitorIndex);
+    // Other sessions may capture the same monitor, switch to its shared source instead of retargeting ours
+    std::string target = "monitor_" + std::to_string(monitorIndex);
+    if (_sources) {
+        std::unique_ptr<CaptureSource> source = _sources->open(target, [monitorIndex] {
+            std::unique_ptr<CaptureSource> platform = createPlatformCaptureSource();
+            platform->selectMonitor(monitorIndex);
+            return platform;
+        });
+        if (!source) {
+            return false;
+        }
+        _screenCapture->setCaptureSource(std::move(source));
+    } else {
+        _screenCapture->selectMonitor(monitorIndex);
+    }
+    
+    std::lock_guard<std::mutex> lock(_targetMutex);
+    _captureTarget = target;
     return true;
 }
 
@@ -121,32 +999,53 @@ bool ScreenSharing::selectWindow(const std::string& windowId) {
         return false;
     }
     
-    HWND hwnd = it->second;
-    return _screenCapture->selectWindow(hwnd);
+    WindowHandle handle = it->second;
+    if (_sources) {
+        std::unique_ptr<CaptureSource> source = _sources->open(windowId, [handle] {
+            std::unique_ptr<CaptureSource> platform = createPlatformCaptureSource();
+            return platform->selectWindow(handle) ? std::move(platform) : nullptr;
+        });
+        if (!source) {
+            return false;
+        }
+        _screenCapture->setCaptureSource(std::move(source));
+    } else if (!_screenCapture->selectWindow(handle)) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(_targetMutex);
+    _captureTarget = windowId;
+    return true;
+}
+
+// Get the capture target
+std::string ScreenSharing::getCaptureTarget() {
+    std::lock_guard<std::mutex> lock(_targetMutex);
+    return _captureTarget;
 }
 
 // Generate window ID
-std::string ScreenSharing::generateWindowId(HWND hwnd) {
+std::string ScreenSharing::generateWindowId(WindowHandle hwnd) {
     std::stringstream ss;
-    ss << "window_" << reinterpret_cast<intptr_t>(hwnd);
+    ss << "window_" << static_cast<intptr_t>(hwnd);
     return ss.str();
 }
 
 // Process input event from client
 bool ScreenSharing::processInputEvent(const nlohmann::json& eventJson) {
-    return _inputHandler->processInputEvent(eventJson);
-}
-
-// Main processing loop
-void ScreenSharing::processingLoop() {
-    while (_isSharing) {
-        // Sleep to maintain the desired frame rate
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000 / _fps));
+    if (!_inputHandler->processInputEvent(eventJson)) {
+        return false;
     }
+    
+    // Show the result of the input without waiting for the next scheduled frame
+    if (_isSharing) {
+        _screenCapture->triggerBurst();
+    }
+    return true;
 }
 
 // Handle client message
-nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
+nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message, ViewerId viewer) {
     nlohmann::json response;
     response["type"] = "error";
     response["message"] = "Unknown message type";
@@ -164,27 +1063,139 @@ nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
             int height = message.value("height", 720);
             int quality = message.value("quality", 70);
             int fps = message.value("fps", 10);
+            std::string mode = message.value("mode", "jpeg");
+            int tileSize = message.value("tile_size", 64);
+            int keyframeInterval = message.value("keyframe_interval", 150);
+            
+            // A client joining a session others are watching takes it as it runs: only its own output
+            // size, quality, codecs and cursor apply, and it catches up from the cached frames at once.
+            // Clients that are merely connected do not count, and the client that started the session restarts it
+            bool joining = false;
+            {
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                auto it = _viewers.find(viewer);
+                bool owner = it != _viewers.end() && it->second.owner;
+                joining = _isSharing && !owner && isWatchedByOthers(viewer);
+            }
+            
+            if (!joining) {
+                if (message.contains("tile_cache_mb")) {
+                    setTileCacheBudget(static_cast<size_t>(std::max(0, message["tile_cache_mb"].get<int>())) * 1024 * 1024);
+                }
+                
+                {
+                    std::lock_guard<std::mutex> lock(_viewersMutex);
+                    _adaptive = message.value("adaptive", _adaptive);
+                    _latencyBudgetMs = std::max(10.0, message.value("latency_budget_ms", _latencyBudgetMs));
+                }
+                
+                // Quality becomes an upper limit when frames are sized to a bitrate or PSNR floor
+                _screenCapture->setTargetBitrate(message.value("bitrate_kbps", 0));
+                _screenCapture->setPsnrFloor(message.value("psnr_floor", 0.0));
+                
+                // Static screen behaviour, 0 disables heartbeats or the refinement frame
+                ScreenCapture::IdleOptions idle;
+                idle.heartbeatMs = message.value("heartbeat_ms", idle.heartbeatMs);
+                idle.idleDelayMs = message.value("idle_delay_ms", idle.idleDelayMs);
+                idle.refineQuality = message.value("refine_quality", idle.refineQuality);
+                _screenCapture->setIdleOptions(idle);
+                
+                // Capture rate after remote input, 0 fps disables bursts
+                ScreenCapture::BurstOptions burst;
+                burst.fps = message.value("burst_fps", burst.fps);
+                burst.holdMs = message.value("burst_ms", burst.holdMs);
+                _screenCapture->setBurstOptions(burst);
+            }
+            
+            // Clients that draw the pointer themselves get it as separate messages
+            setCursorUpdates(viewer, message.value("cursor", false), message.value("cursor_fps", _cursorFps));
             
-            bool success = startSharing(width, height, quality, fps);
+            // Whole frames go out in the first format the client lists that is built in
+            FrameEncoder::Codec codec = negotiateCodec(viewer, message.value("codecs", std::vector<std::string>{"jpeg"}));
+            
+            // The caller's own output size and quality, other clients keep theirs
+            {
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                auto it = _viewers.find(viewer);
+                if (it != _viewers.end()) {
+                    it->second.watching = true;
+                    if (!joining) {
+                        // Starting the session over gets every frame from its first keyframe, and
+                        // only the client that started it changes its settings from now on
+                        it->second.joining = false;
+                        for (auto& [id, other] : _viewers) {
+                            other.owner = false;
+                        }
+                        it->second.owner = true;
+                    }
+                    it->second.width = width;
+                    it->second.height = height;
+                    it->second.quality = quality;
+                    it->second.rate.setLimits(quality, _fps);
+                    _rateDirty = true;
+                }
+            }
+            
+            bool success = true;
+            if (joining) {
+                updateOutputs();
+                catchUp(viewer);
+            } else {
+                // The session's capture target, kept from earlier selections when not given
+                bool targetSelected = true;
+                if (message.contains("window")) {
+                    targetSelected = selectWindow(message["window"].get<std::string>());
+                } else if (message.contains("monitor")) {
+                    targetSelected = selectMonitor(message["monitor"].get<int>());
+                }
+                
+                success = targetSelected && setEncodingMode(mode, tileSize, keyframeInterval, message.value("region_coding", true)) &&
+                          startSharing(width, height, quality, fps);
+            }
             
             response["type"] = "sharing_status";
             response["success"] = success;
             if (success) {
-                response["message"] = "Screen sharing started";
+                response["message"] = joining ? "Joined screen sharing" : "Screen sharing started";
+                response["joined"] = joining;
                 response["width"] = _width;
                 response["height"] = _height;
                 response["quality"] = _quality;
                 response["fps"] = _fps;
+                response["mode"] = getEncodingMode();
+                response["codec"] = FrameEncoder::codecName(codec);
+                response["target"] = getCaptureTarget();
+                response["cursor"] = message.value("cursor", false);
+                response["tile_cache_mb"] = _tileCacheBudget / (1024 * 1024);
+                response["adaptive"] = _adaptive;
+                response["latency_budget_ms"] = _latencyBudgetMs;
             } else {
                 response["message"] = "Failed to start screen sharing";
             }
         }
         else if (type == "stop_sharing") {
-            stopSharing();
+            // Only the last watching client ends the capture. The others leave it running, and the
+            // caller gets no live frames until a later start_sharing catches it up again
+            bool watched = false;
+            {
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                auto it = _viewers.find(viewer);
+                if (it != _viewers.end()) {
+                    it->second.watching = false;
+                    it->second.joining = true;
+                    it->second.needsKeyframe = true;
+                    it->second.current = false;
+                }
+                handOverSession(viewer);
+                watched = isWatchedByOthers(viewer);
+            }
+            if (!watched) {
+                stopSharing();
+            }
             
             response["type"] = "sharing_status";
             response["success"] = true;
-            response["message"] = "Screen sharing stopped";
+            response["message"] = watched ? "Left screen sharing" : "Screen sharing stopped";
         }
         else if (type == "get_monitors") {
             std::vector<std::string> monitors = getMonitors();
@@ -194,7 +1205,7 @@ nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
         }
         else if (type == "select_monitor") {
             int monitorIndex = message.value("index", 0);
-            bool success = selectMonitor(monitorIndex);
+            bool success = canConfigure(viewer) && selectMonitor(monitorIndex);
             
             response["type"] = "monitor_selected";
             response["success"] = success;
@@ -212,7 +1223,7 @@ nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
         }
         else if (type == "select_window") {
             std::string windowId = message.value("id", "");
-            bool success = selectWindow(windowId);
+            bool success = canConfigure(viewer) && selectWindow(windowId);
             
             response["type"] = "window_selected";
             response["success"] = success;
@@ -224,6 +1235,35 @@ nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
             response["type"] = "input_event_result";
             response["success"] = success;
         }
+        else if (type == "set_viewport") {
+            // Part of the screen the client shows, in screen pixels; no size returns to the whole screen
+            CaptureRect viewport;
+            viewport.x = std::max(0, message.value("x", 0));
+            viewport.y = std::max(0, message.value("y", 0));
+            viewport.width = std::max(0, message.value("width", 0));
+            viewport.height = std::max(0, message.value("height", 0));
+            bool thumbnail = message.value("thumbnail", false);
+            
+            // Thumbnail settings are shared by every client
+            {
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                _thumbnailFps = std::clamp(message.value("thumbnail_fps", _thumbnailFps), 0.0, 30.0);
+                _thumbnailSize = std::clamp(message.value("thumbnail_size", _thumbnailSize), 16, 1024);
+            }
+            
+            setViewport(viewer, viewport, message.value("display_width", 0), message.value("display_height", 0),
+                        thumbnail);
+            
+            auto [screenWidth, screenHeight] = _screenCapture->getScreenSize();
+            response["type"] = "viewport";
+            response["x"] = viewport.x;
+            response["y"] = viewport.y;
+            response["width"] = viewport.width;
+            response["height"] = viewport.height;
+            response["thumbnail"] = thumbnail;
+            response["screen_width"] = screenWidth;
+            response["screen_height"] = screenHeight;
+        }
         else if (type == "get_status") {
             response["type"] = "sharing_status";
             response["active"] = static_cast<bool>(_isSharing);
@@ -233,6 +1273,65 @@ nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
                 response["height"] = _height;
                 response["quality"] = _quality;
                 response["fps"] = _fps;
+                response["mode"] = getEncodingMode();
+                response["adaptive"] = _adaptive;
+                response["target"] = getCaptureTarget();
+                auto [screenWidth, screenHeight] = _screenCapture->getScreenSize();
+                response["screen_width"] = screenWidth;
+                response["screen_height"] = screenHeight;
+                
+                // Encode cost of each whole-frame codec in use
+                ScreenCapture::Stats captureStats = _screenCapture->getStats();
+                response["codecs"] = nlohmann::json::object();
+                for (size_t i = 0; i < FrameEncoder::kCodecCount; i++) {
+                    const FrameEncoder::Cost& cost = captureStats.codecCosts[i];
+                    if (cost.frames > 0) {
+                        response["codecs"][FrameEncoder::codecName(static_cast<FrameEncoder::Codec>(i))] = {
+                            {"frames", cost.frames},
+                            {"avg_encode_ms", cost.totalMs / cost.frames},
+                            {"avg_bytes", cost.bytes / cost.frames}
+                        };
+                    }
+                }
+                
+                // What rate control currently chose for this client
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                auto it = _viewers.find(viewer);
+                if (it != _viewers.end()) {
+                    response["codec"] = FrameEncoder::codecName(it->second.codec);
+                    response["cursor"] = it->second.cursor;
+                }
+                
+                // The client's whole-frame output and how many distinct ones are encoded per frame
+                if (!_appliedProfiles.empty() && it != _viewers.end()) {
+                    response["profile"] = {
+                        {"width", it->second.frameWidth},
+                        {"height", it->second.frameHeight},
+                        {"quality", it->second.profile.quality}
+                    };
+                }
+                response["profiles"] = _appliedProfiles.size();
+                response["cursor_updates"] = captureStats.cursorUpdates;
+                response["thumbnails"] = captureStats.thumbnails;
+                if (it != _viewers.end() && it->second.viewport.width > 0) {
+                    const CaptureRect& viewport = it->second.viewport;
+                    response["viewport"] = {
+                        {"x", viewport.x}, {"y", viewport.y}, {"width", viewport.width}, {"height", viewport.height}
+                    };
+                }
+                if (_adaptive && it != _viewers.end()) {
+                    RateController::Target target = it->second.rate.getTarget();
+                    RateController::Stats stats = it->second.rate.getStats();
+                    response["rate"] = {
+                        {"quality", target.quality},
+                        {"fps", target.fps},
+                        {"scale", target.scale},
+                        {"level", stats.level},
+                        {"latency_ms", stats.latencyMs},
+                        {"rtt_ms", stats.rttMs},
+                        {"throughput_kbps", stats.throughputKbps}
+                    };
+                }
             }
         }
         else if (type == "update_settings") {
@@ -242,21 +1341,91 @@ nlohmann::json ScreenSharing::handleMessage(const nlohmann::json& message) {
                 return response;
             }
             
-            // Update quality if provided
+            // A client watching someone else's session only changes its own quality
+            if (!canConfigure(viewer)) {
+                int quality = _quality;
+                {
+                    std::lock_guard<std::mutex> lock(_viewersMutex);
+                    auto it = _viewers.find(viewer);
+                    if (it != _viewers.end()) {
+                        if (message.contains("quality")) {
+                            it->second.quality = message["quality"].get<int>();
+                            it->second.rate.setLimits(it->second.quality, _fps);
+                            _rateDirty = true;
+                        }
+                        quality = it->second.quality > 0 ? it->second.quality : _quality;
+                    }
+                }
+                
+                response["type"] = "settings_updated";
+                response["quality"] = quality;
+                response["fps"] = _fps;
+                response["mode"] = getEncodingMode();
+                response["adaptive"] = _adaptive;
+                response["latency_budget_ms"] = _latencyBudgetMs;
+                response["session_settings"] = false;
+                return response;
+            }
+            
+            // Update quality if provided, for the caller and clients without their own
             if (message.contains("quality")) {
                 _quality = message["quality"];
                 _screenCapture->setQuality(_quality);
+                
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                auto it = _viewers.find(viewer);
+                if (it != _viewers.end()) {
+                    it->second.quality = _quality;
+                }
             }
             
             // Update fps if provided
             if (message.contains("fps")) {
-                _fps = message["fps"];
-                _screenCapture->setCaptureInterval(1000 / _fps);
+                _fps = std::clamp(message["fps"].get<int>(), 1, 240);
+                _screenCapture->setFrameRate(_fps);
+            }
+            
+            // Update the per-frame quality target if provided
+            if (message.contains("bitrate_kbps")) {
+                _screenCapture->setTargetBitrate(message["bitrate_kbps"].get<int>());
+            }
+            if (message.contains("psnr_floor")) {
+                _screenCapture->setPsnrFloor(message["psnr_floor"].get<double>());
+            }
+            
+            // New limits restart rate control from the top
+            if (message.contains("adaptive")) {
+                setAdaptive(message["adaptive"].get<bool>());
+            }
+            if (message.contains("latency_budget_ms")) {
+                setLatencyBudget(message["latency_budget_ms"].get<double>());
+            } else if (message.contains("quality") || message.contains("fps")) {
+                std::lock_guard<std::mutex> lock(_viewersMutex);
+                resetRateControl();
+            }
+            
+            // Update encoding mode if provided
+            if (message.contains("mode")) {
+                setEncodingMode(message["mode"], message.value("tile_size", 64),
+                                message.value("keyframe_interval", 150), message.value("region_coding", true));
             }
             
             response["type"] = "settings_updated";
             response["quality"] = _quality;
             response["fps"] = _fps;
+            response["mode"] = getEncodingMode();
+            response["adaptive"] = _adaptive;
+            response["latency_budget_ms"] = _latencyBudgetMs;
+            response["session_settings"] = true;
+        }
+        else if (type == "screen_feedback") {
+            // Periodic client report, no reply
+            std::lock_guard<std::mutex> lock(_viewersMutex);
+            auto it = _viewers.find(viewer);
+            if (it != _viewers.end() && message.contains("decode_ms")) {
+                it->second.rate.onClientFeedback(message["decode_ms"].get<double>());
+            }
+            return nullptr;
         }
     } catch (const std::exception& e) {
         response["type"] = "error";
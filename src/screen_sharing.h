@@ -1,21 +1,34 @@
 #pragma once
 
 #include "screen_capture/screen_capture.h"
+#include "screen_capture/shared_capture_source.h"
+#include "encoding/tile_cache.h"
+#include "encoding/rate_controller.h"
 #include "input/input_handler.h"
 #include <string>
-#include <thread>
 #include <atomic>
 #include <mutex>
 #include <functional>
 #include <nlohmann/json.hpp>
 #include <vector>
 #include <map>
+#include <set>
 #include <memory>
+#include <chrono>
 
 class ScreenSharing {
 public:
-    // Constructor
-    ScreenSharing();
+    // Identifies a connected client (its socket)
+    using ViewerId = uint64_t;
+    
+    // Sends an encoded message to one client
+    using SendCallback = std::function<bool(ViewerId, const std::vector<uint8_t>&)>;
+    
+    // Reads a client's TCP round-trip time and unacknowledged bytes, false when unavailable
+    using NetworkInfoCallback = std::function<bool(ViewerId, double& rttMs, uint64_t& bytesInFlight)>;
+    
+    // Constructor; with a pool, monitors and windows are captured through it so sessions on the same target share one capture
+    explicit ScreenSharing(CaptureSourcePool* sources = nullptr);
     
     // Destructor
     ~ScreenSharing();
@@ -44,14 +57,51 @@ public:
     // Select window to capture
     bool selectWindow(const std::string& windowId);
     
+    // Get the captured monitor or window, e.g. "monitor_0" or a window id
+    std::string getCaptureTarget();
+    
     // Process input event from client
     bool processInputEvent(const nlohmann::json& eventJson);
     
-    // Set frame callback
-    void setFrameCallback(std::function<void(const std::vector<uint8_t>&, int, int)> callback) {
-        _frameCallback = std::move(callback);
+    // Set the callback used to deliver frames to clients
+    void setSendCallback(SendCallback callback) {
+        _sendCallback = std::move(callback);
+    }
+    
+    // Set the callback used to poll each client's connection for rate control
+    void setNetworkInfoCallback(NetworkInfoCallback callback) {
+        _networkInfoCallback = std::move(callback);
     }
     
+    // Adapt quality, frame rate and output scale to each client's latency
+    void setAdaptive(bool adaptive);
+    
+    // Set the end-to-end latency the rate controllers aim for
+    void setLatencyBudget(double latencyBudgetMs);
+    
+    // Register a connected client; a running session sends it the cached latest frame right away
+    void addViewer(ViewerId id);
+    
+    // Forget a disconnected client and its tile cache
+    void removeViewer(ViewerId id);
+    
+    // Get the number of registered clients
+    size_t getViewerCount();
+    
+    // Pick the first whole-frame codec in a client's list that is built in, JPEG when none is
+    FrameEncoder::Codec negotiateCodec(ViewerId id, const std::vector<std::string>& codecs);
+    
+    // Send a client pointer position and shape messages at fps (0 stops them), it draws the pointer itself
+    void setCursorUpdates(ViewerId id, bool enabled, double fps = 60.0);
+    
+    // Show a client only part of the screen, in screen pixels, scaled to its display size (0 keeps the
+    // session size); an empty rect shows the whole screen. With thumbnail set it also gets low-rate
+    // whole-screen thumbnails while a viewport is in effect
+    void setViewport(ViewerId id, const CaptureRect& viewport, int displayWidth, int displayHeight, bool thumbnail);
+    
+    // Set the per-client tile cache budget (0 disables tile caching)
+    void setTileCacheBudget(size_t bytes);
+    
     // Get current resolution
     std::pair<int, int> getResolution() const {
         return {_width, _height};
@@ -67,8 +117,15 @@ public:
         return _fps;
     }
     
-    // Handle client message
-    nlohmann::json handleMessage(const nlohmann::json& message);
+    // Set encoding mode ("jpeg", "tiles", "lossless" or "video") for the next session; region coding picks each tile's codec by content
+    bool setEncodingMode(const std::string& mode, int tileSize = 64, int keyframeInterval = 150,
+                         bool regionCoding = true);
+    
+    // Get current encoding mode name
+    std::string getEncodingMode() const;
+    
+    // Handle client message, a null result means no reply
+    nlohmann::json handleMessage(const nlohmann::json& message, ViewerId viewer = 0);
     
 private:
     // Screen capture
@@ -77,8 +134,13 @@ private:
     // Input handler
     std::unique_ptr<InputHandler> _inputHandler;
     
-    // Window handles map (id -> HWND)
-    std::map<std::string, HWND> _windowHandles;
+    // Window handles map (id -> native window handle)
+    std::map<std::string, WindowHandle> _windowHandles;
+    
+    // Shared capture sources, null when this session owns its source
+    CaptureSourcePool* _sources;
+    std::string _captureTarget{"monitor_0"};
+    std::mutex _targetMutex;
     
     // Sharing state
     std::atomic<bool> _isSharing{false};
@@ -86,19 +148,124 @@ private:
     int _height{720};
     int _quality{70};
     int _fps{10};
+    std::atomic<ScreenCapture::EncodingMode> _encodingMode{ScreenCapture::EncodingMode::JPEG};  // Read while frames are delivered
+    
+    // Frame delivery
+    SendCallback _sendCallback;
+    NetworkInfoCallback _networkInfoCallback;
+    
+    // Rate control, the session's quality and fps are the controllers' upper limits
+    bool _adaptive{true};
+    double _latencyBudgetMs{150.0};
+    int _appliedQuality{70};
+    double _appliedFps{10.0};
+    double _appliedScale{1.0};
+    std::vector<ScreenCapture::OutputProfile> _appliedProfiles;
+    bool _rateDirty{false};
     
-    // Thread for frame processing
-    std::thread _processingThread;
+    // Per-client delivery state
+    struct Viewer {
+        std::unique_ptr<TileCache> tileCache;  // Mirror of the client's tile slots
+        uint32_t tablesVersion{0};             // JPEG tables the client holds
+        bool needsKeyframe{true};
+        bool joining{true};                    // Gets no live frames until caught up from the cached ones
+        bool watching{false};                  // Started sharing and has not stopped it since
+        bool owner{false};                     // May change the session-wide settings
+        bool current{false};                   // Holds the latest whole frame
+        FrameEncoder::Codec codec{FrameEncoder::Codec::JPEG};  // Whole-frame format the client decodes
+        bool cursor{false};                    // Receives cursor messages
+        std::set<uint32_t> cursorShapes;       // Cursor shape ids the client holds
+        CaptureRect viewport;                  // Requested part of the screen, empty for all of it
+        int displayWidth{0};                   // Size the viewport is shown at, 0 for the session size
+        int displayHeight{0};
+        bool thumbnail{false};                 // Receives thumbnails while a viewport is in effect
+        CaptureRect sentViewport;              // Viewport the client last heard of, empty for the whole screen
+        int width{0};                          // Output size and quality the client asked for, 0 for the session's
+        int height{0};
+        int quality{0};
+        ScreenCapture::OutputProfile profile;  // Whole-frame output the client gets in JPEG mode
+        int frameWidth{0};                     // Size of the last frame sent, cursor positions follow it
+        int frameHeight{0};
+        RateController rate;                   // Per-client stream settings
+    };
     
-    // Frame callback
-    std::function<void(const std::vector<uint8_t>&, int, int)> _frameCallback;
+    std::map<ViewerId, Viewer> _viewers;
+    std::mutex _viewersMutex;
+    
+    // What a joining client catches up from: the latest whole frame in JPEG mode, otherwise the
+    // latest keyframe followed by every delta since while they add up to less than it (guarded by _viewersMutex)
+    std::vector<ScreenCapture::FrameData> _joinFrames;
+    size_t _joinKeyframeBytes{0};
+    size_t _joinDeltaBytes{0};
+    bool _joinReplayable{false};  // Every delta since the keyframe is kept
+    
+    // Held while frames are packed and sent, so a joining client gets the cached frames before live ones
+    std::mutex _deliveryMutex;
+    
+    size_t _tileCacheBudget{32 * 1024 * 1024};
+    double _cursorFps{60.0};
+    double _thumbnailFps{1.0};
+    int _thumbnailSize{320};
+    int _tileSize{64};
     
     // Mutex for thread safety
     std::mutex _mutex;
     
-    // Processing thread function
-    void processingLoop();
+    // Pack and send a captured frame to every client
+    void deliverFrame(const ScreenCapture::FrameData& frame);
+    
+    // Send the pointer to every client that draws it
+    void deliverCursor(const CursorEncoder::Update& cursor);
+    
+    // Keep what a joining client needs from a frame being delivered (caller holds _viewersMutex)
+    void recordJoinFrame(const ScreenCapture::FrameData& frame);
+    
+    // Send a joining client the cached frames, or schedule a keyframe when they cannot bring it up to date
+    void catchUp(ViewerId id);
+    
+    // Get a client's whole image in a JPEG-mode frame and its size, false when the frame lacks the client's profile
+    static bool findImage(const ScreenCapture::FrameData& frame, const Viewer& viewer, FrameEncoder::Buffer& image,
+                          int& width, int& height);
+    
+    // Combine every client's viewport into the shared crop and output size, and push them to the
+    // capture with every client's output profile
+    void updateOutputs();
+    
+    // Get the size a client's frames are fitted to before rate control scales them (caller holds _viewersMutex)
+    std::pair<int, int> getOutputBox(const Viewer& viewer) const;
+    
+    // Assign each client its output profile, in JPEG mode, and list the distinct ones (caller holds _viewersMutex)
+    std::vector<ScreenCapture::OutputProfile> collectProfiles();
+    
+    // Restart every client's rate controller from the session settings (caller holds _viewersMutex)
+    void resetRateControl();
+    
+    // Combine every client's rate target into the shared encoder settings and output profiles (caller holds _viewersMutex)
+    bool updateRateTargets(std::chrono::steady_clock::time_point now, int& quality, double& fps, double& scale,
+                           std::vector<ScreenCapture::OutputProfile>& profiles);
+    
+    // Push new encoder settings and output profiles to the capture pipeline
+    void applyRateTargets(int quality, double fps, double scale, const std::vector<ScreenCapture::OutputProfile>& profiles);
+    
+    // Codecs the clients use, JPEG first when any client uses it (caller holds _viewersMutex)
+    std::vector<FrameEncoder::Codec> collectImageCodecs() const;
+    
+    // Check whether every client caches a tile
+    bool allViewersCache(uint64_t hash);
+    
+    // Check whether a client other than this one is watching the session (caller holds _viewersMutex)
+    bool isWatchedByOthers(ViewerId id) const;
+    
+    // Pass the session's settings from a client that stops watching to one still watching (caller holds _viewersMutex)
+    void handOverSession(ViewerId id);
+    
+    // Check whether a client may change the session-wide settings: it started the session, or none is running
+    bool canConfigure(ViewerId id);
+    
+    // Drop all clients' tile caches and the cached join frames until the next keyframe (caller holds _viewersMutex
+    // and requests the keyframe after releasing it; the encoder queries viewers under its own lock)
+    void resetViewers();
     
     // Helper method to generate window ID
-    std::string generateWindowId(HWND hwnd);
+    std::string generateWindowId(WindowHandle hwnd);
 };
\ No newline at end of file
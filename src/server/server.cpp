@@ -14,18 +14,26 @@ Server::~Server() {
 void Server::initialize() {
     std::cout << "Initializing server components..." << std::endl;
     
-    // Create screen sharing instance
-    _screenSharing = std::make_unique<ScreenSharing>();
+    // Screen sharing sessions, one per stream id
+    _sessions = std::make_unique<SessionManager>();
     
-    // Initialize screen sharing
-    if (!_screenSharing->initialize()) {
-        std::cerr << "Failed to initialize screen sharing" << std::endl;
-    }
+    // Frames are packed per client, each with its own tile cache
+    _sessions->setSendCallback([this](ScreenSharing::ViewerId viewer, const std::vector<uint8_t>& data) {
+        return _socketServer.sendBinaryMessage(static_cast<SOCKET>(viewer), data);
+    });
+    
+    // Rate control reads each client's TCP state
+    _sessions->setNetworkInfoCallback([this](ScreenSharing::ViewerId viewer, double& rttMs, uint64_t& bytesInFlight) {
+        return _socketServer.getConnectionInfo(static_cast<SOCKET>(viewer), rttMs, bytesInFlight);
+    });
     
-    // Set up the frame callback
-    _screenSharing->setFrameCallback([this](const std::vector<uint8_t>& jpegData, int width, int height) {
-        // Broadcast the frame to all clients
-        _socketServer.broadcastBinaryMessage(jpegData);
+    // Track clients so their caches start empty on every (re)connect
+    _socketServer.setConnectionHandler([this](SOCKET client, bool connected) {
+        if (connected) {
+            _sessions->addViewer(static_cast<ScreenSharing::ViewerId>(client));
+        } else {
+            _sessions->removeViewer(static_cast<ScreenSharing::ViewerId>(client));
+        }
     });
     
     // Set up binary message handler for the WebSocket server
@@ -34,7 +42,7 @@ void Server::initialize() {
     });
     
     // Set up the message handler for the WebSocket server
-    _socketServer.setMessageHandler([this](const std::string& message) {
+    _socketServer.setMessageHandler([this](SOCKET client, const std::string& message) {
         try {
             auto jsonMessage = nlohmann::json::parse(message);
             
@@ -45,11 +53,18 @@ void Server::initialize() {
                 if (messageType.find("screen_") == 0 || 
                     messageType == "start_sharing" || 
                     messageType == "stop_sharing" ||
+                    messageType == "update_settings" ||
+                    messageType == "get_status" ||
+                    messageType == "set_viewport" ||
+                    messageType == "get_monitors" ||
+                    messageType == "select_monitor" ||
+                    messageType == "get_windows" ||
+                    messageType == "select_window" ||
                     messageType == "input_event") {
                     
-                    // Handle screen sharing message
-                    auto response = _screenSharing->handleMessage(jsonMessage);
-                    return response.dump();
+                    // Handle screen sharing message in the client's session, feedback reports get no reply
+                    auto response = _sessions->handleMessage(jsonMessage, static_cast<ScreenSharing::ViewerId>(client));
+                    return response.is_null() ? std::string() : response.dump();
                 }
             }
             
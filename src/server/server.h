@@ -1,6 +1,6 @@
 #pragma once
 #include "websocket_server.h"
-#include "../screen_sharing.h"
+#include "../session_manager.h"
 #include <utility>
 #include <string>
 #include <functional>
@@ -21,7 +21,7 @@ public:
 private:
     SimpleSocketServer _socketServer;
     std::function<nlohmann::json(const nlohmann::json&)> _messageHandler;
-    std::unique_ptr<ScreenSharing> _screenSharing;
+    std::unique_ptr<SessionManager> _sessions;
     
     void initialize();
     void handleBinaryMessage(SOCKET client, const std::vector<uint8_t>& data);
@@ -6,6 +6,7 @@
 #include <regex>
 #include <vector>
 #include <windows.h>
+#include <mstcpip.h>
 #include <wincrypt.h>
 #include <openssl/sha.h>
 
@@ -78,6 +79,37 @@ int SimpleSocketServer::rawSend(SOCKET client, const char* data, int length, int
     return ::send(client, data, length, flags);
 }
 
+// Send a frame to one client, only other senders to the same socket wait for it
+int SimpleSocketServer::sendFrame(SOCKET client, const std::vector<uint8_t>& frame) {
+    std::shared_ptr<std::mutex> sendMutex;
+    {
+        std::lock_guard<std::mutex> lock(_clientsMutex);
+        auto it = _clients.find(client);
+        if (it == _clients.end()) {
+            return SOCKET_ERROR;
+        }
+        sendMutex = it->second;
+    }
+    
+    std::lock_guard<std::mutex> lock(*sendMutex);
+    return rawSend(client, reinterpret_cast<const char*>(frame.data()), frame.size(), 0);
+}
+
+// Close a client socket and notify the connection handler
+void SimpleSocketServer::disconnectClient(SOCKET clientSocket) {
+    {
+        std::lock_guard<std::mutex> lock(_clientsMutex);
+        if (_clients.erase(clientSocket) == 0) {
+            return;
+        }
+        closesocket(clientSocket);
+    }
+    
+    if (_connectionHandler) {
+        _connectionHandler(clientSocket, false);
+    }
+}
+
 std::pair<bool, std::string> SimpleSocketServer::start() {
     if (_running) return {true, "Server is already running"};
     
@@ -119,14 +151,22 @@ void SimpleSocketServer::stop() {
     _running = false;
     
     // Close all client sockets
+    std::vector<SOCKET> closedClients;
     {
         std::lock_guard<std::mutex> lock(_clientsMutex);
         for (const auto& client : _clients) {
             closesocket(client.first);
+            closedClients.push_back(client.first);
         }
         _clients.clear();
     }
     
+    if (_connectionHandler) {
+        for (SOCKET client : closedClients) {
+            _connectionHandler(client, false);
+        }
+    }
+    
     // Join the server thread
     if (_serverThread.joinable()) {
         _serverThread.join();
@@ -181,8 +221,14 @@ void SimpleSocketServer::runServer() {
             
             // Handle WebSocket handshake
             if (handleWebSocketHandshake(clientSocket)) {
-                std::lock_guard<std::mutex> lock(_clientsMutex);
-                _clients[clientSocket] = true;
+                {
+                    std::lock_guard<std::mutex> lock(_clientsMutex);
+                    _clients[clientSocket] = std::make_shared<std::mutex>();
+                }
+                
+                if (_connectionHandler) {
+                    _connectionHandler(clientSocket, true);
+                }
             } else {
                 closesocket(clientSocket);
             }
@@ -206,9 +252,7 @@ void SimpleSocketServer::runServer() {
             
             if (bytesReceived <= 0) {
                 // Client disconnected
-                std::lock_guard<std::mutex> lock(_clientsMutex);
-                closesocket(clientSocket);
-                _clients.erase(clientSocket);
+                disconnectClient(clientSocket);
                 std::cout << "Client disconnected" << std::endl;
                 continue;
             }
@@ -340,7 +384,7 @@ void SimpleSocketServer::processWebSocketFrame(SOCKET clientSocket, const std::v
         case 0x1: // Text frame
             if (_messageHandler) {
                 std::string textMessage(payloadData.begin(), payloadData.end());
-                std::string response = _messageHandler(textMessage);
+                std::string response = _messageHandler(clientSocket, textMessage);
                 
                 if (!response.empty()) {
                     sendMessage(clientSocket, response);
@@ -355,12 +399,8 @@ void SimpleSocketServer::processWebSocketFrame(SOCKET clientSocket, const std::v
             break;
             
         case 0x8: // Close frame
-            {
-                std::lock_guard<std::mutex> lock(_clientsMutex);
-                closesocket(clientSocket);
-                _clients.erase(clientSocket);
-                std::cout << "Client closed connection" << std::endl;
-            }
+            disconnectClient(clientSocket);
+            std::cout << "Client closed connection" << std::endl;
             break;
             
         case 0x9: // Ping frame
@@ -387,7 +427,7 @@ void SimpleSocketServer::processWebSocketFrame(SOCKET clientSocket, const std::v
                 pongFrame.insert(pongFrame.end(), payloadData.begin(), payloadData.end());
                 
                 // Send pong frame
-                rawSend(clientSocket, reinterpret_cast<const char*>(pongFrame.data()), pongFrame.size(), 0);
+                sendFrame(clientSocket, pongFrame);
             }
             break;
             
@@ -455,7 +495,7 @@ std::vector<uint8_t> SimpleSocketServer::encodeBinaryWebSocketFrame(const std::v
 
 bool SimpleSocketServer::sendMessage(SOCKET client, const std::string& message) {
     std::vector<uint8_t> frame = encodeWebSocketFrame(message);
-    return rawSend(client, reinterpret_cast<const char*>(frame.data()), frame.size(), 0) != SOCKET_ERROR;
+    return sendFrame(client, frame) != SOCKET_ERROR;
 }
 
 bool SimpleSocketServer::broadcastMessage(const std::string& message) {
@@ -463,6 +503,7 @@ bool SimpleSocketServer::broadcastMessage(const std::string& message) {
     
     std::lock_guard<std::mutex> lock(_clientsMutex);
     for (const auto& client : _clients) {
+        std::lock_guard<std::mutex> sendLock(*client.second);
         if (rawSend(client.first, reinterpret_cast<const char*>(frame.data()), frame.size(), 0) == SOCKET_ERROR) {
             std::cerr << "Failed to send message to client: " << WSAGetLastError() << std::endl;
         }
@@ -473,7 +514,7 @@ bool SimpleSocketServer::broadcastMessage(const std::string& message) {
 
 bool SimpleSocketServer::sendBinaryMessage(SOCKET client, const std::vector<uint8_t>& data) {
     std::vector<uint8_t> frame = encodeBinaryWebSocketFrame(data);
-    return rawSend(client, reinterpret_cast<const char*>(frame.data()), frame.size(), 0) != SOCKET_ERROR;
+    return sendFrame(client, frame) != SOCKET_ERROR;
 }
 
 bool SimpleSocketServer::broadcastBinaryMessage(const std::vector<uint8_t>& data) {
@@ -481,10 +522,33 @@ bool SimpleSocketServer::broadcastBinaryMessage(const std::vector<uint8_t>& data
     
     std::lock_guard<std::mutex> lock(_clientsMutex);
     for (const auto& client : _clients) {
+        std::lock_guard<std::mutex> sendLock(*client.second);
         if (rawSend(client.first, reinterpret_cast<const char*>(frame.data()), frame.size(), 0) == SOCKET_ERROR) {
             std::cerr << "Failed to send binary message to client: " << WSAGetLastError() << std::endl;
         }
     }
     
     return true;
-}
\ No newline at end of file
+}
+
+bool SimpleSocketServer::getConnectionInfo(SOCKET client, double& rttMs, uint64_t& bytesInFlight) {
+#ifdef SIO_TCP_INFO
+    // Windows 10 1703 and later report the kernel's TCP state per socket
+    DWORD version = 0;
+    TCP_INFO_v0 info{};
+    DWORD bytesReturned = 0;
+    if (WSAIoctl(client, SIO_TCP_INFO, &version, sizeof(version), &info, sizeof(info),
+                 &bytesReturned, nullptr, nullptr) != 0) {
+        return false;
+    }
+    
+    rttMs = info.RttUs / 1000.0;
+    bytesInFlight = info.BytesInFlight;
+    return true;
+#else
+    (void)client;
+    (void)rttMs;
+    (void)bytesInFlight;
+    return false;
+#endif
+}
@@ -5,6 +5,7 @@
 #include <thread>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <winsock2.h>
@@ -16,8 +17,9 @@
 
 class SimpleSocketServer {
 public:
-    using MessageHandler = std::function<std::string(const std::string&)>;
+    using MessageHandler = std::function<std::string(SOCKET, const std::string&)>;
     using BinaryMessageHandler = std::function<void(SOCKET, const std::vector<uint8_t>&)>;
+    using ConnectionHandler = std::function<void(SOCKET, bool)>;
     
     // Constructor
     explicit SimpleSocketServer(int port, const std::string& host = "127.0.0.1");
@@ -44,6 +46,9 @@ public:
     // Set binary message handler
     void setBinaryMessageHandler(BinaryMessageHandler handler) { _binaryMessageHandler = std::move(handler); }
     
+    // Set connection handler, called with true after the handshake and false on disconnect
+    void setConnectionHandler(ConnectionHandler handler) { _connectionHandler = std::move(handler); }
+    
     // Send binary message to all clients
     bool broadcastBinaryMessage(const std::vector<uint8_t>& data);
     
@@ -56,6 +61,9 @@ public:
     // Send text message to specific client
     bool sendMessage(SOCKET client, const std::string& message);
     
+    // Read a client's smoothed TCP round-trip time and unacknowledged bytes
+    bool getConnectionInfo(SOCKET client, double& rttMs, uint64_t& bytesInFlight);
+    
     // Get client count
     size_t getClientCount() const { return _clients.size(); }
     
@@ -66,12 +74,16 @@ private:
     std::string computeAcceptKey(const std::string& key);
     std::string generateHandshakeResponse(const std::string& key);
     void processWebSocketFrame(SOCKET clientSocket, const std::vector<uint8_t>& frame);
+    void disconnectClient(SOCKET clientSocket);
     std::vector<uint8_t> encodeWebSocketFrame(const std::string& message);
     std::vector<uint8_t> encodeBinaryWebSocketFrame(const std::vector<uint8_t>& data);
     
     // Helper method to use the raw Winsock send
     int rawSend(SOCKET client, const char* data, int length, int flags);
     
+    // Send an encoded frame to a connected client under its send lock
+    int sendFrame(SOCKET client, const std::vector<uint8_t>& frame);
+    
     // Server state
     int _port;
     std::string _host;
@@ -80,6 +92,9 @@ private:
     std::thread _serverThread;
     MessageHandler _messageHandler;
     BinaryMessageHandler _binaryMessageHandler;
-    std::map<SOCKET, bool> _clients;
+    ConnectionHandler _connectionHandler;
+    // Connected clients, each with a send lock that keeps frames from different
+    // threads from interleaving on its socket without stalling the other clients
+    std::map<SOCKET, std::shared_ptr<std::mutex>> _clients;
     std::mutex _clientsMutex;
 };
\ No newline at end of file
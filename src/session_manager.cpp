@@ -0,0 +1,161 @@
+#include "session_manager.h"
+#include <iostream>
+
+namespace {
+    // Longest stream id a client may choose
+    constexpr size_t kMaxStreamIdLength = 64;
+}
+
+// Constructor
+SessionManager::SessionManager() = default;
+
+// Destructor
+SessionManager::~SessionManager() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& [stream, session] : _sessions) {
+        session->stopSharing();
+    }
+}
+
+// Set the frame delivery callback
+void SessionManager::setSendCallback(ScreenSharing::SendCallback callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sendCallback = std::move(callback);
+    for (auto& [stream, session] : _sessions) {
+        session->setSendCallback(_sendCallback);
+    }
+}
+
+// Set the network info callback
+void SessionManager::setNetworkInfoCallback(ScreenSharing::NetworkInfoCallback callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _networkInfoCallback = std::move(callback);
+    for (auto& [stream, session] : _sessions) {
+        session->setNetworkInfoCallback(_networkInfoCallback);
+    }
+}
+
+// Register a client
+void SessionManager::addViewer(ViewerId id) {
+    std::shared_ptr<ScreenSharing> ended;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        joinStream(id, kDefaultStream, ended);
+    }
+    if (ended) {
+        ended->stopSharing();
+    }
+}
+
+// Forget a client
+void SessionManager::removeViewer(ViewerId id) {
+    std::shared_ptr<ScreenSharing> ended;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ended = leaveStream(id);
+    }
+
+    // Stopping joins the session's pipeline threads and releases its capture source
+    if (ended) {
+        ended->stopSharing();
+    }
+}
+
+// Create a session
+std::shared_ptr<ScreenSharing> SessionManager::createSession() {
+    auto session = std::make_shared<ScreenSharing>(&_sources);
+    if (!session->initialize()) {
+        std::cerr << "Failed to initialize screen sharing" << std::endl;
+    }
+    session->setSendCallback(_sendCallback);
+    session->setNetworkInfoCallback(_networkInfoCallback);
+
+    // Window ids come from the list a client fetched in another session, so a new session
+    // knows the open windows before its first start_sharing selects one
+    session->getWindows();
+    return session;
+}
+
+// Move a client into a stream
+std::shared_ptr<ScreenSharing> SessionManager::joinStream(ViewerId id, const std::string& stream,
+                                                          std::shared_ptr<ScreenSharing>& ended) {
+    auto current = _viewerStreams.find(id);
+    if (current != _viewerStreams.end() && current->second == stream) {
+        return _sessions[stream];
+    }
+    ended = leaveStream(id);
+
+    std::shared_ptr<ScreenSharing>& session = _sessions[stream];
+    if (!session) {
+        session = createSession();
+    }
+    session->addViewer(id);
+    _viewerStreams[id] = stream;
+    return session;
+}
+
+// Take a client out of its stream
+std::shared_ptr<ScreenSharing> SessionManager::leaveStream(ViewerId id) {
+    auto it = _viewerStreams.find(id);
+    if (it == _viewerStreams.end()) {
+        return nullptr;
+    }
+    std::string stream = it->second;
+    _viewerStreams.erase(it);
+
+    auto session = _sessions.find(stream);
+    if (session == _sessions.end()) {
+        return nullptr;
+    }
+    session->second->removeViewer(id);
+
+    // Nobody watches this stream any more, the caller stops it
+    if (stream != kDefaultStream && session->second->getViewerCount() == 0) {
+        std::shared_ptr<ScreenSharing> ended = std::move(session->second);
+        _sessions.erase(session);
+        return ended;
+    }
+    return nullptr;
+}
+
+// Route a client message
+nlohmann::json SessionManager::handleMessage(const nlohmann::json& message, ViewerId viewer) {
+    // Starting a stream by id moves the client there, other messages go to its current session
+    std::string type = message.value("type", "");
+    std::string stream;
+    std::shared_ptr<ScreenSharing> session;
+    std::shared_ptr<ScreenSharing> ended;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (type == "start_sharing" && message.contains("stream")) {
+            if (!message["stream"].is_string() || message["stream"].get<std::string>().empty() ||
+                message["stream"].get<std::string>().size() > kMaxStreamIdLength) {
+                nlohmann::json response;
+                response["type"] = "error";
+                response["message"] = "Invalid stream id";
+                return response;
+            }
+            session = joinStream(viewer, message["stream"].get<std::string>(), ended);
+        } else if (_viewerStreams.find(viewer) == _viewerStreams.end()) {
+            session = joinStream(viewer, kDefaultStream, ended);
+        } else {
+            session = _sessions[_viewerStreams[viewer]];
+        }
+        stream = _viewerStreams[viewer];
+    }
+    if (ended) {
+        ended->stopSharing();
+    }
+
+    // The session runs the message without holding up the other streams
+    nlohmann::json response = session->handleMessage(message, viewer);
+    if (response.is_object() && response.value("type", "") != "error") {
+        response["stream"] = stream;
+        if (type == "get_status") {
+            std::lock_guard<std::mutex> lock(_mutex);
+            response["sessions"] = _sessions.size();
+            response["capture_targets"] = _sources.getTargetCount();
+        }
+    }
+    return response;
+}
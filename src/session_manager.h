@@ -0,0 +1,73 @@
+#pragma once
+
+#include "screen_sharing.h"
+#include "screen_capture/shared_capture_source.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <nlohmann/json.hpp>
+
+/**
+ * Runs independent screen-sharing sessions side by side, keyed by stream id
+ *
+ * Every client belongs to one session. Clients join the "default" session on connect,
+ * which keeps the single shared session of older clients; a start_sharing message with a
+ * "stream" id moves the client to that stream's session, creating it, or joining it as it
+ * runs when others are watching. Each session has its
+ * own capture target, resolution, frame rate and encoding, and sessions on the same
+ * monitor or window share one capture through a CaptureSourcePool. Sessions other than
+ * the default one end when their last client leaves.
+ */
+class SessionManager {
+public:
+    using ViewerId = ScreenSharing::ViewerId;
+
+    // Constructor
+    SessionManager();
+
+    // Destructor, stops every session
+    ~SessionManager();
+
+    // Set the callback used to deliver frames to clients
+    void setSendCallback(ScreenSharing::SendCallback callback);
+
+    // Set the callback used to poll each client's connection for rate control
+    void setNetworkInfoCallback(ScreenSharing::NetworkInfoCallback callback);
+
+    // Register a connected client with the default session
+    void addViewer(ViewerId id);
+
+    // Forget a disconnected client, ending its session if it was the last one there
+    void removeViewer(ViewerId id);
+
+    // Route a client message to the client's session, a null result means no reply
+    nlohmann::json handleMessage(const nlohmann::json& message, ViewerId viewer);
+
+    // Name of the session clients join on connect
+    static constexpr const char* kDefaultStream = "default";
+
+private:
+    // Move a client into a stream's session, creating it. A session the client leaves empty is
+    // returned in ended, for the caller to stop after releasing _mutex (caller holds _mutex)
+    std::shared_ptr<ScreenSharing> joinStream(ViewerId id, const std::string& stream,
+                                              std::shared_ptr<ScreenSharing>& ended);
+
+    // Take a client out of its session, returning the session when that leaves it empty and it is
+    // not the default one; the caller stops it after releasing _mutex (caller holds _mutex)
+    std::shared_ptr<ScreenSharing> leaveStream(ViewerId id);
+
+    // Create a session wired to the server callbacks (caller holds _mutex)
+    std::shared_ptr<ScreenSharing> createSession();
+
+    // Capture sources shared between sessions, outlives them
+    CaptureSourcePool _sources;
+
+    // Sessions are shared with the messages running in them, so _mutex only guards the maps
+    // and a slow start or stop in one session does not hold up the others
+    std::map<std::string, std::shared_ptr<ScreenSharing>> _sessions;
+    std::map<ViewerId, std::string> _viewerStreams;
+    ScreenSharing::SendCallback _sendCallback;
+    ScreenSharing::NetworkInfoCallback _networkInfoCallback;
+    std::mutex _mutex;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Bounded lock-free single-producer/single-consumer ring
+ *
+ * One thread may push and one other thread may pop concurrently. Capacity is rounded
+ * up to a power of two so indices wrap with a mask.
+ */
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    // Prevent copying
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer: append a value, false when the ring is full
+    bool tryPush(T&& value) {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) > _mask) {
+            return false;
+        }
+
+        _slots[tail & _mask] = std::move(value);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPush(const T& value) {
+        T copy(value);
+        return tryPush(std::move(copy));
+    }
+
+    // Consumer: take the oldest value, false when the ring is empty
+    bool tryPop(T& value) {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        value = std::move(_slots[head & _mask]);
+        _slots[head & _mask] = T();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+
+    bool full() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire) > _mask;
+    }
+
+    size_t size() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const { return _slots.size(); }
+
+    // Drop all values, only while neither side is running
+    void clear() {
+        for (T& slot : _slots) slot = T();
+        _head.store(0, std::memory_order_relaxed);
+        _tail.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> _slots;
+    size_t _mask{0};
+
+    // Separate cache lines so producer and consumer do not false-share
+    alignas(64) std::atomic<size_t> _head{0};
+    alignas(64) std::atomic<size_t> _tail{0};
+};
@@ -0,0 +1,105 @@
+#include "thread_pool.h"
+
+// Constructor
+ThreadPool::ThreadPool(size_t workerCount) {
+    _workers.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; i++) {
+        _workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+// Destructor
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+}
+
+// Run a job across the pool
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    if (_workers.empty() || count == 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> jobLock(_jobMutex);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _task = &task;
+        _count = count;
+        _next.store(0, std::memory_order_relaxed);
+        _pending = count;
+        _generation++;
+    }
+    _wake.notify_all();
+
+    // The caller works too instead of just waiting
+    runTasks(task, count);
+
+    // Workers still inside the job hold a pointer to task, so wait for them as well
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this] { return _pending == 0 && _activeWorkers == 0; });
+    _task = nullptr;
+}
+
+// Claim parts until the job is exhausted
+void ThreadPool::runTasks(const std::function<void(size_t)>& task, size_t count) {
+    for (;;) {
+        size_t index = _next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= count) {
+            return;
+        }
+
+        task(index);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_pending == 0) {
+            _done.notify_all();
+        }
+    }
+}
+
+// Worker thread: wait for a job, help with it, repeat
+void ThreadPool::workerLoop() {
+    uint64_t seenGeneration = 0;
+
+    for (;;) {
+        const std::function<void(size_t)>* task = nullptr;
+        size_t count = 0;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wake.wait(lock, [&] { return _stopping || _generation != seenGeneration; });
+            if (_stopping) {
+                return;
+            }
+
+            // A job that already finished leaves no task behind
+            seenGeneration = _generation;
+            if (!_task) {
+                continue;
+            }
+            task = _task;
+            count = _count;
+            _activeWorkers++;
+        }
+
+        runTasks(*task, count);
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_activeWorkers == 0 && _pending == 0) {
+            _done.notify_all();
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads for splitting one job into independent parts
+ *
+ * parallelFor() runs the parts on the workers and the calling thread and returns once
+ * all of them are done, so callers can share stack data with the tasks.
+ */
+class ThreadPool {
+public:
+    // Start workerCount threads, 0 runs everything on the calling thread
+    explicit ThreadPool(size_t workerCount);
+    ~ThreadPool();
+
+    // Prevent copying
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Get the number of threads taking part in a job, including the caller
+    size_t getThreadCount() const { return _workers.size() + 1; }
+
+    // Run task(0) .. task(count - 1) in parallel and wait for all of them
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+    void workerLoop();
+
+    // Claim and run parts of the current job until none are left
+    void runTasks(const std::function<void(size_t)>& task, size_t count);
+
+    std::vector<std::thread> _workers;
+
+    // One job at a time
+    std::mutex _jobMutex;
+
+    // Current job, guarded by _mutex except for the part counter
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(size_t)>* _task{nullptr};
+    size_t _count{0};
+    std::atomic<size_t> _next{0};
+    size_t _pending{0};
+    size_t _activeWorkers{0};
+    uint64_t _generation{0};
+    bool _stopping{false};
+};
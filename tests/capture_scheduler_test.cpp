@@ -0,0 +1,122 @@
+#include "screen_capture/capture_scheduler.h"
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono;
+
+namespace {
+    // Allowance for a loaded machine waking threads late; the checks only need the order of magnitude
+    constexpr milliseconds kSlack(150);
+
+    milliseconds since(steady_clock::time_point start) {
+        return duration_cast<milliseconds>(steady_clock::now() - start);
+    }
+
+    // Work shorter than the period must not push later deadlines back
+    bool checkNoDrift() {
+        constexpr int kTicks = 25;
+        constexpr milliseconds kPeriod(20);
+        constexpr milliseconds kWork(8);
+
+        CaptureScheduler scheduler(50.0);
+        scheduler.start();
+        steady_clock::time_point start = steady_clock::now();
+        for (int i = 0; i < kTicks; i++) {
+            scheduler.waitNextTick();
+            std::this_thread::sleep_for(kWork);
+        }
+        milliseconds elapsed = since(start) - kWork;
+        scheduler.stop();
+
+        // The first tick is immediate; sleeping for the period after the work would take (kTicks - 1) * 28 ms
+        milliseconds expected = (kTicks - 1) * kPeriod;
+        std::cout << "pacing: " << kTicks << " ticks in " << elapsed.count() << " ms, " << expected.count()
+                  << " ms expected" << std::endl;
+        if (elapsed < expected - milliseconds(1) || elapsed > expected + kSlack / 2) {
+            std::cout << "pacing: FAILED, deadlines must advance by exactly one period" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Ticks missed while busy are skipped, firing the latest one right away and then keeping the grid
+    bool checkSkipsMissedTicks() {
+        CaptureScheduler scheduler(20.0);
+        scheduler.start();
+        steady_clock::time_point start = steady_clock::now();
+        scheduler.waitNextTick();
+        std::this_thread::sleep_for(milliseconds(180));
+
+        // Deadlines at 50, 100 and 150 ms have passed: two are skipped, 150 fires now and 200 follows on time
+        steady_clock::time_point late = steady_clock::now();
+        scheduler.waitNextTick();
+        milliseconds lateWait = since(late);
+        scheduler.waitNextTick();
+        milliseconds next = since(start);
+        CaptureScheduler::Stats stats = scheduler.getStats();
+        scheduler.stop();
+
+        std::cout << "skip: " << stats.missedTicks << " ticks skipped, late tick after " << lateWait.count()
+                  << " ms, next at " << next.count() << " ms" << std::endl;
+        if (stats.ticks != 3 || stats.missedTicks < 2 || stats.missedTicks > 3 || lateWait > kSlack / 3 ||
+            next < milliseconds(195) || next > milliseconds(200) + kSlack) {
+            std::cout << "skip: FAILED, missed ticks must be skipped rather than fired back to back" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // A burst ticks promptly instead of waiting for the slow base deadline
+    bool checkBurst() {
+        CaptureScheduler scheduler(1.0);
+        scheduler.setBurstProfile(100.0, milliseconds(200), milliseconds(0));
+        scheduler.start();
+        scheduler.waitNextTick();
+
+        steady_clock::time_point start = steady_clock::now();
+        scheduler.burst();
+        bool bursting = scheduler.isBursting();
+        scheduler.waitNextTick();
+        scheduler.waitNextTick();
+        milliseconds elapsed = since(start);
+        scheduler.stop();
+
+        std::cout << "burst: two ticks in " << elapsed.count() << " ms at a 1 fps base rate" << std::endl;
+        if (!bursting || elapsed > milliseconds(20) + kSlack) {
+            std::cout << "burst: FAILED, a burst must tick at its own rate" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // stop() must wake a thread waiting for a distant deadline
+    bool checkStopWakes() {
+        CaptureScheduler scheduler(0.5);
+        scheduler.start();
+        scheduler.waitNextTick();
+
+        steady_clock::time_point start = steady_clock::now();
+        std::future<bool> waiting = std::async(std::launch::async, [&scheduler] { return scheduler.waitNextTick(); });
+        std::this_thread::sleep_for(milliseconds(20));
+        scheduler.stop();
+        bool ticked = waiting.get();
+        milliseconds elapsed = since(start);
+
+        if (ticked || elapsed > milliseconds(20) + kSlack) {
+            std::cout << "stop: FAILED, stop must end the wait without a tick" << std::endl;
+            return false;
+        }
+        std::cout << "stop: waiter released after " << elapsed.count() << " ms" << std::endl;
+        return true;
+    }
+}
+
+int main() {
+    bool ok = checkNoDrift();
+    ok &= checkSkipsMissedTicks();
+    ok &= checkBurst();
+    ok &= checkStopWakes();
+    return ok ? 0 : 1;
+}
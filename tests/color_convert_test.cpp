@@ -0,0 +1,99 @@
+#include "encoding/color_convert.h"
+#include <iostream>
+#include <vector>
+
+namespace {
+    // Name of the vector code the conversion was built with
+    const char* simdName() {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    // BGRA image with a stride wider than its rows, noise or a repeating set of extreme colours
+    std::vector<uint8_t> makeImage(int width, int height, int stride, uint32_t seed, bool extremes) {
+        static const uint8_t kExtremes[][3] = {
+            {0, 0, 0}, {255, 255, 255}, {0, 0, 255}, {0, 255, 0}, {255, 0, 0}, {255, 255, 0}, {255, 0, 255}, {0, 255, 255}
+        };
+        std::vector<uint8_t> image(static_cast<size_t>(stride) * height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint8_t* p = image.data() + static_cast<size_t>(y) * stride + x * 4;
+                seed = seed * 1664525u + 1013904223u;
+                for (int c = 0; c < 4; c++) {
+                    p[c] = extremes ? (c < 3 ? kExtremes[(seed >> 24) % 8][c] : 255) : static_cast<uint8_t>(seed >> (c * 8));
+                }
+            }
+        }
+        return image;
+    }
+
+    // Plain per-pixel conversion with the same fixed-point rounding as the kernels
+    void convertScalar(const std::vector<uint8_t>& image, int stride, int width, int height, YuvPlanes& out) {
+        out.resize(width, height);
+        auto pixel = [&](int x, int y) { return image.data() + static_cast<size_t>(y) * stride + x * 4; };
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const uint8_t* p = pixel(x, y);
+                out.y[static_cast<size_t>(y) * width + x] = static_cast<uint8_t>((77 * p[2] + 150 * p[1] + 29 * p[0] + 128) >> 8);
+            }
+        }
+
+        // An odd last row or column pairs with itself
+        for (int cy = 0; cy < out.chromaHeight(); cy++) {
+            for (int cx = 0; cx < out.chromaWidth(); cx++) {
+                int x0 = cx * 2, y0 = cy * 2;
+                int x1 = x0 + 1 < width ? x0 + 1 : x0;
+                int y1 = y0 + 1 < height ? y0 + 1 : y0;
+                int average[3];
+                for (int c = 0; c < 3; c++) {
+                    average[c] = (pixel(x0, y0)[c] + pixel(x1, y0)[c] + pixel(x0, y1)[c] + pixel(x1, y1)[c] + 2) >> 2;
+                }
+                int b = average[0], g = average[1], r = average[2];
+                size_t index = static_cast<size_t>(cy) * out.chromaWidth() + cx;
+                out.u[index] = static_cast<uint8_t>(((-43 * r - 85 * g + 128 * b + 127) >> 8) + 128);
+                out.v[index] = static_cast<uint8_t>(((128 * r - 107 * g - 21 * b + 127) >> 8) + 128);
+            }
+        }
+    }
+
+    // Convert one image single-threaded and in bands, both must match the plain conversion exactly
+    bool checkCase(int width, int height, bool extremes, ThreadPool& workers) {
+        int stride = width * 4 + 20;
+        std::vector<uint8_t> image = makeImage(width, height, stride, static_cast<uint32_t>(width * 31 + height), extremes);
+
+        YuvPlanes expected, single, banded;
+        convertScalar(image, stride, width, height, expected);
+        color_convert::bgraToYuv420(image.data(), stride, width, height, single);
+        color_convert::bgraToYuv420(image.data(), stride, width, height, banded, workers);
+
+        if (!single.equals(expected) || !banded.equals(expected)) {
+            std::cout << simdName() << ": FAILED, " << width << "x" << height << (extremes ? " extreme colours" : " noise")
+                      << (single.equals(expected) ? " in bands" : "") << " differs from the scalar conversion" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main() {
+    ThreadPool workers(3);
+
+    // Odd sizes leave scalar tails and unpaired rows and columns
+    bool ok = true;
+    for (bool extremes : {false, true}) {
+        ok &= checkCase(1920, 1080, extremes, workers);
+        ok &= checkCase(1283, 721, extremes, workers);
+        ok &= checkCase(17, 3, extremes, workers);
+        ok &= checkCase(1, 1, extremes, workers);
+        ok &= checkCase(31, 257, extremes, workers);
+    }
+
+    if (ok) {
+        std::cout << simdName() << ": YUV 4:2:0 planes match the scalar conversion" << std::endl;
+    }
+    return ok ? 0 : 1;
+}
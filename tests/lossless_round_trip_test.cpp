@@ -0,0 +1,207 @@
+#include "encoding/lossless_encoder.h"
+#include "encoding/frame_protocol.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <zlib.h>
+
+using namespace frame_protocol;
+
+namespace {
+    constexpr int kWidth = 320;
+    constexpr int kHeight = 400;
+    constexpr int kScroll = 24;
+
+    // Reads little-endian fields back out of a message, flagging reads past its end
+    class MessageReader {
+    public:
+        explicit MessageReader(const std::vector<uint8_t>& message) : _message(message) {}
+
+        uint8_t get8() {
+            if (_offset + 1 > _message.size()) {
+                _overrun = true;
+                return 0;
+            }
+            return _message[_offset++];
+        }
+
+        uint16_t get16() {
+            uint16_t low = get8();
+            return static_cast<uint16_t>(low | get8() << 8);
+        }
+
+        uint32_t get32() {
+            uint32_t low = get16();
+            return low | static_cast<uint32_t>(get16()) << 16;
+        }
+
+        const uint8_t* getBytes(size_t size) {
+            if (_offset + size > _message.size()) {
+                _overrun = true;
+                return nullptr;
+            }
+            const uint8_t* bytes = _message.data() + _offset;
+            _offset += size;
+            return bytes;
+        }
+
+        // Every byte was read and none past the end
+        bool consumed() const { return !_overrun && _offset == _message.size(); }
+
+    private:
+        const std::vector<uint8_t>& _message;
+        size_t _offset{0};
+        bool _overrun{false};
+    };
+
+    // The image a client rebuilds from LOSSLESS_FRAME messages, tightly packed BGRA
+    struct ClientImage {
+        std::vector<uint8_t> pixels;
+        int width{0};
+        int height{0};
+        bool keyframe{false};
+        size_t copies{0};
+    };
+
+    // Apply a LOSSLESS_FRAME message the way a client would, false when it is malformed
+    bool decodeLosslessFrame(const std::vector<uint8_t>& message, ClientImage& image) {
+        MessageReader reader(message);
+        if (reader.get8() != MESSAGE_LOSSLESS_FRAME) return false;
+        image.keyframe = (reader.get8() & LOSSLESS_FLAG_KEYFRAME) != 0;
+        int width = reader.get16();
+        int height = reader.get16();
+        reader.get32();
+        if (image.keyframe) {
+            image.width = width;
+            image.height = height;
+            image.pixels.assign(static_cast<size_t>(width) * height * 4, 0);
+        } else if (width != image.width || height != image.height) {
+            return false;
+        }
+
+        std::vector<CopyRect> copies(reader.get16());
+        for (CopyRect& copy : copies) {
+            copy.srcX = reader.get16();
+            copy.srcY = reader.get16();
+            copy.x = reader.get16();
+            copy.y = reader.get16();
+            copy.width = reader.get16();
+            copy.height = reader.get16();
+        }
+        applyCopyRects(image.pixels.data(), width * 4, copies);
+        image.copies = copies.size();
+
+        int rectX = reader.get16();
+        int rectY = reader.get16();
+        int rectWidth = reader.get16();
+        int rectHeight = reader.get16();
+        int bandRows = reader.get16();
+        int bandCount = reader.get8();
+        if (rectX + rectWidth > width || rectY + rectHeight > height) return false;
+
+        for (int band = 0, row = rectY; band < bandCount; band++) {
+            uint32_t length = reader.get32();
+            const uint8_t* compressed = reader.getBytes(length);
+            int rows = std::min(bandRows, rectY + rectHeight - row);
+            std::vector<uint8_t> values(static_cast<size_t>(rectWidth) * rows * 3);
+            uLongf size = static_cast<uLongf>(values.size());
+            if (!compressed || rows <= 0 ||
+                uncompress(values.data(), &size, compressed, length) != Z_OK || size != values.size()) {
+                return false;
+            }
+
+            // Values are RGB, XORed with the current image except in keyframes where it is all zero
+            const uint8_t* value = values.data();
+            for (int end = row + rows; row < end; row++) {
+                uint8_t* p = image.pixels.data() + (static_cast<size_t>(row) * width + rectX) * 4;
+                for (int x = 0; x < rectWidth; x++, p += 4, value += 3) {
+                    p[2] ^= value[0];
+                    p[1] ^= value[1];
+                    p[0] ^= value[2];
+                }
+            }
+        }
+        return reader.consumed();
+    }
+
+    // Fill a rectangle of a frame with pseudo-random pixels
+    void scribble(RawFrame& frame, int x0, int y0, int width, int height, uint32_t seed) {
+        for (int y = y0; y < y0 + height; y++) {
+            for (int x = x0; x < x0 + width; x++) {
+                seed = seed * 1664525u + 1013904223u;
+                std::memcpy(frame.pixels.data() + static_cast<size_t>(y) * frame.stride + x * 4, &seed, 4);
+            }
+        }
+    }
+
+    // Check the client's image against the frame, ignoring the unused alpha byte
+    bool matches(const ClientImage& image, const RawFrame& frame) {
+        if (image.width != frame.width || image.height != frame.height) return false;
+        for (int y = 0; y < frame.height; y++) {
+            for (int x = 0; x < frame.width; x++) {
+                const uint8_t* a = image.pixels.data() + (static_cast<size_t>(y) * image.width + x) * 4;
+                const uint8_t* b = frame.pixels.data() + static_cast<size_t>(y) * frame.stride + x * 4;
+                if (a[0] != b[0] || a[1] != b[1] || a[2] != b[2]) return false;
+            }
+        }
+        return true;
+    }
+
+    // Encode a frame, decode it as a client and compare, with the keyframe and copies expected
+    bool step(const char* name, LosslessEncoder& encoder, ThreadPool& workers, const RawFrame& frame,
+              ClientImage& image, bool keyframe, bool copies) {
+        std::vector<uint8_t> message;
+        bool ok = encoder.encode(frame, workers, message) && decodeLosslessFrame(message, image);
+        if (!ok || image.keyframe != keyframe || (image.copies > 0) != copies || !matches(image, frame)) {
+            std::cout << name << ": FAILED, the decoded image differs from the frame (" << message.size()
+                      << " bytes, " << image.copies << " copies)" << std::endl;
+            return false;
+        }
+        std::cout << name << ": " << message.size() << " bytes round trip" << std::endl;
+        return true;
+    }
+}
+
+int main() {
+    ThreadPool workers(3);
+    LosslessEncoder encoder;
+    ClientImage image;
+
+    RawFrame frame;
+    frame.width = kWidth;
+    frame.height = kHeight;
+    frame.stride = kWidth * 4 + 16;
+    frame.pixels.resize(static_cast<size_t>(frame.stride) * kHeight);
+    scribble(frame, 0, 0, kWidth, kHeight, 1);
+    bool ok = step("keyframe", encoder, workers, frame, image, true, false);
+
+    scribble(frame, 50, 40, 70, 30, 2);
+    ok &= step("delta", encoder, workers, frame, image, false, false);
+
+    // Scroll up and expose a new strip at the bottom
+    for (int y = 0; y < kHeight - kScroll; y++) {
+        std::memmove(frame.pixels.data() + static_cast<size_t>(y) * frame.stride,
+                     frame.pixels.data() + static_cast<size_t>(y + kScroll) * frame.stride, kWidth * 4);
+    }
+    scribble(frame, 0, kHeight - kScroll, kWidth, kScroll, 3);
+    ok &= step("scroll", encoder, workers, frame, image, false, true);
+
+    std::vector<uint8_t> message;
+    if (encoder.encode(frame, workers, message)) {
+        std::cout << "unchanged: FAILED, an unchanged frame must not produce a message" << std::endl;
+        ok = false;
+    }
+
+    // A source tracking damage only has the reported area looked at
+    scribble(frame, 200, 300, 40, 50, 4);
+    frame.dirtyRects.assign(1, CaptureRect{190, 290, 60, 70});
+    frame.dirtyRectsValid = true;
+    ok &= step("damage", encoder, workers, frame, image, false, false);
+
+    frame.dirtyRectsValid = false;
+    encoder.requestKeyframe();
+    ok &= step("requested keyframe", encoder, workers, frame, image, true, false);
+
+    return ok ? 0 : 1;
+}
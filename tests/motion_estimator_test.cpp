@@ -0,0 +1,145 @@
+#include "encoding/motion_estimator.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace {
+    constexpr int kWidth = 256;
+    constexpr int kHeight = 192;
+    constexpr int kStride = kWidth * 4;
+    constexpr int kTileSize = 64;
+    constexpr int kShift = 24;
+
+    // Pseudo-random BGRA pixels, so every row and column of a frame is distinct
+    std::vector<uint8_t> noise(uint32_t seed) {
+        std::vector<uint8_t> pixels(static_cast<size_t>(kStride) * kHeight);
+        for (size_t i = 0; i < pixels.size(); i++) {
+            seed = seed * 1664525u + 1013904223u;
+            pixels[i] = static_cast<uint8_t>(seed >> 24);
+        }
+        return pixels;
+    }
+
+    // Copy one pixel of a frame into another, used to build shifted frames
+    void copyPixel(const std::vector<uint8_t>& from, int fromX, int fromY, std::vector<uint8_t>& to, int x, int y) {
+        std::memcpy(to.data() + static_cast<size_t>(y) * kStride + x * 4,
+                    from.data() + static_cast<size_t>(fromY) * kStride + fromX * 4, 4);
+    }
+
+    // Apply copy rects through a snapshot, the behaviour applyCopyRects must match
+    void applyThroughSnapshot(std::vector<uint8_t>& pixels, const std::vector<CopyRect>& copies) {
+        for (const CopyRect& copy : copies) {
+            std::vector<uint8_t> source = pixels;
+            for (int y = 0; y < copy.height; y++) {
+                for (int x = 0; x < copy.width; x++) {
+                    copyPixel(source, copy.srcX + x, copy.srcY + y, pixels, copy.x + x, copy.y + y);
+                }
+            }
+        }
+    }
+
+    // Overlapping copies in every direction must read their whole source before writing
+    bool checkApplyCopyRects() {
+        std::vector<CopyRect> copies{
+            {0, 10, 0, 0, 128, 100},     // Up, overlapping
+            {0, 0, 0, 12, 128, 100},     // Down, overlapping
+            {0, 0, 9, 0, 200, 50},       // Right within the same rows
+            {30, 100, 0, 100, 220, 60},  // Left within the same rows
+            {200, 150, 10, 20, 40, 30}   // Disjoint
+        };
+
+        for (const CopyRect& copy : copies) {
+            std::vector<uint8_t> expected = noise(7);
+            std::vector<uint8_t> actual = expected;
+            applyThroughSnapshot(expected, {copy});
+            applyCopyRects(actual.data(), kStride, {copy});
+            if (actual != expected) {
+                std::cout << "copy: FAILED, copy from " << copy.srcX << "," << copy.srcY << " to " << copy.x << ","
+                          << copy.y << " differs from a memmove" << std::endl;
+                return false;
+            }
+        }
+
+        std::cout << "copy: " << copies.size() << " overlapping copies behave like memmove" << std::endl;
+        return true;
+    }
+
+    // Scroll a frame by kShift along one axis with a new strip exposed, and check the copies rebuild it
+    bool checkScroll(const char* name, bool vertical, int direction) {
+        std::vector<uint8_t> previous = noise(1);
+        std::vector<uint8_t> exposed = noise(2);
+        RawFrame current;
+        current.width = kWidth;
+        current.height = kHeight;
+        current.stride = kStride;
+        current.pixels = exposed;
+
+        // Pixel (x, y) of the current frame shows the previous one moved by direction * kShift
+        int dx = vertical ? 0 : direction * kShift;
+        int dy = vertical ? direction * kShift : 0;
+        for (int y = 0; y < kHeight; y++) {
+            for (int x = 0; x < kWidth; x++) {
+                int fromX = x - dx;
+                int fromY = y - dy;
+                if (fromX >= 0 && fromX < kWidth && fromY >= 0 && fromY < kHeight) {
+                    copyPixel(previous, fromX, fromY, current.pixels, x, y);
+                }
+            }
+        }
+
+        std::vector<uint8_t> changedTiles(static_cast<size_t>(kWidth / kTileSize) * (kHeight / kTileSize), 1);
+        std::vector<CopyRect> copies;
+        MotionEstimator estimator;
+        estimator.estimate(previous.data(), current, changedTiles, kTileSize, copies);
+
+        // Every pixel that was on screen before must come back from the copies
+        std::vector<uint8_t> rebuilt = previous;
+        applyCopyRects(rebuilt.data(), kStride, copies);
+        int matched = 0;
+        for (int y = 0; y < kHeight; y++) {
+            for (int x = 0; x < kWidth; x++) {
+                size_t offset = static_cast<size_t>(y) * kStride + x * 4;
+                matched += std::memcmp(rebuilt.data() + offset, current.pixels.data() + offset, 4) == 0;
+            }
+        }
+        int kept = vertical ? kWidth * (kHeight - kShift) : (kWidth - kShift) * kHeight;
+
+        std::cout << name << ": " << copies.size() << " copies rebuild " << matched << " of " << kept
+                  << " scrolled pixels" << std::endl;
+        if (copies.empty() || matched < kept) {
+            std::cout << name << ": FAILED, the copies must rebuild the whole scrolled area" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Unrelated content must not produce copies
+    bool checkNoFalseMotion() {
+        std::vector<uint8_t> previous = noise(3);
+        RawFrame current;
+        current.width = kWidth;
+        current.height = kHeight;
+        current.stride = kStride;
+        current.pixels = noise(4);
+
+        std::vector<uint8_t> changedTiles(static_cast<size_t>(kWidth / kTileSize) * (kHeight / kTileSize), 1);
+        std::vector<CopyRect> copies;
+        MotionEstimator estimator;
+        estimator.estimate(previous.data(), current, changedTiles, kTileSize, copies);
+        if (!copies.empty()) {
+            std::cout << "unrelated: FAILED, " << copies.size() << " copies found between unrelated frames" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main() {
+    bool ok = checkApplyCopyRects();
+    ok &= checkScroll("scroll up", true, -1);
+    ok &= checkScroll("scroll down", true, 1);
+    ok &= checkScroll("scroll left", false, -1);
+    ok &= checkScroll("scroll right", false, 1);
+    ok &= checkNoFalseMotion();
+    return ok ? 0 : 1;
+}
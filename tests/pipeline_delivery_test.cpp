@@ -0,0 +1,71 @@
+#include "screen_capture/screen_capture.h"
+#include "screen_capture/synthetic_capture_source.h"
+#include "encoding/frame_protocol.h"
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Frames the encoded-frame ring can still hold when the pipeline stops
+    constexpr size_t kUndeliveredAtStop = 2;
+
+    // Read a little-endian u32 from a message
+    uint32_t read32(const std::vector<uint8_t>& message, size_t offset) {
+        return static_cast<uint32_t>(message[offset]) | static_cast<uint32_t>(message[offset + 1]) << 8 |
+               static_cast<uint32_t>(message[offset + 2]) << 16 | static_cast<uint32_t>(message[offset + 3]) << 24;
+    }
+
+    // Run a pipeline whose client is slower than capture and check that no delta was dropped after encoding
+    bool checkEveryDeltaDelivered(const char* name, ScreenCapture::EncodingMode mode, uint8_t messageType) {
+        ScreenCapture capture(16, 70, std::make_unique<SyntheticCaptureSource>(640, 360));
+        capture.setLosslessOptions(300);
+        capture.setVideoOptions(300);
+        capture.setEncodingMode(mode);
+        if (capture.getEncodingMode() != mode) {
+            std::cout << name << ": not built in, skipped" << std::endl;
+            return true;
+        }
+        capture.setFrameRate(60);
+
+        std::mutex mutex;
+        std::vector<uint32_t> sequences;
+        capture.setFrameCallback([&](const ScreenCapture::FrameData& frame) {
+            if (frame.data && frame.data->size() >= 10 && (*frame.data)[0] == messageType) {
+                std::lock_guard<std::mutex> lock(mutex);
+                sequences.push_back(read32(*frame.data, 6));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        });
+
+        capture.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        capture.stop();
+
+        ScreenCapture::Stats stats = capture.getStats();
+        uint64_t encoded = stats.frames - stats.unchangedFrames;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        bool ordered = true;
+        for (size_t i = 1; i < sequences.size(); i++) {
+            ordered &= sequences[i] > sequences[i - 1];
+        }
+        bool complete = sequences.size() + kUndeliveredAtStop >= encoded;
+
+        std::cout << name << ": " << encoded << " encoded, " << sequences.size() << " delivered" << std::endl;
+        if (!ordered || !complete) {
+            std::cout << name << ": FAILED, every encoded delta must reach the client in order" << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+int main() {
+    bool ok = checkEveryDeltaDelivered("lossless", ScreenCapture::EncodingMode::LOSSLESS,
+                                       frame_protocol::MESSAGE_LOSSLESS_FRAME);
+    ok &= checkEveryDeltaDelivered("video", ScreenCapture::EncodingMode::VIDEO,
+                                   frame_protocol::MESSAGE_VIDEO_FRAME);
+    return ok ? 0 : 1;
+}
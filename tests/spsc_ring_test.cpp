@@ -0,0 +1,98 @@
+#include "utils/spsc_ring.h"
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace {
+    constexpr uint64_t kConcurrentValues = 1000000;
+
+    // Capacity rounding, full and empty states and FIFO order across wrap-around, on one thread
+    bool checkSingleThread() {
+        SpscRing<std::unique_ptr<int>> ring(3);
+        if (ring.capacity() != 4 || !ring.empty() || ring.full()) {
+            std::cout << "ring: FAILED, a ring of 3 must start empty with 4 slots" << std::endl;
+            return false;
+        }
+
+        int next = 0;
+        int expected = 0;
+        std::unique_ptr<int> value;
+        for (int round = 0; round < 10; round++) {
+            while (ring.tryPush(std::make_unique<int>(next))) next++;
+            if (!ring.full() || ring.size() != ring.capacity()) {
+                std::cout << "ring: FAILED, pushes must only fail once the ring is full" << std::endl;
+                return false;
+            }
+
+            // Drain part of the ring so the next round wraps at a different slot
+            for (int i = 0; i < 1 + round % 4; i++) {
+                if (!ring.tryPop(value) || !value || *value != expected++) {
+                    std::cout << "ring: FAILED, values must come out in the order they went in" << std::endl;
+                    return false;
+                }
+            }
+        }
+
+        while (ring.tryPop(value)) {
+            if (*value != expected++) {
+                std::cout << "ring: FAILED, values must come out in the order they went in" << std::endl;
+                return false;
+            }
+        }
+        if (expected != next || !ring.empty() || ring.size() != 0) {
+            std::cout << "ring: FAILED, every pushed value must come out once" << std::endl;
+            return false;
+        }
+
+        ring.tryPush(std::make_unique<int>(0));
+        ring.clear();
+        if (!ring.empty() || ring.tryPop(value)) {
+            std::cout << "ring: FAILED, clear must drop every value" << std::endl;
+            return false;
+        }
+
+        std::cout << "ring: " << next << " values in order through " << ring.capacity() << " slots" << std::endl;
+        return true;
+    }
+
+    // A producer and a consumer thread passing a counter must see every value once, in order
+    bool checkConcurrent() {
+        SpscRing<uint64_t> ring(8);
+        std::thread producer([&ring]() {
+            for (uint64_t i = 1; i <= kConcurrentValues;) {
+                if (ring.tryPush(i)) {
+                    i++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        uint64_t expected = 1;
+        bool ordered = true;
+        while (expected <= kConcurrentValues) {
+            uint64_t value = 0;
+            if (ring.tryPop(value)) {
+                ordered &= value == expected;
+                expected++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+
+        if (!ordered || !ring.empty()) {
+            std::cout << "concurrent: FAILED, values were lost, repeated or reordered" << std::endl;
+            return false;
+        }
+        std::cout << "concurrent: " << kConcurrentValues << " values passed in order" << std::endl;
+        return true;
+    }
+}
+
+int main() {
+    bool ok = checkSingleThread();
+    ok &= checkConcurrent();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#include "encoding/tile_encoder.h"
+#include "encoding/tile_cache.h"
+#include "encoding/frame_protocol.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace frame_protocol;
+
+namespace {
+    constexpr int kTileSize = 64;
+    constexpr size_t kTileBytes = kTileSize * kTileSize * 4;
+
+    // Reads little-endian fields back out of a message, flagging reads past its end
+    class MessageReader {
+    public:
+        explicit MessageReader(const std::vector<uint8_t>& message) : _message(message) {}
+
+        uint8_t get8() {
+            if (_offset + 1 > _message.size()) {
+                _overrun = true;
+                return 0;
+            }
+            return _message[_offset++];
+        }
+
+        uint16_t get16() {
+            uint16_t low = get8();
+            return static_cast<uint16_t>(low | get8() << 8);
+        }
+
+        uint32_t get32() {
+            uint32_t low = get16();
+            return low | static_cast<uint32_t>(get16()) << 16;
+        }
+
+        std::vector<uint8_t> getBytes(size_t size) {
+            if (_offset + size > _message.size()) {
+                _overrun = true;
+                return {};
+            }
+            std::vector<uint8_t> bytes(_message.begin() + _offset, _message.begin() + _offset + size);
+            _offset += size;
+            return bytes;
+        }
+
+        // Every byte was read and none past the end
+        bool consumed() const { return !_overrun && _offset == _message.size(); }
+
+    private:
+        const std::vector<uint8_t>& _message;
+        size_t _offset{0};
+        bool _overrun{false};
+    };
+
+    // One tile as a client decodes it
+    struct ParsedTile {
+        uint16_t x, y, width, height;
+        uint8_t codec;
+        uint32_t slot;
+        std::vector<uint8_t> data;
+    };
+
+    // Decode a TILE_UPDATE the way a client would, false when it is malformed
+    bool parseTileUpdate(const std::vector<uint8_t>& message, uint8_t& flags, std::vector<uint8_t>& tables,
+                         std::vector<CopyRect>& copies, std::vector<ParsedTile>& tiles) {
+        MessageReader reader(message);
+        if (reader.get8() != MESSAGE_TILE_UPDATE) return false;
+        flags = reader.get8();
+        reader.get16();
+        reader.get16();
+        reader.get16();
+        reader.get32();
+
+        tables.clear();
+        if (flags & TILE_FLAG_TABLES) {
+            tables = reader.getBytes(reader.get32());
+        }
+
+        copies.clear();
+        if (flags & TILE_FLAG_COPY) {
+            for (uint16_t count = reader.get16(); count > 0; count--) {
+                CopyRect copy;
+                copy.srcX = reader.get16();
+                copy.srcY = reader.get16();
+                copy.x = reader.get16();
+                copy.y = reader.get16();
+                copy.width = reader.get16();
+                copy.height = reader.get16();
+                copies.push_back(copy);
+            }
+        }
+
+        tiles.clear();
+        for (uint16_t count = reader.get16(); count > 0; count--) {
+            ParsedTile tile;
+            tile.x = reader.get16();
+            tile.y = reader.get16();
+            tile.width = reader.get16();
+            tile.height = reader.get16();
+            tile.codec = reader.get8();
+            tile.slot = (flags & TILE_FLAG_CACHE) ? reader.get32() : 0;
+            tile.data = reader.getBytes(reader.get32());
+            tiles.push_back(tile);
+        }
+        return reader.consumed();
+    }
+
+    // Fill the cache past its capacity and check the least recently used slot is reused
+    bool checkCacheEviction() {
+        TileCache cache(2 * kTileBytes, kTileSize);
+        uint32_t first = cache.insert(1);
+        uint32_t second = cache.insert(2);
+
+        // Touching the first tile leaves the second as the oldest
+        bool touched = cache.lookup(1) == first;
+        uint32_t third = cache.insert(3);
+
+        bool ok = cache.capacity() == 2 && first != second && touched && third == second &&
+                  cache.size() == 2 && cache.contains(1) && !cache.contains(2) &&
+                  cache.lookup(3) == third && cache.lookup(2) == -1 && cache.insert(1) == first;
+        if (!ok) {
+            std::cout << "cache: FAILED, the least recently used slot must be the one reused" << std::endl;
+            return false;
+        }
+
+        cache.clear();
+        if (cache.size() != 0 || cache.insert(4) != 0) {
+            std::cout << "cache: FAILED, clear must start over from slot 0" << std::endl;
+            return false;
+        }
+        std::cout << "cache: LRU eviction reuses slot " << third << std::endl;
+        return true;
+    }
+
+    // Pack a frame for a fresh client, then again once the client caches its tiles
+    bool checkPackRoundTrip() {
+        TileFrame frame;
+        frame.width = 256;
+        frame.height = 128;
+        frame.tileSize = kTileSize;
+        frame.sequence = 7;
+        frame.tables = std::make_shared<const std::vector<uint8_t>>(std::vector<uint8_t>{0xFF, 0xD8, 0xFF, 0xD9});
+        frame.tablesVersion = 3;
+        frame.copies.push_back(CopyRect{0, 64, 0, 0, 256, 64});
+        frame.tiles.push_back(TileFrame::Tile{0, 64, 64, 64, 11, TILE_CODEC_PALETTE, {1, 2, 3}});
+        frame.tiles.push_back(TileFrame::Tile{192, 64, 64, 64, 12, TILE_CODEC_JPEG, {4, 5, 6, 7}});
+
+        TileCache cache(16 * kTileBytes, kTileSize);
+        uint32_t tablesVersion = 0;
+        std::vector<uint8_t> message;
+        uint8_t flags = 0;
+        std::vector<uint8_t> tables;
+        std::vector<CopyRect> copies;
+        std::vector<ParsedTile> tiles;
+
+        bool ok = packTileUpdate(frame, &cache, tablesVersion, message) &&
+                  parseTileUpdate(message, flags, tables, copies, tiles);
+        ok = ok && flags == (TILE_FLAG_TABLES | TILE_FLAG_CACHE | TILE_FLAG_COPY) && tables == *frame.tables &&
+             tablesVersion == frame.tablesVersion && copies.size() == 1 && copies[0].srcY == 64 &&
+             copies[0].width == 256 && copies[0].height == 64 && tiles.size() == 2;
+        for (size_t i = 0; ok && i < tiles.size(); i++) {
+            const TileFrame::Tile& sent = frame.tiles[i];
+            ok = tiles[i].x == sent.x && tiles[i].y == sent.y && tiles[i].width == sent.width &&
+                 tiles[i].height == sent.height && tiles[i].codec == sent.codec && tiles[i].data == sent.data &&
+                 static_cast<int64_t>(tiles[i].slot) == cache.lookup(sent.hash);
+        }
+        if (!ok) {
+            std::cout << "pack: FAILED, the first update must carry tables, copies and both tiles" << std::endl;
+            return false;
+        }
+
+        // The client now has the tables and both tiles, so only slot references remain
+        frame.sequence = 8;
+        frame.copies.clear();
+        std::vector<uint32_t> slots{tiles[0].slot, tiles[1].slot};
+        ok = packTileUpdate(frame, &cache, tablesVersion, message) &&
+             parseTileUpdate(message, flags, tables, copies, tiles);
+        ok = ok && flags == TILE_FLAG_CACHE && tiles.size() == 2;
+        for (size_t i = 0; ok && i < tiles.size(); i++) {
+            ok = tiles[i].codec == TILE_CODEC_CACHED && tiles[i].slot == slots[i] && tiles[i].data.empty();
+        }
+        if (!ok) {
+            std::cout << "pack: FAILED, cached tiles must be sent as slot references" << std::endl;
+            return false;
+        }
+
+        // A tile left unencoded can only go to a client that caches it
+        frame.tiles.push_back(TileFrame::Tile{64, 0, 64, 64, 13, TILE_CODEC_JPEG, {}});
+        size_t cached = cache.size();
+        if (packTileUpdate(frame, &cache, tablesVersion, message) || cache.size() != cached ||
+            packTileUpdate(frame, nullptr, tablesVersion, message)) {
+            std::cout << "pack: FAILED, an unencoded tile the client lacks must be refused" << std::endl;
+            return false;
+        }
+
+        std::cout << "pack: tile updates round trip" << std::endl;
+        return true;
+    }
+}
+
+int main() {
+    bool ok = checkCacheEviction();
+    ok &= checkPackRoundTrip();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+#include "screen_capture/xshm_capture_source.h"
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+namespace {
+    // ctest reports this exit code as a skipped test
+    constexpr int kSkipped = 77;
+
+    // Test window and the rectangle drawn into it, in root window pixels
+    constexpr int kWindowX = 40;
+    constexpr int kWindowY = 30;
+    constexpr int kWindowWidth = 240;
+    constexpr int kWindowHeight = 160;
+    constexpr int kRectX = 60;
+    constexpr int kRectY = 50;
+    constexpr int kRectWidth = 64;
+    constexpr int kRectHeight = 40;
+
+    constexpr uint32_t kBackground = 0xC02020;
+    constexpr uint32_t kRectColor = 0x3366CC;
+
+    // Rectangle drawn after the first grab, to be picked up through XDamage
+    constexpr int kDamageX = 150;
+    constexpr int kDamageY = 100;
+    constexpr int kDamageWidth = 48;
+    constexpr int kDamageHeight = 32;
+    constexpr uint32_t kDamageColor = 0x20C040;
+
+    // Check every pixel of a frame rectangle against a 24-bit RGB colour
+    bool rectIs(const RawFrame& frame, int x, int y, int width, int height, uint32_t rgb) {
+        for (int row = y; row < y + height; row++) {
+            const uint8_t* p = frame.pixels.data() + static_cast<size_t>(row) * frame.stride + x * 4;
+            for (int col = 0; col < width; col++, p += 4) {
+                if (p[0] != (rgb & 0xFF) || p[1] != ((rgb >> 8) & 0xFF) || p[2] != ((rgb >> 16) & 0xFF)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Check that the union of a frame's dirty rects covers a rectangle
+    bool dirtyCovers(const RawFrame& frame, int x, int y, int width, int height) {
+        for (int row = y; row < y + height; row++) {
+            for (int col = x; col < x + width; col++) {
+                bool covered = false;
+                for (const CaptureRect& rect : frame.dirtyRects) {
+                    covered |= col >= rect.x && col < rect.x + rect.width && row >= rect.y && row < rect.y + rect.height;
+                }
+                if (!covered) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Fill a root-relative rectangle of the test window and wait until the server has drawn it
+    void fill(Display* display, Window window, GC gc, int x, int y, int width, int height, uint32_t rgb) {
+        XSetForeground(display, gc, rgb);
+        XFillRectangle(display, window, gc, x - kWindowX, y - kWindowY, width, height);
+        XSync(display, False);
+    }
+}
+
+int main() {
+    const char* displayName = std::getenv("DISPLAY");
+    if (!displayName || !*displayName) {
+        std::cout << "xshm: no DISPLAY, skipped" << std::endl;
+        return kSkipped;
+    }
+
+    Display* display = XOpenDisplay(nullptr);
+    if (!display) {
+        std::cout << "xshm: cannot open " << displayName << ", skipped" << std::endl;
+        return kSkipped;
+    }
+
+    // Colours are written as pixel values, which needs a 24-bit RGB visual such as Xvfb's default
+    int screen = DefaultScreen(display);
+    Visual* visual = DefaultVisual(display, screen);
+    if (DefaultDepth(display, screen) != 24 || visual->red_mask != 0xFF0000 || visual->blue_mask != 0x0000FF) {
+        std::cout << "xshm: display is not 24-bit RGB, skipped" << std::endl;
+        XCloseDisplay(display);
+        return kSkipped;
+    }
+
+    XShmCaptureSource source;
+    if (!source.isOpen()) {
+        std::cout << "xshm: MIT-SHM unavailable, skipped" << std::endl;
+        XCloseDisplay(display);
+        return kSkipped;
+    }
+
+    // An override-redirect window is placed exactly where asked, with or without a window manager
+    XSetWindowAttributes attributes{};
+    attributes.override_redirect = True;
+    attributes.background_pixel = kBackground;
+    attributes.event_mask = ExposureMask;
+    Window window = XCreateWindow(display, RootWindow(display, screen), kWindowX, kWindowY, kWindowWidth, kWindowHeight,
+                                  0, CopyFromParent, InputOutput, CopyFromParent,
+                                  CWOverrideRedirect | CWBackPixel | CWEventMask, &attributes);
+    XMapRaised(display, window);
+    XEvent event;
+    XWindowEvent(display, window, ExposureMask, &event);
+    GC gc = XCreateGC(display, window, 0, nullptr);
+
+    fill(display, window, gc, kWindowX, kWindowY, kWindowWidth, kWindowHeight, kBackground);
+    fill(display, window, gc, kRectX, kRectY, kRectWidth, kRectHeight, kRectColor);
+
+    bool ok = true;
+    RawFrame frame;
+    if (!source.grab(frame) || frame.width < kWindowX + kWindowWidth || frame.height < kWindowY + kWindowHeight) {
+        std::cout << "xshm: FAILED, could not grab the screen" << std::endl;
+        ok = false;
+    } else if (!rectIs(frame, kRectX, kRectY, kRectWidth, kRectHeight, kRectColor) ||
+               !rectIs(frame, kWindowX, kWindowY, kWindowWidth, kRectY - kWindowY, kBackground)) {
+        std::cout << "xshm: FAILED, captured pixels differ from the drawn ones" << std::endl;
+        ok = false;
+    } else {
+        std::cout << "xshm: " << frame.width << "x" << frame.height << " frame matches the drawing" << std::endl;
+    }
+
+    if (ok && !source.hasDamageTracking()) {
+        std::cout << "xshm: XDamage unavailable, dirty rects not checked" << std::endl;
+    } else if (ok) {
+        // Wait for the damage of mapping the window to be read out, then only the new drawing is dirty
+        bool settled = false;
+        for (int i = 0; i < 20 && !settled; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            settled = source.grab(frame) && frame.dirtyRectsValid && frame.dirtyRects.empty();
+        }
+        fill(display, window, gc, kDamageX, kDamageY, kDamageWidth, kDamageHeight, kDamageColor);
+
+        // The same buffer is grabbed again, so only the dirty rects are read back into it
+        long dirtyArea = 0;
+        bool grabbed = settled && source.grab(frame) && frame.dirtyRectsValid;
+        for (const CaptureRect& rect : frame.dirtyRects) {
+            dirtyArea += static_cast<long>(rect.width) * rect.height;
+        }
+        if (!grabbed || !dirtyCovers(frame, kDamageX, kDamageY, kDamageWidth, kDamageHeight) ||
+            dirtyArea > 4L * kDamageWidth * kDamageHeight) {
+            std::cout << "xshm: FAILED, dirty rects do not match the drawing (" << frame.dirtyRects.size()
+                      << " rects, " << dirtyArea << " pixels)" << std::endl;
+            ok = false;
+        } else if (!rectIs(frame, kDamageX, kDamageY, kDamageWidth, kDamageHeight, kDamageColor) ||
+                   !rectIs(frame, kRectX, kRectY, kRectWidth, kRectHeight, kRectColor)) {
+            std::cout << "xshm: FAILED, pixels read back from the dirty rects differ from the drawing" << std::endl;
+            ok = false;
+        } else {
+            std::cout << "xshm: damage reported as " << frame.dirtyRects.size() << " rects, " << dirtyArea
+                      << " pixels" << std::endl;
+        }
+    }
+
+    XFreeGC(display, gc);
+    XDestroyWindow(display, window);
+    XCloseDisplay(display);
+    return ok ? 0 : 1;
+}